@@ -1,3 +1,142 @@
+/*
+ * crc.c
+ *
+ * CRC8/CRC16-CCITT/CRC24/CRC32, bitwise reference and 256-entry table variants,
+ * with optional offload to the DMAC CRC unit (CRC_USE_DMAC)
+ */
+
+#ifdef CUPDI
+
+#include "platform/platform.h"
+#include "crc.h"
+
+#ifdef CRC_USE_DMAC
+#include <compiler.h>
+#endif
+
+static const unsigned char crc8_table[256] = {
+    0x00, 0x5e, 0xbc, 0xe2, 0x61, 0x3f, 0xdd, 0x83, 0xc2, 0x9c, 0x7e, 0x20, 0xa3, 0xfd, 0x1f, 0x41,
+    0x9d, 0xc3, 0x21, 0x7f, 0xfc, 0xa2, 0x40, 0x1e, 0x5f, 0x01, 0xe3, 0xbd, 0x3e, 0x60, 0x82, 0xdc,
+    0x23, 0x7d, 0x9f, 0xc1, 0x42, 0x1c, 0xfe, 0xa0, 0xe1, 0xbf, 0x5d, 0x03, 0x80, 0xde, 0x3c, 0x62,
+    0xbe, 0xe0, 0x02, 0x5c, 0xdf, 0x81, 0x63, 0x3d, 0x7c, 0x22, 0xc0, 0x9e, 0x1d, 0x43, 0xa1, 0xff,
+    0x46, 0x18, 0xfa, 0xa4, 0x27, 0x79, 0x9b, 0xc5, 0x84, 0xda, 0x38, 0x66, 0xe5, 0xbb, 0x59, 0x07,
+    0xdb, 0x85, 0x67, 0x39, 0xba, 0xe4, 0x06, 0x58, 0x19, 0x47, 0xa5, 0xfb, 0x78, 0x26, 0xc4, 0x9a,
+    0x65, 0x3b, 0xd9, 0x87, 0x04, 0x5a, 0xb8, 0xe6, 0xa7, 0xf9, 0x1b, 0x45, 0xc6, 0x98, 0x7a, 0x24,
+    0xf8, 0xa6, 0x44, 0x1a, 0x99, 0xc7, 0x25, 0x7b, 0x3a, 0x64, 0x86, 0xd8, 0x5b, 0x05, 0xe7, 0xb9,
+    0x8c, 0xd2, 0x30, 0x6e, 0xed, 0xb3, 0x51, 0x0f, 0x4e, 0x10, 0xf2, 0xac, 0x2f, 0x71, 0x93, 0xcd,
+    0x11, 0x4f, 0xad, 0xf3, 0x70, 0x2e, 0xcc, 0x92, 0xd3, 0x8d, 0x6f, 0x31, 0xb2, 0xec, 0x0e, 0x50,
+    0xaf, 0xf1, 0x13, 0x4d, 0xce, 0x90, 0x72, 0x2c, 0x6d, 0x33, 0xd1, 0x8f, 0x0c, 0x52, 0xb0, 0xee,
+    0x32, 0x6c, 0x8e, 0xd0, 0x53, 0x0d, 0xef, 0xb1, 0xf0, 0xae, 0x4c, 0x12, 0x91, 0xcf, 0x2d, 0x73,
+    0xca, 0x94, 0x76, 0x28, 0xab, 0xf5, 0x17, 0x49, 0x08, 0x56, 0xb4, 0xea, 0x69, 0x37, 0xd5, 0x8b,
+    0x57, 0x09, 0xeb, 0xb5, 0x36, 0x68, 0x8a, 0xd4, 0x95, 0xcb, 0x29, 0x77, 0xf4, 0xaa, 0x48, 0x16,
+    0xe9, 0xb7, 0x55, 0x0b, 0x88, 0xd6, 0x34, 0x6a, 0x2b, 0x75, 0x97, 0xc9, 0x4a, 0x14, 0xf6, 0xa8,
+    0x74, 0x2a, 0xc8, 0x96, 0x15, 0x4b, 0xa9, 0xf7, 0xb6, 0xe8, 0x0a, 0x54, 0xd7, 0x89, 0x6b, 0x35,
+};
+
+static const unsigned short crc16_ccitt_table[256] = {
+    0x0000, 0x1021, 0x2042, 0x3063, 0x4084, 0x50a5, 0x60c6, 0x70e7,
+    0x8108, 0x9129, 0xa14a, 0xb16b, 0xc18c, 0xd1ad, 0xe1ce, 0xf1ef,
+    0x1231, 0x0210, 0x3273, 0x2252, 0x52b5, 0x4294, 0x72f7, 0x62d6,
+    0x9339, 0x8318, 0xb37b, 0xa35a, 0xd3bd, 0xc39c, 0xf3ff, 0xe3de,
+    0x2462, 0x3443, 0x0420, 0x1401, 0x64e6, 0x74c7, 0x44a4, 0x5485,
+    0xa56a, 0xb54b, 0x8528, 0x9509, 0xe5ee, 0xf5cf, 0xc5ac, 0xd58d,
+    0x3653, 0x2672, 0x1611, 0x0630, 0x76d7, 0x66f6, 0x5695, 0x46b4,
+    0xb75b, 0xa77a, 0x9719, 0x8738, 0xf7df, 0xe7fe, 0xd79d, 0xc7bc,
+    0x48c4, 0x58e5, 0x6886, 0x78a7, 0x0840, 0x1861, 0x2802, 0x3823,
+    0xc9cc, 0xd9ed, 0xe98e, 0xf9af, 0x8948, 0x9969, 0xa90a, 0xb92b,
+    0x5af5, 0x4ad4, 0x7ab7, 0x6a96, 0x1a71, 0x0a50, 0x3a33, 0x2a12,
+    0xdbfd, 0xcbdc, 0xfbbf, 0xeb9e, 0x9b79, 0x8b58, 0xbb3b, 0xab1a,
+    0x6ca6, 0x7c87, 0x4ce4, 0x5cc5, 0x2c22, 0x3c03, 0x0c60, 0x1c41,
+    0xedae, 0xfd8f, 0xcdec, 0xddcd, 0xad2a, 0xbd0b, 0x8d68, 0x9d49,
+    0x7e97, 0x6eb6, 0x5ed5, 0x4ef4, 0x3e13, 0x2e32, 0x1e51, 0x0e70,
+    0xff9f, 0xefbe, 0xdfdd, 0xcffc, 0xbf1b, 0xaf3a, 0x9f59, 0x8f78,
+    0x9188, 0x81a9, 0xb1ca, 0xa1eb, 0xd10c, 0xc12d, 0xf14e, 0xe16f,
+    0x1080, 0x00a1, 0x30c2, 0x20e3, 0x5004, 0x4025, 0x7046, 0x6067,
+    0x83b9, 0x9398, 0xa3fb, 0xb3da, 0xc33d, 0xd31c, 0xe37f, 0xf35e,
+    0x02b1, 0x1290, 0x22f3, 0x32d2, 0x4235, 0x5214, 0x6277, 0x7256,
+    0xb5ea, 0xa5cb, 0x95a8, 0x8589, 0xf56e, 0xe54f, 0xd52c, 0xc50d,
+    0x34e2, 0x24c3, 0x14a0, 0x0481, 0x7466, 0x6447, 0x5424, 0x4405,
+    0xa7db, 0xb7fa, 0x8799, 0x97b8, 0xe75f, 0xf77e, 0xc71d, 0xd73c,
+    0x26d3, 0x36f2, 0x0691, 0x16b0, 0x6657, 0x7676, 0x4615, 0x5634,
+    0xd94c, 0xc96d, 0xf90e, 0xe92f, 0x99c8, 0x89e9, 0xb98a, 0xa9ab,
+    0x5844, 0x4865, 0x7806, 0x6827, 0x18c0, 0x08e1, 0x3882, 0x28a3,
+    0xcb7d, 0xdb5c, 0xeb3f, 0xfb1e, 0x8bf9, 0x9bd8, 0xabbb, 0xbb9a,
+    0x4a75, 0x5a54, 0x6a37, 0x7a16, 0x0af1, 0x1ad0, 0x2ab3, 0x3a92,
+    0xfd2e, 0xed0f, 0xdd6c, 0xcd4d, 0xbdaa, 0xad8b, 0x9de8, 0x8dc9,
+    0x7c26, 0x6c07, 0x5c64, 0x4c45, 0x3ca2, 0x2c83, 0x1ce0, 0x0cc1,
+    0xef1f, 0xff3e, 0xcf5d, 0xdf7c, 0xaf9b, 0xbfba, 0x8fd9, 0x9ff8,
+    0x6e17, 0x7e36, 0x4e55, 0x5e74, 0x2e93, 0x3eb2, 0x0ed1, 0x1ef0,
+};
+
+static const unsigned int crc24_table[256] = {
+    0x000000, 0x80001b, 0x80002d, 0x000036, 0x800041, 0x00005a, 0x00006c, 0x800077,
+    0x800099, 0x000082, 0x0000b4, 0x8000af, 0x0000d8, 0x8000c3, 0x8000f5, 0x0000ee,
+    0x800129, 0x000132, 0x000104, 0x80011f, 0x000168, 0x800173, 0x800145, 0x00015e,
+    0x0001b0, 0x8001ab, 0x80019d, 0x000186, 0x8001f1, 0x0001ea, 0x0001dc, 0x8001c7,
+    0x800249, 0x000252, 0x000264, 0x80027f, 0x000208, 0x800213, 0x800225, 0x00023e,
+    0x0002d0, 0x8002cb, 0x8002fd, 0x0002e6, 0x800291, 0x00028a, 0x0002bc, 0x8002a7,
+    0x000360, 0x80037b, 0x80034d, 0x000356, 0x800321, 0x00033a, 0x00030c, 0x800317,
+    0x8003f9, 0x0003e2, 0x0003d4, 0x8003cf, 0x0003b8, 0x8003a3, 0x800395, 0x00038e,
+    0x800489, 0x000492, 0x0004a4, 0x8004bf, 0x0004c8, 0x8004d3, 0x8004e5, 0x0004fe,
+    0x000410, 0x80040b, 0x80043d, 0x000426, 0x800451, 0x00044a, 0x00047c, 0x800467,
+    0x0005a0, 0x8005bb, 0x80058d, 0x000596, 0x8005e1, 0x0005fa, 0x0005cc, 0x8005d7,
+    0x800539, 0x000522, 0x000514, 0x80050f, 0x000578, 0x800563, 0x800555, 0x00054e,
+    0x0006c0, 0x8006db, 0x8006ed, 0x0006f6, 0x800681, 0x00069a, 0x0006ac, 0x8006b7,
+    0x800659, 0x000642, 0x000674, 0x80066f, 0x000618, 0x800603, 0x800635, 0x00062e,
+    0x8007e9, 0x0007f2, 0x0007c4, 0x8007df, 0x0007a8, 0x8007b3, 0x800785, 0x00079e,
+    0x000770, 0x80076b, 0x80075d, 0x000746, 0x800731, 0x00072a, 0x00071c, 0x800707,
+    0x800909, 0x000912, 0x000924, 0x80093f, 0x000948, 0x800953, 0x800965, 0x00097e,
+    0x000990, 0x80098b, 0x8009bd, 0x0009a6, 0x8009d1, 0x0009ca, 0x0009fc, 0x8009e7,
+    0x000820, 0x80083b, 0x80080d, 0x000816, 0x800861, 0x00087a, 0x00084c, 0x800857,
+    0x8008b9, 0x0008a2, 0x000894, 0x80088f, 0x0008f8, 0x8008e3, 0x8008d5, 0x0008ce,
+    0x000b40, 0x800b5b, 0x800b6d, 0x000b76, 0x800b01, 0x000b1a, 0x000b2c, 0x800b37,
+    0x800bd9, 0x000bc2, 0x000bf4, 0x800bef, 0x000b98, 0x800b83, 0x800bb5, 0x000bae,
+    0x800a69, 0x000a72, 0x000a44, 0x800a5f, 0x000a28, 0x800a33, 0x800a05, 0x000a1e,
+    0x000af0, 0x800aeb, 0x800add, 0x000ac6, 0x800ab1, 0x000aaa, 0x000a9c, 0x800a87,
+    0x000d80, 0x800d9b, 0x800dad, 0x000db6, 0x800dc1, 0x000dda, 0x000dec, 0x800df7,
+    0x800d19, 0x000d02, 0x000d34, 0x800d2f, 0x000d58, 0x800d43, 0x800d75, 0x000d6e,
+    0x800ca9, 0x000cb2, 0x000c84, 0x800c9f, 0x000ce8, 0x800cf3, 0x800cc5, 0x000cde,
+    0x000c30, 0x800c2b, 0x800c1d, 0x000c06, 0x800c71, 0x000c6a, 0x000c5c, 0x800c47,
+    0x800fc9, 0x000fd2, 0x000fe4, 0x800fff, 0x000f88, 0x800f93, 0x800fa5, 0x000fbe,
+    0x000f50, 0x800f4b, 0x800f7d, 0x000f66, 0x800f11, 0x000f0a, 0x000f3c, 0x800f27,
+    0x000ee0, 0x800efb, 0x800ecd, 0x000ed6, 0x800ea1, 0x000eba, 0x000e8c, 0x800e97,
+    0x800e79, 0x000e62, 0x000e54, 0x800e4f, 0x000e38, 0x800e23, 0x800e15, 0x000e0e,
+};
+
+static const unsigned int crc32_table[256] = {
+    0x00000000, 0x77073096, 0xee0e612c, 0x990951ba, 0x076dc419, 0x706af48f, 0xe963a535, 0x9e6495a3,
+    0x0edb8832, 0x79dcb8a4, 0xe0d5e91e, 0x97d2d988, 0x09b64c2b, 0x7eb17cbd, 0xe7b82d07, 0x90bf1d91,
+    0x1db71064, 0x6ab020f2, 0xf3b97148, 0x84be41de, 0x1adad47d, 0x6ddde4eb, 0xf4d4b551, 0x83d385c7,
+    0x136c9856, 0x646ba8c0, 0xfd62f97a, 0x8a65c9ec, 0x14015c4f, 0x63066cd9, 0xfa0f3d63, 0x8d080df5,
+    0x3b6e20c8, 0x4c69105e, 0xd56041e4, 0xa2677172, 0x3c03e4d1, 0x4b04d447, 0xd20d85fd, 0xa50ab56b,
+    0x35b5a8fa, 0x42b2986c, 0xdbbbc9d6, 0xacbcf940, 0x32d86ce3, 0x45df5c75, 0xdcd60dcf, 0xabd13d59,
+    0x26d930ac, 0x51de003a, 0xc8d75180, 0xbfd06116, 0x21b4f4b5, 0x56b3c423, 0xcfba9599, 0xb8bda50f,
+    0x2802b89e, 0x5f058808, 0xc60cd9b2, 0xb10be924, 0x2f6f7c87, 0x58684c11, 0xc1611dab, 0xb6662d3d,
+    0x76dc4190, 0x01db7106, 0x98d220bc, 0xefd5102a, 0x71b18589, 0x06b6b51f, 0x9fbfe4a5, 0xe8b8d433,
+    0x7807c9a2, 0x0f00f934, 0x9609a88e, 0xe10e9818, 0x7f6a0dbb, 0x086d3d2d, 0x91646c97, 0xe6635c01,
+    0x6b6b51f4, 0x1c6c6162, 0x856530d8, 0xf262004e, 0x6c0695ed, 0x1b01a57b, 0x8208f4c1, 0xf50fc457,
+    0x65b0d9c6, 0x12b7e950, 0x8bbeb8ea, 0xfcb9887c, 0x62dd1ddf, 0x15da2d49, 0x8cd37cf3, 0xfbd44c65,
+    0x4db26158, 0x3ab551ce, 0xa3bc0074, 0xd4bb30e2, 0x4adfa541, 0x3dd895d7, 0xa4d1c46d, 0xd3d6f4fb,
+    0x4369e96a, 0x346ed9fc, 0xad678846, 0xda60b8d0, 0x44042d73, 0x33031de5, 0xaa0a4c5f, 0xdd0d7cc9,
+    0x5005713c, 0x270241aa, 0xbe0b1010, 0xc90c2086, 0x5768b525, 0x206f85b3, 0xb966d409, 0xce61e49f,
+    0x5edef90e, 0x29d9c998, 0xb0d09822, 0xc7d7a8b4, 0x59b33d17, 0x2eb40d81, 0xb7bd5c3b, 0xc0ba6cad,
+    0xedb88320, 0x9abfb3b6, 0x03b6e20c, 0x74b1d29a, 0xead54739, 0x9dd277af, 0x04db2615, 0x73dc1683,
+    0xe3630b12, 0x94643b84, 0x0d6d6a3e, 0x7a6a5aa8, 0xe40ecf0b, 0x9309ff9d, 0x0a00ae27, 0x7d079eb1,
+    0xf00f9344, 0x8708a3d2, 0x1e01f268, 0x6906c2fe, 0xf762575d, 0x806567cb, 0x196c3671, 0x6e6b06e7,
+    0xfed41b76, 0x89d32be0, 0x10da7a5a, 0x67dd4acc, 0xf9b9df6f, 0x8ebeeff9, 0x17b7be43, 0x60b08ed5,
+    0xd6d6a3e8, 0xa1d1937e, 0x38d8c2c4, 0x4fdff252, 0xd1bb67f1, 0xa6bc5767, 0x3fb506dd, 0x48b2364b,
+    0xd80d2bda, 0xaf0a1b4c, 0x36034af6, 0x41047a60, 0xdf60efc3, 0xa867df55, 0x316e8eef, 0x4669be79,
+    0xcb61b38c, 0xbc66831a, 0x256fd2a0, 0x5268e236, 0xcc0c7795, 0xbb0b4703, 0x220216b9, 0x5505262f,
+    0xc5ba3bbe, 0xb2bd0b28, 0x2bb45a92, 0x5cb36a04, 0xc2d7ffa7, 0xb5d0cf31, 0x2cd99e8b, 0x5bdeae1d,
+    0x9b64c2b0, 0xec63f226, 0x756aa39c, 0x026d930a, 0x9c0906a9, 0xeb0e363f, 0x72076785, 0x05005713,
+    0x95bf4a82, 0xe2b87a14, 0x7bb12bae, 0x0cb61b38, 0x92d28e9b, 0xe5d5be0d, 0x7cdcefb7, 0x0bdbdf21,
+    0x86d3d2d4, 0xf1d4e242, 0x68ddb3f8, 0x1fda836e, 0x81be16cd, 0xf6b9265b, 0x6fb077e1, 0x18b74777,
+    0x88085ae6, 0xff0f6a70, 0x66063bca, 0x11010b5c, 0x8f659eff, 0xf862ae69, 0x616bffd3, 0x166ccf45,
+    0xa00ae278, 0xd70dd2ee, 0x4e048354, 0x3903b3c2, 0xa7672661, 0xd06016f7, 0x4969474d, 0x3e6e77db,
+    0xaed16a4a, 0xd9d65adc, 0x40df0b66, 0x37d83bf0, 0xa9bcae53, 0xdebb9ec5, 0x47b2cf7f, 0x30b5ffe9,
+    0xbdbdf21c, 0xcabac28a, 0x53b39330, 0x24b4a3a6, 0xbad03605, 0xcdd70693, 0x54de5729, 0x23d967bf,
+    0xb3667a2e, 0xc4614ab8, 0x5d681b02, 0x2a6f2b94, 0xb40bbe37, 0xc30c8ea1, 0x5a05df1b, 0x2d02ef8d,
+};
 
 /*
 calculate one byte input value with CRC 8 Bit
@@ -25,12 +164,12 @@ unsigned char crc8(unsigned char crc, unsigned char data)
 }
 
 /*
-Calculate buffer with crc8
+Calculate buffer with crc8, bitwise reference of calc_crc8()
     @base: buffer input
     @size: data size
     @returns calculated crc value
 */
-unsigned char calc_crc8(const unsigned char *base, int size)
+unsigned char calc_crc8_bitwise(const unsigned char *base, int size)
 {
     unsigned char crc = 0;
     const unsigned char *ptr = base;
@@ -44,6 +183,24 @@ unsigned char calc_crc8(const unsigned char *base, int size)
     return crc;
 }
 
+/*
+Calculate buffer with crc8
+    @base: buffer input
+    @size: data size
+    @returns calculated crc value
+*/
+unsigned char calc_crc8(const unsigned char *base, int size)
+{
+    unsigned char crc = 0;
+    const unsigned char *ptr = base;
+    const unsigned char *end = base + size;
+
+    while (ptr < end)
+        crc = crc8_table[crc ^ *ptr++];
+
+    return crc;
+}
+
 /*
 calculate two byte input value with CRC 24 Bit
     @crc: last crc value
@@ -65,8 +222,37 @@ unsigned int crc24(unsigned int crc, unsigned char firstbyte, unsigned char seco
     return crc;
 }
 
+/*
+Calculate buffer with crc24, bitwise reference of calc_crc24()
+    @base: buffer input
+    @size: data size
+    @returns calculated crc value, only bit[0~23] is valid
+*/
+unsigned int calc_crc24_bitwise(const unsigned char *base, int size)
+{
+    unsigned int crc = 0;
+    const unsigned char *ptr = base;
+    const unsigned char *last_val = base + size - 1;
+
+    while (ptr < last_val) {
+        crc = crc24(crc, *ptr, *(ptr + 1));
+        ptr += 2;
+    }
+
+    /* if len is odd, fill the last byte with 0 */
+    if (ptr == last_val)
+        crc = crc24(crc, *ptr, 0);
+
+    /* Mask to 24-bit */
+    crc &= 0x00FFFFFF;
+
+    return crc;
+}
+
 /*
 Calculate buffer with crc24
+    The crc shifts one bit per 16-bit word, so 8 words shift the crc by one byte: the high byte is
+    reduced by crc24_table, and the 8 words, shifted by 7..0 bits, fit in 23 bits without reduction.
     @base: buffer input
     @size: data size
     @returns calculated crc value, only bit[0~23] is valid
@@ -74,11 +260,22 @@ Calculate buffer with crc24
 unsigned int calc_crc24(const unsigned char *base, int size)
 {
     unsigned int crc = 0;
+    unsigned int words;
     const unsigned char *ptr = base;
     const unsigned char *last_val = base + size - 1;
+    int i;
+
+    while (last_val - ptr >= 15) {
+        words = 0;
+        for (i = 0; i < 8; i++) {
+            words = (words << 1) ^ L8_TO_LT16(ptr[0], ptr[1]);
+            ptr += 2;
+        }
+        crc = ((crc << 8) & 0x00FFFFFF) ^ crc24_table[(crc >> 16) & 0xFF] ^ words;
+    }
 
     while (ptr < last_val) {
-        crc = crc24(crc, *ptr, *(ptr + 1));
+        crc = crc24(crc, *ptr, *(ptr + 1)) & 0x00FFFFFF;
         ptr += 2;
     }
 
@@ -90,4 +287,251 @@ unsigned int calc_crc24(const unsigned char *base, int size)
     crc &= 0x00FFFFFF;
 
     return crc;
-}
\ No newline at end of file
+}
+
+/*
+Continue crc16-ccitt(poly 0x1021, msb first) bitwise, reference of crc16_ccitt_update()
+    @crc: last crc value
+    @base: buffer input
+    @size: data size
+    @returns calculated crc value
+*/
+unsigned short crc16_ccitt_update_bitwise(unsigned short crc, const unsigned char *base, int size)
+{
+    int i;
+
+    while (size-- > 0) {
+        crc ^= (unsigned short)(*base++) << 8;
+        for (i = 0; i < 8; i++)
+            crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+    }
+
+    return crc;
+}
+
+/*
+Continue crc16-ccitt(poly 0x1021, msb first)
+    @crc: last crc value
+    @base: buffer input
+    @size: data size
+    @returns calculated crc value
+*/
+unsigned short crc16_ccitt_update(unsigned short crc, const unsigned char *base, int size)
+{
+    while (size-- > 0)
+        crc = (crc << 8) ^ crc16_ccitt_table[(crc >> 8) ^ *base++];
+
+    return crc;
+}
+
+/*
+Continue crc32(IEEE 802.3, reflected poly 0xEDB88320) bitwise, reference of crc32_update()
+    @crc: last crc value, not complemented
+    @base: buffer input
+    @size: data size
+    @returns calculated crc value, not complemented
+*/
+unsigned int crc32_update_bitwise(unsigned int crc, const unsigned char *base, int size)
+{
+    int i;
+
+    while (size-- > 0) {
+        crc ^= *base++;
+        for (i = 0; i < 8; i++)
+            crc = (crc & 1) ? (crc >> 1) ^ 0xEDB88320 : crc >> 1;
+    }
+
+    return crc;
+}
+
+/*
+Continue crc32(IEEE 802.3, reflected poly 0xEDB88320) with table
+    @crc: last crc value, not complemented
+    @base: buffer input
+    @size: data size
+    @returns calculated crc value, not complemented
+*/
+static unsigned int crc32_table_update(unsigned int crc, const unsigned char *base, int size)
+{
+    while (size-- > 0)
+        crc = (crc >> 8) ^ crc32_table[(crc ^ *base++) & 0xFF];
+
+    return crc;
+}
+
+#ifdef CRC_USE_DMAC
+
+/* DMAC crc unit state: 0 not checked, 1 available, -1 result mismatched the table variant */
+static int crc_dmac_state = 0;
+
+/*
+Calculate buffer with DMAC crc unit through its I/O interface, the DMAC channels are not used
+    @poly: DMAC_CRCCTRL_CRCPOLY_CRC16_Val or DMAC_CRCCTRL_CRCPOLY_CRC32_Val
+    @init: initial checksum
+    @base: buffer input
+    @size: data size
+    @returns checksum register value
+*/
+static unsigned int crc_dmac_calc(unsigned int poly, unsigned int init, const unsigned char *base, int size)
+{
+    const unsigned int *wptr;
+    unsigned int beat;
+    unsigned int chksum;
+
+    /* word beats when the whole buffer is word aligned */
+    beat = (!((size_t)base & 3) && !(size & 3)) ? DMAC_CRCCTRL_CRCBEATSIZE_WORD_Val : DMAC_CRCCTRL_CRCBEATSIZE_BYTE_Val;
+
+    hri_mclk_set_AHBMASK_DMAC_bit(MCLK);
+
+    /* CRCCTRL and CRCCHKSUM are written when the crc unit is disabled */
+    hri_dmac_clear_CTRL_CRCENABLE_bit(DMAC);
+    hri_dmac_write_CRCCTRL_reg(DMAC, DMAC_CRCCTRL_CRCBEATSIZE(beat) | DMAC_CRCCTRL_CRCPOLY(poly) | DMAC_CRCCTRL_CRCSRC(DMAC_CRCCTRL_CRCSRC_IO_Val));
+    hri_dmac_write_CRCCHKSUM_reg(DMAC, init);
+    hri_dmac_set_CTRL_CRCENABLE_bit(DMAC);
+
+    if (beat == DMAC_CRCCTRL_CRCBEATSIZE_WORD_Val) {
+        wptr = (const unsigned int *)base;
+        for (size >>= 2; size > 0; size--)
+            hri_dmac_write_CRCDATAIN_reg(DMAC, *wptr++);
+    } else {
+        while (size-- > 0)
+            hri_dmac_write_CRCDATAIN_reg(DMAC, *base++);
+    }
+
+    /* one clock per byte of the last beat before the checksum is updated */
+    __NOP(); __NOP(); __NOP(); __NOP();
+
+    chksum = hri_dmac_read_CRCCHKSUM_reg(DMAC);
+    hri_dmac_clear_CRCSTATUS_CRCBUSY_bit(DMAC);
+    hri_dmac_clear_CTRL_CRCENABLE_bit(DMAC);
+
+    return chksum;
+}
+
+/*
+Check the DMAC crc unit against the table variants with byte and word beats, it is used only if all matched
+    @returns true if DMAC crc unit is usable
+*/
+static bool crc_dmac_available(void)
+{
+    static const unsigned int check[] = { 0x34333231, 0x38373635, 0x39 };   /* "123456789" */
+    const unsigned char *ptr = (const unsigned char *)check;
+
+    if (!crc_dmac_state) {
+        crc_dmac_state = -1;
+        if (crc_dmac_calc(DMAC_CRCCTRL_CRCPOLY_CRC16_Val, 0xFFFF, ptr, 9) == crc16_ccitt_update(0xFFFF, ptr, 9) &&
+            crc_dmac_calc(DMAC_CRCCTRL_CRCPOLY_CRC16_Val, 0xFFFF, ptr, 8) == crc16_ccitt_update(0xFFFF, ptr, 8) &&
+            crc_dmac_calc(DMAC_CRCCTRL_CRCPOLY_CRC32_Val, 0xFFFFFFFF, ptr, 9) == ~crc32_table_update(0xFFFFFFFF, ptr, 9) &&
+            crc_dmac_calc(DMAC_CRCCTRL_CRCPOLY_CRC32_Val, 0xFFFFFFFF, ptr, 8) == ~crc32_table_update(0xFFFFFFFF, ptr, 8) &&
+            /* continued from a running crc, as crc32_update() */
+            ~crc_dmac_calc(DMAC_CRCCTRL_CRCPOLY_CRC32_Val, 0x12345678, ptr, 8) == crc32_table_update(0x12345678, ptr, 8))
+            crc_dmac_state = 1;
+
+        DBG_INFO(UPDI_DEBUG, "DMAC crc unit %s", crc_dmac_state > 0 ? "enabled" : "mismatched, use table");
+    }
+
+    return crc_dmac_state > 0;
+}
+
+#endif
+
+/*
+Calculate buffer with crc16-ccitt(init 0xFFFF), the CRCSCAN checksum of the target
+    @base: buffer input
+    @size: data size
+    @returns calculated crc value
+*/
+unsigned short calc_crc16_ccitt(const unsigned char *base, int size)
+{
+#ifdef CRC_USE_DMAC
+    if (size >= CRC_DMAC_MIN_SIZE && crc_dmac_available())
+        return (unsigned short)crc_dmac_calc(DMAC_CRCCTRL_CRCPOLY_CRC16_Val, 0xFFFF, base, size);
+#endif
+
+    return crc16_ccitt_update(0xFFFF, base, size);
+}
+
+/*
+Continue crc32(IEEE 802.3, reflected poly 0xEDB88320), the flash checkpoint fingerprint of each committed page
+    @crc: last crc value, not complemented
+    @base: buffer input
+    @size: data size
+    @returns calculated crc value, not complemented
+*/
+unsigned int crc32_update(unsigned int crc, const unsigned char *base, int size)
+{
+#ifdef CRC_USE_DMAC
+    if (size >= CRC_DMAC_MIN_SIZE && crc_dmac_available())
+        return ~crc_dmac_calc(DMAC_CRCCTRL_CRCPOLY_CRC32_Val, crc, base, size);
+#endif
+
+    return crc32_table_update(crc, base, size);
+}
+
+/*
+Calculate buffer with crc32(IEEE 802.3)
+    @base: buffer input
+    @size: data size
+    @returns calculated crc value
+*/
+unsigned int calc_crc32(const unsigned char *base, int size)
+{
+    return ~crc32_update(0xFFFFFFFF, base, size);
+}
+
+#ifdef CRC_BENCHMARK
+
+/*
+Run the crc variants over a buffer and measure them, the bitwise and the fast(table or DMAC) results must be the same
+    @base: buffer input
+    @size: data size
+    @rounds: repeat count of each variant
+    @bench: output of CRC_BENCH_NUM rows, crc8, crc16, crc24 and crc32
+    @returns 0 if all variants matched, other value failed
+*/
+int crc_benchmark(const unsigned char *base, int size, int rounds, crc_bench_t *bench)
+{
+    static const char * const names[CRC_BENCH_NUM] = { "crc8", "crc16", "crc24", "crc32" };
+    /* reloaded each round, the rounds of the same buffer are not folded into one by the compiler */
+    const unsigned char * volatile input = base;
+    unsigned int result[2];
+    u32 start, elapsed[2];
+    int i, k, r, err = 0;
+
+    for (k = 0; k < CRC_BENCH_NUM; k++) {
+        for (i = 0; i < 2; i++) {
+            start = get_time_us();
+            for (r = 0; r < rounds; r++) {
+                switch (k) {
+                case 0:
+                    result[i] = i ? calc_crc8(input, size) : calc_crc8_bitwise(input, size);
+                    break;
+                case 1:
+                    result[i] = i ? calc_crc16_ccitt(input, size) : crc16_ccitt_update_bitwise(0xFFFF, input, size);
+                    break;
+                case 2:
+                    result[i] = i ? calc_crc24(input, size) : calc_crc24_bitwise(input, size);
+                    break;
+                default:
+                    result[i] = i ? calc_crc32(input, size) : ~crc32_update_bitwise(0xFFFFFFFF, input, size);
+                }
+            }
+            elapsed[i] = get_time_us() - start;
+        }
+
+        bench[k].name = names[k];
+        bench[k].bitwise_us = elapsed[0];
+        bench[k].fast_us = elapsed[1];
+        bench[k].result = result[1];
+        bench[k].matched = result[0] == result[1];
+
+        if (!bench[k].matched)
+            err = -2;
+    }
+
+    return err;
+}
+
+#endif
+
+#endif
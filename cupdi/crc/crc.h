@@ -1,2 +1,45 @@
+#ifndef __CRC_H
+#define __CRC_H
+
+/* buffers shorter than this are calculated with table, when CRC_USE_DMAC is defined */
+#define CRC_DMAC_MIN_SIZE 32
+
+unsigned char crc8(unsigned char crc, unsigned char data);
 unsigned char calc_crc8(const unsigned char *base, int size);
-unsigned int calc_crc24(const unsigned char *base, int size);
\ No newline at end of file
+unsigned char calc_crc8_bitwise(const unsigned char *base, int size);
+
+unsigned int crc24(unsigned int crc, unsigned char firstbyte, unsigned char secondbyte);
+unsigned int calc_crc24(const unsigned char *base, int size);
+unsigned int calc_crc24_bitwise(const unsigned char *base, int size);
+
+unsigned short crc16_ccitt_update(unsigned short crc, const unsigned char *base, int size);
+unsigned short crc16_ccitt_update_bitwise(unsigned short crc, const unsigned char *base, int size);
+unsigned short calc_crc16_ccitt(const unsigned char *base, int size);
+
+unsigned int crc32_update(unsigned int crc, const unsigned char *base, int size);
+unsigned int crc32_update_bitwise(unsigned int crc, const unsigned char *base, int size);
+unsigned int calc_crc32(const unsigned char *base, int size);
+
+#ifdef CRC_BENCHMARK
+#define CRC_BENCH_NUM 4
+
+/*
+    Benchmark row of a crc
+    @name: crc8, crc16, crc24 or crc32
+    @bitwise_us: time of the rounds of the bitwise reference
+    @fast_us: time of the rounds of the table variant, or the DMAC crc unit when CRC_USE_DMAC is available
+    @result: crc of the fast variant
+    @matched: both variants got the same crc
+*/
+typedef struct _crc_bench {
+    const char *name;
+    unsigned int bitwise_us;
+    unsigned int fast_us;
+    unsigned int result;
+    int matched;
+}crc_bench_t;
+
+int crc_benchmark(const unsigned char *base, int size, int rounds, crc_bench_t *bench);
+#endif
+
+#endif
@@ -56,49 +56,194 @@ This is C version of UPDI interface achievement, referred to the Python version
 #include <stdio.h>
 #include <platform/platform.h>
 #include <device/device.h>
+#include <updi/constants.h>
 #include <updi/nvm.h>
+#include <updi/trace.h>
 #include <hex_file/ihex.h>
+#include <hex_file/hexfile.h>
+#include <ihex/kk_ihex_write.h>
 #include <crc/crc.h>
 #include "cupdi.h"
+#include "estimate.h"
 #include "hex_file/ihex.h"
 
 #ifdef CUPDI
 
-/* Fuse content */
-// BOD level 2(2.6v Sampled 1Khz at Sleep, Enabled at Active), OSC 16Mhz, NVM protect after POR, 
-// EEPROM erased
-/*BYTE order, ignore set as NULL or the value*/
-u8 fuse_data[] = {0x00, 0x46, 0x7D, 0xFF, 0x00, 0xF6, 0xFF, 0x00, 0x00, 0xFF, 0xC5 };	
-
 /* CUPDI Software version */
 #define SOFTWARE_VERSION "1.10"
 
+/* Flash programming checkpoint of the part programmed by this thread */
+static UPDI_THREAD_LOCAL updi_checkpoint_t updi_checkpoint;
+
 int cupdi_operate()
 {
     char *dev_name = NULL;
     char *comport = NULL;          // no significant meaning
     int baudrate = 115200;
-    const device_info_t * dev;
-    void *nvm_ptr;
+    cupdi_report_t report;
     int result;
 	
 	dev_name = "tiny1617";
 
+    result = cupdi_operate_port(comport, baudrate, dev_name, UPDI_PLAN_DEFAULT, &report);
+    cupdi_report_print(&report);
+
+    return result;
+}
+
+/*
+    Connect a part on the serial port, program it and leave progmode
+    @port: serial port name, NULL for the first port
+    @baud: UPDI baudrate
+    @dev_name: device name of get_chip_info()
+    @flags: UPDI_PLAN_xxx flags of the planner
+    @report: output of the part report, could be NULL
+    @returns 0 - success, other value failed code
+*/
+int cupdi_operate_port(const char *port, int baud, const char *dev_name, int flags, cupdi_report_t *report)
+{
+    const device_info_t * dev;
+    cupdi_report_t local;
+    unsigned int begin, start;
+    void *nvm_ptr;
+    int result;
+
+    if (!report)
+        report = &local;
+
+    cupdi_report_init(report);
+    begin = get_time_ms();
+
     dev = get_chip_info(dev_name);
     if (!dev) {
         DBG_INFO(UPDI_DEBUG, "Device %s not support", dev_name);
+        report->result = -2;
         return -2;
     }
       
-    nvm_ptr = updi_nvm_init(comport, baudrate, (void *)dev);
+    nvm_ptr = updi_nvm_init(port, baud, (void *)dev);
+    report->phase_ms[CUPDI_PHASE_CONNECT] = get_time_ms() - begin;
     if (!nvm_ptr) {
         DBG_INFO(UPDI_DEBUG, "Nvm initialize failed");
+        updi_trace_dump(0);
+        result = -3;
+        goto out;
+    }
+
+    result = cupdi_program_part(nvm_ptr, flags, report);
+  
+ out:
+    start = get_time_ms();
+    nvm_leave_progmode(nvm_ptr);
+    report->phase_ms[CUPDI_PHASE_LEAVE] = get_time_ms() - start;
+    updi_nvm_deinit(nvm_ptr);
+
+    report->result = result;
+    report->total_ms = get_time_ms() - begin;
+
+    return result;
+}
+
+/*
+    Connect a part on the serial port, dump a nvm region as Intel HEX and leave progmode
+    @port: serial port name, NULL for the first port
+    @baud: UPDI baudrate
+    @dev_name: device name of get_chip_info()
+    @type: NVM_TYPE_T region, see cupdi_region_type()
+    @cb_flush: hex line output callback
+    @args: argument of cb_flush
+    @returns 0 - success, other value failed code
+*/
+int cupdi_dump_port(const char *port, int baud, const char *dev_name, int type, cb_ihex_flush_buffer_t cb_flush, void *args)
+{
+    const device_info_t * dev;
+    verbose_t level;
+    void *nvm_ptr;
+    int result;
+
+    dev = get_chip_info(dev_name);
+    if (!dev) {
+        DBG_INFO(UPDI_DEBUG, "Device %s not support", dev_name);
+        return -2;
+    }
+
+    // The connecting is muted too, the hex stream could share the console
+    level = get_verbose_level();
+    set_verbose_level(DEFAULT_DEBUG);
+
+    nvm_ptr = updi_nvm_init(port, baud, (void *)dev);
+    if (!nvm_ptr) {
         result = -3;
         goto out;
     }
 
+    // A locked part is not unlocked here, that would erase what is dumped
+    result = nvm_enter_progmode(nvm_ptr);
+    if (result) {
+        DBG_INFO(UPDI_DEBUG, "nvm_enter_progmode failed %d", result);
+        result = -4;
+        goto out;
+    }
+
+    result = updi_dump(nvm_ptr, type, cb_flush, args);
+    if (result) {
+        DBG_INFO(UPDI_DEBUG, "updi_dump failed %d", result);
+        result = -5;
+    }
+
+ out:
+    nvm_leave_progmode(nvm_ptr);
+    updi_nvm_deinit(nvm_ptr);
+    set_verbose_level(level);
+
+    return result;
+}
+
+/*
+    NVM region of a name
+    @name: flash, eeprom, userrow, fuse or lock
+    @return NVM_TYPE_T, -1 if unknown
+*/
+int cupdi_region_type(const char *name)
+{
+    static const char * const region_names[NUM_NVM_TYPES] = { "flash", "eeprom", "userrow", "fuse", "lock" };
+    int i;
+
+    for (i = 0; name && i < NUM_NVM_TYPES; i++) {
+        if (!strcmp(name, region_names[i]))
+            return i;
+    }
+
+    return -1;
+}
+
+/*
+    Program a connected part: device info, enter progmode(unlock if locked), device id check, fuse, erase, program,
+    verify and lock
+    @nvm_ptr: updi_nvm_init() device handle, the progmode is not left here
+    @flags: UPDI_PLAN_xxx flags of the planner, UPDI_PLAN_PRESERVE_xxx to keep the eeprom or the flash out of image
+    @report: output of the phases DEVICE_INFO...LOCK, plan and result, the other fields are kept. Could be NULL
+    @returns 0 - success, other value failed code
+*/
+int cupdi_program_part(void *nvm_ptr, int flags, cupdi_report_t *report)
+{
+    const app_device_id_t *id;
+    cupdi_report_t local;
+    updi_plan_t plan;
+    unsigned int start;
+    int resumed, result;
+
+    if (!report) {
+        report = &local;
+        cupdi_report_init(report);
+    }
+
+    start = get_time_ms();
+#define CUPDI_PHASE_END(_phase) do { unsigned int _now = get_time_ms(); report->phase_ms[_phase] = _now - start; start = _now; } while (0)
+
     //check device id
     result = nvm_get_device_info(nvm_ptr);
+    CUPDI_PHASE_END(CUPDI_PHASE_DEVICE_INFO);
     if (result) {
         DBG_INFO(UPDI_DEBUG, "nvm_get_device_info failed");
         result = -4;
@@ -111,32 +256,128 @@ int cupdi_operate()
         result = nvm_unlock_device(nvm_ptr);
         if (result) {
             DBG_INFO(UPDI_DEBUG, "NVM unlock device failed %d", result);
+            CUPDI_PHASE_END(CUPDI_PHASE_PROGMODE);
             result = -5;
             goto out;
         }
+
+        // Unlocking erased the chip, nothing to resume
+        flags |= UPDI_PLAN_BLANK;
+        updi_checkpoint_clear();
+    }
+    CUPDI_PHASE_END(CUPDI_PHASE_PROGMODE);
+
+    // The signature row is readable in progmode only
+    id = nvm_get_device_id(nvm_ptr);
+    if (!id || !id->sigrow_valid || dev_check_signature(nvm_get_device(nvm_ptr), id->sigrow)) {
+        DBG_INFO(UPDI_DEBUG, "Device id mismatch");
+        result = -4;
+        goto out;
     }
 
     result = updi_write_fuse(nvm_ptr);
+    CUPDI_PHASE_END(CUPDI_PHASE_FUSE);
 	if (result) {
-		DBG_INFO(UPDI_DEBUG, "updi_program failed %d", result);
+		DBG_INFO(UPDI_DEBUG, "updi_write_fuse failed %d", result);
 		result = -6;
 		goto out;
 	}
 
-    result = updi_program(nvm_ptr);//file);
+    // The flash programming interrupted on this part is resumed, otherwise planned and erased
+    resumed = updi_resume_check(nvm_ptr, &plan);
+    if (resumed < 0)
+        DBG_INFO(UPDI_DEBUG, "updi_resume_check failed %d, start over", resumed);
+
+    if (resumed > 0)
+        result = 0;
+    else
+        result = updi_erase_plan(nvm_ptr, flags, &plan);
+    CUPDI_PHASE_END(CUPDI_PHASE_ERASE);
+    if (result) {
+        DBG_INFO(UPDI_DEBUG, "updi_erase_plan failed %d", result);
+        result = -8;
+        goto out;
+    }
+    report->plan = plan.plan;
+    report->resumed = max(resumed, 0);
+
+    result = updi_program_planned(nvm_ptr, &plan);
+    CUPDI_PHASE_END(CUPDI_PHASE_PROGRAM);
     if (result) {
-        DBG_INFO(UPDI_DEBUG, "updi_program failed %d", result);
+        DBG_INFO(UPDI_DEBUG, "updi_program_planned failed %d", result);
         result = -9;
         goto out;
     }
-  
- out:
-    nvm_leave_progmode(nvm_ptr);
-    updi_nvm_deinit(nvm_ptr);
+
+    result = updi_verify(nvm_ptr);
+    CUPDI_PHASE_END(CUPDI_PHASE_VERIFY);
+    if (result) {
+        DBG_INFO(UPDI_DEBUG, "updi_verify failed %d", result);
+        result = -10;
+        goto out;
+    }
+
+    // Lock is the last one, the memory can't be accessed after locked
+    result = updi_write_lock(nvm_ptr);
+    CUPDI_PHASE_END(CUPDI_PHASE_LOCK);
+    if (result) {
+        DBG_INFO(UPDI_DEBUG, "updi_write_lock failed %d", result);
+        result = -11;
+        goto out;
+    }
+
+out:
+#undef CUPDI_PHASE_END
+    // The bus transactions before the failure
+    if (result)
+        updi_trace_dump(0);
+
+    report->result = result;
 
     return result;
 }
 
+/*
+    Clear a part report
+    @report: report
+*/
+void cupdi_report_init(cupdi_report_t *report)
+{
+    memset(report, 0, sizeof(*report));
+    report->plan = -1;
+}
+
+/*
+    Get the phase name
+    @phase: CUPDI_PHASE_T
+    @returns name, "unknown" if phase invalid
+*/
+const char *cupdi_phase_name(int phase)
+{
+    static const char * const phase_names[CUPDI_PHASE_NUM] = {
+        "connect", "device_info", "progmode", "fuse", "erase", "program", "verify", "lock", "leave"
+    };
+
+    if (phase < 0 || phase >= CUPDI_PHASE_NUM)
+        return "unknown";
+
+    return phase_names[phase];
+}
+
+/*
+    Print a part report, always compiled as the statistics reports, not subject to UPDI_LOG_LEVEL
+    @report: report
+*/
+void cupdi_report_print(const cupdi_report_t *report)
+{
+    int i;
+
+    printf("Part %s(%d), %u ms, flash plan %d, resumed %d pages\n", report->result ? "FAIL" : "PASS", report->result,
+        report->total_ms, report->plan, report->resumed);
+    for (i = 0; i < CUPDI_PHASE_NUM; i++)
+        printf("  %-12s %6u ms\n", cupdi_phase_name(i), report->phase_ms[i]);
+}
+
 /*
     Erase the chip
     @nvm_ptr: updi_nvm_init() device handle
@@ -156,40 +397,119 @@ int updi_erase(void *nvm_ptr)
 }
 
 /*
-UPDI Fuse Write
+    Find the next fuse byte to write, each fuse byte is written by one command so the same ones are skipped
+    @current: fuse content of the part
+    @data: fuse content of the image
+    @len: content len
+    @from: first byte to check
+    @returns index of the changed byte, len if no more
+*/
+int updi_fuse_next_changed(const u8 *current, const u8 *data, int len, int from)
+{
+    for (; from < len && current[from] == data[from]; from++);
+
+    return from;
+}
+
+/*
+    Write fuse type content, only the changed bytes are written since each fuse byte is written by one command
+    @nvm_ptr: updi_nvm_init() device handle
+    @address: target address
+    @data: fuse content
+    @len: content len
+    @returns 0 - success, other value failed code
+*/
+int _updi_write_fuse_changed(void *nvm_ptr, u16 address, const u8 *data, int len)
+{
+    u8 current[16];
+    int i, result;
+
+    if (len > sizeof(current)) {
+        DBG_INFO(UPDI_DEBUG, "Fuse len %d overflow", len);
+        return -2;
+    }
+
+    result = nvm_read_mem(nvm_ptr, address, current, len);
+    if (result) {
+        DBG_INFO(UPDI_DEBUG, "nvm_read_mem fuse failed %d", result);
+        return -3;
+    }
+
+    for (i = updi_fuse_next_changed(current, data, len, 0); i < len; i = updi_fuse_next_changed(current, data, len, i + 1)) {
+        result = nvm_write_auto(nvm_ptr, address + i, &data[i], 1);
+        if (result) {
+            DBG_INFO(UPDI_DEBUG, "nvm_write_auto fuse %04x failed %d", address + i, result);
+            return -4;
+        }
+    }
+
+    return 0;
+}
+
+/*
+    Program the image segments located in the region
+        flash: page write after chip erase
+        eeprom/userrow: page erase-write
+        fuses/lockbits: byte write for the changed ones
+    @nvm_ptr: updi_nvm_init() device handle
+    @dhex: image
+    @type: NVM_TYPE_T region
+    @returns 0 - success, other value failed code
+*/
+int updi_program_region(void *nvm_ptr, hex_data_t *dhex, int type)
+{
+    segment_buffer_t *seg;
+    nvm_info_t info;
+    ihex_address_t offset;
+    int i, result;
+
+    result = nvm_get_block_info(nvm_ptr, type, &info);
+    if (result) {
+        DBG_INFO(UPDI_DEBUG, "nvm_get_block_info %d failed %d", type, result);
+        return -2;
+    }
+
+    for (i = 0; i < ARRAY_SIZE(dhex->segment); i++) {
+        seg = &dhex->segment[i];
+        if (!seg->data || dhex_segment_region(seg, &offset) != type)
+            continue;
+
+        if (offset + seg->len > info.nvm_size) {
+            DBG_INFO(UPDI_DEBUG, "Segment %d (region %d) overflow, offset %x len %x", i, type, offset, seg->len);
+            return -3;
+        }
+
+        if (type == NVM_FUSES || type == NVM_LOCKBITS)
+            result = _updi_write_fuse_changed(nvm_ptr, info.nvm_start + offset, (const u8 *)seg->data, seg->len);
+        else
+            result = nvm_write_auto(nvm_ptr, info.nvm_start + offset, (const u8 *)seg->data, seg->len);
+        if (result) {
+            DBG_INFO(UPDI_DEBUG, "Segment %d (region %d) write failed %d", i, type, result);
+            return -4;
+        }
+    }
+
+    return 0;
+}
+
+/*
+UPDI Fuse Write, the fuse content is from the fuse region of image
     @nvm_ptr: updi_nvm_init() device handle
     @returns 0 - success, other value failed code
 */
 int updi_write_fuse(void *nvm_ptr)
 {
-	int result;
-	int index;
-	nvm_info_t info;
-	u8 data[16];
-	
-	result = nvm_get_block_info(nvm_ptr, NVM_FUSES, &info);
-	if (result) {
-		DBG_INFO(NVM_DEBUG, "nvm_get_block_info failed");
-		return -1;
-	}
-	
-	result = nvm_read_fuse(nvm_ptr, 0, data, info.nvm_size);
-	if (result) {
-		DBG_INFO(NVM_DEBUG, "nvm_read_fuse failed");
-		return -2;
-	}
-	
-	for (index = 0; index < info.nvm_size; index++) {
-		if (data[index] != fuse_data[index]) {
-			result = nvm_write_fuse(nvm_ptr, index, (const u8 *)&fuse_data[index], 1);
-			if (result) {
-				DBG_INFO(NVM_DEBUG, "nvm_write_fuse failed");
-				return -3;
-			}
-		}
-	}
-	
-	return 0;
+    return updi_program_region(nvm_ptr, dhex_get_image(), NVM_FUSES);
+}
+
+/*
+UPDI Lock bits Write, the lock content is from the lock region of image
+    @nvm_ptr: updi_nvm_init() device handle
+    @returns 0 - success, other value failed code
+*/
+int updi_write_lock(void *nvm_ptr)
+{
+    return updi_program_region(nvm_ptr, dhex_get_image(), NVM_LOCKBITS);
 }
 
 int set_default_segment_id(hex_data_t *dhex, ihex_segment_t segmentid)
@@ -209,52 +529,913 @@ int set_default_segment_id(hex_data_t *dhex, ihex_segment_t segmentid)
 }
 
 /*
-    UPDI Program flash
-    This flowchart is: load firmware file->erase chip->program firmware
+    Decide how to program a flash page of the image from the part content
+        same content: skipped
+        image page blank: page erased
+        only bits cleared(e.g. the part page blank): page written without erase
+        other: erase-written
+    @current: page content of the part
+    @data: page content of the image
+    @page_size: flash page size
+    @blank: the image page has no data, see dhex_page_data()
+    @returns UPDI_PAGE_xxx action
+*/
+int updi_page_compare(const u8 *current, const u8 *data, int page_size, bool blank)
+{
+    int i;
+
+    if (!memcmp(current, data, page_size))
+        return UPDI_PAGE_SKIP;
+
+    if (blank)
+        return UPDI_PAGE_ERASE;
+
+    // Programming only clears bits
+    for (i = 0; i < page_size && (current[i] & data[i]) == data[i]; i++);
+
+    return i == page_size ? UPDI_PAGE_WRITE : UPDI_PAGE_ERASE_WRITE;
+}
+
+/*
+    Compare a flash page of the image with the part and decide how to program it, see updi_page_compare()
     @nvm_ptr: updi_nvm_init() device handle
-    @file: hex/ihex file path
-    @returns 0 - success, other value failed code
+    @dhex: image
+    @seg: flash segment of dhex
+    @address: page address of the part
+    @page_size: flash page size, max MAX_MANIFEST_PAGE_SIZE
+    @page: page index in the segment
+    @data: output of the image page content
+    @returns UPDI_PAGE_xxx action, negative value failed code
 */
-int updi_program(void *nvm_ptr)
+static int updi_page_action(void *nvm_ptr, const hex_data_t *dhex, const segment_buffer_t *seg, u16 address, int page_size, int page, u8 *data)
 {
-    hex_data_t *dhex = &hexdata;//NULL;
-    segment_buffer_t *seg;
-    ihex_segment_t sid;
-    nvm_info_t iflash;
-    int i, result = 0;
+    u8 current[MAX_MANIFEST_PAGE_SIZE];
+    bool blank;
+    int result;
 
-    result = nvm_get_block_info(nvm_ptr, NVM_FLASH, &iflash);
+    blank = dhex_page_data(seg, page_size, page, data);
+
+    result = nvm_read_flash(nvm_ptr, address, current, page_size);
     if (result) {
-        DBG_INFO(UPDI_DEBUG, "nvm_get_block_info failed %d", result);
+        DBG_INFO(UPDI_DEBUG, "nvm_read_flash %04x failed %d", address, result);
         return -2;
     }
-        
-    sid = ADDR_TO_SEGMENTID(iflash.nvm_start);
-    set_default_segment_id(dhex, sid);
 
-    result = nvm_chip_erase(nvm_ptr);
-    if (result) {
-        DBG_INFO(UPDI_DEBUG, "nvm_chip_erase failed %d", result);
-        result = -4;
-        goto out;
-    }
+    return updi_page_compare(current, data, page_size, blank);
+}
+
+/*
+    Get the part address of a flash segment page
+    @iflash: flash info
+    @seg: flash segment
+    @offset: segment offset in flash region of dhex_segment_region()
+    @page: page index in the segment
+    @returns address
+*/
+u16 updi_page_address(const nvm_info_t *iflash, const segment_buffer_t *seg, ihex_address_t offset, int page)
+{
+    return iflash->nvm_start + offset - seg->addr_from + dhex_page_address(seg, iflash->nvm_pagesize, page);
+}
+
+/*
+    Find an image flash page by its index counted through the flash segments in order
+    @dhex: image
+    @iflash: flash info
+    @index: page index of all the image flash pages
+    @offset: output of the segment offset in flash region
+    @page: output of the page index in the segment
+    @returns flash segment, NULL if index is out of the image
+*/
+const segment_buffer_t *updi_flash_page(const hex_data_t *dhex, const nvm_info_t *iflash, int index, ihex_address_t *offset, int *page)
+{
+    const segment_buffer_t *seg;
+    int i, pages;
 
     for (i = 0; i < ARRAY_SIZE(dhex->segment); i++) {
         seg = &dhex->segment[i];
-        if (seg->data) {
-            result = nvm_write_flash/*nvm_write_auto*/(nvm_ptr, SEGMENTID_TO_ADDR(seg->sid) + seg->addr_from, (u8 *)seg->data, seg->len);
-            if (result) {
-                DBG_INFO(UPDI_DEBUG, "nvm_write_auto %d failed %d", i, result);
-                result = -5;
-                goto out;
-            }
+        if (!seg->data || dhex_segment_region(seg, offset) != NVM_FLASH)
+            continue;
+
+        pages = dhex_page_count(seg, iflash->nvm_pagesize);
+        if (index < pages) {
+            *page = index;
+            return seg;
         }
+        index -= pages;
     }
 
-    DBG_INFO(UPDI_DEBUG, "Program finished");
+    return NULL;
+}
 
-out:
-    return result;
+/*
+    Program a flash page by the action of updi_page_action()
+    @nvm_ptr: updi_nvm_init() device handle
+    @action: UPDI_PAGE_xxx action, negative value is returned as is
+    @address: page address of the part
+    @data: page content
+    @page_size: flash page size
+    @returns 0 - success, other value failed code
+*/
+static int updi_page_program(void *nvm_ptr, int action, u16 address, const u8 *data, int page_size)
+{
+    switch (action) {
+    case UPDI_PAGE_SKIP:
+        return 0;
+    case UPDI_PAGE_WRITE:
+        return nvm_write_flash(nvm_ptr, address, data, page_size);
+    case UPDI_PAGE_ERASE:
+        return nvm_erase_flash_page(nvm_ptr, address);
+    case UPDI_PAGE_ERASE_WRITE:
+        return nvm_erase_write_flash(nvm_ptr, address, data, page_size);
+    default:
+        return action;
+    }
+}
+
+/*
+    Get the serial number of the part from the signature row read once in the session
+    @nvm_ptr: updi_nvm_init() device handle
+    @serial: output buffer, UPDI_SERIAL_SIZE bytes
+    @returns 0 - success, other value failed code
+*/
+static int updi_read_serial(void *nvm_ptr, u8 *serial)
+{
+    const app_device_id_t *id = nvm_get_device_id(nvm_ptr);
+
+    if (!id || !id->sigrow_valid)
+        return -2;
+
+    memcpy(serial, id->sigrow + UPDI_SERIAL_OFFSET, UPDI_SERIAL_SIZE);
+
+    return 0;
+}
+
+/*
+    Start recording the flash programming of a plan on a checkpoint
+    @ckpt: checkpoint, the last record is dropped
+    @plan: UPDI_PLAN_T
+    @serial: serial number of the part, NULL if not read then nothing is recorded
+*/
+void updi_checkpoint_init(updi_checkpoint_t *ckpt, int plan, const u8 *serial)
+{
+    memset(ckpt, 0, sizeof(*ckpt));
+    ckpt->plan = plan;
+    ckpt->crc = 0xFFFFFFFF;
+
+    if (serial) {
+        memcpy(ckpt->serial, serial, sizeof(ckpt->serial));
+        ckpt->valid = true;
+    }
+}
+
+/*
+    Record a committed flash page on a checkpoint, the pages are committed in the image order
+    @ckpt: checkpoint
+    @data: page content
+    @page_size: flash page size
+*/
+void updi_checkpoint_record(updi_checkpoint_t *ckpt, const u8 *data, int page_size)
+{
+    if (!ckpt->valid)
+        return;
+
+    ckpt->crc = crc32_update(ckpt->crc, data, page_size);
+    ckpt->pages++;
+}
+
+/*
+    Check a checkpoint is of the part and the image: the same serial number and the same committed image pages
+    (running crc), the committed pages on the part are not read here
+    @ckpt: checkpoint with pages committed, its valid flag is checked by the caller
+    @dhex: image
+    @iflash: flash info
+    @serial: serial number of the part
+    @returns true if matched
+*/
+bool updi_checkpoint_match(const updi_checkpoint_t *ckpt, const hex_data_t *dhex, const nvm_info_t *iflash, const u8 *serial)
+{
+    const segment_buffer_t *seg;
+    ihex_address_t offset;
+    u8 data[MAX_MANIFEST_PAGE_SIZE];
+    unsigned int crc;
+    int i, page;
+
+    if (!ckpt->pages || iflash->nvm_pagesize > sizeof(data))
+        return false;
+
+    if (memcmp(serial, ckpt->serial, sizeof(ckpt->serial))) {
+        DBG_INFO(UPDI_DEBUG, "Checkpoint of another part");
+        return false;
+    }
+
+    for (i = 0, crc = 0xFFFFFFFF; i < ckpt->pages; i++) {
+        seg = updi_flash_page(dhex, iflash, i, &offset, &page);
+        if (!seg)
+            break;
+
+        dhex_page_data(seg, iflash->nvm_pagesize, page, data);
+        crc = crc32_update(crc, data, iflash->nvm_pagesize);
+    }
+
+    if (i < ckpt->pages || crc != ckpt->crc) {
+        DBG_INFO(UPDI_DEBUG, "Checkpoint of another image");
+        return false;
+    }
+
+    return true;
+}
+
+/*
+    Start recording the flash programming of a plan, the checkpoint of the last part is dropped.
+    Not recorded if the page can't be checked by the crc manifest or the serial number is not read
+    @nvm_ptr: updi_nvm_init() device handle
+    @plan: UPDI_PLAN_T
+*/
+static void updi_checkpoint_start(void *nvm_ptr, int plan)
+{
+    nvm_info_t iflash;
+    u8 serial[UPDI_SERIAL_SIZE];
+
+    if (nvm_get_block_info(nvm_ptr, NVM_FLASH, &iflash) || iflash.nvm_pagesize > MAX_MANIFEST_PAGE_SIZE ||
+        updi_read_serial(nvm_ptr, serial))
+        updi_checkpoint_init(&updi_checkpoint, plan, NULL);
+    else
+        updi_checkpoint_init(&updi_checkpoint, plan, serial);
+}
+
+/*
+    Record a committed flash page in the checkpoint of this thread
+    @data: page content
+    @page_size: flash page size
+*/
+static void updi_checkpoint_commit(const u8 *data, int page_size)
+{
+    updi_checkpoint_record(&updi_checkpoint, data, page_size);
+}
+
+/*
+    Get the flash programming checkpoint of this thread
+    @returns checkpoint
+*/
+const updi_checkpoint_t *updi_checkpoint_get(void)
+{
+    return &updi_checkpoint;
+}
+
+/*
+    Drop the flash programming checkpoint of this thread, the next programming starts over
+*/
+void updi_checkpoint_clear(void)
+{
+    memset(&updi_checkpoint, 0, sizeof(updi_checkpoint));
+}
+
+/*
+    Get the committed flash page of a resume sample, the samples are evenly located and the last one is the last
+    committed page
+    @pages: committed pages of the checkpoint
+    @sample: sample index, 0 ~ UPDI_RESUME_SAMPLE_PAGES - 1
+    @returns page index counted through the flash segments in order(the same one may be returned for the near
+        samples), negative if no more sample
+*/
+int updi_resume_sample(int pages, int sample)
+{
+    if (sample >= UPDI_RESUME_SAMPLE_PAGES)
+        return -1;
+
+    return max((sample + 1) * pages / UPDI_RESUME_SAMPLE_PAGES - 1, 0);
+}
+
+/*
+    Check the checkpoint of the last failed attempt before resuming it: the same part(serial number), the same image
+    (running crc of the committed pages) and the committed pages sampled(the last one included) are read back
+    and compared with the crc manifest. The checkpoint is dropped if any of them mismatched
+    @nvm_ptr: updi_nvm_init() device handle
+    @plan: output of the plan resumed by updi_program_planned()
+    @returns committed pages kept, 0 nothing to resume, negative value failed code
+*/
+int updi_resume_check(void *nvm_ptr, updi_plan_t *plan)
+{
+    hex_data_t *dhex = dhex_get_image();
+    updi_checkpoint_t *ckpt = &updi_checkpoint;
+    const segment_buffer_t *seg;
+    nvm_info_t iflash;
+    ihex_address_t offset;
+    u8 serial[UPDI_SERIAL_SIZE];
+    u8 data[MAX_MANIFEST_PAGE_SIZE];
+    int i, page, sample, last, result;
+
+    ckpt->resumed = false;
+    if (!ckpt->valid || !ckpt->pages)
+        return 0;
+
+    // Dropped unless it's resumed
+    ckpt->valid = false;
+
+    result = nvm_get_block_info(nvm_ptr, NVM_FLASH, &iflash);
+    if (result) {
+        DBG_INFO(UPDI_DEBUG, "nvm_get_block_info failed %d", result);
+        return -2;
+    }
+
+    result = updi_read_serial(nvm_ptr, serial);
+    if (result) {
+        DBG_INFO(UPDI_DEBUG, "updi_read_serial failed %d", result);
+        return -3;
+    }
+
+    if (!updi_checkpoint_match(ckpt, dhex, &iflash, serial))
+        return 0;
+
+    for (i = 0, last = -1; i < UPDI_RESUME_SAMPLE_PAGES; i++) {
+        sample = updi_resume_sample(ckpt->pages, i);
+        if (sample <= last)
+            continue;
+        last = sample;
+
+        seg = updi_flash_page(dhex, &iflash, sample, &offset, &page);
+        result = nvm_read_flash(nvm_ptr, updi_page_address(&iflash, seg, offset, page), data, iflash.nvm_pagesize);
+        if (result) {
+            DBG_INFO(UPDI_DEBUG, "nvm_read_flash page %d failed %d", sample, result);
+            return -4;
+        }
+
+        if (calc_crc24(data, iflash.nvm_pagesize) != dhex_get_page_crc(dhex, seg, iflash.nvm_pagesize, page)) {
+            DBG_INFO(UPDI_DEBUG, "Checkpoint page %d mismatch", sample);
+            return 0;
+        }
+    }
+
+    memset(plan, 0, sizeof(*plan));
+    plan->plan = ckpt->plan;
+    ckpt->valid = ckpt->resumed = true;
+
+    DBG_INFO(UPDI_DEBUG, "Resume flash plan %d from page %d", ckpt->plan, ckpt->pages);
+
+    return ckpt->pages;
+}
+
+/*
+    Get the image flash page of a plan sample, the samples are evenly located in the image flash pages
+    @total: image flash pages
+    @sample: sample index, 0 ~ UPDI_PLAN_SAMPLE_PAGES - 1
+    @returns page index counted through the flash segments in order, negative if no more sample
+*/
+int updi_plan_sample(int total, int sample)
+{
+    int index;
+
+    if (sample >= UPDI_PLAN_SAMPLE_PAGES)
+        return -1;
+
+    index = (sample * total + UPDI_PLAN_SAMPLE_PAGES - 1) / UPDI_PLAN_SAMPLE_PAGES;
+
+    return index < total ? index : -1;
+}
+
+/*
+    Get the image flash pages, counted through the flash segments
+    @dhex: image
+    @page_size: flash page size
+    @returns page count
+*/
+int updi_flash_pages(const hex_data_t *dhex, int page_size)
+{
+    const segment_buffer_t *seg;
+    int i, total;
+
+    for (i = 0, total = 0; i < ARRAY_SIZE(dhex->segment); i++) {
+        seg = &dhex->segment[i];
+        if (seg->data && dhex_segment_region(seg, NULL) == NVM_FLASH)
+            total += dhex_page_count(seg, page_size);
+    }
+
+    return total;
+}
+
+/*
+    Compare the sample pages of updi_plan_sample() with the part
+    @nvm_ptr: updi_nvm_init() device handle
+    @dhex: image
+    @iflash: flash info
+    @sampled: output of pages compared
+    @changed: output of pages different
+    @returns 0 - success, other value failed code
+*/
+static int updi_sample_pages(void *nvm_ptr, const hex_data_t *dhex, const nvm_info_t *iflash, int *sampled, int *changed)
+{
+    const segment_buffer_t *seg;
+    ihex_address_t offset;
+    u8 data[MAX_MANIFEST_PAGE_SIZE];
+    int i, index, page, total, result;
+
+    *sampled = *changed = 0;
+
+    total = updi_flash_pages(dhex, iflash->nvm_pagesize);
+    for (i = 0; (index = updi_plan_sample(total, i)) >= 0; i++) {
+        seg = updi_flash_page(dhex, iflash, index, &offset, &page);
+        result = updi_page_action(nvm_ptr, dhex, seg, updi_page_address(iflash, seg, offset, page), iflash->nvm_pagesize, page, data);
+        if (result < 0)
+            return -2;
+
+        if (result != UPDI_PAGE_SKIP)
+            (*changed)++;
+        (*sampled)++;
+    }
+
+    return 0;
+}
+
+/*
+    Decide the flash plan from the sampled pages, the cheaper one of chip erase and comparing each page is picked by
+    the programming time estimate, comparing each page if chip erase not allowed(UPDI_PLAN_PRESERVE_xxx)
+    @dev: device of the part
+    @dhex: image
+    @baud/ibdly: link timing of the estimate
+    @flags: UPDI_PLAN_xxx flags
+    @plan: plan with the sampled and changed pages of updi_plan_sample(), output of the plan and its prediction
+    @returns 0 - success, other value failed code
+*/
+int updi_plan_decide(const void *dev, const hex_data_t *dhex, int baud, int ibdly, int flags, updi_plan_t *plan)
+{
+    estimate_param_t param;
+    estimate_image_t img;
+    estimate_result_t res;
+    int strategy, result;
+
+    result = estimate_image_stats(dev, dhex, &img);
+    if (result) {
+        DBG_INFO(UPDI_DEBUG, "estimate_image_stats failed %d", result);
+        return -2;
+    }
+
+    estimate_default_param(&param, baud, ibdly);
+    if (plan->sampled)
+        img.flash_changed = (plan->changed * img.flash_pages + plan->sampled - 1) / plan->sampled;
+
+    if (flags & (UPDI_PLAN_PRESERVE_EEPROM | UPDI_PLAN_PRESERVE_FLASH)) {
+        strategy = ESTIMATE_ERASE_WRITE;
+        result = estimate_program(&param, &img, strategy, &res);
+    }
+    else {
+        strategy = estimate_recommend(&param, &img, &res);
+        result = strategy < 0 ? strategy : 0;
+    }
+    if (result) {
+        DBG_INFO(UPDI_DEBUG, "Estimate failed %d", result);
+        return -3;
+    }
+
+    plan->plan = strategy == ESTIMATE_ERASE_WRITE ? UPDI_PLAN_PAGES : UPDI_PLAN_CHIP_ERASE;
+    plan->predict_ms = res.total_us / 1000;
+
+    return 0;
+}
+
+/*
+    Plan the flash programming
+        blank flash(UPDI_PLAN_BLANK): page write, no erase
+        other: some pages are compared, then updi_plan_decide()
+    @nvm_ptr: updi_nvm_init() device handle
+    @dhex: image
+    @flags: UPDI_PLAN_xxx flags
+    @plan: output
+    @returns 0 - success, other value failed code
+*/
+int updi_plan_flash(void *nvm_ptr, hex_data_t *dhex, int flags, updi_plan_t *plan)
+{
+    nvm_info_t iflash;
+    int baud, ibdly, result;
+
+    memset(plan, 0, sizeof(*plan));
+
+    if (flags & UPDI_PLAN_BLANK) {
+        plan->plan = UPDI_PLAN_WRITE;
+        return 0;
+    }
+
+    result = nvm_get_block_info(nvm_ptr, NVM_FLASH, &iflash);
+    if (result) {
+        DBG_INFO(UPDI_DEBUG, "nvm_get_block_info failed %d", result);
+        return -2;
+    }
+
+    if (iflash.nvm_pagesize > MAX_MANIFEST_PAGE_SIZE) {
+        if (flags & (UPDI_PLAN_PRESERVE_EEPROM | UPDI_PLAN_PRESERVE_FLASH)) {
+            DBG_INFO(UPDI_DEBUG, "Flash page size %d not supported by page programming", iflash.nvm_pagesize);
+            return -3;
+        }
+
+        plan->plan = UPDI_PLAN_CHIP_ERASE;
+        return 0;
+    }
+
+    result = updi_sample_pages(nvm_ptr, dhex, &iflash, &plan->sampled, &plan->changed);
+    if (result) {
+        DBG_INFO(UPDI_DEBUG, "updi_sample_pages failed %d", result);
+        return -4;
+    }
+
+    result = nvm_get_timing(nvm_ptr, &baud, &ibdly);
+    if (result) {
+        DBG_INFO(UPDI_DEBUG, "nvm_get_timing failed %d", result);
+        return -5;
+    }
+
+    result = updi_plan_decide(nvm_get_device(nvm_ptr), dhex, baud, ibdly, flags, plan);
+    if (result) {
+        DBG_INFO(UPDI_DEBUG, "updi_plan_decide failed %d", result);
+        return -6;
+    }
+
+    return 0;
+}
+
+/*
+    UPDI Program flash by comparing each image page with the part, the pages out of the image are kept.
+    The pages committed before the checkpoint resumed are skipped
+    @nvm_ptr: updi_nvm_init() device handle
+    @dhex: image
+    @returns 0 - success, other value failed code
+*/
+int updi_program_pages(void *nvm_ptr, hex_data_t *dhex)
+{
+    segment_buffer_t *seg;
+    nvm_info_t iflash;
+    ihex_address_t offset;
+    u8 data[MAX_MANIFEST_PAGE_SIZE];
+    int count[UPDI_PAGE_ACTION_NUM] = { 0 };
+    int i, page, pages, index, skip, action, result;
+    u16 address;
+
+    result = nvm_get_block_info(nvm_ptr, NVM_FLASH, &iflash);
+    if (result) {
+        DBG_INFO(UPDI_DEBUG, "nvm_get_block_info failed %d", result);
+        return -2;
+    }
+
+    if (iflash.nvm_pagesize > sizeof(data)) {
+        DBG_INFO(UPDI_DEBUG, "Flash page size %d not supported", iflash.nvm_pagesize);
+        return -3;
+    }
+
+    skip = updi_checkpoint.resumed ? updi_checkpoint.pages : 0;
+
+    for (i = 0, index = 0; i < ARRAY_SIZE(dhex->segment); i++) {
+        seg = &dhex->segment[i];
+        if (!seg->data || dhex_segment_region(seg, &offset) != NVM_FLASH)
+            continue;
+
+        if (offset + seg->len > iflash.nvm_size) {
+            DBG_INFO(UPDI_DEBUG, "Segment %d overflow, offset %x len %x", i, offset, seg->len);
+            return -4;
+        }
+
+        pages = dhex_page_count(seg, iflash.nvm_pagesize);
+        for (page = 0; page < pages; page++, index++) {
+            if (index < skip)
+                continue;
+
+            address = updi_page_address(&iflash, seg, offset, page);
+            action = updi_page_action(nvm_ptr, dhex, seg, address, iflash.nvm_pagesize, page, data);
+            result = updi_page_program(nvm_ptr, action, address, data, iflash.nvm_pagesize);
+            if (result) {
+                DBG_INFO(UPDI_DEBUG, "Page %04x action %d failed %d", address, action, result);
+                return -5;
+            }
+
+            updi_checkpoint_commit(data, iflash.nvm_pagesize);
+            count[action]++;
+        }
+    }
+
+    DBG_INFO(UPDI_DEBUG, "Pages skipped %d, written %d, erased %d, erase-written %d",
+        count[UPDI_PAGE_SKIP], count[UPDI_PAGE_WRITE], count[UPDI_PAGE_ERASE], count[UPDI_PAGE_ERASE_WRITE]);
+
+    return 0;
+}
+
+/*
+    UPDI Program flash page by page after the chip erase(or the flash is blank), each committed page is recorded in
+    the checkpoint. The first page resumed may be committed partly by the failed attempt, it's compared and programmed
+    as the differential programming
+    @nvm_ptr: updi_nvm_init() device handle
+    @dhex: image
+    @returns 0 - success, other value failed code
+*/
+static int updi_program_flash(void *nvm_ptr, hex_data_t *dhex)
+{
+    segment_buffer_t *seg;
+    nvm_info_t iflash;
+    ihex_address_t offset;
+    u8 data[MAX_MANIFEST_PAGE_SIZE];
+    int i, page, pages, index, skip, action, result;
+    u16 address;
+
+    // Not recorded, the segments are written as a whole
+    if (!updi_checkpoint.valid)
+        return updi_program_region(nvm_ptr, dhex, NVM_FLASH);
+
+    result = nvm_get_block_info(nvm_ptr, NVM_FLASH, &iflash);
+    if (result) {
+        DBG_INFO(UPDI_DEBUG, "nvm_get_block_info failed %d", result);
+        return -2;
+    }
+
+    skip = updi_checkpoint.resumed ? updi_checkpoint.pages : 0;
+
+    for (i = 0, index = 0; i < ARRAY_SIZE(dhex->segment); i++) {
+        seg = &dhex->segment[i];
+        if (!seg->data || dhex_segment_region(seg, &offset) != NVM_FLASH)
+            continue;
+
+        if (offset + seg->len > iflash.nvm_size) {
+            DBG_INFO(UPDI_DEBUG, "Segment %d overflow, offset %x len %x", i, offset, seg->len);
+            return -3;
+        }
+
+        pages = dhex_page_count(seg, iflash.nvm_pagesize);
+        for (page = 0; page < pages; page++, index++) {
+            if (index < skip)
+                continue;
+
+            address = updi_page_address(&iflash, seg, offset, page);
+            if (skip && index == skip) {
+                action = updi_page_action(nvm_ptr, dhex, seg, address, iflash.nvm_pagesize, page, data);
+                result = updi_page_program(nvm_ptr, action, address, data, iflash.nvm_pagesize);
+            }
+            else {
+                dhex_page_data(seg, iflash.nvm_pagesize, page, data);
+                result = nvm_write_flash(nvm_ptr, address, data, iflash.nvm_pagesize);
+            }
+
+            if (result) {
+                DBG_INFO(UPDI_DEBUG, "Write flash page %04x failed %d", address, result);
+                return -4;
+            }
+
+            updi_checkpoint_commit(data, iflash.nvm_pagesize);
+        }
+    }
+
+    return 0;
+}
+
+/*
+    UPDI Erase flash by the plan
+    This flowchart is: check image->plan the flash erase->chip erase if planned
+    @nvm_ptr: updi_nvm_init() device handle
+    @flags: UPDI_PLAN_xxx flags of the planner
+    @plan: output of the plan, programmed by updi_program_planned()
+    @returns 0 - success, other value failed code
+*/
+int updi_erase_plan(void *nvm_ptr, int flags, updi_plan_t *plan)
+{
+    hex_data_t *dhex = dhex_get_image();
+    int result;
+
+    result = dhex_check_manifest(dhex);
+    if (result) {
+        DBG_INFO(UPDI_DEBUG, "dhex_check_manifest failed %d, image corrupted", result);
+        return -3;
+    }
+
+    result = updi_plan_flash(nvm_ptr, dhex, flags, plan);
+    if (result) {
+        DBG_INFO(UPDI_DEBUG, "updi_plan_flash failed %d", result);
+        return -6;
+    }
+
+    DBG_INFO(UPDI_DEBUG, "Flash plan %d, sampled %d changed %d, predicted %u ms", plan->plan, plan->sampled, plan->changed, plan->predict_ms);
+
+    updi_checkpoint_start(nvm_ptr, plan->plan);
+
+    if (plan->plan == UPDI_PLAN_CHIP_ERASE) {
+        result = nvm_chip_erase(nvm_ptr);
+        if (result) {
+            DBG_INFO(UPDI_DEBUG, "nvm_chip_erase failed %d", result);
+            return -4;
+        }
+    }
+
+    return 0;
+}
+
+/*
+    UPDI Program flash by the plan of updi_erase_plan(), eeprom and userrow
+    @nvm_ptr: updi_nvm_init() device handle
+    @plan: flash plan
+    @returns 0 - success, other value failed code
+*/
+int updi_program_planned(void *nvm_ptr, const updi_plan_t *plan)
+{
+    hex_data_t *dhex = dhex_get_image();
+    const int regions[] = { NVM_EEPROM, NVM_USERROW };
+    int i, result;
+
+    if (plan->plan == UPDI_PLAN_PAGES)
+        result = updi_program_pages(nvm_ptr, dhex);
+    else
+        result = updi_program_flash(nvm_ptr, dhex);
+
+    if (result) {
+        DBG_INFO(UPDI_DEBUG, "Flash plan %d program failed %d", plan->plan, result);
+        return -5;
+    }
+
+    for (i = 0; i < ARRAY_SIZE(regions); i++) {
+        result = updi_program_region(nvm_ptr, dhex, regions[i]);
+        if (result) {
+            DBG_INFO(UPDI_DEBUG, "updi_program_region %d failed %d", regions[i], result);
+            return -5;
+        }
+    }
+
+    // Nothing left to resume
+    updi_checkpoint_clear();
+
+    DBG_INFO(UPDI_DEBUG, "Program finished");
+
+    return 0;
+}
+
+/*
+    UPDI Program flash, eeprom and userrow
+    This flowchart is: check image->plan the flash erase->program each region
+    @nvm_ptr: updi_nvm_init() device handle
+    @flags: UPDI_PLAN_xxx flags of the planner
+    @returns 0 - success, other value failed code
+*/
+int updi_program_plan(void *nvm_ptr, int flags)
+{
+    updi_plan_t plan;
+    int result;
+
+    result = updi_erase_plan(nvm_ptr, flags, &plan);
+    if (result)
+        return result;
+
+    return updi_program_planned(nvm_ptr, &plan);
+}
+
+/*
+    UPDI Verify flash
+    Each flash page is read back and its crc is compared with the page crc manifest of the image
+    @nvm_ptr: updi_nvm_init() device handle
+    @returns 0 - success, other value failed code
+*/
+int updi_verify(void *nvm_ptr)
+{
+    hex_data_t *dhex = dhex_get_image();
+    segment_buffer_t *seg;
+    nvm_info_t iflash;
+    ihex_address_t offset;
+    u8 data[MAX_MANIFEST_PAGE_SIZE];
+    unsigned int crc, expected;
+    int i, page, pages, result;
+
+    result = nvm_get_block_info(nvm_ptr, NVM_FLASH, &iflash);
+    if (result) {
+        DBG_INFO(UPDI_DEBUG, "nvm_get_block_info failed %d", result);
+        return -2;
+    }
+
+    if (iflash.nvm_pagesize > sizeof(data)) {
+        DBG_INFO(UPDI_DEBUG, "Flash page size %d not supported", iflash.nvm_pagesize);
+        return -3;
+    }
+
+    for (i = 0; i < ARRAY_SIZE(dhex->segment); i++) {
+        seg = &dhex->segment[i];
+        if (!seg->data || dhex_segment_region(seg, &offset) != NVM_FLASH)
+            continue;
+
+        pages = dhex_page_count(seg, iflash.nvm_pagesize);
+        for (page = 0; page < pages; page++) {
+            result = nvm_read_flash(nvm_ptr, iflash.nvm_start + offset - seg->addr_from + dhex_page_address(seg, iflash.nvm_pagesize, page), data, iflash.nvm_pagesize);
+            if (result) {
+                DBG_INFO(UPDI_DEBUG, "nvm_read_flash %d page %d failed %d", i, page, result);
+                return -4;
+            }
+
+            crc = calc_crc24(data, iflash.nvm_pagesize);
+            expected = dhex_get_page_crc(dhex, seg, iflash.nvm_pagesize, page);
+            if (crc != expected) {
+                DBG_INFO(UPDI_DEBUG, "Verify %d page %d mismatch crc %06x(%06x)", i, page, crc, expected);
+                return -5;
+            }
+        }
+    }
+
+    DBG_INFO(UPDI_DEBUG, "Verify finished");
+
+    return 0;
+}
+
+/*
+    Wait an NVM async operation finished
+    @op: async operation object
+    @result: result of the start or the last poll
+    @returns 0 - success, other value failed code
+*/
+static int updi_async_wait(nvm_async_t *op, int result)
+{
+    int delay;
+
+    while (result == APP_ASYNC_PENDING) {
+        delay = (int)(nvm_async_wake(op) - get_time_ms());
+        if (delay > 0)
+            msleep(delay);
+        result = nvm_async_poll(op);
+    }
+
+    return result;
+}
+
+/*
+    UPDI Dump nvm region to Intel HEX
+    The region is read in maximal UPDI bursts into two buffers, the read of the next burst is started before the
+    current one is encoded, so the encoding and the hex line output of cb_flush(e.g. queued to the host uart) run
+    while the burst is still on the UPDI wire. The memory used is two bursts, the erased(0xFF) flash burst is
+    skipped in output.
+    The logging sites above DEFAULT_DEBUG are muted during the dump, they don't go into the hex stream when it
+    shares the console.
+    @nvm_ptr: updi_nvm_init() device handle
+    @type: NVM_TYPE_T region to dump
+    @cb_flush: hex line output callback
+    @args: argument of cb_flush
+    @returns 0 - success, other value failed code
+*/
+int updi_dump(void *nvm_ptr, int type, cb_ihex_flush_buffer_t cb_flush, void *args)
+{
+    struct ihex_state ihex;
+    nvm_async_t op;
+    nvm_info_t info;
+    ihex_address_t base;
+    verbose_t level;
+    u8 data[2][UPDI_MAX_TRANSFER_SIZE];
+    u8 *cur;
+    int i, j, off, size, next, result;
+
+    if (type < 0 || type >= NUM_NVM_TYPES || !cb_flush)
+        return -2;
+
+    result = nvm_get_block_info(nvm_ptr, type, &info);
+    if (result) {
+        DBG_INFO(UPDI_DEBUG, "nvm_get_block_info %d failed %d", type, result);
+        return -3;
+    }
+
+    result = dhex_region_address(type, &base);
+    if (result) {
+        DBG_INFO(UPDI_DEBUG, "dhex_region_address %d failed %d", type, result);
+        return -4;
+    }
+
+    level = get_verbose_level();
+    set_verbose_level(DEFAULT_DEBUG);
+
+    ihex_init(&ihex, cb_flush, args);
+    ihex_write_at_address(&ihex, base);
+
+    size = min(info.nvm_size, (int)sizeof(data[0]));
+    result = updi_async_wait(&op, nvm_async_read_mem(&op, nvm_ptr, info.nvm_start, data[0], size));
+
+    for (off = 0, i = 0; !result && off < info.nvm_size; off += size, i ^= 1) {
+        cur = data[i];
+        size = min(info.nvm_size - off, (int)sizeof(data[0]));
+
+        // The next burst is on the wire while this one is encoded
+        next = min(info.nvm_size - off - size, (int)sizeof(data[0]));
+        if (next > 0) {
+            result = nvm_async_read_mem(&op, nvm_ptr, info.nvm_start + off + size, data[i ^ 1], next);
+            if (result != APP_ASYNC_PENDING)
+                break;
+        }
+
+        for (j = 0; type == NVM_FLASH && j < size && cur[j] == 0xFF; j++);
+        if (type == NVM_FLASH && j == size)
+            ihex_write_at_address(&ihex, base + off + size);
+        else
+            ihex_write_bytes(&ihex, cur, size);
+
+        if (next > 0)
+            result = updi_async_wait(&op, nvm_async_poll(&op));
+    }
+
+    if (!result)
+        ihex_end_write(&ihex);
+
+    set_verbose_level(level);
+
+    if (result) {
+        DBG_INFO(UPDI_DEBUG, "Dump region %d read at %x failed %d", type, off, result);
+        return -5;
+    }
+
+    DBG_INFO(UPDI_DEBUG, "Dump region %d finished", type);
+
+    return 0;
 }
 
 /*
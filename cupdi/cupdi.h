@@ -2,10 +2,147 @@
 #define __CUPDI_H
 
 #ifdef CUPDI
+
+#include <hex_file/ihex.h>
+
+struct ihex_state;
+struct _hex_data;
+struct _segment_buffer;
+struct _nvm_info;
+
+/*
+    Phases of programming a part, in order
+*/
+typedef enum {
+    CUPDI_PHASE_CONNECT,        //port open, double break and link init
+    CUPDI_PHASE_DEVICE_INFO,
+    CUPDI_PHASE_PROGMODE,       //enter progmode, or unlock with chip erase
+    CUPDI_PHASE_FUSE,
+    CUPDI_PHASE_ERASE,          //flash plan and its erase
+    CUPDI_PHASE_PROGRAM,
+    CUPDI_PHASE_VERIFY,
+    CUPDI_PHASE_LOCK,
+    CUPDI_PHASE_LEAVE,          //leave progmode
+    CUPDI_PHASE_NUM
+}CUPDI_PHASE_T;
+
+/*
+    Report of a programmed part
+    @result: 0 passed, other value failed code
+    @plan: UPDI_PLAN_T of the flash, -1 not planned
+    @resumed: flash pages kept from the checkpoint of the last failed attempt, 0 not resumed
+    @total_ms: time of the part
+    @phase_ms: time of each CUPDI_PHASE_T, 0 if not reached
+*/
+typedef struct _cupdi_report {
+    int result;
+    int plan;
+    int resumed;
+    unsigned int total_ms;
+    unsigned int phase_ms[CUPDI_PHASE_NUM];
+}cupdi_report_t;
+
+/*
+    Actions of a flash page in differential programming, see updi_page_compare()
+*/
+enum { UPDI_PAGE_SKIP, UPDI_PAGE_WRITE, UPDI_PAGE_ERASE, UPDI_PAGE_ERASE_WRITE, UPDI_PAGE_ACTION_NUM };
+
+/*
+    Flash programming plans of updi_plan_flash()
+*/
+typedef enum {
+    UPDI_PLAN_CHIP_ERASE,   //chip erase then page write of the image pages
+    UPDI_PLAN_WRITE,        //flash known blank, page write without erase
+    UPDI_PLAN_PAGES,        //each image page compared with the part: skipped, written, page erased or erase-written
+    UPDI_PLAN_NUM
+}UPDI_PLAN_T;
+
+/* Planner flags */
+#define UPDI_PLAN_PRESERVE_EEPROM (1 << 0)  //chip erase not allowed, it erases the eeprom(EESAVE fuse not set)
+#define UPDI_PLAN_PRESERVE_FLASH (1 << 1)   //chip erase not allowed, the flash out of image(bootloader or data) is kept
+#define UPDI_PLAN_BLANK (1 << 2)            //the flash is blank, e.g. erased by the unlocking
+
+/* Planner flags of the MCU build entries, cupdi_operate() and cupdi_production() */
+#ifndef UPDI_PLAN_DEFAULT
+#define UPDI_PLAN_DEFAULT 0
+#endif
+
+/* Flash pages compared to predict the changed pages */
+#define UPDI_PLAN_SAMPLE_PAGES 4
+
+/*
+    Flash programming plan
+    @plan: UPDI_PLAN_T
+    @sampled: pages compared with the part
+    @changed: pages found different of the sampled
+    @predict_ms: predicted time of the plan, 0 if not predicted
+*/
+typedef struct _updi_plan {
+    int plan;
+    int sampled;
+    int changed;
+    unsigned int predict_ms;
+}updi_plan_t;
+
+/* Committed flash pages read back to check the checkpoint before resuming */
+#define UPDI_RESUME_SAMPLE_PAGES 4
+
+/* Serial number bytes in the signature row, identify the part of a checkpoint */
+#define UPDI_SERIAL_OFFSET 3
+#define UPDI_SERIAL_SIZE 10
+
+/*
+    Flash programming checkpoint, kept when the programming failed so the next attempt on the same part
+    resumes from the first missing page instead of erasing the chip again
+    @valid: the flash programming is recorded
+    @resumed: the checkpoint is checked against the part, the committed pages are skipped
+    @plan: UPDI_PLAN_T being programmed
+    @pages: image flash pages committed, counted through the flash segments in order
+    @crc: running crc32 of the committed image pages
+    @serial: serial number of the part
+*/
+typedef struct _updi_checkpoint {
+    bool valid;
+    bool resumed;
+    int plan;
+    int pages;
+    unsigned int crc;
+    u8 serial[UPDI_SERIAL_SIZE];
+}updi_checkpoint_t;
+
 int cupdi_operate();
+int cupdi_operate_port(const char *port, int baud, const char *dev_name, int flags, cupdi_report_t *report);
+int cupdi_dump_port(const char *port, int baud, const char *dev_name, int type, void (*cb_flush)(struct ihex_state *ihex, char *buffer, char *eptr), void *args);
+int cupdi_region_type(const char *name);
+int cupdi_program_part(void *nvm_ptr, int flags, cupdi_report_t *report);
+void cupdi_report_init(cupdi_report_t *report);
+const char *cupdi_phase_name(int phase);
+void cupdi_report_print(const cupdi_report_t *report);
 int updi_erase(void *nvm_ptr);
 int updi_write_fuse(void *nvm_ptr);
-int updi_program(void *nvm_ptr);
+int updi_write_lock(void *nvm_ptr);
+int updi_program_region(void *nvm_ptr, struct _hex_data *dhex, int type);
+int updi_plan_flash(void *nvm_ptr, struct _hex_data *dhex, int flags, updi_plan_t *plan);
+int updi_plan_sample(int total, int sample);
+int updi_plan_decide(const void *dev, const struct _hex_data *dhex, int baud, int ibdly, int flags, updi_plan_t *plan);
+int updi_flash_pages(const struct _hex_data *dhex, int page_size);
+const struct _segment_buffer *updi_flash_page(const struct _hex_data *dhex, const struct _nvm_info *iflash, int index, ihex_address_t *offset, int *page);
+u16 updi_page_address(const struct _nvm_info *iflash, const struct _segment_buffer *seg, ihex_address_t offset, int page);
+int updi_page_compare(const u8 *current, const u8 *data, int page_size, bool blank);
+int updi_fuse_next_changed(const u8 *current, const u8 *data, int len, int from);
+int updi_program_pages(void *nvm_ptr, struct _hex_data *dhex);
+int updi_erase_plan(void *nvm_ptr, int flags, updi_plan_t *plan);
+int updi_program_planned(void *nvm_ptr, const updi_plan_t *plan);
+int updi_program_plan(void *nvm_ptr, int flags);
+const updi_checkpoint_t *updi_checkpoint_get(void);
+void updi_checkpoint_clear(void);
+void updi_checkpoint_init(updi_checkpoint_t *ckpt, int plan, const u8 *serial);
+void updi_checkpoint_record(updi_checkpoint_t *ckpt, const u8 *data, int page_size);
+bool updi_checkpoint_match(const updi_checkpoint_t *ckpt, const struct _hex_data *dhex, const struct _nvm_info *iflash, const u8 *serial);
+int updi_resume_sample(int pages, int sample);
+int updi_resume_check(void *nvm_ptr, updi_plan_t *plan);
+int updi_verify(void *nvm_ptr);
+int updi_dump(void *nvm_ptr, int type, void (*cb_flush)(struct ihex_state *ihex, char *buffer, char *eptr), void *args);
 //int updi_reset(void *nvm_ptr);
 #endif
 
@@ -11,15 +11,16 @@
 */
 
 
-/* dev_name | {flash_start | flash_size | flash_pagesize} | {syscfg_address | nvmctrl_address | sigrow_address } | {fuses} | {userrow} | {eeprom} */
+/* dev_name | {flash_start | flash_size | flash_pagesize} | {syscfg_address | nvmctrl_address | sigrow_address } | {fuses} | {userrow} | {eeprom} | {lockbits} */
 const chip_info_t device_tiny_161x = {
     //  tiny1617/tiny1616
-    "tiny161x",{ 0x8000, 16 * 1024, 64 },{ 0x0F00, 0x1000, 0x1100 },{ 0x1280, 11, 1 },{ 0x1300, 32, 32 },{ 0x1400, 128, 32 }
+    "tiny161x",{ 0x8000, 16 * 1024, 64 },{ 0x0F00, 0x1000, 0x1100 },{ 0x1280, 11, 1 },{ 0x1300, 32, 32 },{ 0x1400, 128, 32 },{ 0x128A, 1, 1 }
 };
 
 static const device_info_t device_1617 = {
 	.name = "tiny1617", 
 	.mmap = &device_tiny_161x,
+	.signature = { 0x1E, 0x94, 0x20 },
 };
 
 inline const device_info_t * get_chip_info(const char *dev_name) 
@@ -55,6 +56,9 @@ int dev_get_nvm_info(const void *dev_ptr, NVM_TYPE_T type, nvm_info_t * info)
     case NVM_FUSES:
         iblock = &dev->mmap->fuse;
         break;
+    case NVM_LOCKBITS:
+        iblock = &dev->mmap->lockbits;
+        break;
     default:
         return -2;
     }
@@ -63,4 +67,20 @@ int dev_get_nvm_info(const void *dev_ptr, NVM_TYPE_T type, nvm_info_t * info)
 
     return 0;
 }
-#endif
\ No newline at end of file
+/*
+Device check the device id read from the signature row
+    @dev_ptr: device
+    @sigrow: signature row of the part, the device id at 0
+    @return 0 matched, other value failed
+*/
+int dev_check_signature(const void *dev_ptr, const unsigned char *sigrow)
+{
+    const device_info_t *dev = (const device_info_t *)dev_ptr;
+
+    if (!dev || !sigrow)
+        return ERROR_PTR;
+
+    return memcmp(dev->signature, sigrow, sizeof(dev->signature)) ? -2 : 0;
+}
+
+#endif
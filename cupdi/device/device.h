@@ -22,17 +22,26 @@ typedef struct _chip_info {
     nvm_info_t fuse;
     nvm_info_t userrow;
     nvm_info_t eeprom;
+    nvm_info_t lockbits;
 }chip_info_t;
 
+/*
+    Device
+    @name: device name
+    @mmap: memory map
+    @signature: device id at the start of the signature row
+*/
 typedef struct _device_info {
     const char *name;
     const chip_info_t *mmap;
+    unsigned char signature[3];
 }device_info_t;
 
 const device_info_t * get_chip_info(const char *dev_name);
 
-typedef enum _NVM_TYPE { NVM_FLASH, NVM_EEPROM, NVM_USERROW, NVM_FUSES, NUM_NVM_TYPES } NVM_TYPE_T;
+typedef enum _NVM_TYPE { NVM_FLASH, NVM_EEPROM, NVM_USERROW, NVM_FUSES, NVM_LOCKBITS, NUM_NVM_TYPES } NVM_TYPE_T;
 int dev_get_nvm_info(const void *dev, NVM_TYPE_T type, nvm_info_t * info);
+int dev_check_signature(const void *dev, const unsigned char *sigrow);
 #endif
 
 #endif
@@ -0,0 +1,468 @@
+/*
+ * estimate.c
+ *
+ * Programming time estimator: the UPDI exchanges of each step of cupdi_program_part() are counted as the
+ * blocking stack issues them, and each exchange is priced by the link timing(baud, ibdly, host tick and
+ * latency) and the NVM controller busy time of the target, so a line configuration could be evaluated
+ * before a part is connected.
+ */
+
+#ifdef CUPDI
+
+#include <platform/platform.h>
+#include <device/device.h>
+#include <hex_file/hexfile.h>
+#include <updi/constants.h>
+#include <updi/nvm.h>
+#include "estimate.h"
+
+/* Bits of a UPDI character: start, 8 data, even parity and 2 stop bits */
+#define ESTIMATE_CHAR_BITS 12
+
+/* Gap bits inserted by the target between response characters, the CTRLA IBDLY set by link_set_init() */
+#define ESTIMATE_IBDLY_BITS 2
+
+/* Double break: 2 zero characters of 8E1 at 300 baud, see phy_send_double_break() */
+#define ESTIMATE_BREAK_BAUD 300
+#define ESTIMATE_BREAK_BITS (2 * 11)
+
+/* Baud of link_set_init() before the UPDI clock is selected */
+#define ESTIMATE_INIT_BAUD 115200
+
+/* Status polls of app_wait_unlocked() before it gives up, a locked part never unlocks by the NVM key */
+#define ESTIMATE_UNLOCK_POLLS 100
+
+/* Upper bound of the fitted latency */
+#define ESTIMATE_MAX_LATENCY_US 100000
+
+static const char * const part_names[ESTIMATE_PART_NUM] = {
+    "connect", "key_reset", "erase", "page_load", "nvm_busy", "verify"
+};
+
+static const char * const strategy_names[ESTIMATE_STRATEGY_NUM] = {
+    "chip_erase", "erase_write"
+};
+
+/*
+    Set the link timing of the host stack and the NVM timing of tinyAVR 1-series
+    @p: parameters output
+    @baud: UPDI baud
+    @ibdly: PHY delay(ms) after each sending
+    @no return
+*/
+void estimate_default_param(estimate_param_t *p, int baud, int ibdly)
+{
+    memset(p, 0, sizeof(*p));
+    p->baud = baud;
+    p->ibdly = ibdly;
+    p->tick_us = 1000;
+    p->latency_us = 0;
+    p->guard_bits = 128;
+    p->page_write_us = 2000;
+    p->page_erase_us = 2000;
+    p->chip_erase_us = 4000;
+    p->eeprom_write_us = 4000;
+    p->fuse_write_us = 4000;
+    p->unlock_us = 0;
+    p->locked = false;
+}
+
+static unsigned int est_bits_us(int baud, unsigned int bits)
+{
+    return baud > 0 ? (unsigned int)((unsigned long long)bits * 1000000 / baud) : 0;
+}
+
+static unsigned int est_round(unsigned int t, unsigned int tick)
+{
+    return tick ? (t + tick - 1) / tick * tick : t;
+}
+
+/*
+    phy_send(): the echo is waited by tick sleeps(one at least), then the ibdly delay
+    @p: parameters
+    @len: characters sent
+    @return time(us)
+*/
+static unsigned int est_send(const estimate_param_t *p, int len)
+{
+    unsigned int echo = est_bits_us(p->baud, len * ESTIMATE_CHAR_BITS) + p->latency_us;
+
+    return max(est_round(echo, p->tick_us), p->tick_us) + p->ibdly * 1000;
+}
+
+/*
+    phy_transfer(): phy_send() and the response received after the guard time, waited by tick sleeps if not arrived
+    @p: parameters
+    @wlen: characters sent
+    @rlen: characters received
+    @return time(us)
+*/
+static unsigned int est_xfer(const estimate_param_t *p, int wlen, int rlen)
+{
+    unsigned int t = est_send(p, wlen);
+    unsigned int resp = est_bits_us(p->baud, wlen * ESTIMATE_CHAR_BITS + p->guard_bits + rlen * (ESTIMATE_CHAR_BITS + ESTIMATE_IBDLY_BITS)) + p->latency_us;
+
+    if (resp > t)
+        t += est_round(resp - t, p->tick_us);
+
+    return t;
+}
+
+/*
+    Status polling of a busy time, each poll is an exchange followed by a tick sleep
+    @p: parameters
+    @poll: time of the status exchange
+    @busy_us: busy time from the command
+    @elapsed: time passed in the busy before the first poll
+    @return time(us) beyond the final poll which sees ready
+*/
+static unsigned int est_busy(const estimate_param_t *p, unsigned int poll, unsigned int busy_us, unsigned int elapsed)
+{
+    return busy_us > elapsed ? est_round(busy_us - elapsed, poll + p->tick_us) : 0;
+}
+
+#define EST_LDCS(_p) est_xfer(_p, 2, 1)
+#define EST_STCS(_p) est_send(_p, 3)
+#define EST_LD(_p) est_xfer(_p, 4, 1)
+#define EST_ST(_p) (est_xfer(_p, 4, 1) + est_xfer(_p, 1, 1))
+
+/* link_key(): the command and each key byte sent alone */
+static unsigned int est_key(const estimate_param_t *p)
+{
+    return est_send(p, 2) + 8 * est_send(p, 1);
+}
+
+/* app_toggle_reset(): reset set, 1ms and cleared */
+static unsigned int est_reset(const estimate_param_t *p)
+{
+    return 2 * EST_STCS(p) + max(p->tick_us, 1000);
+}
+
+/* app_write_data(): words if the len is even else bytes */
+static unsigned int est_write_data(const estimate_param_t *p, int len)
+{
+    if (len <= 0)
+        return 0;
+
+    if (!(len & 0x1)) {
+        if (len == 2)
+            return est_xfer(p, 4, 1) + est_xfer(p, 2, 1);
+
+        return est_xfer(p, 4, 1) + est_send(p, 4) + est_xfer(p, 4, 1) + (len / 2 - 1) * est_xfer(p, 2, 1);
+    }
+
+    if (len == 1)
+        return EST_ST(p);
+
+    return est_xfer(p, 4, 1) + est_send(p, 3) + est_xfer(p, 3, 1) + (len - 1) * est_xfer(p, 1, 1);
+}
+
+/* nvm_read_mem(): byte reads in UPDI_MAX_TRANSFER_SIZE chunks */
+static unsigned int est_read_mem(const estimate_param_t *p, int len)
+{
+    unsigned int t = 0;
+    int size;
+
+    for (; len > 0; len -= size) {
+        size = min(len, UPDI_MAX_TRANSFER_SIZE);
+        if (size == 1)
+            t += EST_LD(p);
+        else
+            t += est_xfer(p, 4, 1) + est_send(p, 3) + est_xfer(p, 2, size);
+    }
+
+    return t;
+}
+
+static void est_add(estimate_result_t *res, int part, unsigned int us)
+{
+    res->us[part] += us;
+}
+
+/*
+    _app_write_nvm(): ready check, page buffer clear, load, commit and waiting
+    @res: result, accumulated
+    @p: parameters
+    @len: page len
+    @busy_us: busy time of the commit command
+*/
+static void est_page_write(estimate_result_t *res, const estimate_param_t *p, int len, unsigned int busy_us)
+{
+    est_add(res, ESTIMATE_PAGE_LOAD, EST_LD(p) + EST_ST(p) + EST_LD(p) + est_write_data(p, len) + EST_ST(p) + EST_LD(p));
+    est_add(res, ESTIMATE_NVM_BUSY, est_busy(p, EST_LD(p), busy_us, est_xfer(p, 1, 1)));
+}
+
+/*
+    _updi_write_fuse_changed(): the bytes read and each one written by fuse command
+    @res: result, accumulated
+    @p: parameters
+    @len: fuse bytes
+*/
+static void est_fuse_write(estimate_result_t *res, const estimate_param_t *p, int len)
+{
+    if (len <= 0)
+        return;
+
+    est_add(res, ESTIMATE_PAGE_LOAD, est_read_mem(p, len) + len * (EST_LD(p) + 2 * est_write_data(p, 2) + EST_ST(p)));
+    est_add(res, ESTIMATE_NVM_BUSY, len * est_busy(p, EST_LD(p), p->fuse_write_us, est_xfer(p, 1, 1)));
+}
+
+/*
+    Link init and device info: double break, link_set_init() at the default baud, link_check() and SIB
+    @res: result, accumulated
+    @p: parameters
+*/
+static void est_connect(estimate_result_t *res, const estimate_param_t *p)
+{
+    estimate_param_t init = *p;
+    unsigned int t;
+
+    t = max(est_round(est_bits_us(ESTIMATE_BREAK_BAUD, ESTIMATE_BREAK_BITS) + p->latency_us, p->tick_us), p->tick_us) + p->ibdly * 1000;
+
+    init.baud = ESTIMATE_INIT_BAUD;
+    t += 3 * EST_STCS(&init) + EST_LDCS(&init);
+
+    t += 2 * EST_LDCS(p) + est_xfer(p, 2, 16);
+
+    est_add(res, ESTIMATE_CONNECT, t);
+}
+
+/*
+    app_enter_progmode() and the chip erase key unlock if locked, the unlocking is a chip erase
+    @res: result, accumulated
+    @p: parameters
+*/
+static void est_progmode(estimate_result_t *res, const estimate_param_t *p)
+{
+    unsigned int enter;
+
+    enter = EST_LDCS(p) + est_key(p) + EST_LDCS(p) + est_reset(p);
+    if (p->locked) {
+        // NVM key is not accepted on a locked part, wait timeout
+        est_add(res, ESTIMATE_KEY_RESET, enter + ESTIMATE_UNLOCK_POLLS * (EST_LDCS(p) + max(p->tick_us, 1000)));
+        est_add(res, ESTIMATE_KEY_RESET, est_key(p) + EST_LDCS(p) + est_reset(p) + EST_LDCS(p));
+        est_add(res, ESTIMATE_ERASE, est_busy(p, EST_LDCS(p), p->chip_erase_us + p->unlock_us, EST_STCS(p)));
+    }
+
+    // The progmode check after the unlock wait is served by the CS shadow
+    est_add(res, ESTIMATE_KEY_RESET, enter + est_busy(p, EST_LDCS(p), p->unlock_us, EST_STCS(p)) + EST_LDCS(p));
+}
+
+/*
+    Get the page count of the image segments located in a region
+    @dev: device info
+    @dhex: image
+    @type: NVM_TYPE_T region
+    @blank: output of the pages all 0xFF, could be NULL
+    @return page count, negative value if failed
+*/
+static int est_region_pages(const void *dev, const hex_data_t *dhex, int type, int *blank)
+{
+    const segment_buffer_t *seg;
+    nvm_info_t info;
+    ihex_address_t offset, addr, from, to;
+    int i, j, page, pages, count = 0;
+
+    if (dev_get_nvm_info(dev, type, &info) || !info.nvm_pagesize)
+        return -2;
+
+    if (blank)
+        *blank = 0;
+
+    for (i = 0; i < ARRAY_SIZE(dhex->segment); i++) {
+        seg = &dhex->segment[i];
+        if (!seg->data || dhex_segment_region(seg, &offset) != type)
+            continue;
+
+        if (type == NVM_FUSES || type == NVM_LOCKBITS) {
+            count += seg->len;
+            continue;
+        }
+
+        pages = dhex_page_count(seg, info.nvm_pagesize);
+        count += pages;
+
+        for (page = 0; blank && page < pages; page++) {
+            addr = dhex_page_address(seg, info.nvm_pagesize, page);
+            from = max(addr, seg->addr_from);
+            to = min(addr + info.nvm_pagesize, seg->addr_from + seg->len);
+            for (j = from; j < to && (u8)seg->data[j - seg->addr_from] == 0xFF; j++);
+            if (j >= to)
+                (*blank)++;
+        }
+    }
+
+    return count;
+}
+
+/*
+    Get the image statistics for a device
+    @dev: device info of get_chip_info()
+    @dhex: image
+    @img: statistics output, flash_changed is -1(unknown)
+    @return 0 successful, other value failed
+*/
+int estimate_image_stats(const void *dev, const hex_data_t *dhex, estimate_image_t *img)
+{
+    nvm_info_t info;
+
+    if (!dev || !dhex || !img)
+        return ERROR_PTR;
+
+    memset(img, 0, sizeof(*img));
+
+    if (dev_get_nvm_info(dev, NVM_FLASH, &info))
+        return -2;
+
+    img->page_size = info.nvm_pagesize;
+    img->flash_pages = est_region_pages(dev, dhex, NVM_FLASH, &img->flash_blank);
+    img->flash_changed = -1;
+    img->eeprom_pages = est_region_pages(dev, dhex, NVM_EEPROM, NULL);
+    img->userrow_pages = est_region_pages(dev, dhex, NVM_USERROW, NULL);
+    img->fuse_bytes = est_region_pages(dev, dhex, NVM_FUSES, NULL);
+    img->lock_bytes = est_region_pages(dev, dhex, NVM_LOCKBITS, NULL);
+
+    if (img->flash_pages < 0 || img->eeprom_pages < 0 || img->userrow_pages < 0 || img->fuse_bytes < 0 || img->lock_bytes < 0)
+        return -3;
+
+    return 0;
+}
+
+/*
+    Fit the latency of the link parameters with a measured exchange, e.g. the phy round trip of the benchmark
+    @p: parameters, latency_us is updated
+    @wlen: characters sent of the exchange
+    @rlen: characters received of the exchange, 0 for sending only
+    @measured_us: measured time of the exchange
+    @return 0 successful, other value failed
+*/
+int estimate_calibrate(estimate_param_t *p, int wlen, int rlen, unsigned int measured_us)
+{
+    unsigned int latency, step;
+
+    if (!p || wlen <= 0 || rlen < 0 || !measured_us)
+        return ERROR_PTR;
+
+    // The smallest latency whose prediction reaches the measurement, 0 if the model is already slower
+    step = max(est_bits_us(p->baud, ESTIMATE_CHAR_BITS) / 4, 1);
+    for (latency = 0; latency <= ESTIMATE_MAX_LATENCY_US; latency += step) {
+        p->latency_us = latency;
+        if ((rlen ? est_xfer(p, wlen, rlen) : est_send(p, wlen)) >= measured_us)
+            return 0;
+    }
+
+    return -2;
+}
+
+/*
+    Predict the time of cupdi_operate_port() for an image: connect, progmode, fuse, program, verify, lock and leave
+    @p: parameters
+    @img: image statistics
+    @strategy: ESTIMATE_STRATEGY_T
+    @res: result output
+    @return 0 successful, other value failed
+*/
+int estimate_program(const estimate_param_t *p, const estimate_image_t *img, int strategy, estimate_result_t *res)
+{
+    int i, changed, compared;
+
+    if (!p || !img || !res || p->baud <= 0 || img->page_size <= 0)
+        return ERROR_PTR;
+
+    if (strategy < 0 || strategy >= ESTIMATE_STRATEGY_NUM)
+        return -2;
+
+    memset(res, 0, sizeof(*res));
+    res->strategy = strategy;
+
+    est_connect(res, p);
+    est_progmode(res, p);
+    est_fuse_write(res, p, img->fuse_bytes);
+
+    if (strategy == ESTIMATE_CHIP_ERASE) {
+        // All the image pages are written, the blank ones too, a locked part is already erased by unlocking
+        if (!p->locked)
+            est_add(res, ESTIMATE_ERASE, EST_LD(p) + EST_ST(p) + est_busy(p, EST_LD(p), p->chip_erase_us, est_xfer(p, 1, 1)) + EST_LD(p));
+        for (i = 0; i < img->flash_pages; i++)
+            est_page_write(res, p, img->page_size, p->page_write_us);
+    }
+    else {
+        // A locked part is blank after unlocked, nothing to compare and the pages are written without erase
+        changed = img->flash_changed;
+        if (p->locked || changed < 0)
+            changed = img->flash_pages - img->flash_blank;
+        compared = p->locked ? 0 : img->flash_pages;
+
+        est_add(res, ESTIMATE_VERIFY, compared * est_read_mem(p, img->page_size));
+        for (i = 0; i < changed; i++)
+            est_page_write(res, p, img->page_size, p->locked ? p->page_write_us : p->page_erase_us + p->page_write_us);
+    }
+
+    for (i = 0; i < img->eeprom_pages + img->userrow_pages; i++)
+        est_page_write(res, p, img->page_size, p->eeprom_write_us);
+
+    // updi_verify() reads all the image pages
+    est_add(res, ESTIMATE_VERIFY, img->flash_pages * est_read_mem(p, img->page_size));
+    est_fuse_write(res, p, img->lock_bytes);
+
+    // Leave progmode
+    est_add(res, ESTIMATE_KEY_RESET, est_reset(p) + EST_STCS(p));
+
+    for (i = 0; i < ESTIMATE_PART_NUM; i++)
+        res->total_us += res->us[i];
+
+    return 0;
+}
+
+/*
+    Predict all the strategies and pick the cheapest
+    @p: parameters
+    @img: image statistics
+    @res: result output of the cheapest strategy
+    @return ESTIMATE_STRATEGY_T recommended, negative value if failed
+*/
+int estimate_recommend(const estimate_param_t *p, const estimate_image_t *img, estimate_result_t *res)
+{
+    estimate_result_t cur;
+    int i, result, best = -2;
+
+    for (i = 0; i < ESTIMATE_STRATEGY_NUM; i++) {
+        result = estimate_program(p, img, i, &cur);
+        if (result)
+            return result;
+
+        if (best < 0 || cur.total_us < res->total_us) {
+            memcpy(res, &cur, sizeof(cur));
+            best = i;
+        }
+    }
+
+    return best;
+}
+
+const char *estimate_part_name(int part)
+{
+    return part >= 0 && part < ESTIMATE_PART_NUM ? part_names[part] : "unknown";
+}
+
+const char *estimate_strategy_name(int strategy)
+{
+    return strategy >= 0 && strategy < ESTIMATE_STRATEGY_NUM ? strategy_names[strategy] : "unknown";
+}
+
+/*
+    Output the predicted time
+    @res: result
+    @no return
+*/
+void estimate_report(const estimate_result_t *res)
+{
+    int i;
+
+    DBG_INFO(UPDI_DEBUG, "Estimate %s: %u ms", estimate_strategy_name(res->strategy), res->total_us / 1000);
+
+    for (i = 0; i < ESTIMATE_PART_NUM; i++)
+        DBG_INFO(UPDI_DEBUG, "  %s: %u ms", part_names[i], res->us[i] / 1000);
+}
+
+#endif
@@ -0,0 +1,103 @@
+#ifndef __ESTIMATE_H
+#define __ESTIMATE_H
+
+#ifdef CUPDI
+
+#include <hex_file/ihex.h>
+
+/*
+    Programming strategies
+        CHIP_ERASE: chip erase(not needed if the part is blank after unlocked) then page write of all the image pages
+        ERASE_WRITE: differential, each image page is read back and only the changed ones are erase-written
+*/
+typedef enum {
+    ESTIMATE_CHIP_ERASE,
+    ESTIMATE_ERASE_WRITE,
+    ESTIMATE_STRATEGY_NUM
+}ESTIMATE_STRATEGY_T;
+
+/*
+    Parts of the predicted time
+*/
+typedef enum {
+    ESTIMATE_CONNECT,       //double break, link init and device info
+    ESTIMATE_KEY_RESET,     //keys, reset toggles and waiting unlocked, leaving progmode
+    ESTIMATE_ERASE,         //chip erase command and its busy time
+    ESTIMATE_PAGE_LOAD,     //page buffer clear, data load and NVM commands of flash/eeprom/fuse
+    ESTIMATE_NVM_BUSY,      //status polling while NVM controller busy after the page/fuse writes
+    ESTIMATE_VERIFY,        //flash read back(verify, and the compare of differential strategy)
+    ESTIMATE_PART_NUM
+}ESTIMATE_PART_T;
+
+/*
+    Link and target timing, the time of one UPDI exchange is modeled as the blocking stack does:
+        sending: echo waited by tick_us sleeps, then ibdly ms delay
+        receiving: the response after the guard time, waited by tick_us sleeps if not arrived yet
+    @baud: UPDI baud
+    @ibdly: PHY delay(ms) after each sending
+    @tick_us: host sleep quantum of the echo/response/busy waiting(msleep(1))
+    @latency_us: turnaround of the adapter and OS for each exchange, fitted by estimate_calibrate()
+    @guard_bits: target guard time(bits) before the response, 128 with the CTRLA GTVAL set by link_set_init()
+    @page_write_us/page_erase_us/chip_erase_us/eeprom_write_us/fuse_write_us: NVM controller busy time
+    @unlock_us: time from reset released to LOCKSTATUS cleared
+    @locked: the part is locked, unlocked by chip erase key so the flash is blank before programming
+*/
+typedef struct _estimate_param {
+    int baud;
+    int ibdly;
+    unsigned int tick_us;
+    unsigned int latency_us;
+    unsigned int guard_bits;
+    unsigned int page_write_us;
+    unsigned int page_erase_us;
+    unsigned int chip_erase_us;
+    unsigned int eeprom_write_us;
+    unsigned int fuse_write_us;
+    unsigned int unlock_us;
+    bool locked;
+}estimate_param_t;
+
+/*
+    Image statistics of a device
+    @page_size: flash page size
+    @flash_pages: flash pages covered by the image segments, all of them are written after chip erase
+    @flash_blank: pages of flash_pages which are all 0xFF
+    @flash_changed: pages differ from the part, -1 unknown(all non-blank pages assumed), for ERASE_WRITE
+    @eeprom_pages/userrow_pages: pages of eeprom/userrow segments
+    @fuse_bytes/lock_bytes: bytes of fuse/lock segments, all assumed changed
+*/
+typedef struct _estimate_image {
+    int page_size;
+    int flash_pages;
+    int flash_blank;
+    int flash_changed;
+    int eeprom_pages;
+    int userrow_pages;
+    int fuse_bytes;
+    int lock_bytes;
+}estimate_image_t;
+
+/*
+    Predicted time
+    @strategy: ESTIMATE_STRATEGY_T
+    @us: time(us) of each ESTIMATE_PART_T
+    @total_us: sum of us[]
+*/
+typedef struct _estimate_result {
+    int strategy;
+    unsigned int us[ESTIMATE_PART_NUM];
+    unsigned int total_us;
+}estimate_result_t;
+
+void estimate_default_param(estimate_param_t *p, int baud, int ibdly);
+int estimate_calibrate(estimate_param_t *p, int wlen, int rlen, unsigned int measured_us);
+int estimate_image_stats(const void *dev, const hex_data_t *dhex, estimate_image_t *img);
+int estimate_program(const estimate_param_t *p, const estimate_image_t *img, int strategy, estimate_result_t *res);
+int estimate_recommend(const estimate_param_t *p, const estimate_image_t *img, estimate_result_t *res);
+const char *estimate_part_name(int part);
+const char *estimate_strategy_name(int strategy);
+void estimate_report(const estimate_result_t *res);
+
+#endif
+
+#endif
@@ -0,0 +1,327 @@
+/*
+ * gang.c
+ *
+ * Gang programming: one UPDI session for each serial port, the sessions are interleaved by a
+ * round-robin scheduler, when a channel is waiting for chip erase or page write (NVM busy),
+ * the other channels are serviced. The NVM operations are run with the nvm_async_xxx() non-blocking API.
+ */
+
+#ifdef CUPDI
+
+#include <platform/platform.h>
+#include <device/device.h>
+#include <updi/constants.h>
+#include <updi/application.h>
+#include <updi/nvm.h>
+#include <hex_file/ihex.h>
+#include <hex_file/hexfile.h>
+#include "cupdi.h"
+#include "gang.h"
+
+/* Max sleep of the scheduler when all channels wait, ms */
+#define GANG_IDLE_MAX_MS 10
+
+/*
+    Channel state, executed in order
+*/
+enum {
+    GANG_INIT,
+    GANG_PROGMODE,
+    GANG_UNLOCK,
+    GANG_FUSE,
+    GANG_ERASE,
+    GANG_PROGRAM,
+    GANG_WAIT,
+    GANG_REGIONS,
+    GANG_VERIFY,
+    GANG_LOCK,
+    GANG_DONE,
+    GANG_FAILED,
+};
+
+/*
+    Gang channel
+    @port: serial port name
+    @nvm: updi_nvm_init() device handle
+    @op: NVM async operation polled in GANG_WAIT
+    @state: channel state
+    @next: state after the async operation finished in GANG_WAIT
+    @error: failed code if the async operation failed
+    @seg: flash segment index being programmed
+    @page: next page index in the segment
+    @result: 0 passed, other value failed code, same as cupdi_operate()
+*/
+typedef struct _gang_channel {
+    const char *port;
+    void *nvm;
+    nvm_async_t op;
+    int state;
+    int next;
+    int error;
+    int seg;
+    int page;
+    int result;
+}gang_channel_t;
+
+/*
+    Close the channel session and set its final state
+    @ch: gang channel
+    @result: 0 passed, other value failed code
+*/
+static void gang_finish(gang_channel_t *ch, int result)
+{
+    DBG_INFO(UPDI_DEBUG, "Gang %s finished %d", ch->port, result);
+
+    if (ch->nvm) {
+        nvm_leave_progmode(ch->nvm);
+        updi_nvm_deinit(ch->nvm);
+        ch->nvm = NULL;
+    }
+
+    ch->result = result;
+    ch->state = result ? GANG_FAILED : GANG_DONE;
+}
+
+/*
+    Let the channel wait for the async operation started, then go to next state
+    @ch: gang channel
+    @result: result of nvm_async_xxx() start function
+    @next: state after the operation finished
+    @error: failed code of the channel if the operation failed
+*/
+static void gang_wait(gang_channel_t *ch, int result, int next, int error)
+{
+    if (result != APP_ASYNC_PENDING) {
+        DBG_INFO(UPDI_DEBUG, "Gang %s async operation start failed %d", ch->port, result);
+        gang_finish(ch, error);
+        return;
+    }
+
+    ch->next = next;
+    ch->error = error;
+    ch->state = GANG_WAIT;
+}
+
+/*
+    Start writing the next flash page of the image
+    @ch: gang channel
+    @return APP_ASYNC_PENDING page started, 0 no page left, negative value failed
+*/
+static int gang_write_next_page(gang_channel_t *ch)
+{
+    hex_data_t *dhex = dhex_get_image();
+    segment_buffer_t *seg;
+    nvm_info_t info;
+    ihex_address_t offset, addr, from, to;
+    int result;
+
+    result = nvm_get_block_info(ch->nvm, NVM_FLASH, &info);
+    if (result) {
+        DBG_INFO(UPDI_DEBUG, "nvm_get_block_info failed %d", result);
+        return -2;
+    }
+
+    for (; ch->seg < ARRAY_SIZE(dhex->segment); ch->seg++, ch->page = 0) {
+        seg = &dhex->segment[ch->seg];
+        if (!seg->data || dhex_segment_region(seg, &offset) != NVM_FLASH)
+            continue;
+
+        if (ch->page < dhex_page_count(seg, info.nvm_pagesize)) {
+            addr = dhex_page_address(seg, info.nvm_pagesize, ch->page);
+            from = max(addr, seg->addr_from);
+            to = min(addr + info.nvm_pagesize, seg->addr_from + seg->len);
+
+            result = nvm_async_write_flash_page(&ch->op, ch->nvm, info.nvm_start + offset + from - seg->addr_from,
+                (const u8 *)seg->data + from - seg->addr_from, to - from);
+            ch->page++;
+
+            return result;
+        }
+    }
+
+    return 0;
+}
+
+/*
+    Run one step of the channel, only the async operation is polled in GANG_WAIT, so the step is short when
+    the channel is waiting
+    @ch: gang channel
+    @dev: chip info
+*/
+static void gang_step(gang_channel_t *ch, const device_info_t *dev)
+{
+    const int regions[] = { NVM_EEPROM, NVM_USERROW };
+    int i, result;
+
+    switch (ch->state) {
+    case GANG_INIT:
+        ch->nvm = updi_nvm_init(ch->port, 115200, (void *)dev);
+        if (!ch->nvm) {
+            DBG_INFO(UPDI_DEBUG, "Gang %s nvm initialize failed", ch->port);
+            gang_finish(ch, -3);
+            break;
+        }
+
+        result = nvm_get_device_info(ch->nvm);
+        if (result) {
+            DBG_INFO(UPDI_DEBUG, "Gang %s nvm_get_device_info failed %d", ch->port, result);
+            gang_finish(ch, -4);
+            break;
+        }
+        ch->state = GANG_PROGMODE;
+        break;
+    case GANG_PROGMODE:
+        gang_wait(ch, nvm_async_enter_progmode(&ch->op, ch->nvm), GANG_FUSE, -5);
+        break;
+    case GANG_UNLOCK:
+        DBG_INFO(UPDI_DEBUG, "Gang %s is locked. Performing unlock with chip erase.", ch->port);
+        result = nvm_unlock_device(ch->nvm);
+        if (result) {
+            DBG_INFO(UPDI_DEBUG, "Gang %s unlock device failed %d", ch->port, result);
+            gang_finish(ch, -5);
+            break;
+        }
+        ch->state = GANG_FUSE;
+        break;
+    case GANG_FUSE:
+        result = updi_write_fuse(ch->nvm);
+        if (result) {
+            DBG_INFO(UPDI_DEBUG, "Gang %s updi_write_fuse failed %d", ch->port, result);
+            gang_finish(ch, -6);
+            break;
+        }
+        ch->state = GANG_ERASE;
+        break;
+    case GANG_ERASE:
+        ch->seg = 0;
+        ch->page = 0;
+        gang_wait(ch, nvm_async_chip_erase(&ch->op, ch->nvm), GANG_PROGRAM, -9);
+        break;
+    case GANG_PROGRAM:
+        result = gang_write_next_page(ch);
+        if (result)
+            gang_wait(ch, result, GANG_PROGRAM, -9);
+        else
+            ch->state = GANG_REGIONS;
+        break;
+    case GANG_WAIT:
+        result = nvm_async_poll(&ch->op);
+        if (result == APP_ASYNC_PENDING)
+            break;
+
+        if (!result)
+            ch->state = ch->next;
+        else if (ch->op.app.type == APP_ASYNC_PROGMODE)
+            ch->state = GANG_UNLOCK;
+        else {
+            DBG_INFO(UPDI_DEBUG, "Gang %s async operation failed %d", ch->port, result);
+            gang_finish(ch, ch->error);
+        }
+        break;
+    case GANG_REGIONS:
+        for (i = 0; i < ARRAY_SIZE(regions); i++) {
+            result = updi_program_region(ch->nvm, dhex_get_image(), regions[i]);
+            if (result) {
+                DBG_INFO(UPDI_DEBUG, "Gang %s updi_program_region %d failed %d", ch->port, regions[i], result);
+                gang_finish(ch, -9);
+                return;
+            }
+        }
+        ch->state = GANG_VERIFY;
+        break;
+    case GANG_VERIFY:
+        result = updi_verify(ch->nvm);
+        if (result) {
+            DBG_INFO(UPDI_DEBUG, "Gang %s updi_verify failed %d", ch->port, result);
+            gang_finish(ch, -10);
+            break;
+        }
+        ch->state = GANG_LOCK;
+        break;
+    case GANG_LOCK:
+        // Lock is the last one, the memory can't be accessed after locked
+        result = updi_write_lock(ch->nvm);
+        gang_finish(ch, result ? -11 : 0);
+        break;
+    default:
+        break;
+    }
+}
+
+/*
+    Program the image to the targets on several serial ports concurrently
+    The flow of each channel is the same as cupdi_operate(), chip erase and flash page write are started
+    without waiting, the scheduler services the other channels until the NVM is ready.
+    @ports: serial port names, NULL for all ports of the programmer
+    @count: port count of ports, max UPDI_MAX_CHANNEL
+    @results: output of each channel result(0 passed, other value failed code of cupdi_operate()), could be NULL
+    @returns 0 - all passed, other value failed code
+*/
+int cupdi_gang_operate(const char * const *ports, int count, int *results)
+{
+    char *dev_name = "tiny1617";
+    const device_info_t * dev;
+    gang_channel_t channels[UPDI_MAX_CHANNEL];
+    gang_channel_t *ch;
+    unsigned int wake;
+    int i, active, waiting, delay, failed = 0;
+
+    if (!ports)
+        count = GetPortCount();
+
+    if (count > ARRAY_SIZE(channels))
+        count = ARRAY_SIZE(channels);
+
+    dev = get_chip_info(dev_name);
+    if (!dev) {
+        DBG_INFO(UPDI_DEBUG, "Device %s not support", dev_name);
+        return -2;
+    }
+
+    // The image is shared by all channels, check it once
+    if (dhex_check_manifest(dhex_get_image())) {
+        DBG_INFO(UPDI_DEBUG, "dhex_check_manifest failed, image corrupted");
+        return -3;
+    }
+
+    memset(channels, 0, sizeof(channels));
+    for (i = 0; i < count; i++)
+        channels[i].port = ports ? ports[i] : GetPortName(i);
+
+    do {
+        active = 0;
+        waiting = 0;
+        wake = get_time_ms() + GANG_IDLE_MAX_MS;
+        for (i = 0; i < count; i++) {
+            ch = &channels[i];
+            if (ch->state < GANG_DONE) {
+                gang_step(ch, dev);
+                active++;
+                if (ch->state == GANG_WAIT) {
+                    waiting++;
+                    if ((int)(nvm_async_wake(&ch->op) - wake) < 0)
+                        wake = nvm_async_wake(&ch->op);
+                }
+            }
+        }
+
+        // All channels wait for their targets, sleep until the nearest one is due
+        if (active && waiting == active) {
+            delay = (int)(wake - get_time_ms());
+            msleep(delay > 0 ? delay : 1);
+        }
+    } while (active);
+
+    for (i = 0; i < count; i++) {
+        if (results)
+            results[i] = channels[i].result;
+        if (channels[i].result)
+            failed++;
+    }
+
+    DBG_INFO(UPDI_DEBUG, "Gang finished, %d passed, %d failed", count - failed, failed);
+
+    return failed ? -4 : 0;
+}
+
+#endif
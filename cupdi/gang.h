@@ -0,0 +1,10 @@
+#ifndef __GANG_H
+#define __GANG_H
+
+#ifdef CUPDI
+
+int cupdi_gang_operate(const char * const *ports, int count, int *results);
+
+#endif
+
+#endif
@@ -0,0 +1,225 @@
+/*
+ * hexfile.c
+ *
+ * Page crc manifest and address region map of the image built into the programmer
+ */
+
+#ifdef CUPDI
+
+#include "platform/platform.h"
+#include "crc/crc.h"
+#include "device/device.h"
+#include "hexfile.h"
+
+/*
+    avr-gcc hex address region map
+    @start: region start address in hex file
+    @end: region end address in hex file
+    @type: NVM_TYPE_T the region is programmed to
+*/
+typedef struct _hex_region {
+    ihex_address_t start;
+    ihex_address_t end;
+    int type;
+}hex_region_t;
+
+static const hex_region_t hex_regions[] = {
+    { HEX_REGION_FLASH_ADDR, 0x800000, NVM_FLASH },
+    { HEX_REGION_EEPROM_ADDR, HEX_REGION_EEPROM_ADDR + 0x10000, NVM_EEPROM },
+    { HEX_REGION_FUSE_ADDR, HEX_REGION_FUSE_ADDR + 0x10000, NVM_FUSES },
+    { HEX_REGION_LOCK_ADDR, HEX_REGION_LOCK_ADDR + 0x10000, NVM_LOCKBITS },
+    { HEX_REGION_USERROW_ADDR, HEX_REGION_USERROW_ADDR + 0x10000, NVM_USERROW },
+};
+
+/*
+    Get the page count covered by the segment, the first page is aligned down from addr_from
+    @seg: segment buffer
+    @page_size: page size
+    @return page count, 0 if segment is empty
+*/
+int dhex_page_count(const segment_buffer_t *seg, int page_size)
+{
+    ihex_address_t from, to;
+
+    if (!seg->data || !seg->len || page_size <= 0)
+        return 0;
+
+    from = seg->addr_from & ~(page_size - 1);
+    to = seg->addr_from + seg->len;
+
+    return (to - from + page_size - 1) / page_size;
+}
+
+/*
+    Get the address of the segment page
+    @seg: segment buffer
+    @page_size: page size
+    @page: page index in the segment
+    @return page address relative to the segment id
+*/
+ihex_address_t dhex_page_address(const segment_buffer_t *seg, int page_size, int page)
+{
+    return (seg->addr_from & ~(page_size - 1)) + page * page_size;
+}
+
+/*
+    Get the content of a segment page, the bytes not covered by the segment is filled with 0xFF(erased value)
+    @seg: segment buffer
+    @page_size: page size
+    @page: page index in the segment
+    @buf: output of page_size bytes
+    @return true if the page is blank(all 0xFF)
+*/
+bool dhex_page_data(const segment_buffer_t *seg, int page_size, int page, u8 *buf)
+{
+    ihex_address_t addr, from, to;
+    int i;
+
+    addr = dhex_page_address(seg, page_size, page);
+    from = max(addr, seg->addr_from);
+    to = min(addr + page_size, seg->addr_from + seg->len);
+
+    memset(buf, 0xFF, page_size);
+    if (to > from)
+        memcpy(buf + from - addr, seg->data + from - seg->addr_from, to - from);
+
+    for (i = 0; i < page_size && buf[i] == 0xFF; i++);
+
+    return i == page_size;
+}
+
+/*
+    Calculate crc24 of a segment page from the image bytes, the bytes not covered by the segment is filled with 0xFF(erased value)
+    @seg: segment buffer
+    @page_size: page size, max MAX_MANIFEST_PAGE_SIZE
+    @page: page index in the segment
+    @return crc24 value
+*/
+unsigned int dhex_calc_page_crc(const segment_buffer_t *seg, int page_size, int page)
+{
+    u8 buf[MAX_MANIFEST_PAGE_SIZE];
+
+    if (page_size > MAX_MANIFEST_PAGE_SIZE)
+        page_size = MAX_MANIFEST_PAGE_SIZE;
+
+    dhex_page_data(seg, page_size, page, buf);
+
+    return calc_crc24(buf, page_size);
+}
+
+/*
+    Get the crc of a segment page, from the manifest if exist, else calculated from the image
+    @dhex: hex data
+    @seg: segment buffer of dhex
+    @page_size: page size
+    @page: page index in the segment
+    @return crc24 value
+*/
+unsigned int dhex_get_page_crc(const hex_data_t *dhex, const segment_buffer_t *seg, int page_size, int page)
+{
+    if (seg->page_crc && dhex->page_size == page_size)
+        return seg->page_crc[page];
+
+    return dhex_calc_page_crc(seg, page_size, page);
+}
+
+/*
+    Check the image against its crc manifest, to detect image corrupted in programmer flash
+    @dhex: hex data
+    @return 0 if passed or no manifest, other value failed
+*/
+int dhex_check_manifest(const hex_data_t *dhex)
+{
+    const segment_buffer_t *seg;
+    int i, page, pages;
+    unsigned int crc;
+
+    if (!dhex->page_size)
+        return 0;
+
+    for (i = 0; i < ARRAY_SIZE(dhex->segment); i++) {
+        seg = &dhex->segment[i];
+        if (!seg->data || !seg->page_crc)
+            continue;
+
+        pages = dhex_page_count(seg, dhex->page_size);
+        for (page = 0; page < pages; page++) {
+            crc = dhex_calc_page_crc(seg, dhex->page_size, page);
+            if (crc != seg->page_crc[page]) {
+                DBG_INFO(UPDI_DEBUG, "Image segment %d page %d crc mismatch %06x(%06x)", i, page, crc, seg->page_crc[page]);
+                return -2;
+            }
+        }
+    }
+
+    return 0;
+}
+
+/*
+    Get the NVM region of the segment by its hex file address
+    @seg: segment buffer
+    @offset: output of the segment offset inside the region
+    @return NVM_TYPE_T of the region, negative if the segment is out of any region
+*/
+int dhex_segment_region(const segment_buffer_t *seg, ihex_address_t *offset)
+{
+    const hex_region_t *region;
+    ihex_address_t addr;
+    int i;
+
+    addr = SEGMENTID_TO_ADDR((ihex_address_t)seg->sid) + seg->addr_from;
+
+    for (i = 0; i < ARRAY_SIZE(hex_regions); i++) {
+        region = &hex_regions[i];
+        if (addr >= region->start && addr + seg->len <= region->end) {
+            if (offset)
+                *offset = addr - region->start;
+            return region->type;
+        }
+    }
+
+    return -2;
+}
+
+/*
+    Get the hex file address of the NVM region
+    @type: NVM_TYPE_T of the region
+    @address: output of the region start address in hex file
+    @return 0 successful, other value if the region is not in hex file
+*/
+int dhex_region_address(int type, ihex_address_t *address)
+{
+    int i;
+
+    for (i = 0; i < ARRAY_SIZE(hex_regions); i++) {
+        if (hex_regions[i].type == type) {
+            *address = hex_regions[i].start;
+            return 0;
+        }
+    }
+
+    return -2;
+}
+
+/* Image programmed, the one built in unless another is loaded at runtime */
+static hex_data_t *dhex_image = &hexdata;
+
+/*
+    Get the image to be programmed
+    @return hex data
+*/
+hex_data_t *dhex_get_image(void)
+{
+    return dhex_image;
+}
+
+/*
+    Select the image to be programmed, called before any part is programmed(the image is shared by all sessions)
+    @dhex: hex data, NULL for the built-in image
+*/
+void dhex_set_image(hex_data_t *dhex)
+{
+    dhex_image = dhex ? dhex : &hexdata;
+}
+
+#endif
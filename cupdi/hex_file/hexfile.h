@@ -20,4 +20,37 @@ char *hexarray_gets(char *str, int n, const char *fp[]);
 */
 int set_default_segment_id(hex_data_t *dhex, ihex_segment_t segmentid);
 
+/* Max page size supported by the crc manifest */
+#define MAX_MANIFEST_PAGE_SIZE 128
+
+int dhex_page_count(const segment_buffer_t *seg, int page_size);
+ihex_address_t dhex_page_address(const segment_buffer_t *seg, int page_size, int page);
+bool dhex_page_data(const segment_buffer_t *seg, int page_size, int page, u8 *buf);
+unsigned int dhex_calc_page_crc(const segment_buffer_t *seg, int page_size, int page);
+unsigned int dhex_get_page_crc(const hex_data_t *dhex, const segment_buffer_t *seg, int page_size, int page);
+int dhex_check_manifest(const hex_data_t *dhex);
+
+/* Address regions of the avr-gcc hex file */
+#define HEX_REGION_FLASH_ADDR 0x000000
+#define HEX_REGION_EEPROM_ADDR 0x810000
+#define HEX_REGION_FUSE_ADDR 0x820000
+#define HEX_REGION_LOCK_ADDR 0x830000
+#define HEX_REGION_USERROW_ADDR 0x850000
+
+int dhex_segment_region(const segment_buffer_t *seg, ihex_address_t *offset);
+int dhex_region_address(int type, ihex_address_t *address);
+
+hex_data_t *dhex_get_image(void);
+void dhex_set_image(hex_data_t *dhex);
+
+/*
+    Runtime hex loading into the segment arena, compiled in with UPDI_HEX_LOADER,
+    SEGMENT_POOL_SIZE is the arena size(bytes of all the segment data)
+*/
+#ifdef UPDI_HEX_LOADER
+hex_data_t *get_hex_info_from_file(const char *file[], hex_data_t *dhex);
+int dhex_load_file(const char *path, hex_data_t *dhex);
+void release_dhex(hex_data_t *dhex);
+#endif
+
 #endif /* HEXFILE_H_ */
\ No newline at end of file
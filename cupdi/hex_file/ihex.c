@@ -2,6 +2,8 @@
 
 #include "ihex.h"
 
+/* Generated by host/hex2array, do not edit */
+
 const char bindata0[] = {
 	0x0c,0x94,0x3e,0x00,0x0c,0x94,0x5b,0x00,0x0c,0x94,0x5b,0x00,0x0c,0x94,0x5b,0x00,0x0c,
 	0x94,0x5b,0x00,0x0c,0x94,0x5b,0x00,0x0c,0x94,0x62,0x00,0x0c,0x94,0x5b,0x00,0x0c,0x94,
@@ -462,14 +464,53 @@ const char bindata0[] = {
 	0x01,0x00,
 };
 
+const char bindata1[] = {
+	0x00,0x46,0x7d,0xff,0x00,0xf6,0xff,0x00,0x00,
+};
+
+const char bindata2[] = {
+	0xc5,
+};
+
+const uint32_t bindata0_crc[] = {
+	0x748a6b,0xa0fc6e,0x26d24e,0x258759,0xc050fe,0x14db8b,0xe61471,0x66fe82,
+	0x142478,0x396344,0x2eed80,0x16cd01,0xde7675,0x4f5be7,0x0913a8,0xd0af19,
+	0x433a17,0x849d99,0x7d03f1,0xac8a32,0x84ee10,0xfd19f8,0x437699,0x15d786,
+	0xc56f9c,0x163038,0x5d53db,0xb4994d,0x1d8118,0x29dc84,0x544f38,0x482814,
+	0x1508cc,0x777bfb,0xedc72f,0x5201db,0x7bfcd4,0x1dbedb,0x93a7e2,0xf6b319,
+	0x939178,0x6231ed,0x24f8d9,0x387b7e,0xe84184,0x237552,0x4e75af,0x3a402d,
+	0xdd120f,0x0bd1b1,0x7c545c,0x0630aa,0x4ba19e,0xfb31ef,0x32a15c,0x7bfcf3,
+	0xe0dad1,0xf0b74b,0x4ebafd,0x8d8a9a,0x145f09,0xe0351d,0x477c4f,0xf76b4c,
+	0xf2e3a3,0x4477cc,0x5c955f,0x09d166,0xc0e14a,0x5e93c8,0x4c88e0,0x2c4cd7,
+	0x55e13f,0x97a238,0xbc56f0,0x7c3a5f,0x59e56d,0xd15f0c,0x485ccd,0xb08bd7,
+	0x3b1468,0x85c5cf,0x253b3d,0x12ad81,0x740ed7,0x03ec47,0xc77e1a,0xbdfe0b,
+	0xe71007,0x6750fb,0xe12972,0xc5164c,0xadedae,0x2ac9f0,0x35eec6,0x766e3d,
+	0xaa2013,0x19d44f,0x77ab6d,0xc2fde3,0x552c3d,0x696589,0x51552e,0x566643,
+	0xd19e2d,0x9b3e2e,0xc5be3b,0xe2d366,0x7cea21,0x94be5d,0x6dfb1d,0xe3abab,
+	0x868c22,0x6da009,0x53c5bd,0xf95177,0x59cbd5,0x6e1696,0xedab44,0x1460fe,
+	0xfd1f11,0x069c07,
+};
+
 hex_data_t hexdata =
 {
 	.flag = 1,
+	.page_size = 64,
 	.segment[0].addr_from = 0,
 	.segment[0].addr_to = 7754,
 	.segment[0].len = 7754,
 	.segment[0].sid = 0,
 	.segment[0].data = bindata0,
+	.segment[0].page_crc = bindata0_crc,
+	.segment[1].addr_from = 8519680,
+	.segment[1].addr_to = 8519689,
+	.segment[1].len = 9,
+	.segment[1].sid = 0,
+	.segment[1].data = bindata1,
+	.segment[2].addr_from = 8585216,
+	.segment[2].addr_to = 8585217,
+	.segment[2].len = 1,
+	.segment[2].sid = 0,
+	.segment[2].data = bindata2,
 };
 
 #endif
\ No newline at end of file
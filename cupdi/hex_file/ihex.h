@@ -20,6 +20,7 @@ typedef struct _segment_buffer {
     const char *data;    //buffer pointer
     int len;       //buffer data len
 
+    const uint32_t *page_crc;   //crc24 of each page(0xFF padded) from addr_from aligned down, NULL if no manifest
 }segment_buffer_t;
 
 typedef struct _hex_data {
@@ -27,6 +28,8 @@ typedef struct _hex_data {
 
 #define SEG_ALLOC_MEMORY (1 << 0)
     int flag;
+
+    int page_size;  //page size the crc manifest is generated with, 0 if no manifest
 }hex_data_t;
 
 #define ADDR_TO_SEGMENTID(_addr) ((_addr) >> 4)
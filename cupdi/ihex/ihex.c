@@ -5,8 +5,23 @@
 #include <errno.h>
 
 #include "platform/platform.h"
-#include "ihex.h"
+#include "platform/arena.h"
+#include "kk_ihex_read.h"
+#include "hex_file/ihex.h"
 #include "hex_file/hexfile.h"
+
+#ifdef UPDI_HEX_LOADER
+
+/*
+    Segment buffer memory pool of runtime hex loading, all the segment data is allocated from the arena
+    and released together by unload_segments(). Only linked with UPDI_HEX_LOADER, the size is configurable
+*/
+#ifndef SEGMENT_POOL_SIZE
+#define SEGMENT_POOL_SIZE (16 * 1024)
+#endif
+
+static unsigned char segment_pool[SEGMENT_POOL_SIZE];
+static arena_t segment_arena = { segment_pool, sizeof(segment_pool), 0, NULL };
 /*
 Get buffer by the segment value
     @dhex: hex_data_t structure, the 
@@ -21,22 +36,6 @@ segment_buffer_t *get_segment_default(hex_data_t *dhex)
 }
 */
 
-int set_default_segment_id(hex_data_t *dhex, ihex_segment_t segmentid)
-{
-    segment_buffer_t *seg;
-    int result = 0;
-
-    for (int i = 0; i < MAX_SEGMENT_COUNT_IN_RECORDS; i++) {
-        seg = &dhex->segment[i];
-        if (!seg->sid && seg->addr_to && seg->data) {      
-            seg->sid = segmentid;
-            result++;
-        }
-    }
-
-    return result;
-}
-
 segment_buffer_t *get_segment_by_id(hex_data_t *dhex, ihex_segment_t segmentid)
 {
     segment_buffer_t *seg;
@@ -98,6 +97,7 @@ segment_buffer_t *_set_segment_data_by_id_addr(hex_data_t *dhex, ihex_segment_t
     segment_buffer_t *seg;
     ihex_address_t addr_to;
     ihex_count_t size;
+    char *buf;
 
     //search seg first
     for (int i = 0; i < MAX_SEGMENT_COUNT_IN_RECORDS; i++) {
@@ -108,29 +108,37 @@ segment_buffer_t *_set_segment_data_by_id_addr(hex_data_t *dhex, ihex_segment_t
                 addr_to = addr + len;
                 addr_to = max(addr_to, seg->addr_to);
                 size = addr_to - seg->addr_from;
-                seg->addr_to = addr_to;
 
+                // addr_to is moved only after the buffer covers it
                 if (data) {
                     if (seg->data) {
                         if (size > seg->len) {
-                            //seg->data = realloc(seg->data, size);
-                            if (seg->data)
+                            buf = arena_realloc(&segment_arena, (void *)seg->data, seg->len, size);
+                            if (buf) {
+                                memset(buf + seg->len, 0xFF, size - seg->len);
+                                seg->data = buf;
                                 seg->len = size;
+                            }
                             else
-                                seg->len = 0;// report mem error
+                                return NULL;    // out of memory, the old buffer is kept
                         }
                     }
                     else {
-                        //seg->data = malloc(size);
-                        if (seg->data)
+                        buf = arena_alloc(&segment_arena, size);
+                        if (buf) {
+                            memset(buf, 0xFF, size);
+                            seg->data = buf;
                             seg->len = size;
+                        }
                         else
-                            seg->len = 0;// report mem error
+                            return NULL;
                     }
                 }
 
+                seg->addr_to = addr_to;
+
                 if (seg->data && data)
-                    memcpy(seg->data + addr - seg->addr_from, data, len);
+                    memcpy((char *)seg->data + addr - seg->addr_from, data, len);
                 
                 return seg;
             }
@@ -143,13 +151,14 @@ segment_buffer_t *_set_segment_data_by_id_addr(hex_data_t *dhex, ihex_segment_t
         //get an unused seg
         if (!seg->sid && !seg->addr_from && !seg->addr_to) {
             if (data) {
-                //seg->data = malloc(len);
-                if (seg->data) {
+                buf = arena_alloc(&segment_arena, len);
+                if (buf) {
+                    memcpy(buf, data, len);
+                    seg->data = buf;
                     seg->len = len;
-                    memcpy(seg->data, data, len);
                 }
                 else
-                    seg->len = 0; // report mem error
+                    return NULL;
             }
 
             seg->sid = segmentid;
@@ -252,7 +261,8 @@ ihex_bool_t ihex_data_read(struct ihex_state *ihex,
 
     if (type == IHEX_DATA_RECORD) {
         //start = (ihex_address_t)IHEX_LINEAR_ADDRESS(ihex);
-        set_segment_data_by_id_addr(dhex, sid, ihex->address, ihex->length, (char *)ihex->data, dhex->flag);
+        if (!set_segment_data_by_id_addr(dhex, sid, ihex->address, ihex->length, (char *)ihex->data, dhex->flag))
+            return false;
     }
     else if (type == IHEX_EXTENDED_SEGMENT_ADDRESS_RECORD) {
     
@@ -266,7 +276,7 @@ ihex_bool_t ihex_data_read(struct ihex_state *ihex,
 
 /*
 Read dhex content, and process in cb_read()
-    @fp: file pointer
+    @fp: hex lines, end with NULL
     @cb_read: callback function for process each record
     @args: arguments for cb
     return true if success, else failed
@@ -274,18 +284,13 @@ Read dhex content, and process in cb_read()
 ihex_bool_t dhex_read(/*FILE *fp*/const char *fp[], cb_ihex_data_read_t cb_read, void *args)
 {
     struct ihex_state ihex;
-    unsigned long line_number = 1L;
     ihex_count_t count;
-    char buf[256];
-
-    //fseek(fp, 0, SEEK_SET);
-	hexarray_seek_begin();
+    int i;
 
     ihex_read_at_address(&ihex, 0, cb_read, args);
-    while (/*fgets*/hexarray_gets(buf, sizeof(buf), fp)) {
-        count = (ihex_count_t)strlen(buf);
-        ihex_read_bytes(&ihex, buf, count);
-        line_number += (count && buf[count - 1] == '\n');
+    for (i = 0; fp[i]; i++) {
+        count = (ihex_count_t)strlen(fp[i]);
+        ihex_read_bytes(&ihex, fp[i], count);
     }
     ihex_end_read(&ihex);
 
@@ -338,8 +343,7 @@ void unload_segment_by_sid(hex_data_t *dhex, ihex_segment_t segmentid)
     for (i = 0; i < ARRAY_SIZE(dhex->segment); i++) {
         seg = &dhex->segment[i];
         if (seg->sid == segmentid) {
-            if (seg->data)
-                //free(seg->data);
+            // the buffer is kept in arena until unload_segments()
             memset(seg, 0, sizeof(*seg));
         }
     }
@@ -353,34 +357,110 @@ void unload_segments(hex_data_t *dhex)
     //alloc data buffer
     for (i = 0; i < ARRAY_SIZE(dhex->segment); i++) {
         seg = &dhex->segment[i];
-        //if (seg->data)
-            //free(seg->data);
-
         memset(seg, 0, sizeof(*seg));
     }
+
+    // release all segment buffers
+    arena_reset(&segment_arena);
 }
 
-//hex_data_t hexdata;
-hex_data_t * get_hex_info_from_file(const char *file[])
+/*
+Load the hex lines into a hex data structure of its own, the built-in image is not touched
+    @file: hex lines, end with NULL
+    @dhex: hex data to load, the segments loaded before are released
+    return dhex if success, NULL if failed
+*/
+hex_data_t * get_hex_info_from_file(const char *file[], hex_data_t *dhex)
 {
-    hex_data_t *dhex = &hexdata;
     int result = 0;
 
-    /*dhex = malloc(sizeof(*dhex));
-    if (!dhex)
-        return NULL;*/
+    if (!dhex || dhex == &hexdata)
+        return NULL;
 
+    unload_segments(dhex);
     memset(dhex, 0, sizeof(*dhex));
 
     result = load_segments_from_file(file, dhex);
     if (result) {
-        //free(dhex);
+        unload_segments(dhex);
         return NULL;
     }
 
     return dhex;
 }
 
+/*
+Read a hex file, and process each record in cb_read()
+    @fp: hex file
+    @cb_read: callback function for process each record
+    @args: arguments for cb
+    return true if success, else failed
+*/
+static ihex_bool_t dhex_read_file(FILE *fp, cb_ihex_data_read_t cb_read, void *args)
+{
+    struct ihex_state ihex;
+    char line[128];
+
+    rewind(fp);
+    ihex_read_at_address(&ihex, 0, cb_read, args);
+    while (fgets(line, sizeof(line), fp))
+        ihex_read_bytes(&ihex, line, (ihex_count_t)strlen(line));
+    ihex_end_read(&ihex);
+
+    return !ferror(fp);
+}
+
+/*
+Load a hex file into a hex data structure of its own, the same two passes as load_segments_from_file()
+    @path: hex file
+    @dhex: hex data to load, the segments loaded before are released
+    return 0 if sucess else failed
+*/
+int dhex_load_file(const char *path, hex_data_t *dhex)
+{
+    FILE *fp;
+    int result = 0;
+
+    if (!dhex || dhex == &hexdata)
+        return -2;
+
+    fp = fopen(path, "r");
+    if (!fp)
+        return -2;
+
+    unload_segments(dhex);
+    memset(dhex, 0, sizeof(*dhex));
+
+    //walk without alloc memory (for data range combination)
+    dhex->flag = 0;
+    if (!dhex_read_file(fp, ihex_data_read, dhex)) {
+        result = -3;
+        goto out;
+    }
+
+    //alloc memory and read data
+    dhex->flag = SEG_ALLOC_MEMORY;
+    if (!dhex_read_file(fp, ihex_data_read, dhex)) {
+        result = -4;
+        goto out;
+    }
+
+    // every segment must have got its data
+    for (int i = 0; i < ARRAY_SIZE(dhex->segment); i++) {
+        if (dhex->segment[i].addr_to && !dhex->segment[i].data) {
+            result = -5;
+            break;
+        }
+    }
+
+out:
+    fclose(fp);
+    if (result)
+        unload_segments(dhex);
+
+    return result;
+}
+
 void release_dhex(hex_data_t *dhex)
 {
     if (dhex) {
@@ -389,6 +469,8 @@ void release_dhex(hex_data_t *dhex)
     }
 }
 
+#endif
+
 void ihex_flush_buffer(struct ihex_state *ihex, char *buffer, char *eptr) 
 {
     FILE *outfile = (FILE *)ihex->args;
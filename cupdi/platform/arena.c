@@ -0,0 +1,98 @@
+#ifdef CUPDI
+
+#include <string.h>
+#include "arena.h"
+
+#define ARENA_ROUND_UP(_size) (((_size) + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1))
+
+/*
+    Arena init
+    @arena: arena object
+    @pool: memory pool
+    @size: pool size
+*/
+void arena_init(arena_t *arena, void *pool, size_t size)
+{
+    arena->base = (unsigned char *)pool;
+    arena->size = size;
+    arena_reset(arena);
+}
+
+/*
+    Arena allocate a block
+    @arena: arena object
+    @size: block size
+    @return block pointer, NULL if the arena is exhausted
+*/
+void *arena_alloc(arena_t *arena, size_t size)
+{
+    unsigned char *ptr;
+
+    size = ARENA_ROUND_UP(size);
+    if (!size || size > arena->size - arena->used)
+        return NULL;
+
+    ptr = arena->base + arena->used;
+    arena->used += size;
+    arena->last = ptr;
+
+    return ptr;
+}
+
+/*
+    Arena resize a block, the last allocated block is grown in place, others are moved to a new block
+        and the old space is not reused until arena_reset()
+    @arena: arena object
+    @ptr: block allocated by arena_alloc(), NULL to allocate a new one
+    @old_size: size of the block, the arena doesn't record it
+    @size: new block size
+    @return block pointer, NULL if the arena is exhausted(the old block is still valid)
+*/
+void *arena_realloc(arena_t *arena, void *ptr, size_t old_size, size_t size)
+{
+    unsigned char *block = (unsigned char *)ptr;
+    unsigned char *nblock;
+    size_t offset;
+
+    if (!block)
+        return arena_alloc(arena, size);
+
+    offset = block - arena->base;
+    size = ARENA_ROUND_UP(size);
+
+    if (block == arena->last) {
+        if (size > arena->size - offset)
+            return NULL;
+
+        arena->used = offset + size;
+        return block;
+    }
+
+    nblock = arena_alloc(arena, size);
+    if (nblock)
+        memcpy(nblock, block, old_size < size ? old_size : size);
+
+    return nblock;
+}
+
+/*
+    Arena release all blocks
+    @arena: arena object
+*/
+void arena_reset(arena_t *arena)
+{
+    arena->used = 0;
+    arena->last = NULL;
+}
+
+/*
+    Arena left space
+    @arena: arena object
+    @return bytes could be allocated
+*/
+size_t arena_available(const arena_t *arena)
+{
+    return arena->size - arena->used;
+}
+
+#endif
@@ -0,0 +1,33 @@
+#ifndef __ARENA_H
+#define __ARENA_H
+
+#ifdef CUPDI
+
+#include <stddef.h>
+
+/*
+    Fixed size arena memory, allocated by bump pointer and released as a whole
+    @base: memory pool
+    @size: pool size
+    @used: bytes allocated
+    @last: last allocated block, could be grown in place
+*/
+typedef struct _arena {
+    unsigned char *base;
+    size_t size;
+    size_t used;
+    unsigned char *last;
+}arena_t;
+
+/* Allocation alignment of the arena */
+#define ARENA_ALIGN sizeof(void *)
+
+void arena_init(arena_t *arena, void *pool, size_t size);
+void *arena_alloc(arena_t *arena, size_t size);
+void *arena_realloc(arena_t *arena, void *ptr, size_t old_size, size_t size);
+void arena_reset(arena_t *arena);
+size_t arena_available(const arena_t *arena);
+
+#endif
+
+#endif
@@ -1,6 +1,22 @@
 #ifdef CUPDI
 
 #include "hal_delay.h"
+#include <compiler.h>
+#include <peripheral_clk_config.h>
+
+/* millisecond counter of the SysTick, SysTick is started at first time read */
+static volatile unsigned int systick_ms;
+
+void SysTick_Handler(void)
+{
+    systick_ms++;
+}
+
+static void systick_start(void)
+{
+    if (!(SysTick->CTRL & SysTick_CTRL_ENABLE_Msk))
+        SysTick_Config(CONF_CPU_FREQUENCY / 1000);
+}
 
 //delay millisecond here
 void msleep(int ms)
@@ -9,4 +25,28 @@ void msleep(int ms)
 	delay_ms(ms);
 }
 
-#endif
\ No newline at end of file
+//monotonic millisecond time
+unsigned int get_time_ms(void)
+{
+    systick_start();
+
+    return systick_ms;
+}
+
+//monotonic microsecond time, wraps at 2^32 us
+unsigned int get_time_us(void)
+{
+    unsigned int ms, val;
+
+    systick_start();
+
+    /* re-read if the counter wrapped between the two reads */
+    do {
+        ms = systick_ms;
+        val = SysTick->VAL;
+    } while (ms != systick_ms);
+
+    return ms * 1000 + (SysTick->LOAD - val) / (CONF_CPU_FREQUENCY / 1000000);
+}
+
+#endif
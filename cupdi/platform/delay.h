@@ -3,6 +3,8 @@
 
 #ifdef CUPDI
 void msleep(int ms);
+unsigned int get_time_ms(void);
+unsigned int get_time_us(void);
 #endif
 
 #endif
@@ -0,0 +1,46 @@
+/*
+ * delay_linux.c
+ *
+ * Delay and monotonic time of the Linux host build
+ */
+
+#ifdef CUPDI
+
+#include <time.h>
+#include <errno.h>
+#include "platform/platform.h"
+
+//delay millisecond here
+void msleep(int ms)
+{
+    struct timespec ts;
+
+    if (ms <= 0)
+        return;
+
+    ts.tv_sec = ms / 1000;
+    ts.tv_nsec = (ms % 1000) * 1000000L;
+    while (nanosleep(&ts, &ts) && errno == EINTR);
+}
+
+//monotonic millisecond time
+unsigned int get_time_ms(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (unsigned int)(ts.tv_sec * 1000ULL + ts.tv_nsec / 1000000);
+}
+
+//monotonic microsecond time, wraps at 2^32 us
+unsigned int get_time_us(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (unsigned int)(ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000);
+}
+
+#endif
@@ -0,0 +1,486 @@
+/**
+ * @filename serial_linux.c
+ *
+ * Serial port backend of the Linux host build, termios tty with non-blocking I/O,
+ * the reading and writing wait by poll() with a timeout.
+ *
+ * This file contains the function implementations of serial.h for USB-UART adapters.
+ */
+#ifdef CUPDI
+
+#define _GNU_SOURCE /* GLOB_BRACE */
+#include "platform/platform.h"
+#include "updi/constants.h"
+#include <fcntl.h>
+#include <errno.h>
+#include <glob.h>
+#include <poll.h>
+#include <pthread.h>
+#include <termios.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/ioctl.h>
+#include <linux/serial.h>
+
+/* Max time(ms) ReadData() waits for the first byte if nothing received */
+#ifndef SERIAL_READ_TIMEOUT_MS
+#define SERIAL_READ_TIMEOUT_MS 1
+#endif
+
+/* Max time(ms) SendData() waits for the tty output buffer */
+#ifndef SERIAL_WRITE_TIMEOUT_MS
+#define SERIAL_WRITE_TIMEOUT_MS 1000
+#endif
+
+/* Serial ports listed by GetPortName() */
+#define SERIAL_PORT_PATTERN "/dev/tty{USB,ACM}*"
+#define SERIAL_MAX_PORT_NAME 64
+#ifndef SERIAL_MAX_PORT
+#define SERIAL_MAX_PORT 256
+#endif
+/* Min interval(ms) between the port rescans of GetPortCount(), the list is stable within a loop over the ports */
+#ifndef SERIAL_RESCAN_MS
+#define SERIAL_RESCAN_MS 1000
+#endif
+
+/*
+    Port object
+    @fd: tty fd
+    @icount: driver error counters at the last check, the line errors are the increments
+*/
+typedef struct _upd_sercom {
+#define UPD_SERCOM_MAGIC_WORD 0xA5A5//'user'
+    unsigned int mgwd;
+    int fd;
+    struct serial_icounter_struct icount;
+}upd_sercom_t;
+
+#define VALID_SER(_ser) ((_ser) && (((upd_sercom_t *)(_ser))->mgwd == UPD_SERCOM_MAGIC_WORD))
+
+static UPDI_THREAD_LOCAL upd_sercom_t sercom[UPDI_MAX_CHANNEL];
+
+/*
+    Serial port list shared by all threads, guarded by port_lock
+    @port_names/name_count: every port name seen, never rewritten so the GetPortName() pointers stay valid
+    @port_list/port_count: index in port_names of each port present at the last scan
+    @port_scanned: get_time_ms() of the last scan
+*/
+static pthread_mutex_t port_lock = PTHREAD_MUTEX_INITIALIZER;
+static char port_names[SERIAL_MAX_PORT][SERIAL_MAX_PORT_NAME];
+static int name_count;
+static int port_list[SERIAL_MAX_PORT];
+static int port_count = -1;
+static unsigned int port_scanned;
+
+/*
+    Baudrate to termios speed
+    @baud: baudrate
+    @return speed_t, B0 if not supported
+*/
+static speed_t serial_speed(DWORD baud)
+{
+    static const struct {
+        DWORD baud;
+        speed_t speed;
+    } speeds[] = {
+        { 300, B300 }, { 600, B600 }, { 1200, B1200 }, { 2400, B2400 }, { 4800, B4800 },
+        { 9600, B9600 }, { 19200, B19200 }, { 38400, B38400 }, { 57600, B57600 },
+        { 115200, B115200 }, { 230400, B230400 }, { 460800, B460800 }, { 500000, B500000 },
+        { 921600, B921600 }, { 1000000, B1000000 }, { 1500000, B1500000 }, { 2000000, B2000000 },
+    };
+    int i;
+
+    for (i = 0; i < ARRAY_SIZE(speeds); i++) {
+        if (speeds[i].baud == baud)
+            return speeds[i].speed;
+    }
+
+    return B0;
+}
+
+/**
+ * Initialises a serial port handle for reading and writing
+ *
+ * @param char *port  The tty path of the serial port to open, NULL for the first port listed.
+ * @param SER_PORT_STATE_T *st The port state
+ * @returns HANDLE fd   The pointer to the handle, NULL if failed
+ */
+HANDLE OpenPort(const void *port, const SER_PORT_STATE_T *st) {
+    upd_sercom_t *ser = NULL;
+    int i, fd;
+
+    if (!port)
+        port = GetPortName(0);
+
+    if (!port)
+        return NULL;
+
+    for (i = 0; i < ARRAY_SIZE(sercom); i++) {
+        if (!VALID_SER(&sercom[i])) {
+            ser = &sercom[i];
+            break;
+        }
+    }
+
+    if (!ser)
+        return NULL;
+
+    fd = open((const char *)port, O_RDWR | O_NOCTTY | O_NONBLOCK);
+    if (fd < 0)
+        return NULL;
+
+    /* Exclusive access, the port may be used by another process */
+    if (flock(fd, LOCK_EX | LOCK_NB)) {
+        close(fd);
+        return NULL;
+    }
+
+    ser->fd = fd;
+    ser->mgwd = UPD_SERCOM_MAGIC_WORD;
+    GetPortError(ser, NULL);
+
+    if (SetPortState(ser, st) != 0) {
+        ClosePort(ser);
+        return NULL;
+    }
+
+    return (HANDLE)ser;
+}
+
+/*
+    Find the name in the port name table, appended if not seen before
+    @name: port name
+    @return index in port_names, negative if the table is full
+*/
+static int serial_name_index(const char *name)
+{
+    int i;
+
+    for (i = 0; i < name_count; i++) {
+        if (!strcmp(port_names[i], name))
+            return i;
+    }
+
+    if (name_count >= ARRAY_SIZE(port_names) || strlen(name) >= sizeof(port_names[0]))
+        return -1;
+
+    snprintf(port_names[name_count], sizeof(port_names[name_count]), "%s", name);
+
+    return name_count++;
+}
+
+/*
+    Scan the USB-UART adapters present, called with port_lock held
+*/
+static void serial_scan_ports(void)
+{
+    glob_t g;
+    int i, index;
+
+    port_count = 0;
+    if (glob(SERIAL_PORT_PATTERN, GLOB_BRACE, NULL, &g) == 0) {
+        for (i = 0; i < g.gl_pathc && port_count < ARRAY_SIZE(port_list); i++) {
+            index = serial_name_index(g.gl_pathv[i]);
+            if (index >= 0)
+                port_list[port_count++] = index;
+        }
+        globfree(&g);
+    }
+
+    port_scanned = get_time_ms();
+}
+
+/**
+* Get the count of serial ports, the USB-UART adapters are rescanned if the list is older than SERIAL_RESCAN_MS
+*
+* @returns port count
+*/
+int GetPortCount(void) {
+    int count;
+
+    pthread_mutex_lock(&port_lock);
+    if (port_count < 0 || get_time_ms() - port_scanned >= SERIAL_RESCAN_MS)
+        serial_scan_ports();
+    count = port_count;
+    pthread_mutex_unlock(&port_lock);
+
+    return count;
+}
+
+/**
+* Get the name of serial port
+*
+* @param int index  The port index, 0 ~ GetPortCount() - 1
+* @returns port name, valid until the process exits, NULL if index overflow
+*/
+const char *GetPortName(int index) {
+    const char *name = NULL;
+
+    if (index < 0 || index >= GetPortCount())
+        return NULL;
+
+    pthread_mutex_lock(&port_lock);
+    if (index < port_count)
+        name = port_names[port_list[index]];
+    pthread_mutex_unlock(&port_lock);
+
+    return name;
+}
+
+/**
+* Set a serial port state
+*
+* @param char *ser  The port handle.
+* @param SER_PORT_STATE_T *st The port state
+* @returns 0 - success, other value failed code
+*/
+int SetPortState(void *ptr_ser, const SER_PORT_STATE_T *st) {
+    upd_sercom_t *ser = (upd_sercom_t *)ptr_ser;
+    struct termios tio;
+    speed_t speed;
+
+    if (!VALID_SER(ser))
+        return ERROR_PTR;
+
+    if (tcgetattr(ser->fd, &tio))
+        return -2;
+
+    cfmakeraw(&tio);
+    tio.c_cflag |= CLOCAL | CREAD;
+    tio.c_cc[VMIN] = 0;
+    tio.c_cc[VTIME] = 0;
+
+    // Set baund rate
+    speed = serial_speed(st->baudRate);
+    if (speed == B0)
+        return -5;
+    cfsetispeed(&tio, speed);
+    cfsetospeed(&tio, speed);
+
+    /* Set databits */
+    tio.c_cflag &= ~CSIZE;
+    switch (st->byteSize) {
+        case 5:
+            tio.c_cflag |= CS5;
+            break;
+        case 6:
+            tio.c_cflag |= CS6;
+            break;
+        case 7:
+            tio.c_cflag |= CS7;
+            break;
+        case 8:
+            tio.c_cflag |= CS8;
+            break;
+        default:
+            return -6;
+    }
+
+    /* Set stopbits */
+    switch (st->stopBits) {
+        case ONESTOPBIT:
+            tio.c_cflag &= ~CSTOPB;
+            break;
+        case TWOSTOPBITS:
+            tio.c_cflag |= CSTOPB;
+            break;
+        default:
+            return -7;
+    }
+
+    /* Set parity */
+    switch (st->parity) {
+        case NOPARITY:
+            tio.c_cflag &= ~(PARENB | PARODD);
+            break;
+        case ODDPARITY:
+            tio.c_cflag |= PARENB | PARODD;
+            break;
+        case EVENPARITY:
+            tio.c_cflag |= PARENB;
+            tio.c_cflag &= ~PARODD;
+            break;
+        default:
+            return -8;
+    }
+
+    /* The characters in output buffer are sent at the old baud, the break of double break needs it */
+    if (tcsetattr(ser->fd, TCSADRAIN, &tio))
+        return -9;
+
+    return 0;
+}
+
+int FlushPort(void *ptr_ser)
+{
+    upd_sercom_t *ser = (upd_sercom_t *)ptr_ser;
+
+    if (!VALID_SER(ser))
+        return ERROR_PTR;
+
+    if (tcflush(ser->fd, TCIFLUSH))
+        return -2;
+
+    GetPortError(ser, NULL);
+
+    return 0;
+}
+
+/**
+ * Sends data out the serial port pointed to by the handle fd.
+ *
+ * @param HANDLE fd The handle to the serial port.
+ * @param LPVOID tx The data to be transmitted.
+ * @param DWORD len The length of the data.
+ *
+ * @returns 0 if successful, greater than 0 otherwise.
+ */
+int SendData(void *ptr_ser, const /*LPVOID*/u8 *tx, DWORD len) {
+    upd_sercom_t *ser = (upd_sercom_t *)ptr_ser;
+    struct pollfd pfd;
+    DWORD written = 0;
+    ssize_t n;
+
+    if (!VALID_SER(ser))
+        return ERROR_PTR;
+
+    pfd.fd = ser->fd;
+    pfd.events = POLLOUT;
+
+    while (written < len) {
+        n = write(ser->fd, tx + written, len - written);
+        if (n > 0) {
+            written += n;
+            continue;
+        }
+
+        if (n < 0 && errno != EAGAIN && errno != EINTR)
+            return -2;
+
+        /* Output buffer full */
+        if (poll(&pfd, 1, SERIAL_WRITE_TIMEOUT_MS) <= 0)
+            return -3;
+    }
+
+    return 0;
+}
+
+/**
+ * Reads data from the serial port, waits SERIAL_READ_TIMEOUT_MS at most if nothing received
+ *
+ * @param HANDLE fd   The handle to the serial port
+ * @param LPVOID rx The data buffer to be received.
+ * @param DWORD len The length of the data.
+ * @returns bytes received, negative value mean error code
+ */
+int ReadData(void *ptr_ser, LPVOID rx, DWORD len) {
+    upd_sercom_t *ser = (upd_sercom_t *)ptr_ser;
+    struct pollfd pfd;
+    ssize_t n;
+
+    if (!VALID_SER(ser))
+        return ERROR_PTR;
+
+    n = read(ser->fd, rx, len);
+    if (n < 0 && errno != EAGAIN && errno != EINTR)
+        return -2;
+
+    if (n <= 0) {
+        pfd.fd = ser->fd;
+        pfd.events = POLLIN;
+        if (poll(&pfd, 1, SERIAL_READ_TIMEOUT_MS) <= 0)
+            return 0;
+
+        n = read(ser->fd, rx, len);
+        if (n < 0)
+            return errno == EAGAIN || errno == EINTR ? 0 : -2;
+    }
+
+    return (int)n;
+}
+
+/**
+ * Arms the response destination, the tty has its own buffer
+ *
+ * @param HANDLE fd   The handle to the serial port
+ * @returns negative value, not supported
+ */
+int ArmReceive(void *ptr_ser, u8 *rx, DWORD len) {
+    return -1;
+}
+
+/**
+ * Waits the transfer, ReadData() polls the tty itself
+ *
+ * @param HANDLE fd   The handle to the serial port
+ * @returns negative value, not supported
+ */
+int WaitData(void *ptr_ser, int ms) {
+    return -1;
+}
+
+/**
+ * Gets and clears the line errors by the error counters of the tty driver(TIOCGICOUNT),
+ * the adapters without the counters report none
+ *
+ * @param HANDLE fd   The handle to the serial port
+ * @param int *offset -1, the position is unknown
+ * @returns SER_ERR_xxx, 0 if none, negative value mean error code
+ */
+int GetPortError(void *ptr_ser, int *offset) {
+    upd_sercom_t *ser = (upd_sercom_t *)ptr_ser;
+    struct serial_icounter_struct ic;
+    int err = 0;
+
+    if (!VALID_SER(ser))
+        return ERROR_PTR;
+
+    if (offset)
+        *offset = -1;
+
+    if (ioctl(ser->fd, TIOCGICOUNT, &ic))
+        return 0;
+
+    if (ic.parity != ser->icount.parity)
+        err |= SER_ERR_PARITY;
+    if (ic.frame != ser->icount.frame)
+        err |= SER_ERR_FRAME;
+    if (ic.overrun != ser->icount.overrun || ic.buf_overrun != ser->icount.buf_overrun)
+        err |= SER_ERR_OVERRUN;
+    ser->icount = ic;
+
+    return err;
+}
+
+/**
+ * Gets the file descriptor of the port, the event loop waits on it
+ *
+ * @param HANDLE fd   The handle to the serial port
+ * @returns fd, negative value mean error code
+ */
+int GetPortFd(void *ptr_ser) {
+    upd_sercom_t *ser = (upd_sercom_t *)ptr_ser;
+
+    if (!VALID_SER(ser))
+        return ERROR_PTR;
+
+    return ser->fd;
+}
+
+/**
+ * Closes a serial port handle.
+ *
+ * @param HANDLE fd    The pointer to the handle of the serial port.
+ * @no return  */
+void ClosePort(void *ptr_ser) {
+    upd_sercom_t *ser = (upd_sercom_t *)ptr_ser;
+
+    if (!VALID_SER(ser))
+        return;
+
+    flock(ser->fd, LOCK_UN);
+    close(ser->fd);
+    ser->mgwd = 0;
+}
+
+#endif
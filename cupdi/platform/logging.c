@@ -1,66 +1,70 @@
 #ifdef CUPDI
 
-#include <stdlib.h>  
-#include <stdio.h>  
+#include <stdlib.h>
+#include <stdio.h>
 #include <stdarg.h>
 
+#include "platform.h"
 #include "logging.h"
-#if 0
-verbose_t g_verbose_level = DEFAULT_DEBUG;
 
-int _vscprintf (const char * format, va_list pargs)
-{ 
-    int retval; 
-    va_list argcopy;
-    va_copy(argcopy, pargs); 
-    retval = vsnprintf(NULL, 0, format, argcopy); 
-    va_end(argcopy); 
-    return retval;
-}
+/* Runtime verbose level, only the sites compiled in by UPDI_LOG_LEVEL could be enabled */
+#if UPDI_LOG_LEVEL >= 0
+verbose_t g_verbose_level = UPDI_LOG_LEVEL;
+#else
+verbose_t g_verbose_level = DEFAULT_DEBUG;
+#endif
 
 void set_verbose_level(verbose_t level)
 {
     g_verbose_level = level;
 }
 
-void _logv(verbose_t level, char *format, const unsigned char *data, int len, const unsigned char * dformat, int rowsize, va_list args)
+verbose_t get_verbose_level(void)
 {
-    int     size;
-    char    *buffer;
+    return g_verbose_level;
+}
 
-    if (level > g_verbose_level)
-        return;
+#if UPDI_LOG_LEVEL >= 0
 
+/*
+    Print data in rows
+    @data: data buffer
+    @len: data len
+    @dformat: printf format of each byte
+    @rowsize: bytes each row, the offset is printed in front of a row when data is longer than a row
+*/
+static void _logdump(const unsigned char *data, int len, const unsigned char * dformat, int rowsize)
+{
     if (rowsize <= 0)
         rowsize = DEFAULT_ROWDATA_SIZE;
 
-    if (format && format[0]) {
-        size = _vscprintf(format, args) // _vscprintf doesn't count  
-            + 1; // terminating '\0'  
-
-        buffer = (char*)malloc(size * sizeof(char));
-
-        vsnprintf(buffer, size, format, args); // C4996  
-                                               // Note: vsprintf is deprecated; consider using vsprintf_s instead  
-        puts(buffer);
+    for (int i = 0; i < len; i++) {
+        if (len > rowsize) {
+            if (!(i % rowsize)) {
+                if (i)
+                    puts("");
+                printf("%04x:\t", i);
+            }
+        }
 
-        free(buffer);
+        printf((const char *)dformat, data[i]);
     }
+    puts("");
+}
 
-    if (data && len) {
-        for (int i = 0; i < len; i++) {
-            if (len > rowsize) {
-                if (!(i % rowsize)) {
-                    if (i)
-                        puts("");
-                    printf("%04x:\t", i);
-                }
-            }
+void _logv(verbose_t level, char *format, const unsigned char *data, int len, const unsigned char * dformat, int rowsize, va_list args)
+{
+    if (level > g_verbose_level)
+        return;
 
-            printf(dformat, data[i]);
-        }
+    // Formatted directly to stdout, no temporary buffer
+    if (format && format[0]) {
+        vprintf(format, args);
         puts("");
     }
+
+    if (data && len)
+        _logdump(data, len, dformat, rowsize);
 }
 
 void _loginfo(char *format, const unsigned char *data, int len, const unsigned char * dformat, ...)
@@ -81,7 +85,225 @@ void _loginfo_i(char* format, ...)
     va_end(args);
 }
 
-void DBG(verbose_t level, char *format, const unsigned char *data, int len, const unsigned char * dformat, ...)
+#ifdef UPDI_LOG_DEFERRED
+
+#if LOG_RING_SIZE & (LOG_RING_SIZE - 1)
+#error "LOG_RING_SIZE must be power of 2"
+#endif
+
+/*
+    Binary log record
+    @format: format string, a constant so the pointer is the format id
+    @dformat: byte format of the data, NULL no data
+    @time_us: get_time_us() when pushed
+    @level: verbose_t
+    @nargs: words in args
+    @len: bytes in data
+    @truncated: data bytes not kept
+*/
+typedef struct _log_record {
+    const char *format;
+    const unsigned char *dformat;
+    unsigned int time_us;
+    u8 level;
+    u8 nargs;
+    u8 len;
+    u16 truncated;
+    uintptr_t args[LOG_MAX_ARGS];
+    u8 data[LOG_RECORD_DATA];
+}log_record_t;
+
+/*
+    Ring of the records, the logging sites and log_drain() run in the same session thread,
+    a full ring overwrites its oldest record. The indexes are free running
+    @head: next record to be pushed
+    @tail: next record to be drained
+    @dropped: records overwritten before drained, free running
+    @reported: dropped count already reported by log_drain()
+*/
+typedef struct _log_ring {
+    log_record_t record[LOG_RING_SIZE];
+    unsigned int head;
+    unsigned int tail;
+    unsigned int dropped;
+    unsigned int reported;
+}log_ring_t;
+
+/* Each session thread logs to and drains its own ring */
+static UPDI_THREAD_LOCAL log_ring_t log_ring;
+
+/*
+    Push a record, called by DBG()/DBG_INFO(), the cost is copying the words and no formatting
+    @level: verbose_t
+    @format: constant format string
+    @data: data buffer of DBG(), NULL no data
+    @len: data len
+    @dformat: byte format of the data
+    @nargs: words in args
+    @args: format arguments in words
+*/
+void _log_push(verbose_t level, const char *format, const unsigned char *data, int len, const unsigned char *dformat, int nargs, const uintptr_t *args)
+{
+    log_ring_t *ring = &log_ring;
+    log_record_t *rec;
+    unsigned int head = ring->head;
+    int i;
+
+    if (level > g_verbose_level)
+        return;
+
+    // Full: the oldest record is lost, the latest ones are kept for the failure being logged
+    if (head - ring->tail >= LOG_RING_SIZE) {
+        ring->tail++;
+        ring->dropped++;
+    }
+
+    rec = &ring->record[head & (LOG_RING_SIZE - 1)];
+    rec->format = format;
+    rec->time_us = get_time_us();
+    rec->level = level;
+    rec->nargs = nargs;
+    for (i = 0; i < nargs; i++)
+        rec->args[i] = args[i];
+
+    if (data && len > 0) {
+        rec->dformat = dformat;
+        rec->len = min(len, LOG_RECORD_DATA);
+        rec->truncated = len - rec->len;
+        memcpy(rec->data, data, rec->len);
+    }
+    else {
+        rec->dformat = NULL;
+        rec->len = 0;
+        rec->truncated = 0;
+    }
+
+    ring->head = head + 1;
+}
+
+/*
+    Print the format with the argument words, each conversion gets its word converted back to the type
+    it expects(int, long, long long, size_t or pointer), the word of a negative int is sign extended
+    when stored so the conversion back keeps the value
+    @format: format string
+    @args: argument words
+    @nargs: words in args, a conversion without word or not supported('*', floating point) is printed as is
+*/
+static void _log_format(const char *format, const uintptr_t *args, int nargs)
+{
+    char spec[16];
+    const char *p = format, *s;
+    int i = 0, n, lng, size;
+
+    while (*p) {
+        if (*p != '%') {
+            putchar(*p++);
+            continue;
+        }
+
+        s = p++;
+        if (*p == '%') {
+            putchar(*p++);
+            continue;
+        }
+
+        while (*p && strchr("-+ #0123456789.", *p))
+            p++;
+
+        lng = size = 0;
+        while (*p == 'h' || *p == 'l' || *p == 'z') {
+            if (*p == 'l')
+                lng++;
+            else if (*p == 'z')
+                size = 1;
+            p++;
+        }
+
+        if (!*p)
+            break;
+
+        n = (int)(++p - s);
+        if (i >= nargs || n >= (int)sizeof(spec) || !strchr("diuxXocsp", p[-1])) {
+            fwrite(s, 1, n, stdout);
+            continue;
+        }
+
+        memcpy(spec, s, n);
+        spec[n] = '\0';
+
+        switch (p[-1]) {
+        case 'd':
+        case 'i':
+            if (size)
+                printf(spec, (size_t)args[i]);
+            else if (lng >= 2)
+                printf(spec, (long long)(intptr_t)args[i]);
+            else if (lng)
+                printf(spec, (long)(intptr_t)args[i]);
+            else
+                printf(spec, (int)(intptr_t)args[i]);
+            break;
+        case 's':
+            printf(spec, (const char *)args[i]);
+            break;
+        case 'p':
+            printf(spec, (void *)args[i]);
+            break;
+        default:
+            if (size)
+                printf(spec, (size_t)args[i]);
+            else if (lng >= 2)
+                printf(spec, (unsigned long long)args[i]);
+            else if (lng)
+                printf(spec, (unsigned long)args[i]);
+            else
+                printf(spec, (unsigned int)args[i]);
+            break;
+        }
+        i++;
+    }
+}
+
+/*
+    Format and print the pushed records, called at idle time and in the PHY waits
+    @max: max records printed, 0 all of them
+    @returns records printed
+*/
+int log_drain(int max)
+{
+    log_ring_t *ring = &log_ring;
+    log_record_t *rec;
+    int count = 0;
+
+    if (ring->dropped != ring->reported) {
+        printf("<LOG> %u records dropped\n", ring->dropped - ring->reported);
+        ring->reported = ring->dropped;
+    }
+
+    while (ring->tail != ring->head && (!max || count < max)) {
+        rec = &ring->record[ring->tail & (LOG_RING_SIZE - 1)];
+
+        printf("[%10u] ", rec->time_us);
+        if (rec->format && rec->format[0])
+            _log_format(rec->format, rec->args, rec->nargs);
+        puts("");
+
+        if (rec->dformat && rec->len) {
+            _logdump(rec->data, rec->len, rec->dformat, DEFAULT_ROWDATA_SIZE);
+            if (rec->truncated)
+                printf("(%d bytes more)\n", rec->truncated);
+        }
+
+        ring->tail++;
+        count++;
+    }
+
+    return count;
+}
+
+#else
+
+void _dbg(verbose_t level, char *format, const unsigned char *data, int len, const unsigned char * dformat, ...)
 {
     va_list args;
 
@@ -90,7 +312,7 @@ void DBG(verbose_t level, char *format, const unsigned char *data, int len, cons
     va_end(args);
 }
 
-void DBG_INFO(verbose_t level, char* format, ...)
+void _dbg_info(verbose_t level, char* format, ...)
 {
     va_list args;
 
@@ -98,6 +320,18 @@ void DBG_INFO(verbose_t level, char* format, ...)
     _logv(level, format, NULL, 0, NULL, DEFAULT_ROWDATA_SIZE, args);
     va_end(args);
 }
+
+/*
+    Nothing pushed in the synchronous logging
+    @max: unused
+    @returns 0
+*/
+int log_drain(int max)
+{
+    return 0;
+}
+
+#endif
 #endif
 
-#endif
\ No newline at end of file
+#endif
@@ -3,29 +3,92 @@
 
 #ifdef CUPDI
 
-#if 0
 #define DEFAULT_ROWDATA_SIZE 16
 
-void _loginfo(char *format, const unsigned char *data, int len, const unsigned char *dformat, ...);
-void _loginfo_i(char* format, ...);
-
 typedef enum {
     DEFAULT_DEBUG,
     UPDI_DEBUG,
-    NVM_DEBUG, 
-    APP_DEBUG, 
-    LINK_DEBUG, 
-    PHY_DEBUG, 
+    NVM_DEBUG,
+    APP_DEBUG,
+    LINK_DEBUG,
+    PHY_DEBUG,
     SER_DEBUG
 } verbose_t;
 
+/*
+    Highest verbose_t level compiled in, the DBG()/DBG_INFO() sites above it compile to nothing,
+    -1 removes all the logging(the default, as the release build)
+*/
+#ifndef UPDI_LOG_LEVEL
+#define UPDI_LOG_LEVEL -1
+#endif
+
+/*
+    UPDI_LOG_DEFERRED: the sites push a binary record(format pointer, timestamp, arguments) into a ring
+    instead of formatting, the ring is formatted and printed by log_drain() in the PHY waits and at idle time,
+    a full ring overwrites its oldest records and the count lost is printed.
+    The arguments are stored as words and converted back to the type of their conversion when printed,
+    so they must be integers or pointers(no floating point), and the strings of %s must be still valid when drained.
+*/
+#ifndef LOG_RING_SIZE
+#define LOG_RING_SIZE 64    //records, power of 2, the records pushed between two PHY waits
+#endif
+#define LOG_MAX_ARGS 8
+#define LOG_RECORD_DATA 16  //bytes of DBG() data kept in a record, the rest is truncated
+
 void set_verbose_level(verbose_t level);
-void DBG(verbose_t level, char *format, const unsigned char *data, int len, const unsigned char * dformat, ...);
-void DBG_INFO(verbose_t level, char* format, ...);
+verbose_t get_verbose_level(void);
+
+#if UPDI_LOG_LEVEL >= 0
+
+void _loginfo(char *format, const unsigned char *data, int len, const unsigned char *dformat, ...);
+void _loginfo_i(char* format, ...);
+
+#ifdef UPDI_LOG_DEFERRED
+
+/* Count(max LOG_MAX_ARGS) and word list of the macro arguments */
+#define _LOG_NARG(_args...) _LOG_NARG_(0, ##_args, 8, 7, 6, 5, 4, 3, 2, 1, 0)
+#define _LOG_NARG_(_0, _1, _2, _3, _4, _5, _6, _7, _8, _n, ...) _n
+#define _LOG_CAT(_a, _b) _LOG_CAT_(_a, _b)
+#define _LOG_CAT_(_a, _b) _a##_b
+#define _LOG_W0()
+#define _LOG_W1(_a) (uintptr_t)(_a)
+#define _LOG_W2(_a, _args...) (uintptr_t)(_a), _LOG_W1(_args)
+#define _LOG_W3(_a, _args...) (uintptr_t)(_a), _LOG_W2(_args)
+#define _LOG_W4(_a, _args...) (uintptr_t)(_a), _LOG_W3(_args)
+#define _LOG_W5(_a, _args...) (uintptr_t)(_a), _LOG_W4(_args)
+#define _LOG_W6(_a, _args...) (uintptr_t)(_a), _LOG_W5(_args)
+#define _LOG_W7(_a, _args...) (uintptr_t)(_a), _LOG_W6(_args)
+#define _LOG_W8(_a, _args...) (uintptr_t)(_a), _LOG_W7(_args)
+/* The leading 0 keeps the initializer valid without arguments */
+#define _LOG_WORDS(_args...) ((const uintptr_t []){ 0, _LOG_CAT(_LOG_W, _LOG_NARG(_args))(_args) } + 1)
+
+void _log_push(verbose_t level, const char *format, const unsigned char *data, int len, const unsigned char *dformat, int nargs, const uintptr_t *args);
+
+#define DBG(level, format, data, len, dformat, args...) \
+    do { if ((level) <= UPDI_LOG_LEVEL) _log_push((level), (format), (data), (len), (dformat), _LOG_NARG(args), _LOG_WORDS(args)); } while (0)
+#define DBG_INFO(level, format, args...) \
+    do { if ((level) <= UPDI_LOG_LEVEL) _log_push((level), (format), NULL, 0, NULL, _LOG_NARG(args), _LOG_WORDS(args)); } while (0)
+
+#else
+
+void _dbg(verbose_t level, char *format, const unsigned char *data, int len, const unsigned char * dformat, ...);
+void _dbg_info(verbose_t level, char* format, ...);
+
+#define DBG(level, format, data, len, dformat, args...) \
+    do { if ((level) <= UPDI_LOG_LEVEL) _dbg((level), (format), (data), (len), (dformat), ##args); } while (0)
+#define DBG_INFO(level, format, args...) \
+    do { if ((level) <= UPDI_LOG_LEVEL) _dbg_info((level), (format), ##args); } while (0)
+
+#endif
+
+int log_drain(int max);
+
 #else
-#define DBG(level, format, data, len, dformat...) 
-#define DBG_INFO(level, format...) 
+#define DBG(level, format, data, len, dformat...)
+#define DBG_INFO(level, format...)
+#define log_drain(max) ((void)(max))
 #endif
 #endif
 
-#endif
\ No newline at end of file
+#endif
@@ -71,6 +71,12 @@ typedef void                *LPCTSTR;
 
 #define PACK( __Declaration__ ) __Declaration__ __attribute__((__packed__))
 
+/* Storage class of the session object pools, defined as __thread by hosts running sessions in several threads
+   so each thread has its own isolated pools */
+#ifndef UPDI_THREAD_LOCAL
+#define UPDI_THREAD_LOCAL
+#endif
+
 #endif
 
 #endif
\ No newline at end of file
@@ -10,7 +10,7 @@
  * This file contains the function implementations for serial port
  * communication.
  */
-#ifdef CUPDI
+#if defined(CUPDI) && !defined(UPDI_SERCOM_LEAN)
 
 #include "serial.h"
 #include "error.h"
@@ -36,18 +36,62 @@
 /////////////////////////   The end of modification      //////////////////////////////////////////////
 /////////////////////////////////////////////////////////////////////////////////////////////////////*/
 
+/*
+    Serial port table, each port is one SERCOM USART instance generated by Atmel Start,
+    add the USART_x descriptor of a new SERCOM here for one more UPDI channel
+    @name: port name passed to OpenPort()
+    @usart: USART async descriptor
+    @freq: SERCOM core clock frequency
+*/
+typedef struct _ser_port {
+    const char *name;
+    struct usart_async_descriptor *usart;
+    unsigned int freq;
+}ser_port_t;
+
+static const ser_port_t ser_ports[] = {
+    { "USART_0", &USART_0, CONF_GCLK_SERCOM4_CORE_FREQUENCY },
+};
+
+/*
+    Port object
+    @rx_cnt: bytes received since SendData(), updated by the callback
+    @err: SER_ERR_xxx latched by the error callback
+    @err_pos: rx_cnt when the first error latched
+*/
 typedef struct _upd_sercom {
 #define UPD_SERCOM_MAGIC_WORD 0xA5A5//'user'
     unsigned int mgwd;
     struct io_descriptor *io;
+    const ser_port_t *port;
+    volatile int rx_cnt;
+    volatile u8 err;
+    volatile int err_pos;
 }upd_sercom_t;
 
 #define VALID_SER(_ser) ((_ser) && (((upd_sercom_t *)(_ser))->mgwd == UPD_SERCOM_MAGIC_WORD)/* && ((upd_sercom_t *)(_ser))->io*/)
-#define USART_BAUD_RATE(baud)                                                                                  \
-65536 - ((65536 * 16.0f * baud) / CONF_GCLK_SERCOM4_CORE_FREQUENCY)
+#define USART(_ser) ((_ser)->port->usart)
+#define USART_BAUD_RATE(baud, freq)                                                                                  \
+65536 - ((65536 * 16.0f * baud) / (freq))
+
+upd_sercom_t sercom[ARRAY_SIZE(ser_ports)];
 
-struct io_descriptor *iodes;
-upd_sercom_t sercom;
+/*
+    Port object of the USART descriptor
+    @io_descr: USART async descriptor
+    @returns port object, NULL if not opened
+*/
+static upd_sercom_t *ser_of_usart(const struct usart_async_descriptor *const io_descr)
+{
+    int i;
+
+    for (i = 0; i < ARRAY_SIZE(ser_ports); i++) {
+        if (ser_ports[i].usart == io_descr)
+            return VALID_SER(&sercom[i]) ? &sercom[i] : NULL;
+    }
+
+    return NULL;
+}
 
 static void tx_cb_USART_0(const struct usart_async_descriptor *const io_descr)
 {
@@ -56,11 +100,39 @@ static void tx_cb_USART_0(const struct usart_async_descriptor *const io_descr)
 
 static void rx_cb_USART_0(const struct usart_async_descriptor *const io_descr)
 {
-	/* Transfer completed */
+    upd_sercom_t *ser = ser_of_usart(io_descr);
+
+    /* One byte into the ring buffer */
+    if (ser)
+        ser->rx_cnt++;
 }
+
 static void err_cb_USART_0(const struct usart_async_descriptor *const io_descr)
 {
-	/* Transfer completed */
+    upd_sercom_t *ser = ser_of_usart(io_descr);
+    u32 status;
+    u8 err = 0;
+
+    if (!ser)
+        return;
+
+    /*
+        The HPL handler usually clears STATUS with the byte before the ERROR interrupt comes,
+        so the kind is reported if it's still there
+    */
+    status = hri_sercomusart_read_STATUS_reg(io_descr->device.hw);
+    if (status & SERCOM_USART_STATUS_PERR)
+        err |= SER_ERR_PARITY;
+    if (status & SERCOM_USART_STATUS_FERR)
+        err |= SER_ERR_FRAME;
+    if (status & SERCOM_USART_STATUS_BUFOVF)
+        err |= SER_ERR_OVERRUN;
+    if (!err)
+        err = SER_ERR_LINE;
+
+    if (!ser->err)
+        ser->err_pos = ser->rx_cnt;
+    ser->err |= err;
 }
 /**
  * Initialises a serial port handle for reading and writing
@@ -75,25 +147,63 @@ static void err_cb_USART_0(const struct usart_async_descriptor *const io_descr)
  */
 
 HANDLE OpenPort(const void *port, const SER_PORT_STATE_T *st) {
-    upd_sercom_t* ser = &sercom;
-//    int fd = 0;
-	
-	usart_async_register_callback(&USART_0, USART_ASYNC_TXC_CB, tx_cb_USART_0);
-	usart_async_register_callback(&USART_0, USART_ASYNC_RXC_CB, rx_cb_USART_0);
-	usart_async_register_callback(&USART_0, USART_ASYNC_ERROR_CB, err_cb_USART_0);
-	usart_async_get_io_descriptor(&USART_0, &iodes);
-	usart_async_enable(&USART_0);
+    upd_sercom_t* ser = NULL;
+    struct io_descriptor *iodes;
+    int i;
+
+    /* NULL port name is the first port */
+    for (i = 0; i < ARRAY_SIZE(ser_ports); i++) {
+        if (!port || !strcmp((const char *)port, ser_ports[i].name)) {
+            ser = &sercom[i];
+            break;
+        }
+    }
+
+    if (!ser || VALID_SER(ser))
+        return NULL;
+
+    ser->port = &ser_ports[i];
+	usart_async_register_callback(USART(ser), USART_ASYNC_TXC_CB, tx_cb_USART_0);
+	usart_async_register_callback(USART(ser), USART_ASYNC_RXC_CB, rx_cb_USART_0);
+	usart_async_register_callback(USART(ser), USART_ASYNC_ERROR_CB, err_cb_USART_0);
+	usart_async_get_io_descriptor(USART(ser), &iodes);
+	usart_async_enable(USART(ser));
 
+    ser->rx_cnt = 0;
+    ser->err = 0;
     ser->mgwd = UPD_SERCOM_MAGIC_WORD;
     ser->io = iodes;
 
     if (SetPortState(ser, st) != 0) {
         ClosePort(ser);
+        return NULL;
     }
 
     return (HANDLE)ser;
 }
 
+/**
+* Get the count of serial ports
+*
+* @returns port count
+*/
+int GetPortCount(void) {
+    return ARRAY_SIZE(ser_ports);
+}
+
+/**
+* Get the name of serial port
+*
+* @param int index  The port index, 0 ~ GetPortCount() - 1
+* @returns port name, NULL if index overflow
+*/
+const char *GetPortName(int index) {
+    if (index < 0 || index >= ARRAY_SIZE(ser_ports))
+        return NULL;
+
+    return ser_ports[index].name;
+}
+
 /**
 * Set a serial port state
 *
@@ -105,14 +215,13 @@ HANDLE OpenPort(const void *port, const SER_PORT_STATE_T *st) {
 * @returns 0 - success, other value failed code
 */
 int SetPortState(void *ptr_ser, const SER_PORT_STATE_T *st) {
-    //upd_sercom_t *ser = (upd_sercom_t *)ptr_ser;
-    //struct io_descriptor * io = ser->io;
+    upd_sercom_t *ser = (upd_sercom_t *)ptr_ser;
 
-    //if (!VALID_SER(ser))
-    //    return ERROR_PTR;
+    if (!VALID_SER(ser))
+        return ERROR_PTR;
 			
 	// Set baund rate
-	usart_async_set_baud_rate(&USART_0, USART_BAUD_RATE(st->baudRate));
+	usart_async_set_baud_rate(USART(ser), USART_BAUD_RATE(st->baudRate, ser->port->freq));
 
     /* Set databits */
 	enum usart_character_size charSize;
@@ -133,7 +242,7 @@ int SetPortState(void *ptr_ser, const SER_PORT_STATE_T *st) {
             charSize = USART_CHARACTER_SIZE_9BITS;
             return -6;
     }
-	usart_async_set_character_size(&USART_0, charSize);
+	usart_async_set_character_size(USART(ser), charSize);
 
     /* Set stopbits */
 	enum usart_stop_bits stopBits;
@@ -148,7 +257,7 @@ int SetPortState(void *ptr_ser, const SER_PORT_STATE_T *st) {
             stopBits = USART_STOP_BITS_ONE;
             return -7;
     }
-	usart_async_set_stopbits(&USART_0, stopBits);
+	usart_async_set_stopbits(USART(ser), stopBits);
 
     /* Set parity */
 	enum usart_parity parity;
@@ -166,7 +275,7 @@ int SetPortState(void *ptr_ser, const SER_PORT_STATE_T *st) {
             parity = USART_PARITY_NONE;
             return -8;
     }
-	usart_async_set_parity(&USART_0, parity);
+	usart_async_set_parity(USART(ser), parity);
 
     return 0;
 }
@@ -178,7 +287,8 @@ int FlushPort(void *ptr_ser)
     if (!VALID_SER(ser))
         return ERROR_PTR;
 
-    usart_async_flush_rx_buffer(&USART_0);
+    usart_async_flush_rx_buffer(USART(ser));
+    ser->err = 0;
 
     return 0;
 }
@@ -199,6 +309,8 @@ int SendData(void *ptr_ser, const /*LPVOID*/u8 *tx, DWORD len) {
     if (!VALID_SER(ser))
         return ERROR_PTR;
 
+    ser->rx_cnt = 0;
+
     /* Write to the port handle */
 	written = io_write(ser->io, tx, len);
     if (written < 0) {
@@ -220,6 +332,9 @@ int ReadData(void *ptr_ser, LPVOID rx, DWORD len) {
     upd_sercom_t *ser = (upd_sercom_t *)ptr_ser;
     DWORD reading = 0;    
 
+    if (!VALID_SER(ser))
+        return ERROR_PTR;
+
     reading = io_read(ser->io, rx, len);
     if (reading < 0) {
         return -2;
@@ -228,6 +343,60 @@ int ReadData(void *ptr_ser, LPVOID rx, DWORD len) {
     return reading;
 }
 
+/**
+ * Arms the response destination, the async driver receives into its own ring buffer
+ *
+ * @param HANDLE fd   The handle to the serial port
+ * @returns negative value, not supported
+ */
+int ArmReceive(void *ptr_ser, u8 *rx, DWORD len) {
+    return -1;
+}
+
+/**
+ * Waits the transfer, the async driver has no done event
+ *
+ * @param HANDLE fd   The handle to the serial port
+ * @returns negative value, not supported
+ */
+int WaitData(void *ptr_ser, int ms) {
+    return -1;
+}
+
+/**
+ * Gets and clears the line errors latched by the error callback
+ *
+ * @param HANDLE fd   The handle to the serial port
+ * @param int *offset The byte position of the first error since SendData(), about one byte late
+ * @returns SER_ERR_xxx, 0 if none, negative value mean error code
+ */
+int GetPortError(void *ptr_ser, int *offset) {
+    upd_sercom_t *ser = (upd_sercom_t *)ptr_ser;
+    int err;
+
+    if (!VALID_SER(ser))
+        return ERROR_PTR;
+
+    CRITICAL_SECTION_ENTER()
+    err = ser->err;
+    if (offset)
+        *offset = err ? ser->err_pos : -1;
+    ser->err = 0;
+    CRITICAL_SECTION_LEAVE()
+
+    return err;
+}
+
+/**
+ * Gets the file descriptor of the port, the MCU port has none
+ *
+ * @param HANDLE fd   The handle to the serial port
+ * @returns negative value
+ */
+int GetPortFd(void *ptr_ser) {
+    return -1;
+}
+
 /**
  * Closes a serial port handle.
  *
@@ -236,10 +405,11 @@ int ReadData(void *ptr_ser, LPVOID rx, DWORD len) {
 void ClosePort(void *ptr_ser) {
     upd_sercom_t *ser = (upd_sercom_t *)ptr_ser;
 
-    if (!ser)
+    if (!VALID_SER(ser))
         return;
 
-    usart_async_disable(&USART_0);
+    usart_async_disable(USART(ser));
+    ser->mgwd = 0;
 }
 
 #endif
\ No newline at end of file
@@ -30,6 +30,12 @@
 #define TWOSTOPBITS         2
 #endif
 
+/* Line errors latched by the port, see GetPortError() */
+#define SER_ERR_PARITY      0x01
+#define SER_ERR_FRAME       0x02
+#define SER_ERR_OVERRUN     0x04
+#define SER_ERR_LINE        0x08    //error reported without the kind
+
 typedef struct __SER_PORT_STATE{
     DWORD baudRate;
     BYTE byteSize;
@@ -43,6 +49,13 @@ typedef struct __SER_PORT_STATE{
  */
 HANDLE OpenPort(const void *port, const SER_PORT_STATE_T *state);
 
+/**
+* Get the count and names of serial ports which could be opened
+* @implementation serial.c
+*/
+int GetPortCount(void);
+const char *GetPortName(int index);
+
 /**
 * configure a serial port 
 * @implementation serial.c
@@ -67,6 +80,33 @@ int SendData(void *ptr_ser, const /*LPVOID*/u8 *tx, DWORD len);
  */
 int ReadData(void *ptr_ser, LPVOID rx, DWORD len);
 
+/**
+ * Arms the destination of the response following the echo of the next SendData(),
+ * the driver may receive into it directly, NULL disarms. Negative if not supported
+ * @implementation serial.c
+ */
+int ArmReceive(void *ptr_ser, u8 *rx, DWORD len);
+
+/**
+ * Waits until the transfer of SendData() is done(the echo and the armed response received)
+ * or ReadData() has other bytes, up to ms. Negative if not supported, the caller sleeps instead
+ * @implementation serial.c
+ */
+int WaitData(void *ptr_ser, int ms);
+
+/**
+ * Gets and clears the line errors(SER_ERR_xxx) latched since FlushPort() or the last call,
+ * @offset is the byte position of the first one counted from the last SendData()(echo included), -1 if unknown
+ * @implementation serial.c
+ */
+int GetPortError(void *ptr_ser, int *offset);
+
+/**
+ * Gets the file descriptor of the port for poll()/epoll(), negative if no fd
+ * @implementation serial.c
+ */
+int GetPortFd(void *ptr_ser);
+
 /**
  * Closes a serial port handle.
  * @implementation serial.c
@@ -0,0 +1,530 @@
+/**
+ * @filename serial_sercom.c
+ *
+ * Lean SERCOM USART backend of the MCU build, compiled in with UPDI_SERCOM_LEAN(defined by the Debug
+ * configuration of updi_test_V4.cproj) instead of serial.c.
+ * The generic usart_async stack(ring buffer, io descriptor and callbacks) is bypassed, the SERCOM
+ * interrupt handler works on the transfer directly:
+ *  - the sent bytes are fed from the caller buffer by DRE
+ *  - the echo is compared in place against the sent bytes, nothing is stored unless mismatched
+ *  - the response is written straight into the destination armed by ArmReceive()
+ *  - the transfer is flagged done when the target count is reached, WaitData() sleeps until then
+ * So it keeps up with the 0.9 - 1.8 Mbaud UPDI clock(8x oversampling above core clock / 16).
+ *
+ * Atmel Start still initializes the clock, the pins and the NVIC of the SERCOM, but its
+ * SERCOMn_Handler() is excluded(hpl_sercom.c) with UPDI_SERCOM_LEAN.
+ *
+ * This file contains the function implementations of serial.h.
+ */
+#if defined(CUPDI) && defined(UPDI_SERCOM_LEAN)
+
+#include "serial.h"
+#include "error.h"
+#include "platform/platform.h"
+#include <string.h>
+#include <hpl_sercom_config.h>
+#include "driver_init.h"
+
+/* Bytes received without an armed destination(the caller reads them later), power of 2 */
+#ifndef SER_RING_SIZE
+#define SER_RING_SIZE 32
+#endif
+
+#if SER_RING_SIZE & (SER_RING_SIZE - 1)
+#error "SER_RING_SIZE must be power of 2"
+#endif
+
+/*
+    Serial port table, each port is one SERCOM in USART mode,
+    add the SERCOM(and its handler below) here for one more UPDI channel
+    @name: port name passed to OpenPort()
+    @hw: SERCOM instance
+    @irq: SERCOM interrupt
+    @freq: SERCOM core clock frequency
+*/
+typedef struct _ser_port {
+    const char *name;
+    void *hw;
+    IRQn_Type irq;
+    unsigned int freq;
+}ser_port_t;
+
+static const ser_port_t ser_ports[] = {
+    { "USART_0", SERCOM4, SERCOM4_IRQn, CONF_GCLK_SERCOM4_CORE_FREQUENCY },
+};
+
+/*
+    Port object, the volatile members are updated by the interrupt handler
+    @tx/tx_len: data being sent(the echo reference too), kept by caller until echoed
+    @tx_cnt: bytes written into DATA
+    @echo_cnt: bytes echoed
+    @echo_rd: echo bytes returned by ReadData()
+    @echo_bad_pos/echo_bad: the first mismatched echo byte, position is 0xFFFF if none
+    @dst/dst_len: armed destination of the response
+    @dst_cnt: bytes received into dst
+    @dst_rd: dst bytes returned by ReadData()
+    @armed: dst armed for the next SendData()
+    @done: echo and response completed
+    @err: SER_ERR_xxx latched since FlushPort()
+    @err_pos: byte position of the first error since SendData()
+    @ring/ring_head/ring_tail: bytes not expected by the transfer
+*/
+typedef struct _upd_sercom {
+#define UPD_SERCOM_MAGIC_WORD 0xA5A5//'user'
+    unsigned int mgwd;
+    const ser_port_t *port;
+
+    const u8 *tx;
+    u16 tx_len;
+    volatile u16 tx_cnt;
+    volatile u16 echo_cnt;
+    u16 echo_rd;
+    volatile u16 echo_bad_pos;
+    volatile u8 echo_bad;
+
+    u8 *dst;
+    u16 dst_len;
+    volatile u16 dst_cnt;
+    u16 dst_rd;
+    bool armed;
+    volatile bool done;
+
+    volatile u8 err;
+    volatile u16 err_pos;
+
+    u8 ring[SER_RING_SIZE];
+    volatile u16 ring_head;
+    u16 ring_tail;
+}upd_sercom_t;
+
+#define VALID_SER(_ser) ((_ser) && (((upd_sercom_t *)(_ser))->mgwd == UPD_SERCOM_MAGIC_WORD))
+#define HW(_ser) ((_ser)->port->hw)
+#define ECHO_BAD_NONE 0xFFFF
+
+static upd_sercom_t sercom[ARRAY_SIZE(ser_ports)];
+
+/*
+    SERCOM interrupt handler, one RXC/DRE each entry
+    @ser: port object
+*/
+static void ser_isr(upd_sercom_t *ser)
+{
+    void *hw = HW(ser);
+    hri_sercomusart_intflag_reg_t flags = hri_sercomusart_read_INTFLAG_reg(hw);
+    hri_sercomusart_status_reg_t status;
+    u16 n;
+    u8 val;
+
+    if (flags & SERCOM_USART_INTFLAG_RXC) {
+        // Latch the error with the byte position, the byte is taken anyway to keep the count
+        status = hri_sercomusart_read_STATUS_reg(hw);
+        if (status & (SERCOM_USART_STATUS_PERR | SERCOM_USART_STATUS_FERR | SERCOM_USART_STATUS_BUFOVF)) {
+            hri_sercomusart_clear_STATUS_reg(hw, SERCOM_USART_STATUS_MASK);
+            if (!ser->err)
+                ser->err_pos = ser->echo_cnt < ser->tx_len ? ser->echo_cnt : ser->tx_len + ser->dst_cnt;
+            ser->err |= ((status & SERCOM_USART_STATUS_PERR) ? SER_ERR_PARITY : 0) |
+                ((status & SERCOM_USART_STATUS_FERR) ? SER_ERR_FRAME : 0) |
+                ((status & SERCOM_USART_STATUS_BUFOVF) ? SER_ERR_OVERRUN : 0);
+        }
+
+        val = (u8)hri_sercomusart_read_DATA_reg(hw);
+
+        n = ser->echo_cnt;
+        if (n < ser->tx_len) {
+            if (val != ser->tx[n] && ser->echo_bad_pos == ECHO_BAD_NONE) {
+                ser->echo_bad = val;
+                ser->echo_bad_pos = n;
+            }
+            ser->echo_cnt = ++n;
+        } else if (ser->dst_cnt < ser->dst_len) {
+            ser->dst[ser->dst_cnt++] = val;
+        } else {
+            ser->ring[ser->ring_head++ & (SER_RING_SIZE - 1)] = val;
+        }
+
+        if (n == ser->tx_len && ser->dst_cnt == ser->dst_len)
+            ser->done = true;
+    }
+
+    if ((flags & SERCOM_USART_INTFLAG_DRE) && ser->tx_cnt < ser->tx_len) {
+        hri_sercomusart_write_DATA_reg(hw, ser->tx[ser->tx_cnt++]);
+        if (ser->tx_cnt == ser->tx_len)
+            hri_sercomusart_clear_INTEN_DRE_bit(hw);
+    }
+}
+
+void SERCOM4_Handler(void)
+{
+    ser_isr(&sercom[0]);
+}
+
+/*
+    Disarm the transfer, the interrupt of the port should be masked
+    @ser: port object
+*/
+static void ser_reset_xfer(upd_sercom_t *ser)
+{
+    ser->tx_len = 0;
+    ser->tx_cnt = 0;
+    ser->echo_cnt = 0;
+    ser->echo_rd = 0;
+    ser->echo_bad_pos = ECHO_BAD_NONE;
+    ser->dst = NULL;
+    ser->dst_len = 0;
+    ser->dst_cnt = 0;
+    ser->dst_rd = 0;
+    ser->armed = false;
+    ser->done = false;
+}
+
+/**
+ * Initialises a serial port handle for reading and writing
+ *
+ * @param char *port  The name of the serial port to open, NULL is the first port.
+ * @param SER_PORT_STATE_T *st The baudrate and the frame format
+ * @returns HANDLE    The pointer to the port object, NULL if failed
+ */
+HANDLE OpenPort(const void *port, const SER_PORT_STATE_T *st) {
+    upd_sercom_t* ser = NULL;
+    int i;
+
+    for (i = 0; i < ARRAY_SIZE(ser_ports); i++) {
+        if (!port || !strcmp((const char *)port, ser_ports[i].name)) {
+            ser = &sercom[i];
+            break;
+        }
+    }
+
+    if (!ser || VALID_SER(ser))
+        return NULL;
+
+    memset(ser, 0, sizeof(*ser));
+    ser->port = &ser_ports[i];
+    ser_reset_xfer(ser);
+    ser->mgwd = UPD_SERCOM_MAGIC_WORD;
+
+    if (SetPortState(ser, st) != 0) {
+        ClosePort(ser);
+        return NULL;
+    }
+
+    hri_sercomusart_clear_INTEN_reg(HW(ser), SERCOM_USART_INTENSET_MASK);
+    hri_sercomusart_set_INTEN_RXC_bit(HW(ser));
+    NVIC_ClearPendingIRQ(ser->port->irq);
+    NVIC_EnableIRQ(ser->port->irq);
+
+    return (HANDLE)ser;
+}
+
+/**
+* Get the count of serial ports
+*
+* @returns port count
+*/
+int GetPortCount(void) {
+    return ARRAY_SIZE(ser_ports);
+}
+
+/**
+* Get the name of serial port
+*
+* @param int index  The port index, 0 ~ GetPortCount() - 1
+* @returns port name, NULL if index overflow
+*/
+const char *GetPortName(int index) {
+    if (index < 0 || index >= ARRAY_SIZE(ser_ports))
+        return NULL;
+
+    return ser_ports[index].name;
+}
+
+/**
+* Set a serial port state, the SERCOM is disabled while the enable-protected registers are written
+*
+* @param char *ser  The port handle.
+* @param SER_PORT_STATE_T *st The baudrate and the frame format
+* @returns 0 - success, other value failed code
+*/
+int SetPortState(void *ptr_ser, const SER_PORT_STATE_T *st) {
+    upd_sercom_t *ser = (upd_sercom_t *)ptr_ser;
+    unsigned int freq, sampr, over;
+    u16 baud;
+    void *hw;
+
+    if (!VALID_SER(ser))
+        return ERROR_PTR;
+
+    hw = HW(ser);
+    freq = ser->port->freq;
+
+    /* 16x oversampling if the core clock allows, else 8x(the UPDI Mbaud range) */
+    if (st->baudRate && st->baudRate * 16 <= freq) {
+        sampr = 0;
+        over = 16;
+    } else if (st->baudRate && st->baudRate * 8 <= freq) {
+        sampr = 2;
+        over = 8;
+    } else {
+        return -5;
+    }
+    // Arithmetic mode: BAUD = 65536 * (1 - over * baud / freq), rounded
+    baud = (u16)(65536 - (((unsigned long long)65536 * over * st->baudRate + freq / 2) / freq));
+
+    if (st->byteSize < 5 || st->byteSize > 8)
+        return -6;
+
+    if (st->stopBits != ONESTOPBIT && st->stopBits != TWOSTOPBITS)
+        return -7;
+
+    if (st->parity != NOPARITY && st->parity != ODDPARITY && st->parity != EVENPARITY)
+        return -8;
+
+    hri_sercomusart_clear_CTRLA_ENABLE_bit(hw);
+
+    CRITICAL_SECTION_ENTER()
+    hri_sercomusart_wait_for_sync(hw, SERCOM_USART_SYNCBUSY_ENABLE);
+    hri_sercomusart_write_CTRLA_SAMPR_bf(hw, sampr);
+    hri_sercomusart_write_BAUD_reg(hw, baud);
+    if (st->parity != NOPARITY)
+        hri_sercomusart_write_CTRLA_FORM_bf(hw, 1);
+    else
+        hri_sercomusart_write_CTRLA_FORM_bf(hw, 0);
+    hri_sercomusart_write_CTRLB_PMODE_bit(hw, st->parity == ODDPARITY);
+    // CHSIZE 5..7 bits is 5..7, 8 bits is 0
+    hri_sercomusart_write_CTRLB_CHSIZE_bf(hw, st->byteSize & 0x7);
+    hri_sercomusart_write_CTRLB_SBMODE_bit(hw, st->stopBits == TWOSTOPBITS);
+    hri_sercomusart_set_CTRLB_reg(hw, SERCOM_USART_CTRLB_TXEN | SERCOM_USART_CTRLB_RXEN);
+    CRITICAL_SECTION_LEAVE()
+
+    hri_sercomusart_set_CTRLA_ENABLE_bit(hw);
+
+    return 0;
+}
+
+/**
+* Clear the serial port, the bytes not taken by the last transfer and the latched errors are dropped
+*
+* @param char *ser  The port handle.
+* @returns 0 - success, other value failed code
+*/
+int FlushPort(void *ptr_ser)
+{
+    upd_sercom_t *ser = (upd_sercom_t *)ptr_ser;
+
+    if (!VALID_SER(ser))
+        return ERROR_PTR;
+
+    NVIC_DisableIRQ(ser->port->irq);
+    ser->ring_tail = ser->ring_head;
+    ser->err = 0;
+    NVIC_EnableIRQ(ser->port->irq);
+
+    return 0;
+}
+
+/**
+ * Arms the destination of the response following the echo of the next SendData(),
+ * the interrupt handler writes into it directly and ReadData() of it copies nothing.
+ *
+ * @param HANDLE fd The handle to the serial port.
+ * @param u8 *rx The response buffer, kept by caller until disarmed, NULL to disarm.
+ * @param DWORD len The response length.
+ *
+ * @returns 0 if successful, negative value mean error code
+ */
+int ArmReceive(void *ptr_ser, u8 *rx, DWORD len) {
+    upd_sercom_t *ser = (upd_sercom_t *)ptr_ser;
+
+    if (!VALID_SER(ser))
+        return ERROR_PTR;
+
+    if (len > 0xFFFF)
+        return -2;
+
+    NVIC_DisableIRQ(ser->port->irq);
+    ser->dst = rx;
+    ser->dst_len = rx ? (u16)len : 0;
+    ser->dst_cnt = 0;
+    ser->dst_rd = 0;
+    ser->armed = !!rx;
+    NVIC_EnableIRQ(ser->port->irq);
+
+    return 0;
+}
+
+/**
+ * Sends data out the serial port, the interrupt handler feeds the bytes from tx.
+ *
+ * @param HANDLE fd The handle to the serial port.
+ * @param LPVOID tx The data to be transmitted, kept by caller until echoed.
+ * @param DWORD len The length of the data.
+ *
+ * @returns 0 if successful, greater than 0 otherwise.
+ */
+int SendData(void *ptr_ser, const /*LPVOID*/u8 *tx, DWORD len) {
+    upd_sercom_t *ser = (upd_sercom_t *)ptr_ser;
+
+    if (!VALID_SER(ser))
+        return ERROR_PTR;
+
+    if (len > 0xFFFF)
+        return -2;
+
+    NVIC_DisableIRQ(ser->port->irq);
+    ser->tx = tx;
+    ser->tx_len = (u16)len;
+    ser->tx_cnt = 0;
+    ser->echo_cnt = 0;
+    ser->echo_rd = 0;
+    ser->echo_bad_pos = ECHO_BAD_NONE;
+    // The destination belongs to this transfer only if armed just before
+    if (!ser->armed) {
+        ser->dst = NULL;
+        ser->dst_len = 0;
+        ser->dst_cnt = 0;
+        ser->dst_rd = 0;
+    }
+    ser->armed = false;
+    ser->done = !len && ser->dst_cnt == ser->dst_len;
+    if (len)
+        hri_sercomusart_set_INTEN_DRE_bit(HW(ser));
+    NVIC_EnableIRQ(ser->port->irq);
+
+    return 0;
+}
+
+/**
+ * Reads data from the serial port without waiting, the echo of SendData() first,
+ * then the response, then the bytes not expected.
+ * The echo was compared by the interrupt handler, so it is rebuilt from the sent data
+ * with the mismatched byte, if any.
+ *
+ * @param HANDLE fd   The handle to the serial port
+ * @param LPVOID rx The data buffer to be received.
+ * @param DWORD len The length of the data.
+ * @returns bytes received, negative value mean error code
+ */
+int ReadData(void *ptr_ser, LPVOID rx, DWORD len) {
+    upd_sercom_t *ser = (upd_sercom_t *)ptr_ser;
+    u8 *buf = (u8 *)rx;
+    u16 n, head, pos;
+
+    if (!VALID_SER(ser))
+        return ERROR_PTR;
+
+    /* Echo */
+    if (ser->echo_rd < ser->tx_len) {
+        n = ser->echo_cnt - ser->echo_rd;
+        if (n > len)
+            n = (u16)len;
+        memcpy(buf, ser->tx + ser->echo_rd, n);
+        pos = ser->echo_bad_pos;
+        if (pos != ECHO_BAD_NONE && pos >= ser->echo_rd && pos < ser->echo_rd + n)
+            buf[pos - ser->echo_rd] = ser->echo_bad;
+        ser->echo_rd += n;
+        return n;
+    }
+
+    /* Response in the armed destination, in place if the caller reads into it */
+    if (ser->dst_rd < ser->dst_len) {
+        n = ser->dst_cnt - ser->dst_rd;
+        if (n > len)
+            n = (u16)len;
+        if (buf != ser->dst + ser->dst_rd)
+            memcpy(buf, ser->dst + ser->dst_rd, n);
+        ser->dst_rd += n;
+        return n;
+    }
+
+    /* The others */
+    head = ser->ring_head;
+    if ((u16)(head - ser->ring_tail) > SER_RING_SIZE)
+        ser->ring_tail = head - SER_RING_SIZE;  // overwritten
+    for (n = 0; n < len && ser->ring_tail != head; n++)
+        buf[n] = ser->ring[ser->ring_tail++ & (SER_RING_SIZE - 1)];
+
+    return n;
+}
+
+/**
+ * Waits until the transfer is done, or the bytes not expected by it are received, or a line error is latched,
+ * the core sleeps between the interrupts(SysTick wakes it each ms)
+ *
+ * @param HANDLE fd   The handle to the serial port
+ * @param int ms The timeout
+ * @returns 1 if done, 0 if timeout, negative value mean error code
+ */
+int WaitData(void *ptr_ser, int ms) {
+    upd_sercom_t *ser = (upd_sercom_t *)ptr_ser;
+    unsigned int start;
+
+    if (!VALID_SER(ser))
+        return ERROR_PTR;
+
+    start = get_time_us();
+    for (;;) {
+        // The done transfer counts until its echo and response are read
+        if ((ser->done && (ser->echo_rd < ser->tx_len || ser->dst_rd < ser->dst_len)) ||
+            ser->ring_head != ser->ring_tail || ser->err)
+            return 1;
+
+        if (get_time_us() - start >= (unsigned int)ms * 1000)
+            return 0;
+
+        __WFI();
+    }
+}
+
+/**
+ * Gets and clears the line errors latched by the interrupt handler
+ *
+ * @param HANDLE fd   The handle to the serial port
+ * @param int *offset The byte position of the first error since SendData()
+ * @returns SER_ERR_xxx, 0 if none, negative value mean error code
+ */
+int GetPortError(void *ptr_ser, int *offset) {
+    upd_sercom_t *ser = (upd_sercom_t *)ptr_ser;
+    int err;
+
+    if (!VALID_SER(ser))
+        return ERROR_PTR;
+
+    NVIC_DisableIRQ(ser->port->irq);
+    err = ser->err;
+    if (offset)
+        *offset = err ? ser->err_pos : -1;
+    ser->err = 0;
+    NVIC_EnableIRQ(ser->port->irq);
+
+    return err;
+}
+
+/**
+ * Gets the file descriptor of the port, the MCU port has none
+ *
+ * @param HANDLE fd   The handle to the serial port
+ * @returns negative value
+ */
+int GetPortFd(void *ptr_ser) {
+    return -1;
+}
+
+/**
+ * Closes a serial port handle.
+ *
+ * @param HANDLE fd    The pointer to the handle of the serial port.
+ * @no return  */
+void ClosePort(void *ptr_ser) {
+    upd_sercom_t *ser = (upd_sercom_t *)ptr_ser;
+
+    if (!VALID_SER(ser))
+        return;
+
+    NVIC_DisableIRQ(ser->port->irq);
+    hri_sercomusart_clear_INTEN_reg(HW(ser), SERCOM_USART_INTENSET_MASK);
+    hri_sercomusart_clear_CTRLA_ENABLE_bit(HW(ser));
+    ser_reset_xfer(ser);
+    ser->mgwd = 0;
+}
+
+#endif
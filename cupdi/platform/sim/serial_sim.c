@@ -0,0 +1,175 @@
+/*
+ * serial_sim.c
+ *
+ * Serial port and delay backend of the host simulator: ports "SIM0" ~ "SIMn" are the wires of updi_sim.c,
+ * time is a virtual clock advanced by msleep() only, so the result doesn't depend on the host speed
+ */
+
+#ifdef CUPDI
+
+#include "platform/platform.h"
+#include "updi_sim.h"
+
+typedef struct _upd_sercom {
+#define UPD_SERCOM_MAGIC_WORD 0xA5A5//'user'
+    unsigned int mgwd;
+    void *sim;
+    SER_PORT_STATE_T st;
+}upd_sercom_t;
+
+#define VALID_SER(_ser) ((_ser) && (((upd_sercom_t *)(_ser))->mgwd == UPD_SERCOM_MAGIC_WORD))
+
+static upd_sercom_t sercom[UPDI_SIM_PORT_NUM];
+static char port_names[UPDI_SIM_PORT_NUM][8];
+static unsigned long long sim_clock;   //ns
+
+/*
+    Get the virtual clock
+    @return time(ns) since started
+*/
+unsigned long long updi_sim_clock_ns(void)
+{
+    return sim_clock;
+}
+
+void msleep(int ms)
+{
+    if (ms > 0)
+        sim_clock += ms * 1000000ULL;
+}
+
+unsigned int get_time_ms(void)
+{
+    return (unsigned int)(sim_clock / 1000000ULL);
+}
+
+unsigned int get_time_us(void)
+{
+    return (unsigned int)(sim_clock / 1000ULL);
+}
+
+HANDLE OpenPort(const void *port, const SER_PORT_STATE_T *st) {
+    upd_sercom_t *ser = NULL;
+    int i;
+
+    /* NULL port name is the first port */
+    for (i = 0; i < ARRAY_SIZE(sercom); i++) {
+        if (!port || !strcmp((const char *)port, GetPortName(i))) {
+            ser = &sercom[i];
+            break;
+        }
+    }
+
+    if (!ser || VALID_SER(ser))
+        return NULL;
+
+    ser->mgwd = UPD_SERCOM_MAGIC_WORD;
+    ser->sim = updi_sim_get(i);
+
+    if (SetPortState(ser, st) != 0) {
+        ClosePort(ser);
+        return NULL;
+    }
+
+    return (HANDLE)ser;
+}
+
+int GetPortCount(void) {
+    return ARRAY_SIZE(sercom);
+}
+
+const char *GetPortName(int index) {
+    if (index < 0 || index >= ARRAY_SIZE(sercom))
+        return NULL;
+
+    if (!port_names[index][0])
+        snprintf(port_names[index], sizeof(port_names[index]), "SIM%d", index);
+
+    return port_names[index];
+}
+
+int SetPortState(void *ptr_ser, const SER_PORT_STATE_T *st) {
+    upd_sercom_t *ser = (upd_sercom_t *)ptr_ser;
+
+    if (!VALID_SER(ser))
+        return ERROR_PTR;
+
+    if (st->byteSize < 5 || st->byteSize > 8)
+        return -6;
+
+    if (st->stopBits != ONESTOPBIT && st->stopBits != TWOSTOPBITS)
+        return -7;
+
+    if (st->parity != NOPARITY && st->parity != ODDPARITY && st->parity != EVENPARITY)
+        return -8;
+
+    memcpy(&ser->st, st, sizeof(ser->st));
+
+    return 0;
+}
+
+int FlushPort(void *ptr_ser)
+{
+    upd_sercom_t *ser = (upd_sercom_t *)ptr_ser;
+
+    if (!VALID_SER(ser))
+        return ERROR_PTR;
+
+    updi_sim_flush(ser->sim, sim_clock);
+
+    return 0;
+}
+
+int SendData(void *ptr_ser, const /*LPVOID*/u8 *tx, DWORD len) {
+    upd_sercom_t *ser = (upd_sercom_t *)ptr_ser;
+
+    if (!VALID_SER(ser))
+        return ERROR_PTR;
+
+    updi_sim_send(ser->sim, sim_clock, &ser->st, tx, len);
+
+    return 0;
+}
+
+int ReadData(void *ptr_ser, LPVOID rx, DWORD len) {
+    upd_sercom_t *ser = (upd_sercom_t *)ptr_ser;
+
+    if (!VALID_SER(ser))
+        return ERROR_PTR;
+
+    return updi_sim_recv(ser->sim, sim_clock, (u8 *)rx, len);
+}
+
+/* The simulated wire keeps the response itself */
+int ArmReceive(void *ptr_ser, u8 *rx, DWORD len) {
+    return -1;
+}
+
+/* The simulated time only passes by msleep() */
+int WaitData(void *ptr_ser, int ms) {
+    return -1;
+}
+
+/* The simulated wire has no line errors */
+int GetPortError(void *ptr_ser, int *offset) {
+    if (offset)
+        *offset = -1;
+
+    return VALID_SER((upd_sercom_t *)ptr_ser) ? 0 : ERROR_PTR;
+}
+
+/* The wire has no fd, the event loop should poll it by time */
+int GetPortFd(void *ptr_ser) {
+    return -1;
+}
+
+void ClosePort(void *ptr_ser) {
+    upd_sercom_t *ser = (upd_sercom_t *)ptr_ser;
+
+    if (!VALID_SER(ser))
+        return;
+
+    ser->mgwd = 0;
+}
+
+#endif
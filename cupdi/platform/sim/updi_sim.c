@@ -0,0 +1,930 @@
+/*
+ * updi_sim.c
+ *
+ * Host side UPDI target simulator: the wire(echo and character timing) of each simulated serial port,
+ * and an AVR target on it(UPDI instruction set, ASI key and lock state, NVMCTRL page buffer and busy timing)
+ */
+
+#ifdef CUPDI
+
+#include "platform/platform.h"
+#include "updi/constants.h"
+#include "device/device.h"
+#include "updi_sim.h"
+
+/* Data space size of the target */
+#define SIM_DATA_SPACE_SIZE 0x10000
+/* Max page size of the NVMCTRL page buffer */
+#define SIM_MAX_PAGE_SIZE 128
+/* Characters on the wire not read by host yet */
+#define SIM_RX_QUEUE_SIZE 1024
+/* Max response of one instruction, LD with 16bit repeat */
+#define SIM_MAX_RESPONSE ((UPDI_MAX_REPEAT_SIZE + 1) * 2)
+/* Below this baud, a 0x00 character holds the line low long enough to be taken as BREAK */
+#define SIM_BREAK_BAUD 1000
+/* Lock bits value of an unlocked part */
+#define SIM_LOCKBITS_UNLOCKED 0xC5
+/* Signature row is read only */
+#define SIM_SIGROW_SIZE 0x40
+/* CTRLA guard time value field */
+#define SIM_CTRLA_GTVAL_MASK 0x07
+
+/* Instruction decoder state */
+enum { SIM_IDLE, SIM_OPCODE, SIM_ADDRESS, SIM_DATA, SIM_PTR, SIM_CS_DATA, SIM_REPEAT, SIM_KEY };
+
+/*
+    Character on the wire
+    @val: character value
+    @ready: time(ns) of the stop bit, host could read it after that
+*/
+typedef struct _sim_char {
+    u8 val;
+    unsigned long long ready;
+}sim_char_t;
+
+/*
+    Simulated serial port wire and the target attached
+    @mgwd: magicword
+    @present: a target is attached on the wire
+    @cfg: target configuration
+    @insert_at/insert_cfg: time(ns) a new target is put on the wire after updi_sim_replace(), 0 none
+    @rx/head/count: characters queued to host
+    @line_free: time(ns) the wire is idle
+    @seed: random state of the fault injection
+    @state/opcode/buf/cnt/need: instruction decoder
+    @address: LDS/STS address
+    @ptr: LD/ST pointer
+    @repeat: LD/ST repeat counter
+    @disabled: UPDI is disabled by CTRLB.UPDIDIS until the next BREAK or character
+    @cs: CS/ASI registers
+    @in_reset: ASI reset request is applied
+    @progmode: NVM programming is enabled
+    @locked: lock state latched at reset
+    @pagebuf/pagemask: NVMCTRL page buffer and the bytes written in it
+    @busy_until/busy_bits/error: NVMCTRL status
+    @mem: data space
+*/
+typedef struct _updi_sim {
+#define UPDI_SIM_MAGIC_WORD 0x9696 //'usim'
+    unsigned int mgwd;
+    bool present;
+    updi_sim_config_t cfg;
+    unsigned long long insert_at;
+    updi_sim_config_t insert_cfg;
+
+    sim_char_t rx[SIM_RX_QUEUE_SIZE];
+    int head;
+    int count;
+    unsigned long long line_free;
+    unsigned int seed;
+
+    int state;
+    u8 opcode;
+    u8 buf[16];
+    int cnt;
+    int need;
+    u16 address;
+    u16 ptr;
+    u16 repeat;
+    bool disabled;
+
+    u8 cs[16];
+    bool in_reset;
+    bool progmode;
+    bool locked;
+
+    u8 pagebuf[SIM_MAX_PAGE_SIZE];
+    u8 pagemask[SIM_MAX_PAGE_SIZE];
+    unsigned long long busy_until;
+    u8 busy_bits;
+    bool error;
+
+    u8 mem[SIM_DATA_SPACE_SIZE];
+}updi_sim_t;
+
+#define VALID_SIM(_sim) ((_sim) && ((_sim)->mgwd == UPDI_SIM_MAGIC_WORD))
+#define SIM_REG(_sim, _name) ((_sim)->cfg.dev->mmap->reg._name)
+
+static updi_sim_t sims[UPDI_SIM_PORT_NUM];
+
+/*
+    Get default configuration of a target, timing is about the tinyAVR 1-series datasheet
+    @cfg: output configuration
+    @dev: device memory map and signature
+    @no return
+*/
+void updi_sim_default_config(updi_sim_config_t *cfg, const device_info_t *dev)
+{
+    memset(cfg, 0, sizeof(*cfg));
+    cfg->dev = dev;
+    cfg->sib = (dev && !strncmp(dev->name, "mega", 4)) ? "megaAVR P:0D:1-3" : "tinyAVR P:0D:0-3";
+    if (dev)
+        memcpy(cfg->signature, dev->signature, sizeof(cfg->signature));
+    cfg->turnaround_us = 0;
+    cfg->page_write_us = 2000;
+    cfg->page_erase_us = 2000;
+    cfg->chip_erase_us = 4000;
+    cfg->eeprom_write_us = 4000;
+}
+
+/*
+    Get the wire object of a simulated port
+    @index: port index, 0 ~ UPDI_SIM_PORT_NUM - 1
+    @return sim ptr, NULL if index overflow
+*/
+void *updi_sim_get(int index)
+{
+    updi_sim_t *sim;
+
+    if (index < 0 || index >= ARRAY_SIZE(sims))
+        return NULL;
+
+    sim = &sims[index];
+    if (!VALID_SIM(sim)) {
+        memset(sim, 0, sizeof(*sim));
+        sim->mgwd = UPDI_SIM_MAGIC_WORD;
+    }
+
+    return sim;
+}
+
+/*
+    Get NVM region of a data space address
+    @sim: sim object
+    @address: data space address
+    @info: output of the region information, could be NULL
+    @return NVM_TYPE_T, negative if not in any NVM region
+*/
+static int sim_nvm_region(updi_sim_t *sim, u16 address, nvm_info_t *info)
+{
+    nvm_info_t iblock;
+    int type;
+
+    for (type = 0; type < NUM_NVM_TYPES; type++) {
+        if (dev_get_nvm_info(sim->cfg.dev, type, &iblock))
+            continue;
+
+        if (iblock.nvm_size && address >= iblock.nvm_start && address < iblock.nvm_start + iblock.nvm_size) {
+            if (info)
+                memcpy(info, &iblock, sizeof(iblock));
+            return type;
+        }
+    }
+
+    return -2;
+}
+
+/*
+    Fill a whole NVM region with erased value
+    @sim: sim object
+    @type: NVM_TYPE_T
+    @no return
+*/
+static void sim_nvm_fill(updi_sim_t *sim, int type, u8 val)
+{
+    nvm_info_t info;
+
+    if (dev_get_nvm_info(sim->cfg.dev, type, &info) == 0)
+        memset(sim->mem + info.nvm_start, val, info.nvm_size);
+}
+
+/*
+    Attach a target on a simulated port, the memory is in erased state
+    @index: port index
+    @cfg: target configuration
+    @return 0 successful, other value if failed
+*/
+int updi_sim_attach(int index, const updi_sim_config_t *cfg)
+{
+    updi_sim_t *sim = (updi_sim_t *)updi_sim_get(index);
+    nvm_info_t info;
+    int i;
+
+    if (!sim || !cfg || !cfg->dev)
+        return ERROR_PTR;
+
+    if (dev_get_nvm_info(cfg->dev, NVM_FLASH, &info) || info.nvm_pagesize > SIM_MAX_PAGE_SIZE)
+        return -2;
+
+    sim->present = false;
+    memcpy(&sim->cfg, cfg, sizeof(sim->cfg));
+    memset(sim->mem, 0, sizeof(sim->mem));
+    memset(sim->cs, 0, sizeof(sim->cs));
+
+    sim_nvm_fill(sim, NVM_FLASH, 0xFF);
+    sim_nvm_fill(sim, NVM_EEPROM, 0xFF);
+    sim_nvm_fill(sim, NVM_USERROW, 0xFF);
+    sim_nvm_fill(sim, NVM_FUSES, 0x00);
+    sim_nvm_fill(sim, NVM_LOCKBITS, cfg->locked ? 0x00 : SIM_LOCKBITS_UNLOCKED);
+
+    // Signature row: device id and serial number
+    memcpy(sim->mem + SIM_REG(sim, sigrow_address), cfg->signature, sizeof(cfg->signature));
+    for (i = 3; i < 13; i++)
+        sim->mem[SIM_REG(sim, sigrow_address) + i] = (u8)(index * 16 + i);
+
+    sim->state = SIM_IDLE;
+    sim->seed = 0x2545F491 + index;
+    sim->disabled = true;   //UPDI is enabled by the first BREAK or character
+    sim->in_reset = false;
+    sim->progmode = false;
+    sim->locked = cfg->locked;
+    sim->busy_until = 0;
+    sim->error = false;
+    memset(sim->pagemask, 0, sizeof(sim->pagemask));
+    sim->present = true;
+
+    return 0;
+}
+
+/*
+    Remove the target from a simulated port, the wire keeps echo
+    @index: port index
+    @no return
+*/
+void updi_sim_detach(int index)
+{
+    updi_sim_t *sim = (updi_sim_t *)updi_sim_get(index);
+
+    if (sim)
+        sim->present = false;
+}
+
+/*
+    Take the target off a simulated port, a fresh target is put on the wire later, as the operator of a production line
+    @index: port index
+    @cfg: configuration of the new target
+    @delay_ms: time until the new target is inserted
+    @return 0 successful, other value if failed
+*/
+int updi_sim_replace(int index, const updi_sim_config_t *cfg, unsigned int delay_ms)
+{
+    updi_sim_t *sim = (updi_sim_t *)updi_sim_get(index);
+
+    if (!sim || !cfg || !cfg->dev)
+        return ERROR_PTR;
+
+    sim->present = false;
+    memcpy(&sim->insert_cfg, cfg, sizeof(sim->insert_cfg));
+    sim->insert_at = updi_sim_clock_ns() + delay_ms * 1000000ULL;
+
+    return 0;
+}
+
+/*
+    Insert the new target of updi_sim_replace() when its time is due
+    @sim: sim object
+    @now: current time(ns)
+    @no return
+*/
+static void sim_insert_due(updi_sim_t *sim, unsigned long long now)
+{
+    updi_sim_config_t cfg;
+
+    if (sim->present || !sim->insert_at || now < sim->insert_at)
+        return;
+
+    sim->insert_at = 0;
+    memcpy(&cfg, &sim->insert_cfg, sizeof(cfg));
+    updi_sim_attach((int)(sim - sims), &cfg);
+}
+
+/*
+    Get character time on the line
+    @line: serial port state of host
+    @bits: output of one bit time(ns), could be NULL
+    @return character time(ns)
+*/
+static unsigned long long sim_char_time(const SER_PORT_STATE_T *line, unsigned long long *bits)
+{
+    unsigned long long bit = 1000000000ULL / (line->baudRate ? line->baudRate : 1);
+    int frame = 1 + line->byteSize + (line->parity != NOPARITY ? 1 : 0) + (line->stopBits == TWOSTOPBITS ? 2 : 1);
+
+    if (bits)
+        *bits = bit;
+
+    return bit * frame;
+}
+
+/*
+    Queue a character to host
+    @sim: sim object
+    @val: character
+    @ready: time the character is completed
+    @no return
+*/
+static void sim_queue(updi_sim_t *sim, u8 val, unsigned long long ready)
+{
+    sim_char_t *ch;
+
+    if (sim->count >= SIM_RX_QUEUE_SIZE)
+        return; //overrun, the character is lost
+
+    ch = &sim->rx[(sim->head + sim->count) % SIM_RX_QUEUE_SIZE];
+    ch->val = val;
+    ch->ready = ready;
+    sim->count++;
+}
+
+/*
+    Target transmits response after the guard time
+    @sim: sim object
+    @t: time the last request character is completed
+    @line: serial port state
+    @data: response
+    @len: response length
+    @no return
+*/
+static void sim_respond(updi_sim_t *sim, unsigned long long t, const SER_PORT_STATE_T *line, const u8 *data, int len)
+{
+    unsigned long long bit, frame, start;
+    int gtval, i;
+
+    // Fault injection: the response is lost on the wire, the host must recover
+    if (sim->cfg.drop_every) {
+        sim->seed ^= sim->seed << 13;
+        sim->seed ^= sim->seed >> 17;
+        sim->seed ^= sim->seed << 5;
+        if (sim->seed % sim->cfg.drop_every == 0)
+            return;
+    }
+
+    frame = sim_char_time(line, &bit);
+    gtval = sim->cs[UPDI_CS_CTRLA] & SIM_CTRLA_GTVAL_MASK;
+    start = t + (128 >> min(gtval, 6)) * bit + sim->cfg.turnaround_us * 1000ULL;
+    start = max(start, sim->line_free);
+
+    for (i = 0; i < len; i++) {
+        start += frame;
+        sim_queue(sim, data[i], start);
+        if (TEST_BIT(sim->cs[UPDI_CS_CTRLA], UPDI_CTRLA_IBDLY_BIT))
+            start += 2 * bit;
+    }
+
+    sim->line_free = start;
+}
+
+static void sim_ack(updi_sim_t *sim, unsigned long long t, const SER_PORT_STATE_T *line)
+{
+    const u8 ack[] = { UPDI_PHY_ACK };
+
+    // Response signature disabled
+    if (TEST_BIT(sim->cs[UPDI_CS_CTRLA], UPDI_CTRLA_RSD_BIT))
+        return;
+
+    sim_respond(sim, t, line, ack, sizeof(ack));
+}
+
+/*
+    Release the target from reset, the keys are consumed here
+    @sim: sim object
+    @no return
+*/
+static void sim_reset_release(updi_sim_t *sim)
+{
+    nvm_info_t info;
+    u8 keys = sim->cs[UPDI_ASI_KEY_STATUS];
+
+    sim->in_reset = false;
+
+    if (TEST_BIT(keys, UPDI_ASI_KEY_STATUS_CHIPERASE)) {
+        sim_nvm_fill(sim, NVM_FLASH, 0xFF);
+        sim_nvm_fill(sim, NVM_EEPROM, 0xFF);
+        if (dev_get_nvm_info(sim->cfg.dev, NVM_LOCKBITS, &info) == 0)
+            memset(sim->mem + info.nvm_start, SIM_LOCKBITS_UNLOCKED, info.nvm_size);
+    }
+
+    if (dev_get_nvm_info(sim->cfg.dev, NVM_LOCKBITS, &info) == 0)
+        sim->locked = sim->mem[info.nvm_start] != SIM_LOCKBITS_UNLOCKED;
+
+    sim->progmode = TEST_BIT(keys, UPDI_ASI_KEY_STATUS_NVMPROG) && !sim->locked;
+    sim->cs[UPDI_ASI_KEY_STATUS] = 0;
+
+    sim->busy_until = 0;
+    sim->error = false;
+    memset(sim->pagemask, 0, sizeof(sim->pagemask));
+}
+
+/*
+    Target CS/ASI register read
+*/
+static u8 sim_ldcs(updi_sim_t *sim, u8 address)
+{
+    u8 val;
+
+    switch (address) {
+    case UPDI_CS_STATUSA:
+        val = 1 << UPDI_ASI_STATUSA_REVID;
+        break;
+    case UPDI_ASI_SYS_STATUS:
+        val = 0;
+        if (sim->in_reset)
+            SET_BIT(val, UPDI_ASI_SYS_STATUS_RSTSYS);
+        if (sim->progmode)
+            SET_BIT(val, UPDI_ASI_SYS_STATUS_NVMPROG);
+        if (sim->locked)
+            SET_BIT(val, UPDI_ASI_SYS_STATUS_LOCKSTATUS);
+        break;
+    default:
+        val = sim->cs[address & 0x0F];
+    }
+
+    return val;
+}
+
+/*
+    Target CS/ASI register write
+*/
+static void sim_stcs(updi_sim_t *sim, u8 address, u8 val)
+{
+    switch (address) {
+    case UPDI_CS_CTRLB:
+        sim->cs[address] = val;
+        if (TEST_BIT(val, UPDI_CTRLB_UPDIDIS_BIT)) {
+            // Disabling UPDI releases all keys and NVM programming
+            sim->disabled = true;
+            sim->progmode = false;
+            sim->cs[UPDI_ASI_KEY_STATUS] = 0;
+        }
+        break;
+    case UPDI_ASI_RESET_REQ:
+        if (val == UPDI_RESET_REQ_VALUE) {
+            sim->in_reset = true;
+            sim->progmode = false;
+        }
+        else if (sim->in_reset) {
+            sim_reset_release(sim);
+        }
+        break;
+    case UPDI_ASI_KEY_STATUS:
+        sim->cs[address] &= ~val;
+        break;
+    default:
+        sim->cs[address & 0x0F] = val;
+    }
+}
+
+/*
+    Key received, the key is sent with reversed byte order
+*/
+static void sim_key(updi_sim_t *sim)
+{
+    static const struct {
+        const char *key;
+        int bit;
+    } keys[] = {
+        { UPDI_KEY_NVM, UPDI_ASI_KEY_STATUS_NVMPROG },
+        { UPDI_KEY_CHIPERASE, UPDI_ASI_KEY_STATUS_CHIPERASE },
+        { "NVMUs&te", UPDI_ASI_KEY_STATUS_UROWWRITE },
+    };
+    int i, j;
+
+    for (i = 0; i < ARRAY_SIZE(keys); i++) {
+        if (sim->cnt != strlen(keys[i].key))
+            continue;
+
+        for (j = 0; j < sim->cnt; j++) {
+            if (sim->buf[j] != (u8)keys[i].key[sim->cnt - j - 1])
+                break;
+        }
+
+        if (j == sim->cnt)
+            SET_BIT(sim->cs[UPDI_ASI_KEY_STATUS], keys[i].bit);
+    }
+}
+
+/*
+    Execute a NVMCTRL command, the page is selected by NVMCTRL.ADDR
+    @sim: sim object
+    @t: time of the command written
+    @command: NVMCTRL.CTRLA command
+    @no return
+*/
+static void sim_nvm_command(updi_sim_t *sim, unsigned long long t, u8 command)
+{
+    u16 nvmctrl = SIM_REG(sim, nvmctrl_address);
+    u16 address = L8_TO_LT16(sim->mem[nvmctrl + UPDI_NVMCTRL_ADDRL], sim->mem[nvmctrl + UPDI_NVMCTRL_ADDRH]);
+    unsigned int busy_us = 0;
+    nvm_info_t info;
+    u16 base;
+    int type, i;
+
+    if (!sim->progmode || t < sim->busy_until) {
+        sim->error = true;
+        return;
+    }
+
+    sim->error = false;
+    sim->busy_bits = 0;
+    type = sim_nvm_region(sim, address, &info);
+
+    switch (command) {
+    case UPDI_NVMCTRL_CTRLA_NOP:
+        break;
+    case UPDI_NVMCTRL_CTRLA_WRITE_PAGE:
+    case UPDI_NVMCTRL_CTRLA_ERASE_PAGE:
+    case UPDI_NVMCTRL_CTRLA_ERASE_WRITE_PAGE:
+        if (type != NVM_FLASH && type != NVM_EEPROM && type != NVM_USERROW) {
+            sim->error = true;
+            break;
+        }
+
+        base = address & ~(info.nvm_pagesize - 1);
+        if (command != UPDI_NVMCTRL_CTRLA_WRITE_PAGE) {
+            memset(sim->mem + base, 0xFF, info.nvm_pagesize);
+            busy_us += type == NVM_FLASH ? sim->cfg.page_erase_us : 0;
+        }
+
+        if (command != UPDI_NVMCTRL_CTRLA_ERASE_PAGE) {
+            // Programming only clears bits
+            for (i = 0; i < info.nvm_pagesize; i++) {
+                if (sim->pagemask[i])
+                    sim->mem[base + i] &= sim->pagebuf[i];
+            }
+            busy_us += type == NVM_FLASH ? sim->cfg.page_write_us : 0;
+        }
+
+        if (type == NVM_FLASH) {
+            SET_BIT(sim->busy_bits, UPDI_NVM_STATUS_FLASH_BUSY);
+        }
+        else {
+            busy_us = sim->cfg.eeprom_write_us;
+            SET_BIT(sim->busy_bits, UPDI_NVM_STATUS_EEPROM_BUSY);
+        }
+        memset(sim->pagemask, 0, sizeof(sim->pagemask));
+        break;
+    case UPDI_NVMCTRL_CTRLA_PAGE_BUFFER_CLR:
+        memset(sim->pagebuf, 0xFF, sizeof(sim->pagebuf));
+        memset(sim->pagemask, 0, sizeof(sim->pagemask));
+        break;
+    case UPDI_NVMCTRL_CTRLA_CHIP_ERASE:
+        sim_nvm_fill(sim, NVM_FLASH, 0xFF);
+        sim_nvm_fill(sim, NVM_EEPROM, 0xFF);
+        busy_us = sim->cfg.chip_erase_us;
+        sim->busy_bits = BIT_MASK(UPDI_NVM_STATUS_FLASH_BUSY) | BIT_MASK(UPDI_NVM_STATUS_EEPROM_BUSY);
+        break;
+    case UPDI_NVMCTRL_CTRLA_ERASE_EEPROM:
+        sim_nvm_fill(sim, NVM_EEPROM, 0xFF);
+        busy_us = sim->cfg.eeprom_write_us;
+        SET_BIT(sim->busy_bits, UPDI_NVM_STATUS_EEPROM_BUSY);
+        break;
+    case UPDI_NVMCTRL_CTRLA_WRITE_FUSE:
+        if (type != NVM_FUSES && type != NVM_LOCKBITS) {
+            sim->error = true;
+            break;
+        }
+        sim->mem[address] = sim->mem[nvmctrl + UPDI_NVMCTRL_DATAL];
+        busy_us = sim->cfg.eeprom_write_us;
+        SET_BIT(sim->busy_bits, UPDI_NVM_STATUS_EEPROM_BUSY);
+        break;
+    default:
+        sim->error = true;
+    }
+
+    sim->busy_until = t + busy_us * 1000ULL;
+}
+
+/*
+    Target data space read
+*/
+static u8 sim_mem_read(updi_sim_t *sim, unsigned long long t, u16 address)
+{
+    u16 nvmctrl = SIM_REG(sim, nvmctrl_address);
+    u8 val;
+
+    if (address == nvmctrl + UPDI_NVMCTRL_STATUS) {
+        val = t < sim->busy_until ? sim->busy_bits : 0;
+        if (sim->error)
+            SET_BIT(val, UPDI_NVM_STATUS_WRITE_ERROR);
+        return val;
+    }
+
+    return sim->mem[address];
+}
+
+/*
+    Target data space write, the NVM is written to page buffer
+*/
+static void sim_mem_write(updi_sim_t *sim, unsigned long long t, u16 address, u8 val)
+{
+    u16 nvmctrl = SIM_REG(sim, nvmctrl_address);
+    nvm_info_t info;
+    int type;
+
+    if (address == nvmctrl + UPDI_NVMCTRL_CTRLA) {
+        sim_nvm_command(sim, t, val);
+        return;
+    }
+
+    if (address == nvmctrl + UPDI_NVMCTRL_STATUS)
+        return;
+
+    type = sim_nvm_region(sim, address, &info);
+    switch (type) {
+    case NVM_FLASH:
+    case NVM_EEPROM:
+    case NVM_USERROW:
+        if (!sim->progmode)
+            break;
+
+        sim->pagebuf[address & (info.nvm_pagesize - 1)] = val;
+        sim->pagemask[address & (info.nvm_pagesize - 1)] = 1;
+        sim->mem[nvmctrl + UPDI_NVMCTRL_ADDRL] = address & 0xFF;
+        sim->mem[nvmctrl + UPDI_NVMCTRL_ADDRH] = (address >> 8) & 0xFF;
+        break;
+    case NVM_FUSES:
+    case NVM_LOCKBITS:
+        break;
+    default:
+        if (address >= SIM_REG(sim, sigrow_address) && address < SIM_REG(sim, sigrow_address) + SIM_SIGROW_SIZE)
+            break;
+        sim->mem[address] = val;
+    }
+}
+
+/*
+    Target receives a character, decode the instruction
+    @sim: sim object
+    @t: time of the stop bit
+    @line: serial port state
+    @val: character
+    @no return
+*/
+static void sim_target_rx(updi_sim_t *sim, unsigned long long t, const SER_PORT_STATE_T *line, u8 val)
+{
+    u8 resp[SIM_MAX_RESPONSE];
+    int size, i, n;
+
+    // BREAK resets the UPDI decoder and enables UPDI
+    if (line->baudRate < SIM_BREAK_BAUD) {
+        if (val == UPDI_BREAK) {
+            sim->state = SIM_IDLE;
+            sim->repeat = 0;
+            sim->disabled = false;
+        }
+        return;
+    }
+
+    // A disabled UPDI is enabled by the low level of the start bit, the character itself is lost
+    if (sim->disabled) {
+        sim->disabled = false;
+        sim->state = SIM_IDLE;
+        return;
+    }
+
+    // Frame error out of the target synchronization range
+    if ((sim->cfg.max_baud && line->baudRate > sim->cfg.max_baud) ||
+        line->byteSize != 8 || line->parity != EVENPARITY) {
+        sim->state = SIM_IDLE;
+        return;
+    }
+
+    if (sim->state != SIM_IDLE && sim->state != SIM_OPCODE) {
+        sim->buf[sim->cnt++] = val;
+        if (sim->cnt < sim->need)
+            return;
+    }
+
+    size = (sim->opcode & 0x3) + 1;
+    switch (sim->state) {
+    case SIM_IDLE:
+        if (val == UPDI_PHY_SYNC)
+            sim->state = SIM_OPCODE;
+        return;
+    case SIM_OPCODE:
+        sim->opcode = val;
+        sim->cnt = 0;
+        sim->state = SIM_IDLE;
+        size = (val & 0x3) + 1;
+
+        switch (val & 0xE0) {
+        case UPDI_LDS:
+        case UPDI_STS:
+            if (sim->locked)
+                break;
+            sim->need = ((val >> 2) & 0x3) + 1;
+            sim->state = SIM_ADDRESS;
+            break;
+        case UPDI_LD:
+            if (sim->locked)
+                break;
+            if ((val & 0x0C) == UPDI_PTR_ADDRESS) {
+                resp[0] = sim->ptr & 0xFF;
+                resp[1] = (sim->ptr >> 8) & 0xFF;
+                sim_respond(sim, t, line, resp, size);
+            }
+            else {
+                n = 0;
+                do {
+                    for (i = 0; i < size; i++)
+                        resp[n++] = sim_mem_read(sim, t, sim->ptr + i);
+                    if ((val & 0x0C) == UPDI_PTR_INC)
+                        sim->ptr += size;
+                } while (sim->repeat-- > 0 && n + size <= sizeof(resp));
+                sim->repeat = 0;
+                sim_respond(sim, t, line, resp, n);
+            }
+            break;
+        case UPDI_ST:
+            if (sim->locked)
+                break;
+            sim->need = size;
+            sim->state = (val & 0x0C) == UPDI_PTR_ADDRESS ? SIM_PTR : SIM_DATA;
+            break;
+        case UPDI_LDCS:
+            resp[0] = sim_ldcs(sim, val & 0x0F);
+            sim_respond(sim, t, line, resp, 1);
+            break;
+        case UPDI_STCS:
+            sim->need = 1;
+            sim->state = SIM_CS_DATA;
+            break;
+        case UPDI_REPEAT:
+            sim->need = size;
+            sim->state = SIM_REPEAT;
+            break;
+        case UPDI_KEY:
+            n = 8 << (val & 0x3);
+            if (val & UPDI_KEY_SIB) {
+                memset(resp, ' ', n);
+                memcpy(resp, sim->cfg.sib, min(n, (int)strlen(sim->cfg.sib)));
+                sim_respond(sim, t, line, resp, n);
+            }
+            else if (n <= sizeof(sim->buf)) {
+                sim->need = n;
+                sim->state = SIM_KEY;
+            }
+            break;
+        }
+        return;
+    case SIM_ADDRESS:
+        sim->address = L8_TO_LT16(sim->buf[0], sim->cnt > 1 ? sim->buf[1] : 0);
+        sim->cnt = 0;
+        if ((sim->opcode & 0xE0) == UPDI_LDS) {
+            for (i = 0; i < size; i++)
+                resp[i] = sim_mem_read(sim, t, sim->address + i);
+            sim_respond(sim, t, line, resp, size);
+            sim->state = SIM_IDLE;
+        }
+        else {
+            sim_ack(sim, t, line);
+            sim->need = size;
+            sim->state = SIM_DATA;
+        }
+        return;
+    case SIM_DATA:
+        if ((sim->opcode & 0xE0) == UPDI_STS) {
+            for (i = 0; i < size; i++)
+                sim_mem_write(sim, t, sim->address + i, sim->buf[i]);
+            sim->state = SIM_IDLE;
+        }
+        else {
+            for (i = 0; i < size; i++)
+                sim_mem_write(sim, t, sim->ptr + i, sim->buf[i]);
+            if ((sim->opcode & 0x0C) == UPDI_PTR_INC)
+                sim->ptr += size;
+
+            // Wait for the next data of repeat
+            if (sim->repeat > 0)
+                sim->repeat--;
+            else
+                sim->state = SIM_IDLE;
+        }
+        sim->cnt = 0;
+        sim_ack(sim, t, line);
+        return;
+    case SIM_PTR:
+        sim->ptr = L8_TO_LT16(sim->buf[0], sim->cnt > 1 ? sim->buf[1] : 0);
+        sim_ack(sim, t, line);
+        break;
+    case SIM_CS_DATA:
+        sim_stcs(sim, sim->opcode & 0x0F, sim->buf[0]);
+        break;
+    case SIM_REPEAT:
+        sim->repeat = L8_TO_LT16(sim->buf[0], sim->cnt > 1 ? sim->buf[1] : 0);
+        break;
+    case SIM_KEY:
+        sim_key(sim);
+        break;
+    }
+
+    sim->state = SIM_IDLE;
+}
+
+/*
+    Host sends characters on the wire, each one is echoed and received by the target
+    @sim_ptr: sim object from updi_sim_get()
+    @now: host time(ns) of the transmitting started
+    @line: serial port state of host
+    @data: characters
+    @len: count of characters
+    @no return
+*/
+void updi_sim_send(void *sim_ptr, unsigned long long now, const SER_PORT_STATE_T *line, const u8 *data, int len)
+{
+    updi_sim_t *sim = (updi_sim_t *)sim_ptr;
+    unsigned long long frame, t;
+    int i;
+
+    if (!VALID_SIM(sim))
+        return;
+
+    sim_insert_due(sim, now);
+
+    frame = sim_char_time(line, NULL);
+    t = max(now, sim->line_free);
+
+    for (i = 0; i < len; i++) {
+        t += frame;
+        sim->line_free = t;
+        sim_queue(sim, data[i], t);
+
+        if (sim->present)
+            sim_target_rx(sim, t, line, data[i]);
+
+        // Host waits the line idle if the target is responding
+        t = max(t, sim->line_free);
+    }
+}
+
+/*
+    Host reads the characters completed on the wire
+    @sim_ptr: sim object from updi_sim_get()
+    @now: host time(ns)
+    @data: output buffer
+    @len: max length to read
+    @return count of characters read
+*/
+int updi_sim_recv(void *sim_ptr, unsigned long long now, u8 *data, int len)
+{
+    updi_sim_t *sim = (updi_sim_t *)sim_ptr;
+    sim_char_t *ch;
+    int n = 0;
+
+    if (!VALID_SIM(sim))
+        return ERROR_PTR;
+
+    while (n < len && sim->count) {
+        ch = &sim->rx[sim->head];
+        if (ch->ready > now)
+            break;
+
+        data[n++] = ch->val;
+        sim->head = (sim->head + 1) % SIM_RX_QUEUE_SIZE;
+        sim->count--;
+    }
+
+    return n;
+}
+
+/*
+    Host discards characters received, the ones still on the wire are not affected
+    @sim_ptr: sim object from updi_sim_get()
+    @now: host time(ns)
+    @no return
+*/
+void updi_sim_flush(void *sim_ptr, unsigned long long now)
+{
+    u8 val;
+
+    while (updi_sim_recv(sim_ptr, now, &val, 1) == 1);
+}
+
+/*
+    Read target data space by backdoor, no wire activity
+    @sim_ptr: sim object from updi_sim_get()
+    @address: data space address
+    @data: output buffer
+    @len: length to read
+    @return 0 successful, other value if failed
+*/
+int updi_sim_peek(void *sim_ptr, u16 address, u8 *data, int len)
+{
+    updi_sim_t *sim = (updi_sim_t *)sim_ptr;
+
+    if (!VALID_SIM(sim) || !sim->present)
+        return ERROR_PTR;
+
+    if (address + len > SIM_DATA_SPACE_SIZE)
+        return -2;
+
+    memcpy(data, sim->mem + address, len);
+
+    return 0;
+}
+
+/*
+    Get the lock state latched at the last reset of target
+    @sim_ptr: sim object from updi_sim_get()
+    @return true if locked
+*/
+bool updi_sim_locked(void *sim_ptr)
+{
+    updi_sim_t *sim = (updi_sim_t *)sim_ptr;
+
+    if (!VALID_SIM(sim) || !sim->present)
+        return false;
+
+    return sim->locked;
+}
+
+#endif
@@ -0,0 +1,59 @@
+#ifndef __UPDI_SIM_H
+#define __UPDI_SIM_H
+
+#ifdef CUPDI
+
+#include "platform/platform.h"
+#include "device/device.h"
+#include "updi/constants.h"
+
+/* Simulated serial ports, each one is a wire with optional target attached */
+#ifndef UPDI_SIM_PORT_NUM
+#define UPDI_SIM_PORT_NUM UPDI_MAX_CHANNEL
+#endif
+
+/*
+    Simulated target configuration
+    @dev: device memory map of the target
+    @sib: system information block string, 16 chars
+    @signature: device id in signature row
+    @max_baud: the target is not synchronized above this baud, 0 no limit
+    @turnaround_us: extra delay before each response of target, the USB-UART adapter latency
+    @page_write_us: flash page write time
+    @page_erase_us: flash page erase time
+    @chip_erase_us: chip erase time
+    @eeprom_write_us: eeprom/userrow page erase-write and fuse write time
+    @locked: the part starts with lock bits set
+    @drop_every: one of N target responses is lost at random(a glitch on the wire), 0 never
+*/
+typedef struct _updi_sim_config {
+    const device_info_t *dev;
+    const char *sib;
+    u8 signature[3];
+    unsigned int max_baud;
+    unsigned int turnaround_us;
+    unsigned int page_write_us;
+    unsigned int page_erase_us;
+    unsigned int chip_erase_us;
+    unsigned int eeprom_write_us;
+    bool locked;
+    unsigned int drop_every;
+}updi_sim_config_t;
+
+void updi_sim_default_config(updi_sim_config_t *cfg, const device_info_t *dev);
+int updi_sim_attach(int index, const updi_sim_config_t *cfg);
+void updi_sim_detach(int index);
+int updi_sim_replace(int index, const updi_sim_config_t *cfg, unsigned int delay_ms);
+void *updi_sim_get(int index);
+
+void updi_sim_send(void *sim_ptr, unsigned long long now, const SER_PORT_STATE_T *line, const u8 *data, int len);
+int updi_sim_recv(void *sim_ptr, unsigned long long now, u8 *data, int len);
+void updi_sim_flush(void *sim_ptr, unsigned long long now);
+int updi_sim_peek(void *sim_ptr, u16 address, u8 *data, int len);
+bool updi_sim_locked(void *sim_ptr);
+
+unsigned long long updi_sim_clock_ns(void);
+
+#endif
+
+#endif
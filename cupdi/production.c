@@ -0,0 +1,212 @@
+/*
+ * production.c
+ *
+ * Continuous production mode: wait a target inserted, program it, report the result and wait it removed
+ */
+
+#ifdef CUPDI
+
+#include <platform/platform.h>
+#include <device/device.h>
+#include <updi/nvm.h>
+#include <updi/stats.h>
+#include "cupdi.h"
+#include "production.h"
+
+/*
+    Clear the production statistics
+    @stats: statistics
+*/
+void production_stats_reset(production_stats_t *stats)
+{
+    memset(stats, 0, sizeof(*stats));
+}
+
+/*
+    Add a part result to the production statistics
+    @stats: statistics
+    @result: 0 passed, other value failed code
+    @cycle: cycle time(ms) of the part
+    @phase_ms: time(ms) of each CUPDI_PHASE_T, could be NULL
+*/
+void production_stats_add(production_stats_t *stats, int result, unsigned int cycle, const unsigned int *phase_ms)
+{
+    int i;
+
+    stats->count++;
+    if (!result)
+        stats->passed++;
+    else if (result < 0 && -result < PRODUCTION_MAX_FAIL_CODE - 1)
+        stats->fail_code[-result]++;
+    else
+        stats->fail_code[PRODUCTION_MAX_FAIL_CODE - 1]++;
+
+    stats->cycle[stats->head] = cycle;
+    stats->head = (stats->head + 1) % PRODUCTION_STATS_WINDOW;
+    if (stats->window < PRODUCTION_STATS_WINDOW)
+        stats->window++;
+
+    if (phase_ms) {
+        for (i = 0; i < CUPDI_PHASE_NUM; i++)
+            stats->phase_sum[i] += phase_ms[i];
+    }
+}
+
+/*
+    Summarize the cycle time of the rolling window
+    @stats: statistics
+    @sum: output of min/mean/p99/max cycle time(ms), all 0 if no part
+*/
+void production_stats_summary(const production_stats_t *stats, production_summary_t *sum)
+{
+    unsigned int sorted[PRODUCTION_STATS_WINDOW];
+    unsigned int v, total = 0;
+    int i, j, n = stats->window;
+
+    memset(sum, 0, sizeof(*sum));
+    if (!n)
+        return;
+
+    // insertion sort, the window is small
+    for (i = 0; i < n; i++) {
+        v = stats->cycle[i];
+        total += v;
+        for (j = i; j > 0 && sorted[j - 1] > v; j--)
+            sorted[j] = sorted[j - 1];
+        sorted[j] = v;
+    }
+
+    sum->min = sorted[0];
+    sum->max = sorted[n - 1];
+    sum->mean = total / n;
+    // nearest rank
+    sum->p99 = sorted[(n * 99 + 99) / 100 - 1];
+}
+
+/*
+    Output the production statistics, always compiled as cupdi_report_print()
+    @stats: statistics
+*/
+void production_stats_report(const production_stats_t *stats)
+{
+    production_summary_t sum;
+    int i;
+
+    production_stats_summary(stats, &sum);
+
+    printf("Parts %u, passed %u, failed %u\n", stats->count, stats->passed, stats->count - stats->passed);
+    printf("Cycle(ms) of last %d: min %u, mean %u, p99 %u, max %u\n", stats->window, sum.min, sum.mean, sum.p99, sum.max);
+
+    for (i = 0; i < CUPDI_PHASE_NUM && stats->count; i++)
+        printf("  %s: mean %u ms\n", cupdi_phase_name(i), stats->phase_sum[i] / stats->count);
+
+    for (i = 0; i < PRODUCTION_MAX_FAIL_CODE; i++) {
+        if (stats->fail_code[i])
+            printf("  failure %d%s: %u\n", -i, i == PRODUCTION_MAX_FAIL_CODE - 1 ? "(other)" : "", stats->fail_code[i]);
+    }
+}
+
+/*
+    Wait until the probe result is stable for count times
+    @nvm_ptr: updi_nvm_open() device handle
+    @present: true to wait target inserted, false to wait removed
+    @count: consecutive probe count
+*/
+static void production_wait_target(void *nvm_ptr, bool present, int count)
+{
+    int matched = 0;
+
+    while (matched < count) {
+        if ((nvm_probe(nvm_ptr) == 0) == present)
+            matched++;
+        else
+            matched = 0;
+
+        if (matched < count) {
+            // Idle time, print the deferred logs
+            log_drain(0);
+            msleep(PRODUCTION_PROBE_INTERVAL);
+        }
+    }
+}
+
+/*
+    Production loop, runs until the result callback stops it or the session can't be opened
+    Each inserted target is programmed by cupdi_program_part() and the statistics is updated and reported,
+    then the next part is waited after this one removed.
+    @port: serial port name, NULL for the default
+    @flags: UPDI_PLAN_xxx flags of the planner
+    @cb_result: called with the result of each part(for pass/fail indicator), non-zero return stops the loop,
+        NULL never stops
+    @args: argument of cb_result
+    @returns 0 stopped by cb_result, negative failed code
+*/
+int cupdi_production(const char *port, int flags, cb_production_result_t cb_result, void *args)
+{
+    char *dev_name = "tiny1617";
+    int baudrate = 115200;
+    const device_info_t * dev;
+    production_stats_t stats;
+    cupdi_report_t report;
+    unsigned int start, now;
+    void *nvm_ptr;
+    int result;
+
+    dev = get_chip_info(dev_name);
+    if (!dev) {
+        DBG_INFO(UPDI_DEBUG, "Device %s not support", dev_name);
+        return -2;
+    }
+
+    nvm_ptr = updi_nvm_open(port, (void *)dev);
+    if (!nvm_ptr) {
+        DBG_INFO(UPDI_DEBUG, "Nvm open failed");
+        return -3;
+    }
+
+    production_stats_reset(&stats);
+
+    while (1) {
+        DBG_INFO(UPDI_DEBUG, "Waiting for target");
+        production_wait_target(nvm_ptr, true, PRODUCTION_INSERT_COUNT);
+
+        cupdi_report_init(&report);
+        start = get_time_ms();
+
+        result = nvm_connect(nvm_ptr, baudrate);
+        report.phase_ms[CUPDI_PHASE_CONNECT] = get_time_ms() - start;
+        if (result) {
+            DBG_INFO(UPDI_DEBUG, "nvm_connect failed %d", result);
+            result = -3;
+        }
+        else
+            result = cupdi_program_part(nvm_ptr, flags, &report);
+
+        now = get_time_ms();
+        nvm_leave_progmode(nvm_ptr);
+        report.phase_ms[CUPDI_PHASE_LEAVE] = get_time_ms() - now;
+
+        report.result = result;
+        report.total_ms = get_time_ms() - start;
+
+        production_stats_add(&stats, result, report.total_ms, report.phase_ms);
+        printf("Part %u:\n", stats.count);
+        cupdi_report_print(&report);
+        production_stats_report(&stats);
+        // Layer statistics of this part
+        updi_stats_report(updi_stats_get());
+        updi_stats_reset();
+
+        if (cb_result && cb_result(result, &stats, args))
+            break;
+
+        DBG_INFO(UPDI_DEBUG, "Waiting for target removed");
+        production_wait_target(nvm_ptr, false, PRODUCTION_REMOVE_COUNT);
+    }
+
+    updi_nvm_deinit(nvm_ptr);
+
+    return 0;
+}
+
+#endif
@@ -0,0 +1,66 @@
+#ifndef __PRODUCTION_H
+#define __PRODUCTION_H
+
+#ifdef CUPDI
+
+#include "cupdi.h"
+
+/* Interval(ms) between the target presence probes */
+#define PRODUCTION_PROBE_INTERVAL 50
+
+/* Consecutive probe results to accept a target inserted or removed, a target which just left progmode
+   drops the first probe since its UPDI is disabled */
+#define PRODUCTION_INSERT_COUNT 2
+#define PRODUCTION_REMOVE_COUNT 3
+
+/* Parts in the rolling window of cycle time statistics */
+#define PRODUCTION_STATS_WINDOW 64
+
+/* Failure code counted individually, the codes of cupdi_program_part() are -2 ~ -11 */
+#define PRODUCTION_MAX_FAIL_CODE 16
+
+/*
+    Production statistics
+    @count: parts programmed
+    @passed: parts passed
+    @fail_code: failure count indexed by the negative code, the last one for the other codes
+    @cycle: cycle time(ms, from target detected to finished) of last PRODUCTION_STATS_WINDOW parts
+    @window: parts in cycle[]
+    @head: next position of cycle[]
+    @phase_sum: time sum(ms) of each CUPDI_PHASE_T of all parts
+*/
+typedef struct _production_stats {
+    unsigned int count;
+    unsigned int passed;
+    unsigned int fail_code[PRODUCTION_MAX_FAIL_CODE];
+    unsigned int cycle[PRODUCTION_STATS_WINDOW];
+    int window;
+    int head;
+    unsigned int phase_sum[CUPDI_PHASE_NUM];
+}production_stats_t;
+
+/*
+    Cycle time summary of the rolling window
+*/
+typedef struct _production_summary {
+    unsigned int min;
+    unsigned int mean;
+    unsigned int p99;
+    unsigned int max;
+}production_summary_t;
+
+/*
+    Result of each part
+    @return 0 continue with the next part, other value stop the production loop
+*/
+typedef int (*cb_production_result_t)(int result, const production_stats_t *stats, void *args);
+
+void production_stats_reset(production_stats_t *stats);
+void production_stats_add(production_stats_t *stats, int result, unsigned int cycle, const unsigned int *phase_ms);
+void production_stats_summary(const production_stats_t *stats, production_summary_t *sum);
+void production_stats_report(const production_stats_t *stats);
+int cupdi_production(const char *port, int flags, cb_production_result_t cb_result, void *args);
+
+#endif
+
+#endif
@@ -22,18 +22,25 @@ limitations under the License.
 #include "link.h"
 #include "application.h"
 #include "constants.h"
+#include "stats.h"
 
 /*
     APP level memory struct
     @mgwd: magicword
     @link: pointer to link object
     @dev: point chip dev object
+    @progmode: NVM programming mode entered by the session, restored by the recovery
+    @entries: programming mode entered by the key and reset, the page buffer of the target is cleared by each
+    @id: device identification cached in the session, dropped at connect
 */
 typedef struct _upd_application {
 #define UPD_APPLICATION_MAGIC_WORD 0xB4B4 //'uapp'
     unsigned int mgwd;  //magic word
     void *link;
     device_info_t *dev;
+    bool progmode;
+    unsigned int entries;
+    app_device_id_t id;
 }upd_application_t;
 
 /*
@@ -47,31 +54,100 @@ typedef struct _upd_application {
 #define APP_REG(_app, _name) ((_app)->dev->mmap->reg._name)
 
 /*
-    APP object init
+    APP object open, the target is not required to be connected
     @port: serial port name of Window or Linux
-    @baud: baudrate
     @dev: point chip dev object
     @return APP ptr, NULL if failed
 */
-upd_application_t application;
-void *updi_application_init(const char *port, int baud, void *dev)
+UPDI_THREAD_LOCAL upd_application_t application[UPDI_MAX_CHANNEL];
+void *updi_application_open(const char *port, void *dev)
 {
     upd_application_t *app = NULL;
     void *link;
+    int i;
 
-    DBG_INFO(APP_DEBUG, "<APP> init application");
+    DBG_INFO(APP_DEBUG, "<APP> open application");
+
+    for (i = 0; i < ARRAY_SIZE(application); i++) {
+        if (!VALID_APP(&application[i]))
+            break;
+    }
+
+    if (i >= ARRAY_SIZE(application)) {
+        DBG_INFO(APP_DEBUG, "<APP> no free channel");
+        return NULL;
+    }
 
-    link = updi_datalink_init(port, baud);
+    link = updi_datalink_open(port);
     if (link) {
-        app = &application;//(upd_application_t *)malloc(sizeof(*app));
+        app = &application[i];//(upd_application_t *)malloc(sizeof(*app));
         app->mgwd = UPD_APPLICATION_MAGIC_WORD;
         app->link = (void *)link;
         app->dev = (device_info_t *)dev;
+        app->progmode = false;
+        memset(&app->id, 0, sizeof(app->id));
     }
 
     return app;
 }
 
+/*
+    APP object init
+    @port: serial port name of Window or Linux
+    @baud: baudrate
+    @dev: point chip dev object
+    @return APP ptr, NULL if failed
+*/
+void *updi_application_init(const char *port, int baud, void *dev)
+{
+    void *app;
+
+    DBG_INFO(APP_DEBUG, "<APP> init application");
+
+    app = updi_application_open(port, dev);
+    if (app && app_connect(app, baud)) {
+        updi_application_deinit(app);
+        return NULL;
+    }
+
+    return app;
+}
+
+/*
+    APP connect the target
+    @app_ptr: APP object pointer, acquired from updi_application_open()
+    @baud: baudrate
+    @return 0 successful, other value if failed
+*/
+int app_connect(void *app_ptr, int baud)
+{
+    upd_application_t *app = (upd_application_t *)app_ptr;
+
+    if (!VALID_APP(app))
+        return ERROR_PTR;
+
+    // Another part may be connected
+    app->progmode = false;
+    memset(&app->id, 0, sizeof(app->id));
+
+    return link_connect(LINK(app), baud);
+}
+
+/*
+    APP probe whether the target is connected with a UPDI status check, no retry
+    @app_ptr: APP object pointer, acquired from updi_application_open()
+    @return 0 target responded, other value if failed
+*/
+int app_probe(void *app_ptr)
+{
+    upd_application_t *app = (upd_application_t *)app_ptr;
+
+    if (!VALID_APP(app))
+        return ERROR_PTR;
+
+    return link_check(LINK(app));
+}
+
 /*
     APP object destroy
     @app_ptr: APP object pointer, acquired from updi_application_init()
@@ -84,12 +160,87 @@ void updi_application_deinit(void *app_ptr)
         DBG_INFO(APP_DEBUG, "<APP> deinit application");
 
         updi_datalink_deinit(LINK(app));
+        app->mgwd = 0;
         //free(app);
     }
 }
 
 /*
-    APP get device ID information, in Unlocked Mode, the SIGROW could be readout
+    APP set the delay after each sending of PHY
+    @app_ptr: APP object pointer, acquired from updi_application_init()
+    @ibdly: delay ms, 0 no delay
+    @return 0 successful, other value if failed
+*/
+int app_set_ibdly(void *app_ptr, int ibdly)
+{
+    upd_application_t *app = (upd_application_t *)app_ptr;
+
+    if (!VALID_APP(app))
+        return ERROR_PTR;
+
+    return link_set_ibdly(LINK(app), ibdly);
+}
+
+/*
+    APP get the baudrate and the delay after each sending of PHY
+    @app_ptr: APP object pointer, acquired from updi_application_init()
+    @baud: output of baudrate
+    @ibdly: output of delay ms
+    @return 0 successful, other value if failed
+*/
+int app_get_timing(void *app_ptr, int *baud, int *ibdly)
+{
+    upd_application_t *app = (upd_application_t *)app_ptr;
+
+    if (!VALID_APP(app))
+        return ERROR_PTR;
+
+    return link_get_timing(LINK(app), baud, ibdly);
+}
+
+/*
+    APP set the recovery policy of the link
+    @app_ptr: APP object pointer, acquired from updi_application_init()
+    @policy: recovery policy, NULL for the default
+    @return 0 successful, other value if failed
+*/
+int app_set_retry(void *app_ptr, const link_retry_t *policy)
+{
+    upd_application_t *app = (upd_application_t *)app_ptr;
+
+    if (!VALID_APP(app))
+        return ERROR_PTR;
+
+    return link_set_retry(LINK(app), policy);
+}
+
+/*
+    APP decide whether a failed idempotent transaction(block read, page or fuse write) is retried, the link
+    is recovered and the programming mode is entered again if the target lost it
+    @app_ptr: APP object pointer, acquired from updi_application_init()
+    @attempt: retries done of the transaction
+    @return true to retry
+*/
+bool app_retry(void *app_ptr, int attempt)
+{
+    upd_application_t *app = (upd_application_t *)app_ptr;
+
+    if (!VALID_APP(app) || !link_retry(LINK(app), attempt))
+        return false;
+
+    if (app->progmode && !app_in_prog_mode(app)) {
+        DBG_INFO(APP_DEBUG, "<APP> Progmode lost, enter again");
+        app->progmode = false;
+        if (app_enter_progmode(app))
+            return false;
+    }
+
+    return true;
+}
+
+/*
+    APP get device ID information, in Unlocked Mode, the SIGROW could be readout.
+        The result is cached in the session, see app_get_device_id()
     @app_ptr: APP object pointer, acquired from updi_application_init()
     @return 0 successful, other value if failed
 */
@@ -99,10 +250,7 @@ int app_device_info(void *app_ptr)
         Reads out device information from various sources
     */
     upd_application_t *app = (upd_application_t *)app_ptr;
-    u8 sib[16];
-    //u8 pdi;
-    u8 sigrow[14];
-    u8 revid[1];
+    u8 *sib;
     int result;
 
     if (!VALID_APP(app))
@@ -110,41 +258,93 @@ int app_device_info(void *app_ptr)
 
     DBG_INFO(APP_DEBUG, "<APP> Device info");
 
-    result = link_read_sib(LINK(app), sib, sizeof(sib));
-    if (result) {
-        DBG_INFO(APP_DEBUG, "link_read_sib failed %d", result);
-        return -2;
+    sib = app->id.sib;
+    if (!app->id.sib_valid) {
+        result = link_read_sib(LINK(app), sib, sizeof(app->id.sib));
+        if (result) {
+            DBG_INFO(APP_DEBUG, "link_read_sib failed %d", result);
+            return -2;
+        }
+        app->id.sib_valid = true;
     }
 
-    DBG(APP_DEBUG, "[SIB]", sib, sizeof(sib), (unsigned char *)"%02x ");
+    DBG(APP_DEBUG, "[SIB]", sib, sizeof(app->id.sib), (unsigned char *)"%02x ");
     DBG(APP_DEBUG, "[Family ID]", sib, 7, (unsigned char *)"%c");
     DBG(APP_DEBUG, "[NVM revision]", sib + 8, 3, (unsigned char *)"%c");
     DBG(APP_DEBUG, "[OCD revision]", sib + 11, 3, (unsigned char *)"%c");
     DBG_INFO(APP_DEBUG, "[PDI OSC] is %cMHz", sib[15]);
 
-    //pdi = link_ldcs(LINK(app), UPDI_CS_STATUSA);
-    DBG_INFO(APP_DEBUG, "[PDI Rev] is %d", (pdi >> 4));
-
-    if (app_in_prog_mode(app)) {
-        result = app_read_data(app, APP_REG(app, sigrow_address), sigrow, sizeof(sigrow));
+    if (app->id.sigrow_valid || app_in_prog_mode(app)) {
+        result = app_read_device_id(app);
         if (result) {
-            DBG_INFO(APP_DEBUG, "app_read_data sigrow failed %d", result);
+            DBG_INFO(APP_DEBUG, "app_read_device_id failed %d", result);
             return -3;
         }
+    }
+
+    return 0;
+}
+
+/*
+    APP read the signature row and the revision once in the session, the target should be in progmode.
+        The signature row is read by a single ST ptr/REPEAT/LD burst, the revision(in SYSCFG) by a LDS.
+        So the identification takes 3 round trips of a session: the SIB(app_device_info(), before progmode),
+        the burst and the LDS. They can't share one transfer: the wire is half-duplex and the target answers
+        each instruction once received, so only the last instruction of a transfer may have a response.
+        CTRLA.RSD suppresses the ACKs only, not the data of SIB/LD/LDS, and the revision is not in reach of the burst
+    @app_ptr: APP object pointer, acquired from updi_application_init()
+    @return 0 successful, other value if failed
+*/
+int app_read_device_id(void *app_ptr)
+{
+    upd_application_t *app = (upd_application_t *)app_ptr;
+    app_device_id_t *id;
+    int result;
+
+    if (!VALID_APP(app))
+        return ERROR_PTR;
+
+    id = &app->id;
+    if (!id->sigrow_valid) {
+        DBG_INFO(APP_DEBUG, "<APP> Read device id");
+
+        result = link_ld_burst(LINK(app), APP_REG(app, sigrow_address), id->sigrow, sizeof(id->sigrow));
+        if (result) {
+            DBG_INFO(APP_DEBUG, "link_ld_burst sigrow failed %d", result);
+            return -2;
+        }
 
-        result = app_read_data(app, APP_REG(app, syscfg_address) + 1, revid, sizeof(revid));
+        result = _link_ld(LINK(app), APP_REG(app, syscfg_address) + 1, &id->revid);
         if (result) {
-            DBG_INFO(APP_DEBUG, "app_read_data revid failed %d", result);
-            return -4;
+            DBG_INFO(APP_DEBUG, "_link_ld revid failed %d", result);
+            return -3;
         }
-        DBG(APP_DEBUG, "[Device ID]", sigrow, 3, (unsigned char *)"%02x ");
-        DBG(APP_DEBUG, "[Sernum ID]", sigrow + 3, 10, (unsigned char *)"%02x ");
-        DBG_INFO(APP_DEBUG, "[Device Rev] is %c", revid[0] + 'A');
+
+        id->sigrow_valid = true;
     }
 
+    DBG(APP_DEBUG, "[Device ID]", id->sigrow, 3, (unsigned char *)"%02x ");
+    DBG(APP_DEBUG, "[Sernum ID]", id->sigrow + 3, 10, (unsigned char *)"%02x ");
+    DBG_INFO(APP_DEBUG, "[Device Rev] is %c", id->revid + 'A');
+
     return 0;
 }
 
+/*
+    APP get the device identification cached in the session, the fields not read are marked invalid
+    @app_ptr: APP object pointer, acquired from updi_application_init()
+    @return identification, NULL if failed
+*/
+const app_device_id_t *app_get_device_id(void *app_ptr)
+{
+    upd_application_t *app = (upd_application_t *)app_ptr;
+
+    if (!VALID_APP(app))
+        return NULL;
+
+    return &app->id;
+}
+
 /*
     APP check whether device in Unlocked Mode
     @app_ptr: APP object pointer, acquired from updi_application_init()
@@ -163,6 +363,7 @@ bool app_in_prog_mode(void *app_ptr)
     if (!VALID_APP(app))
         return ret;
 
+    // Read from the target, NVMPROG could be set after LOCKSTATUS is cleared, the value of the last poll is stale
     result = _link_ldcs(LINK(app), UPDI_ASI_SYS_STATUS, &status);
     if (!result && status & (1 << UPDI_ASI_SYS_STATUS_NVMPROG))
         ret = true;
@@ -286,6 +487,7 @@ int app_enter_progmode(void *app_ptr)
     // First check if NVM is already enabled
     if (app_in_prog_mode(app_ptr)) {
         DBG_INFO(APP_DEBUG, "Already in NVM programming mode");
+        app->progmode = true;
         return 0;
     }
 
@@ -324,6 +526,8 @@ int app_enter_progmode(void *app_ptr)
         return -6;
     }else {
         DBG_INFO(APP_DEBUG, "Now in NVM programming mode");
+        app->progmode = true;
+        app->entries++;
         return 0;
     }
 }
@@ -346,6 +550,8 @@ int app_leave_progmode(void *app_ptr)
 
     DBG_INFO(APP_DEBUG, "<APP> Leaving program mode");
 
+    app->progmode = false;
+
     result = app_toggle_reset(app_ptr, 1);
     if (result) {
         DBG_INFO(APP_DEBUG, "app_toggle_reset failed %d", result);
@@ -421,6 +627,9 @@ int app_reset(void *app_ptr, bool apply_reset)
         return -2;
     }
 
+    if (apply_reset)
+        UPDI_STATS_INC(app.resets);
+
     return 0;
 }
 
@@ -475,6 +684,7 @@ int app_wait_flash_ready(void *app_ptr, int timeout)
     upd_application_t *app = (upd_application_t *)app_ptr;
     u8 status;
     int result;
+    UPDI_STATS_TIME(start);
 
     if (!VALID_APP(app))
         return ERROR_PTR;
@@ -501,6 +711,9 @@ int app_wait_flash_ready(void *app_ptr, int timeout)
         msleep(1);
     } while (--timeout > 0);
 
+    UPDI_STATS_HIST(nvm_ready, get_time_us() - start);
+    UPDI_STATS_ADD(app.nvm_wait_us, get_time_us() - start);
+
     if (timeout <= 0 || result) {
         DBG_INFO(APP_DEBUG, "Timeout waiting for wait flash ready status %02x result %d", status, result);
         return -3;
@@ -527,29 +740,26 @@ int app_execute_nvm_command(void *app_ptr, u8 command)
 
     DBG_INFO(APP_DEBUG, "<APP> NVMCMD %d executing", command);
 
+    UPDI_STATS_INC(app.nvm_cmd[command & 0x7]);
+
     return link_st(LINK(app), APP_REG(app, nvmctrl_address) + UPDI_NVMCTRL_CTRLA, command);
 }
 
 /*
-    APP erase page
+    APP erase page, the page is selected by a dummy write into its page buffer which latches NVMCTRL.ADDR
     @app_ptr: APP object pointer, acquired from updi_application_init()
-    @page: page address to be erased
+    @address: an address in the page to be erased
     @return 0 successful, other value if failed
 */
 int app_page_erase(void *app_ptr, u16 address)
 {
-    /*
-    Does a chip erase using the NVM controller
-    Note that on locked devices this it not possible and the ERASE KEY has to be used instead
-    */
-
     upd_application_t *app = (upd_application_t *)app_ptr;
     int result;
 
     if (!VALID_APP(app))
         return ERROR_PTR;
 
-    DBG_INFO(APP_DEBUG, "<APP> page erase using NVM CTRL");
+    DBG_INFO(APP_DEBUG, "<APP> Page erase at %04x using NVM CTRL", address);
 
     //Wait until NVM CTRL is ready to erase
     result = app_wait_flash_ready(app, TIMEOUT_WAIT_FLASH_READY);
@@ -558,29 +768,36 @@ int app_page_erase(void *app_ptr, u16 address)
         return -2;
     }
 
+    //Select the page, the erased value is written so nothing is programmed if the buffer is committed later
+    result = link_st(LINK(app), address, 0xFF);
+    if (result) {
+        DBG_INFO(APP_DEBUG, "link_st page select failed %d", result);
+        return -3;
+    }
+
     //Erase
-    result = app_execute_nvm_command(app, UPDI_NVMCTRL_CTRLA_CHIP_ERASE);
+    result = app_execute_nvm_command(app, UPDI_NVMCTRL_CTRLA_ERASE_PAGE);
     if (result) {
         DBG_INFO(APP_DEBUG, "app_execute_nvm_command failed %d", result);
-        return -3;
+        return -4;
     }
 
     // And wait for it
     result = app_wait_flash_ready(app, TIMEOUT_WAIT_FLASH_READY);
     if (result) {
         DBG_INFO(APP_DEBUG, "app_wait_flash_ready timeout after erase failed %d", result);
-        return -2;
+        return -5;
     }
 
     return 0;
 }
 
 /*
-    APP erase chip
+    APP start erasing chip, not wait for the erase finished
     @app_ptr: APP object pointer, acquired from updi_application_init()
     @return 0 successful, other value if failed
 */
-int app_chip_erase(void *app_ptr)
+static int app_chip_erase_start(void *app_ptr)
 {
     /*
         Does a chip erase using the NVM controller
@@ -609,6 +826,23 @@ int app_chip_erase(void *app_ptr)
         return -3;
     }
 
+    return 0;
+}
+
+/*
+    APP erase chip
+    @app_ptr: APP object pointer, acquired from updi_application_init()
+    @return 0 successful, other value if failed
+*/
+int app_chip_erase(void *app_ptr)
+{
+    upd_application_t *app = (upd_application_t *)app_ptr;
+    int result;
+
+    result = app_chip_erase_start(app);
+    if (result)
+        return result;
+
     // And wait for it
     result = app_wait_flash_ready(app, TIMEOUT_WAIT_FLASH_READY);
     if (result) {
@@ -756,18 +990,22 @@ int app_read_data(void *app_ptr, u16 address, u8 *data, int len)
     /*
     Reads a number of bytes of data from UPDI
     */
+    upd_application_t *app = (upd_application_t *)app_ptr;
     bool use_word_access = !(len & 0x1);
-    int result;
+    int result, attempt = 0;
 
     DBG_INFO(APP_DEBUG, "<APP> Read data(%d)", len);
 
-    if (!VALID_PTR(data) || len <= 0)
+    if (!VALID_APP(app) || !VALID_PTR(data) || len <= 0)
         return ERROR_PTR;
 
-    if (use_word_access)
-        result = app_read_data_words(app_ptr, address, data, len);
-    else
-        result = app_read_data_bytes(app_ptr, address, data, len);
+    // The pointer, repeat and load are retried together
+    do {
+        if (use_word_access)
+            result = app_read_data_words(app_ptr, address, data, len);
+        else
+            result = app_read_data_bytes(app_ptr, address, data, len);
+    } while (result && app_retry(app, attempt++));
 
     return result;
 }
@@ -803,6 +1041,74 @@ int app_read_nvm(void *app_ptr, u16 address, u8 *data, int len)
     return 0;
 }
 
+/*
+    APP store a block by the pointer and the repeat, each data acknowledged is kept by the target(the page buffer),
+    so a failed block is resumed from the first data not acknowledged after the link recovery, and the retries
+    are counted again when it progressed. The whole block is stored again if the programming mode was entered again
+    @app: APP object
+    @address: target address
+    @data: data buffer
+    @len: data len, 2 ~ (UPDI_MAX_REPEAT_SIZE + 1) units
+    @use_word_access: 16bit units
+    @return 0 successful, other value if failed
+*/
+static int app_write_data_repeat(upd_application_t *app, u16 address, const u8 *data, int len, bool use_word_access)
+{
+    int result, done = 0, acked, attempt = 0;
+    unsigned int entries;
+
+    for (;;) {
+        acked = 0;
+
+        // Store the address
+        result = link_st_ptr(LINK(app), address + done);
+        if (result) {
+            DBG_INFO(APP_DEBUG, "link_st_ptr failed %d", result);
+            result = -4;
+        }
+
+        //Fire up the repeat
+        if (!result) {
+            if (use_word_access)
+                result = link_repeat16(LINK(app), ((len - done) >> 1) - 1);
+            else
+                result = link_repeat(LINK(app), len - done - 1);
+            if (result) {
+                DBG_INFO(APP_DEBUG, "link_repeat failed %d", result);
+                result = -5;
+            }
+        }
+
+        if (!result) {
+            if (use_word_access)
+                result = link_st_ptr_inc16(LINK(app), data + done, len - done, &acked);
+            else
+                result = link_st_ptr_inc(LINK(app), data + done, len - done, &acked);
+            if (result) {
+                DBG_INFO(APP_DEBUG, "link_st_ptr_inc failed %d at %d", result, done + acked);
+                result = -6;
+            }
+        }
+
+        if (!result)
+            break;
+
+        if (acked) {
+            done += acked;
+            attempt = 0;
+        }
+
+        entries = app->entries;
+        if (!app_retry(app, attempt++))
+            break;
+
+        if (app->entries != entries)
+            done = 0;
+    }
+
+    return result;
+}
+
 /*
     APP write data in 16bit mode
     @app_ptr: APP object pointer, acquired from updi_application_init()
@@ -841,27 +1147,7 @@ int app_write_data_words(void *app_ptr, u16 address, const u8 *data, int len)
         return -3;
     }
 
-    // Store the address
-    result = link_st_ptr(LINK(app), address);
-    if (result) {
-        DBG_INFO(APP_DEBUG, "link_st_ptr failed %d", result);
-        return -4;
-    }
-
-    //Fire up the repeat
-    result = link_repeat16(LINK(app), (len >> 1) - 1);
-    if (result) {
-        DBG_INFO(APP_DEBUG, "link_repeat16 failed %d", result);
-        return -5;
-    }
-
-    result = link_st_ptr_inc16(LINK(app), data, len);
-    if (result) {
-        DBG_INFO(APP_DEBUG, "link_st_ptr_inc16 failed %d", result);
-        return -6;
-    }
-
-    return 0;
+    return app_write_data_repeat(app, address, data, len, true);
 }
 
 /*
@@ -892,6 +1178,8 @@ int app_write_data_bytes(void *app_ptr, u16 address, const u8 *data, int len)
             DBG_INFO(APP_DEBUG, "link_st16 failed %d", result);
             return -2;
         }
+
+        return 0;
     }
 
     // Range check
@@ -900,27 +1188,7 @@ int app_write_data_bytes(void *app_ptr, u16 address, const u8 *data, int len)
         return -3;
     }
 
-    // Store the address
-    result = link_st_ptr(LINK(app), address);
-    if (result) {
-        DBG_INFO(APP_DEBUG, "link_st_ptr failed %d", result);
-        return -4;
-    }
-
-    //Fire up the repeat
-    result = link_repeat(LINK(app), len - 1);
-    if (result) {
-        DBG_INFO(APP_DEBUG, "link_repeat failed %d", result);
-        return -5;
-    }
- 
-    result = link_st_ptr_inc(LINK(app), data, len);
-    if (result) {
-        DBG_INFO(APP_DEBUG, "link_st_ptr_inc16 failed %d", result);
-        return -6;
-    }
-
-    return 0;
+    return app_write_data_repeat(app, address, data, len, false);
 }
 
 /*
@@ -953,7 +1221,7 @@ int app_write_data(void *app_ptr, u16 address, const u8 *data, int len, bool use
 }
 
 /*
-    APP write nvm
+    APP start writing nvm, the page is committed but not waited for finished, wait with app_wait_flash_ready() after it
     @app_ptr: APP object pointer, acquired from updi_application_init()
     @address: target address
     @data: data buffer
@@ -961,7 +1229,7 @@ int app_write_data(void *app_ptr, u16 address, const u8 *data, int len, bool use
     @nvm_command: programming command
     @return 0 successful, other value if failed
 */
-int _app_write_nvm(void *app_ptr, u16 address, const u8 *data, int len, u8 nvm_command, bool use_word_access)
+static int _app_write_nvm_start(void *app_ptr, u16 address, const u8 *data, int len, u8 nvm_command, bool use_word_access)
 {
     /*
         Writes a page of data to NVM.
@@ -1014,16 +1282,43 @@ int _app_write_nvm(void *app_ptr, u16 address, const u8 *data, int len, u8 nvm_c
         return -6;
     }
 
-    // Waif for NVM controller to be ready again
-    result = app_wait_flash_ready(app, TIMEOUT_WAIT_FLASH_READY);
-    if (result) {
-        DBG_INFO(APP_DEBUG, "app_wait_flash_ready timeout after page write failed %d", result);
-        return -7;
-    }
-
     return 0;
 }
 
+/*
+    APP write nvm common function, the page is committed and waited for finished
+    @app_ptr: APP object pointer, acquired from updi_application_init()
+    @address: target address
+    @data: data buffer
+    @len: data len
+    @nvm_command: programming command
+    @return 0 successful, other value if failed
+*/
+int _app_write_nvm(void *app_ptr, u16 address, const u8 *data, int len, u8 nvm_command, bool use_word_access)
+{
+    upd_application_t *app = (upd_application_t *)app_ptr;
+    int result, attempt = 0;
+
+    if (!VALID_APP(app))
+        return ERROR_PTR;
+
+    // The whole page is written again if failed, the page buffer is cleared first
+    do {
+        result = _app_write_nvm_start(app, address, data, len, nvm_command, use_word_access);
+        if (result)
+            continue;
+
+        // Waif for NVM controller to be ready again
+        result = app_wait_flash_ready(app, TIMEOUT_WAIT_FLASH_READY);
+        if (result) {
+            DBG_INFO(APP_DEBUG, "app_wait_flash_ready timeout after page write failed %d", result);
+            result = -7;
+        }
+    } while (result && result != ERROR_PTR && app_retry(app, attempt++));
+
+    return result;
+}
+
 /*
     APP write nvm capsule with UPDI_NVMCTRL_CTRLA_WRITE_PAGE command
     @app_ptr: APP object pointer, acquired from updi_application_init()
@@ -1048,10 +1343,10 @@ int app_write_nvm(void *app_ptr, u16 address, const u8 *data, int len)
     @use_word_access: 2 bytes mode for writting
     @return 0 successful, other value if failed
 */
-/*int _app_erase_write_nvm(void *app_ptr, u16 address, const u8 *data, int len, bool use_word_access)
+int _app_erase_write_nvm(void *app_ptr, u16 address, const u8 *data, int len, bool use_word_access)
 {
     return _app_write_nvm(app_ptr, address, data, len, UPDI_NVMCTRL_CTRLA_ERASE_WRITE_PAGE, use_word_access);
-}*/
+}
 
 /*
     APP write flash capsule with UPDI_NVMCTRL_CTRLA_ERASE_WRITE_PAGE command, and determine whether use 2 byte for writting
@@ -1061,12 +1356,493 @@ int app_write_nvm(void *app_ptr, u16 address, const u8 *data, int len)
     @len: data len
     @return 0 successful, other value if failed
 */
-/*int app_erase_write_nvm(void *app_ptr, u16 address, const u8 *data, int len)
+int app_erase_write_nvm(void *app_ptr, u16 address, const u8 *data, int len)
 {
     bool use_word_access = !(len & 0x1);
 
     return _app_write_nvm(app_ptr, address, data, len, UPDI_NVMCTRL_CTRLA_ERASE_WRITE_PAGE, use_word_access);
-}*/
+}
+
+/*
+    APP sequence init
+    @seq: sequence
+    @ops: op buffer
+    @max: op buffer size
+    @nvmctrl: NVM controller address of the device
+*/
+void app_seq_init(app_seq_t *seq, link_op_t *ops, int max, u16 nvmctrl)
+{
+    seq->ops = ops;
+    seq->max = max;
+    seq->nops = 0;
+    seq->nvmctrl = nvmctrl;
+    seq->overflow = false;
+}
+
+/*
+    APP sequence append a micro-op
+    @seq: sequence
+    @type: LINK_OP_T
+    @address: op address
+    @return op to fill the other fields, a scratch op if the sequence overflowed
+*/
+link_op_t *app_seq_op(app_seq_t *seq, u8 type, u16 address)
+{
+    static UPDI_THREAD_LOCAL link_op_t scratch;
+    link_op_t *op;
+
+    if (seq->nops >= seq->max) {
+        seq->overflow = true;
+        op = &scratch;
+    }
+    else
+        op = &seq->ops[seq->nops++];
+
+    memset(op, 0, sizeof(*op));
+    op->type = type;
+    op->address = address;
+
+    return op;
+}
+
+void app_seq_wait(app_seq_t *seq, u8 type, u16 address, u8 mask, u8 value, int timeout)
+{
+    link_op_t *op = app_seq_op(seq, type, address);
+
+    op->mask = mask;
+    op->value = value;
+    op->timeout = timeout;
+}
+
+void app_seq_st(app_seq_t *seq, u16 address, u8 value)
+{
+    app_seq_op(seq, LINK_OP_ST, address)->value = value;
+}
+
+void app_seq_stcs(app_seq_t *seq, u8 address, u8 value)
+{
+    app_seq_op(seq, LINK_OP_STCS, address)->value = value;
+}
+
+/*
+    APP sequence reset the chip, as app_reset() applied and released
+*/
+void app_seq_reset(app_seq_t *seq)
+{
+    app_seq_stcs(seq, UPDI_ASI_RESET_REQ, UPDI_RESET_REQ_VALUE);
+    app_seq_stcs(seq, UPDI_ASI_RESET_REQ, 0x00);
+}
+
+/*
+    APP sequence wait NVM controller ready, neither flash nor eeprom busy, as app_wait_flash_ready()
+    @timeout: max waiting time(ms)
+    @status: output of the NVMCTRL STATUS when ready, the write error is checked by the caller. Could be NULL
+*/
+void app_seq_nvm_ready(app_seq_t *seq, int timeout, u8 *status)
+{
+    link_op_t *op = app_seq_op(seq, LINK_OP_WAIT, seq->nvmctrl + UPDI_NVMCTRL_STATUS);
+
+    op->mask = (1 << UPDI_NVM_STATUS_FLASH_BUSY) | (1 << UPDI_NVM_STATUS_EEPROM_BUSY);
+    op->timeout = timeout;
+    op->rdata = status;
+}
+
+/*
+    APP sequence NVM command, as app_execute_nvm_command()
+*/
+void app_seq_nvm_command(app_seq_t *seq, u8 command)
+{
+    app_seq_st(seq, seq->nvmctrl + UPDI_NVMCTRL_CTRLA, command);
+}
+
+/*
+    APP sequence enter progmode, as app_enter_progmode(): NVM key, reset, then the part is unlocked and in progmode
+    @timeout: max waiting time(ms) of the unlocked and progmode status
+*/
+void app_seq_progmode(app_seq_t *seq, int timeout)
+{
+    app_seq_op(seq, LINK_OP_KEY, 0)->wdata = (const u8 *)UPDI_KEY_NVM;
+    app_seq_wait(seq, LINK_OP_WAIT_CS, UPDI_ASI_KEY_STATUS, 1 << UPDI_ASI_KEY_STATUS_NVMPROG, 1 << UPDI_ASI_KEY_STATUS_NVMPROG, 0);
+    app_seq_reset(seq);
+    app_seq_wait(seq, LINK_OP_WAIT_CS, UPDI_ASI_SYS_STATUS, 1 << UPDI_ASI_SYS_STATUS_LOCKSTATUS, 0, timeout);
+    app_seq_wait(seq, LINK_OP_WAIT_CS, UPDI_ASI_SYS_STATUS, 1 << UPDI_ASI_SYS_STATUS_NVMPROG, 1 << UPDI_ASI_SYS_STATUS_NVMPROG, timeout);
+}
+
+/*
+    APP sequence unlock with chip erase, as app_unlock(): chip erase key, reset, then wait the erase done
+    @timeout: max waiting time(ms) of the erase
+*/
+void app_seq_unlock(app_seq_t *seq, int timeout)
+{
+    app_seq_op(seq, LINK_OP_KEY, 0)->wdata = (const u8 *)UPDI_KEY_CHIPERASE;
+    app_seq_wait(seq, LINK_OP_WAIT_CS, UPDI_ASI_KEY_STATUS, 1 << UPDI_ASI_KEY_STATUS_CHIPERASE, 1 << UPDI_ASI_KEY_STATUS_CHIPERASE, 0);
+    app_seq_reset(seq);
+    app_seq_wait(seq, LINK_OP_WAIT_CS, UPDI_ASI_SYS_STATUS, 1 << UPDI_ASI_SYS_STATUS_LOCKSTATUS, 0, timeout);
+}
+
+/*
+    APP sequence chip erase in progmode, as app_chip_erase()
+    @timeout: max waiting time(ms) of the erase
+    @status: output of NVMCTRL STATUS, see app_seq_nvm_ready()
+*/
+void app_seq_chip_erase(app_seq_t *seq, int timeout, u8 *status)
+{
+    app_seq_nvm_ready(seq, TIMEOUT_WAIT_FLASH_READY, status);
+    app_seq_nvm_command(seq, UPDI_NVMCTRL_CTRLA_CHIP_ERASE);
+    app_seq_nvm_ready(seq, timeout, status);
+}
+
+/*
+    APP sequence page write, as _app_write_nvm(): page buffer cleared, loaded then committed
+    @address: target address
+    @data: page data, kept until the sequence finished
+    @len: data len, max 256
+    @command: UPDI_NVMCTRL_CTRLA_WRITE_PAGE or UPDI_NVMCTRL_CTRLA_ERASE_WRITE_PAGE
+    @status: output of NVMCTRL STATUS, see app_seq_nvm_ready()
+*/
+void app_seq_write_page(app_seq_t *seq, u16 address, const u8 *data, int len, u8 command, u8 *status)
+{
+    link_op_t *op;
+
+    app_seq_nvm_ready(seq, TIMEOUT_WAIT_FLASH_READY, status);
+    app_seq_nvm_command(seq, UPDI_NVMCTRL_CTRLA_PAGE_BUFFER_CLR);
+    app_seq_nvm_ready(seq, TIMEOUT_WAIT_FLASH_READY, status);
+    op = app_seq_op(seq, LINK_OP_WRITE, address);
+    op->wdata = data;
+    op->len = len;
+    app_seq_nvm_command(seq, command);
+    app_seq_nvm_ready(seq, TIMEOUT_WAIT_FLASH_READY, status);
+}
+
+/*
+    APP sequence page erase, as app_page_erase(): the page selected by a dummy write then erased
+    @address: page address
+    @status: output of NVMCTRL STATUS, see app_seq_nvm_ready()
+*/
+void app_seq_erase_page(app_seq_t *seq, u16 address, u8 *status)
+{
+    app_seq_nvm_ready(seq, TIMEOUT_WAIT_FLASH_READY, status);
+    app_seq_st(seq, address, 0xFF);
+    app_seq_nvm_command(seq, UPDI_NVMCTRL_CTRLA_ERASE_PAGE);
+    app_seq_nvm_ready(seq, TIMEOUT_WAIT_FLASH_READY, status);
+}
+
+/*
+    APP sequence fuse write, as app_write_fuse()
+    @address: fuse address
+    @value: fuse value
+    @status: output of NVMCTRL STATUS, see app_seq_nvm_ready()
+*/
+void app_seq_write_fuse(app_seq_t *seq, u16 address, u8 value, u8 *status)
+{
+    app_seq_nvm_ready(seq, TIMEOUT_WAIT_FLASH_READY, status);
+    app_seq_st(seq, seq->nvmctrl + UPDI_NVMCTRL_ADDRL, address & 0xFF);
+    app_seq_st(seq, seq->nvmctrl + UPDI_NVMCTRL_ADDRH, (address >> 8) & 0xFF);
+    app_seq_st(seq, seq->nvmctrl + UPDI_NVMCTRL_DATAL, value);
+    app_seq_nvm_command(seq, UPDI_NVMCTRL_CTRLA_WRITE_FUSE);
+    app_seq_nvm_ready(seq, TIMEOUT_WAIT_FLASH_READY, status);
+}
+
+/*
+    APP sequence read memory in UPDI bursts, as app_read_data_bytes()
+    @address: target address
+    @data: output buffer, kept until the sequence finished
+    @len: data len
+*/
+void app_seq_read(app_seq_t *seq, u16 address, u8 *data, int len)
+{
+    link_op_t *op;
+    int off, size;
+
+    for (off = 0; off < len; off += size) {
+        size = min(len - off, UPDI_MAX_REPEAT_SIZE + 1);
+        op = app_seq_op(seq, LINK_OP_READ, address + off);
+        op->rdata = data + off;
+        op->len = size;
+    }
+}
+
+/*
+    APP sequence leave progmode, as app_leave_progmode(): reset, then disable UPDI
+*/
+void app_seq_leave(app_seq_t *seq)
+{
+    app_seq_reset(seq);
+    app_seq_stcs(seq, UPDI_CS_CTRLB, (1 << UPDI_CTRLB_UPDIDIS_BIT) | (1 << UPDI_CTRLB_CCDETDIS_BIT));
+}
+
+/*
+    APP sequence start on the link
+    @seq: sequence
+    @la: link async state, owned by caller until done
+    @link_ptr: LINK object pointer
+    @return 0 successful, other value if failed
+*/
+int app_seq_start(app_seq_t *seq, link_async_t *la, void *link_ptr)
+{
+    if (seq->overflow) {
+        DBG_INFO(APP_DEBUG, "<APP> Sequence over %d ops", seq->max);
+        return -2;
+    }
+
+    return link_async_start(la, link_ptr, seq->ops, seq->nops) ? -3 : 0;
+}
+
+/*
+    APP async operation start a sequence
+    @op: async operation object
+    @seq: sequence built on op->ops
+    @return APP_ASYNC_PENDING, other value if failed
+*/
+static int _app_async_start(app_async_t *op, app_seq_t *seq)
+{
+    upd_application_t *app = (upd_application_t *)op->app;
+    int result;
+
+    result = app_seq_start(seq, &op->la, LINK(app));
+    if (result) {
+        DBG_INFO(APP_DEBUG, "app_seq_start failed %d", result);
+        op->result = -2;
+        return op->result;
+    }
+
+    op->result = APP_ASYNC_PENDING;
+
+    return APP_ASYNC_PENDING;
+}
+
+/*
+    APP async operation init
+    @op: async operation object
+    @app_ptr: APP object pointer, acquired from updi_application_init()
+    @type: APP_ASYNC_xxx
+    @seq: output of the sequence on op->ops
+    @return 0 successful, other value if failed
+*/
+static int _app_async_init(app_async_t *op, void *app_ptr, int type, app_seq_t *seq)
+{
+    upd_application_t *app = (upd_application_t *)app_ptr;
+
+    if (!op || !VALID_APP(app))
+        return ERROR_PTR;
+
+    memset(op, 0, sizeof(*op));
+    op->app = app_ptr;
+    op->type = type;
+    app_seq_init(seq, op->ops, ARRAY_SIZE(op->ops), APP_REG(app, nvmctrl_address));
+
+    return 0;
+}
+
+/*
+    APP async operation the sequence finished, check its result or start the next one
+    @op: async operation object
+    @return APP_ASYNC_PENDING next sequence started, 0 finished, other value failed
+*/
+static int _app_async_done(app_async_t *op)
+{
+    app_seq_t seq;
+
+    switch (op->type) {
+    case APP_ASYNC_PROGMODE:
+        if (op->stage) {
+            DBG_INFO(APP_DEBUG, "Now in NVM programming mode");
+            return 0;
+        }
+
+        if (op->status & (1 << UPDI_ASI_SYS_STATUS_NVMPROG)) {
+            DBG_INFO(APP_DEBUG, "Already in NVM programming mode");
+            return 0;
+        }
+
+        op->stage = 1;
+        app_seq_init(&seq, op->ops, ARRAY_SIZE(op->ops), APP_REG((upd_application_t *)op->app, nvmctrl_address));
+        app_seq_progmode(&seq, 100);
+        UPDI_STATS_INC(app.resets);
+        return _app_async_start(op, &seq);
+
+    case APP_ASYNC_READ_BLOCK:
+        return 0;
+
+    default:
+        if (op->status & (1 << UPDI_NVM_STATUS_WRITE_ERROR)) {
+            DBG_INFO(APP_DEBUG, "NVM error, status 0x%02x", op->status);
+            return -4;
+        }
+        return 0;
+    }
+}
+
+/*
+    APP async operation poll, advances the sequence without waiting
+    @op: async operation object, started by app_async_xxx()
+    @return APP_ASYNC_PENDING to poll again at app_async_wake(), 0 finished, other value if failed
+*/
+int app_async_poll(app_async_t *op)
+{
+    int result;
+
+    if (!op || !VALID_APP((upd_application_t *)op->app))
+        return ERROR_PTR;
+
+    if (op->result != APP_ASYNC_PENDING)
+        return op->result;
+
+    result = link_async_poll(&op->la);
+    if (result > 0)
+        return APP_ASYNC_PENDING;
+
+    if (result) {
+        DBG_INFO(APP_DEBUG, "<APP> Async %d stage %d op %d failed %d", op->type, op->stage, op->la.index, result);
+        op->result = -3;
+        return op->result;
+    }
+
+    op->result = _app_async_done(op);
+
+    return op->result;
+}
+
+/*
+    APP async operation next poll time, a running transfer has no fd to wait on here so it is polled each ms
+    @op: async operation object
+    @return get_time_ms() time the operation should be polled
+*/
+unsigned int app_async_wake(const app_async_t *op)
+{
+    if (op->result == APP_ASYNC_PENDING && op->la.busy)
+        return get_time_ms() + 1;
+
+    return link_async_wake(&op->la);
+}
+
+/*
+    APP async operation: enter programming mode with UPDI_KEY_NVM, skipped if already in progmode
+    @op: async operation object
+    @app_ptr: APP object pointer, acquired from updi_application_init()
+    @return APP_ASYNC_PENDING, other value if failed
+*/
+int app_async_enter_progmode(app_async_t *op, void *app_ptr)
+{
+    app_seq_t seq;
+    int result;
+
+    DBG_INFO(APP_DEBUG, "<APP> Async enter progmode");
+
+    result = _app_async_init(op, app_ptr, APP_ASYNC_PROGMODE, &seq);
+    if (result)
+        return result;
+
+    app_seq_op(&seq, LINK_OP_LDCS, UPDI_ASI_SYS_STATUS)->rdata = &op->status;
+
+    return _app_async_start(op, &seq);
+}
+
+/*
+    APP async operation: chip erase
+    @op: async operation object
+    @app_ptr: APP object pointer, acquired from updi_application_init()
+    @return APP_ASYNC_PENDING, other value if failed
+*/
+int app_async_chip_erase(app_async_t *op, void *app_ptr)
+{
+    app_seq_t seq;
+    int result;
+
+    DBG_INFO(APP_DEBUG, "<APP> Async chip erase");
+
+    result = _app_async_init(op, app_ptr, APP_ASYNC_CHIP_ERASE, &seq);
+    if (result)
+        return result;
+
+    app_seq_chip_erase(&seq, TIMEOUT_WAIT_FLASH_READY, &op->status);
+
+    return _app_async_start(op, &seq);
+}
+
+/*
+    APP async operation: page write with UPDI_NVMCTRL_CTRLA_WRITE_PAGE command
+    @op: async operation object
+    @app_ptr: APP object pointer, acquired from updi_application_init()
+    @address: target address
+    @data: data buffer, kept until the operation finished
+    @len: data len, max 256
+    @return APP_ASYNC_PENDING, other value if failed
+*/
+int app_async_write_page(app_async_t *op, void *app_ptr, u16 address, const u8 *data, int len)
+{
+    app_seq_t seq;
+    int result;
+
+    DBG_INFO(APP_DEBUG, "<APP> Async write page %hX(%d)", address, len);
+
+    if (!VALID_PTR(data) || len < 1 || len > UPDI_MAX_REPEAT_SIZE + 1)
+        return ERROR_PTR;
+
+    result = _app_async_init(op, app_ptr, APP_ASYNC_WRITE_PAGE, &seq);
+    if (result)
+        return result;
+
+    app_seq_write_page(&seq, address, data, len, UPDI_NVMCTRL_CTRLA_WRITE_PAGE, &op->status);
+
+    return _app_async_start(op, &seq);
+}
+
+/*
+    APP async operation: read block in UPDI bursts, max APP_ASYNC_MAX_OPS bursts
+    @op: async operation object
+    @app_ptr: APP object pointer, acquired from updi_application_init()
+    @address: target address
+    @data: data output buffer, kept until the operation finished
+    @len: data len
+    @return APP_ASYNC_PENDING, other value if failed
+*/
+int app_async_read_block(app_async_t *op, void *app_ptr, u16 address, u8 *data, int len)
+{
+    app_seq_t seq;
+    int result;
+
+    DBG_INFO(APP_DEBUG, "<APP> Async read %hX(%d)", address, len);
+
+    if (!VALID_PTR(data) || len < 1)
+        return ERROR_PTR;
+
+    result = _app_async_init(op, app_ptr, APP_ASYNC_READ_BLOCK, &seq);
+    if (result)
+        return result;
+
+    app_seq_read(&seq, address, data, len);
+
+    return _app_async_start(op, &seq);
+}
+
+/*
+    APP async operation: fuse write with UPDI_NVMCTRL_CTRLA_WRITE_FUSE command
+    @op: async operation object
+    @app_ptr: APP object pointer, acquired from updi_application_init()
+    @address: fuse address
+    @data: fuse value
+    @return APP_ASYNC_PENDING, other value if failed
+*/
+int app_async_write_fuse(app_async_t *op, void *app_ptr, u16 address, const u8 *data)
+{
+    app_seq_t seq;
+    int result;
+
+    DBG_INFO(APP_DEBUG, "<APP> Async write fuse %hX", address);
+
+    if (!VALID_PTR(data))
+        return ERROR_PTR;
+
+    result = _app_async_init(op, app_ptr, APP_ASYNC_WRITE_FUSE, &seq);
+    if (result)
+        return result;
+
+    app_seq_write_fuse(&seq, address, data[0], &op->status);
+
+    return _app_async_start(op, &seq);
+}
+
 /*
     APP load register value
     @app_ptr: APP object pointer, acquired from updi_application_init()
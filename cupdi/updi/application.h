@@ -3,9 +3,39 @@
 
 #ifdef CUPDI
 
+#include "link.h"
+
+/* Signature row bytes read by the identification: device id(3) and serial number(10) */
+#define APP_SIGROW_SIZE 14
+
+/*
+    Device identification of the session, read once after the connect by app_device_info()
+    @sib_valid: SIB read
+    @sigrow_valid: signature row and revision read(only readable in progmode)
+    @sib: System Information Block
+    @sigrow: signature row, device id at 0, serial number at 3
+    @revid: device revision, 0 is 'A'
+*/
+typedef struct _app_device_id {
+    bool sib_valid;
+    bool sigrow_valid;
+    u8 sib[16];
+    u8 sigrow[APP_SIGROW_SIZE];
+    u8 revid;
+}app_device_id_t;
+
+void *updi_application_open(const char *port, void *dev);
 void *updi_application_init(const char *port, int baud, void *dev);
+int app_connect(void *app_ptr, int baud);
+int app_probe(void *app_ptr);
 void updi_application_deinit(void *app_ptr);
+int app_set_ibdly(void *app_ptr, int ibdly);
+int app_get_timing(void *app_ptr, int *baud, int *ibdly);
+int app_set_retry(void *app_ptr, const link_retry_t *policy);
+bool app_retry(void *app_ptr, int attempt);
 int app_device_info(void *app_ptr);
+int app_read_device_id(void *app_ptr);
+const app_device_id_t *app_get_device_id(void *app_ptr);
 bool app_in_prog_mode(void *app_ptr);
 int app_wait_unlocked(void *app_ptr, int timeout);
 int app_unlock(void *app_ptr);
@@ -16,6 +46,7 @@ int app_disable(void *app_ptr);
 int app_toggle_reset(void *app_ptr, int delay);
 int app_wait_flash_ready(void *app_ptr, int timeout);
 int app_execute_nvm_command(void *app_ptr, u8 command);
+int app_page_erase(void *app_ptr, u16 address);
 int app_chip_erase(void *app_ptr);
 int app_read_data_bytes(void *app_ptr, u16 address, u8 *data, int len);
 int app_read_data_words(void *app_ptr, u16 address, u8 *data, int len);
@@ -25,8 +56,8 @@ int app_write_data_words(void *app_ptr, u16 address, const u8 *data, int len);
 int app_write_data_bytes(void *app_ptr, u16 address, const u8 *data, int len);
 int app_write_data(void *app_ptr, u16 address, const u8 *data, int len, bool use_word_access);
 int app_write_nvm(void *app_ptr, u16 address, const u8 *data, int len);
-//int _app_erase_write_nvm(void *app_ptr, u16 address, const u8 *data, int len, bool use_word_access);
-//int app_erase_write_nvm(void *app_ptr, u16 address, const u8 *data, int len);
+int _app_erase_write_nvm(void *app_ptr, u16 address, const u8 *data, int len, bool use_word_access);
+int app_erase_write_nvm(void *app_ptr, u16 address, const u8 *data, int len);
 //int app_ld_reg(void *app_ptr, u16 address, u8* data, int len);
 //int app_st_reg(void *app_ptr, u16 address, const u8 *data, int len);
 
@@ -35,6 +66,77 @@ Max waiting time at flash programming
 */
 #define TIMEOUT_WAIT_FLASH_READY 1000
 
+/*
+    Micro-op list of an APP sequence, the NVM sequences are appended by app_seq_xxx() and run by link_async_start(),
+    they are shared by the APP async operations and the event loop programmer
+    @ops: op buffer
+    @max: op buffer size
+    @nops: ops appended
+    @nvmctrl: NVM controller address of the device
+    @overflow: more ops than max were appended, the list is not started
+*/
+typedef struct _app_seq {
+    link_op_t *ops;
+    int max;
+    int nops;
+    u16 nvmctrl;
+    bool overflow;
+}app_seq_t;
+
+void app_seq_init(app_seq_t *seq, link_op_t *ops, int max, u16 nvmctrl);
+link_op_t *app_seq_op(app_seq_t *seq, u8 type, u16 address);
+void app_seq_wait(app_seq_t *seq, u8 type, u16 address, u8 mask, u8 value, int timeout);
+void app_seq_st(app_seq_t *seq, u16 address, u8 value);
+void app_seq_stcs(app_seq_t *seq, u8 address, u8 value);
+void app_seq_reset(app_seq_t *seq);
+void app_seq_nvm_ready(app_seq_t *seq, int timeout, u8 *status);
+void app_seq_nvm_command(app_seq_t *seq, u8 command);
+void app_seq_progmode(app_seq_t *seq, int timeout);
+void app_seq_unlock(app_seq_t *seq, int timeout);
+void app_seq_chip_erase(app_seq_t *seq, int timeout, u8 *status);
+void app_seq_write_page(app_seq_t *seq, u16 address, const u8 *data, int len, u8 command, u8 *status);
+void app_seq_erase_page(app_seq_t *seq, u16 address, u8 *status);
+void app_seq_write_fuse(app_seq_t *seq, u16 address, u8 value, u8 *status);
+void app_seq_read(app_seq_t *seq, u16 address, u8 *data, int len);
+void app_seq_leave(app_seq_t *seq);
+int app_seq_start(app_seq_t *seq, link_async_t *la, void *link_ptr);
+
+/* Max micro-ops of an APP async operation, a page write or a read of 8 bursts */
+#define APP_ASYNC_MAX_OPS 10
+
+/*
+    APP async operation, started by app_async_xxx() and driven by app_async_poll() from a cooperative loop.
+    The operation is an APP sequence run by link_async_poll(), the transfers don't block, each poll returns
+    APP_ASYNC_PENDING until the sequence finished, the next poll is due at app_async_wake()
+    @app: APP object pointer
+    @type: APP_ASYNC_xxx
+    @stage: 0 the first sequence, 1 the progmode sequence after the status check of APP_ASYNC_PROGMODE
+    @la: link async state of the sequence
+    @ops: micro-ops of the sequence
+    @status: ASI SYS_STATUS or NVMCTRL STATUS read by the sequence
+    @result: APP_ASYNC_PENDING, 0 finished, other value failed
+*/
+enum { APP_ASYNC_PROGMODE, APP_ASYNC_CHIP_ERASE, APP_ASYNC_WRITE_PAGE, APP_ASYNC_READ_BLOCK, APP_ASYNC_WRITE_FUSE };
+#define APP_ASYNC_PENDING 1
+
+typedef struct _app_async {
+    void *app;
+    int type;
+    int stage;
+    link_async_t la;
+    link_op_t ops[APP_ASYNC_MAX_OPS];
+    u8 status;
+    int result;
+}app_async_t;
+
+int app_async_enter_progmode(app_async_t *op, void *app_ptr);
+int app_async_chip_erase(app_async_t *op, void *app_ptr);
+int app_async_write_page(app_async_t *op, void *app_ptr, u16 address, const u8 *data, int len);
+int app_async_read_block(app_async_t *op, void *app_ptr, u16 address, u8 *data, int len);
+int app_async_write_fuse(app_async_t *op, void *app_ptr, u16 address, const u8 *data);
+unsigned int app_async_wake(const app_async_t *op);
+int app_async_poll(app_async_t *op);
+
 #endif
 
 #endif
\ No newline at end of file
@@ -59,6 +59,7 @@
 #define UPDI_ASI_CTRLA_CLKSEL_16M 0x1
 
 #define UPDI_CTRLA_IBDLY_BIT  7
+#define UPDI_CTRLA_RSD_BIT  3
 #define UPDI_CTRLB_CCDETDIS_BIT  3
 #define UPDI_CTRLB_UPDIDIS_BIT  2
 
@@ -105,6 +106,11 @@
 #define UPDI_NVM_STATUS_EEPROM_BUSY  1
 #define UPDI_NVM_STATUS_FLASH_BUSY  0
 
+// Max UPDI sessions run at same time, one for each serial port in gang programming
+#ifndef UPDI_MAX_CHANNEL
+#define UPDI_MAX_CHANNEL  4
+#endif
+
 #endif
 
 #endif
\ No newline at end of file
@@ -20,16 +20,28 @@ limitations under the License.
 #include "physical.h"
 #include "link.h"
 #include "constants.h"
+#include "stats.h"
 
 /*
     LINK level memory struct
     @mgwd: magicword
     @phy: pointer to phy object
+    @baud: baudrate of the last link_set_init(), restored by the recovery
+    @retry: recovery policy
+    @budget: recoveries left of the transaction being retried
+    @recovering: in link_connect() or link_recover(), the transactions of them are not retried
+    @cs/cs_valid: shadow of the CS/ASI registers and the valid bit of each address, see LINK_CS_xxx
 */
 typedef struct _upd_datalink {
 #define UPD_DATALINK_MAGIC_WORD 0xC3C3 //'ulin'
     unsigned int mgwd;  //magic word
     void *phy;
+    int baud;
+    link_retry_t retry;
+    int budget;
+    bool recovering;
+    u8 cs[16];
+    u16 cs_valid;
 }upd_datalink_t;
 
 /*
@@ -40,47 +52,168 @@ typedef struct _upd_datalink {
 #define VALID_LINK(_link) ((_link) && ((_link)->mgwd == UPD_DATALINK_MAGIC_WORD))
 #define PHY(_link) ((_link)->phy)
 
+/*
+    CS/ASI register shadow rules
+    @LINK_CS_CACHED: served from the shadow by _link_ldcs_cached(), the others(PESIG, reset request, CRC status,
+        ASI key and system status) are always read from the target
+    @LINK_CS_SAME_WRITE: the STCS of the value in the shadow is skipped, writing them has no side effect
+    @LINK_CS_ALL: all dropped by the double break and UPDI disable
+    The ASI status registers change without the host(the lock state after chip erase, NVMPROG after the reset),
+    so they are not shadowed
+*/
+#define LINK_CS_BIT(_addr) (1 << (_addr))
+#define LINK_CS_CACHED (LINK_CS_BIT(UPDI_CS_STATUSA) | LINK_CS_BIT(UPDI_CS_CTRLA) | LINK_CS_BIT(UPDI_CS_CTRLB) | \
+    LINK_CS_BIT(UPDI_ASI_CTRLA))
+#define LINK_CS_SAME_WRITE (LINK_CS_BIT(UPDI_CS_CTRLA) | LINK_CS_BIT(UPDI_CS_CTRLB) | LINK_CS_BIT(UPDI_ASI_CTRLA))
+#define LINK_CS_ALL 0xFFFF
+
+/*
+    LINK object create on a PHY object
+    @phy: PHY object pointer
+    @return LINK ptr, NULL if no free channel
+*/
+UPDI_THREAD_LOCAL upd_datalink_t datalink[UPDI_MAX_CHANNEL];
+static void *updi_datalink_create(void *phy)
+{
+    upd_datalink_t *link;
+    int i;
+
+    for (i = 0; i < ARRAY_SIZE(datalink); i++) {
+        if (!VALID_LINK(&datalink[i]))
+            break;
+    }
+
+    if (i >= ARRAY_SIZE(datalink)) {
+        DBG_INFO(LINK_DEBUG, "<LINK> no free channel");
+        return NULL;
+    }
+
+    link = &datalink[i];//(upd_datalink_t *)malloc(sizeof(*link));
+    link->mgwd = UPD_DATALINK_MAGIC_WORD;
+    link->phy = (void *)phy;
+    link->baud = 115200;
+    link->retry.attempts = LINK_RETRY_ATTEMPTS;
+    link->retry.budget = LINK_RECOVER_BUDGET;
+    link->budget = 0;
+    link->recovering = false;
+    link->cs_valid = 0;
+
+    return link;
+}
+
+/*
+    LINK object open, the target is not required to be connected
+    @port: serial port name of Window or Linux
+    @return LINK ptr, NULL if failed
+*/
+void *updi_datalink_open(const char *port)
+{
+    void *link, *phy;
+
+    DBG_INFO(LINK_DEBUG, "<LINK> open link");
+
+    phy = updi_physical_init(port, 115200);  //default baudrate first
+    if (!phy)
+        return NULL;
+
+    link = updi_datalink_create(phy);
+    if (!link)
+        updi_physical_deinit(phy);
+
+    return link;
+}
+
+/*
+    LINK object open for link_async_start(), even the double break is left to LINK_OP_BREAK
+    @port: serial port name of Window or Linux
+    @return LINK ptr, NULL if failed
+*/
+void *updi_datalink_open_async(const char *port)
+{
+    void *link, *phy;
+
+    DBG_INFO(LINK_DEBUG, "<LINK> open async link");
+
+    phy = updi_physical_open(port, 115200);
+    if (!phy)
+        return NULL;
+
+    link = updi_datalink_create(phy);
+    if (!link)
+        updi_physical_deinit(phy);
+
+    return link;
+}
+
+/*
+    LINK send the double break, the UPDI is reset so the CS shadow is dropped
+    @link: LINK object
+    @no return
+*/
+static void link_double_break(upd_datalink_t *link)
+{
+    phy_send_double_break(PHY(link));
+    link->cs_valid = 0;
+}
+
+/*
+    LINK connect the target, set the link parameter and check the UPDI status, retried with double break
+    @link_ptr: LINK object pointer, acquired from updi_datalink_open()
+    @baud: baudrate
+    @return 0 successful, other value if failed
+*/
+int link_connect(void *link_ptr, int baud)
+{
+    upd_datalink_t *link = (upd_datalink_t *)link_ptr;
+    int result, retry = 3;
+
+    if (!VALID_LINK(link))
+        return ERROR_PTR;
+
+    // A new session, the failures of connecting are retried here instead of recovered
+    link->recovering = true;
+    link->cs_valid = 0;
+
+    do {
+      result = link_set_init(link, baud);
+      if (result) {
+          DBG_INFO(LINK_DEBUG, "link_set_init failed %d, retry=%d", result, retry);
+          link_double_break(link);
+          continue;
+      }
+
+      result = link_check(link);
+      if (result) {
+          DBG_INFO(LINK_DEBUG, "link_check failed %d, retry=%d", result, retry);
+          link_double_break(link);
+          continue;
+      }
+    }while(retry-- && result);
+
+    link->recovering = false;
+
+    if (result)
+        return -2;
+
+    return 0;
+}
+
 /*
     LINK object init
     @port: serial port name of Window or Linux
     @baud: baudrate
     @return LINK ptr, NULL if failed
 */
-upd_datalink_t datalink;
 void *updi_datalink_init(const char *port, int baud)
 {
-    upd_datalink_t *link = NULL;
-    void *phy;
-    int result, retry = 3;
+    void *link;
 
     DBG_INFO(LINK_DEBUG, "<LINK> init link");
-    
-    phy = updi_physical_init(port, 115200);  //default baudrate first
-    if (phy) {
-        link = &datalink;//(upd_datalink_t *)malloc(sizeof(*link));
-        link->mgwd = UPD_DATALINK_MAGIC_WORD;
-        link->phy = (void *)phy;
-
-        do {
-          result = link_set_init(link, baud);
-          if (result) {
-              DBG_INFO(LINK_DEBUG, "link_set_init failed %d, retry=%d", result, retry);
-              phy_send_double_break(phy);
-              continue;
-          }
-
-          result = link_check(link);
-          if (result) {
-              DBG_INFO(LINK_DEBUG, "link_check failed %d, retry=%d", result, retry);
-              phy_send_double_break(phy);
-              continue;
-          }
-        }while(retry-- && result);
 
-        if (result) {
-          updi_datalink_deinit(link);
-          return NULL;
-        }
+    link = updi_datalink_open(port);
+    if (link && link_connect(link, baud)) {
+        updi_datalink_deinit(link);
+        return NULL;
     }
 
     return link;
@@ -98,10 +231,44 @@ void updi_datalink_deinit(void *link_ptr)
         DBG_INFO(LINK_DEBUG, "<LINK> deinit link");
 
         updi_physical_deinit(PHY(link));
+        link->mgwd = 0;
         //free(link);
     }
 }
 
+/*
+    LINK set the delay after each sending of PHY
+    @link_ptr: LINK object pointer, acquired from updi_datalink_init()
+    @ibdly: delay ms, 0 no delay
+    @return 0 successful, other value if failed
+*/
+int link_set_ibdly(void *link_ptr, int ibdly)
+{
+    upd_datalink_t *link = (upd_datalink_t *)link_ptr;
+
+    if (!VALID_LINK(link))
+        return ERROR_PTR;
+
+    return phy_set_ibdly(PHY(link), ibdly);
+}
+
+/*
+    LINK get the baudrate and the delay after each sending of PHY
+    @link_ptr: LINK object pointer, acquired from updi_datalink_init()
+    @baud: output of baudrate
+    @ibdly: output of delay ms
+    @return 0 successful, other value if failed
+*/
+int link_get_timing(void *link_ptr, int *baud, int *ibdly)
+{
+    upd_datalink_t *link = (upd_datalink_t *)link_ptr;
+
+    if (!VALID_LINK(link))
+        return ERROR_PTR;
+
+    return phy_get_timing(PHY(link), baud, ibdly);
+}
+
 /*
     LINK Set the inter-byte delay bit and disable collision detection
     @link_ptr: APP object pointer, acquired from updi_datalink_init()
@@ -152,7 +319,7 @@ int link_set_init(void *link_ptr, int baud)
     }
 
     // clock source
-    result = _link_ldcs(link_ptr, UPDI_ASI_CTRLA, &resp);
+    result = _link_ldcs_cached(link_ptr, UPDI_ASI_CTRLA, &resp);
     if (result || resp != clksel) {
         result = link_stcs(link, UPDI_ASI_CTRLA, clksel);
         if (result) {
@@ -168,6 +335,8 @@ int link_set_init(void *link_ptr, int baud)
         return -4;
     }
 
+    link->baud = baud;
+
     return 0;
 }
 
@@ -216,6 +385,108 @@ int link_check(void *link_ptr)
     return 0;
 }
 
+/*
+    LINK set the recovery policy
+    @link_ptr: LINK object pointer, acquired from updi_datalink_init()
+    @policy: recovery policy, NULL for the default
+    @return 0 successful, other value if failed
+*/
+int link_set_retry(void *link_ptr, const link_retry_t *policy)
+{
+    upd_datalink_t *link = (upd_datalink_t *)link_ptr;
+
+    if (!VALID_LINK(link))
+        return ERROR_PTR;
+
+    if (policy) {
+        link->retry = *policy;
+    } else {
+        link->retry.attempts = LINK_RETRY_ATTEMPTS;
+        link->retry.budget = LINK_RECOVER_BUDGET;
+    }
+
+    return 0;
+}
+
+/*
+    LINK recover the link after a failed transaction: double break, link parameters at the session baudrate,
+    and the UPDI status check. The ASI key state is left to the caller(the target may be reset by the glitch)
+    @link_ptr: LINK object pointer, acquired from updi_datalink_init()
+    @return 0 successful, other value if failed
+*/
+int link_recover(void *link_ptr)
+{
+    upd_datalink_t *link = (upd_datalink_t *)link_ptr;
+    int result;
+
+    if (!VALID_LINK(link))
+        return ERROR_PTR;
+
+    if (link->recovering)
+        return -2;
+
+    if (link->budget <= 0) {
+        DBG_INFO(LINK_DEBUG, "<LINK> Recover: no budget");
+        return -3;
+    }
+
+    DBG_INFO(LINK_DEBUG, "<LINK> Recover, budget %d", link->budget);
+
+    link->budget--;
+    link->recovering = true;
+    UPDI_STATS_INC(link.recoveries);
+
+    link_double_break(link);
+
+    result = link_set_init(link, link->baud);
+    if (result) {
+        DBG_INFO(LINK_DEBUG, "link_set_init failed %d", result);
+        result = -4;
+    }
+    else {
+        result = link_check(link);
+        if (result) {
+            DBG_INFO(LINK_DEBUG, "link_check failed %d", result);
+            result = -5;
+        }
+    }
+
+    link->recovering = false;
+    if (result)
+        UPDI_STATS_INC(link.recover_fails);
+
+    return result;
+}
+
+/*
+    LINK decide whether a failed idempotent transaction is retried, the link is recovered if so.
+    The first failure of a transaction(attempt 0) renews the recovery budget
+    @link_ptr: LINK object pointer, acquired from updi_datalink_init()
+    @attempt: retries done of the transaction
+    @return true to retry
+*/
+bool link_retry(void *link_ptr, int attempt)
+{
+    upd_datalink_t *link = (upd_datalink_t *)link_ptr;
+
+    if (!VALID_LINK(link) || link->recovering || attempt >= link->retry.attempts)
+        return false;
+
+    if (!attempt)
+        link->budget = link->retry.budget;
+
+    // A failed recovery is tried again, the budget bounds the total
+    while (link_recover(link)) {
+        if (link->budget <= 0)
+            return false;
+    }
+
+    UPDI_STATS_INC(link.retries);
+    UPDI_STATS_INC(phy.retries);
+
+    return true;
+}
+
 /*
     LINK read udpi control register
     @link_ptr: APP object pointer, acquired from updi_datalink_init()
@@ -232,24 +503,55 @@ int _link_ldcs(void *link_ptr, u8 address, u8 *data)
     upd_datalink_t *link = (upd_datalink_t *)link_ptr;
     u8 cmd[] = { UPDI_PHY_SYNC, UPDI_LDCS | (address & 0x0F) };
     u8 resp;
-    int result;
+    int result, attempt = 0;
 
     if (!VALID_LINK(link) || !data)
         return ERROR_PTR;
 
     DBG_INFO(LINK_DEBUG, "<LINK> LDCS from 0x%02x", address);
-    result = phy_transfer(PHY(link), cmd, sizeof(cmd), &resp, sizeof(resp));
-     if (result != sizeof(resp)) {
+    do {
+        result = phy_transfer(PHY(link), cmd, sizeof(cmd), &resp, sizeof(resp));
+    } while (result != sizeof(resp) && link_retry(link, attempt++));
+    if (result != sizeof(resp)) {
         DBG_INFO(LINK_DEBUG, "phy_transfer failed %d", result);
         return -2;
     }
 
-    
+    address &= 0x0F;
+    link->cs[address] = resp;
+    link->cs_valid |= LINK_CS_BIT(address) & LINK_CS_CACHED;
+
     *data = resp;
 
     return 0;
 }
 
+/*
+    LINK read udpi control register, served from the shadow if the register is cached and not dropped since
+    the last access. Not for polling a status changed by the target itself
+    @link_ptr: APP object pointer, acquired from updi_datalink_init()
+    @address: reg address
+    @data: output 8bit buffer
+    @return 0 successful, other value if failed
+*/
+int _link_ldcs_cached(void *link_ptr, u8 address, u8 *data)
+{
+    upd_datalink_t *link = (upd_datalink_t *)link_ptr;
+
+    if (!VALID_LINK(link) || !data)
+        return ERROR_PTR;
+
+    address &= 0x0F;
+    if (link->cs_valid & LINK_CS_BIT(address)) {
+        DBG_INFO(LINK_DEBUG, "<LINK> LDCS from 0x%02x cached 0x%02x", address, link->cs[address]);
+        UPDI_STATS_INC(link.cs_cached);
+        *data = link->cs[address];
+        return 0;
+    }
+
+    return _link_ldcs(link, address, data);
+}
+
 /*
     LINK read udpi control register capsule
     @link_ptr: APP object pointer, acquired from updi_datalink_init()
@@ -284,19 +586,38 @@ int link_stcs(void *link_ptr, u8 address, u8 value)
     */
     upd_datalink_t *link = (upd_datalink_t *)link_ptr;
     u8 cmd[] = { UPDI_PHY_SYNC, UPDI_STCS | (address & 0x0F), value };
-    int result;
+    int result, attempt = 0;
 
     if (!VALID_LINK(link))
         return ERROR_PTR;
 
-    DBG_INFO(LINK_DEBUG, "<LINK> STCS to 0x02x", address);
+    address &= 0x0F;
+    if ((link->cs_valid & LINK_CS_SAME_WRITE & LINK_CS_BIT(address)) && link->cs[address] == value) {
+        DBG_INFO(LINK_DEBUG, "<LINK> STCS to 0x%02x skipped, same value 0x%02x", address, value);
+        UPDI_STATS_INC(link.cs_cached);
+        return 0;
+    }
 
-    result = phy_send(PHY(link), cmd, sizeof(cmd));
+    DBG_INFO(LINK_DEBUG, "<LINK> STCS to 0x%02x", address);
+
+    do {
+        result = phy_send(PHY(link), cmd, sizeof(cmd));
+    } while (result && link_retry(link, attempt++));
     if (result) {
+        // Not known what the target got
+        link->cs_valid &= ~LINK_CS_BIT(address);
         DBG_INFO(LINK_DEBUG, "phy_send failed %d", result);
         return -2;
     }
 
+    if (address == UPDI_CS_CTRLB && (value & (1 << UPDI_CTRLB_UPDIDIS_BIT))) {
+        link->cs_valid = 0;
+    }
+    else {
+        link->cs[address] = value;
+        link->cs_valid |= LINK_CS_BIT(address) & LINK_CS_CACHED;
+    }
+
     return 0;
 }
 
@@ -316,14 +637,16 @@ int _link_ld(void *link_ptr, u16 address, u8 *val)
     upd_datalink_t *link = (upd_datalink_t *)link_ptr;
     const u8 cmd[] = { UPDI_PHY_SYNC, UPDI_LDS | UPDI_ADDRESS_16 | UPDI_DATA_8, address & 0xFF, (address >> 8) & 0xFF};
     u8 resp;
-    int result;
+    int result, attempt = 0;
 
     if (!VALID_LINK(link) || !val)
         return ERROR_PTR;
 
     DBG_INFO(LINK_DEBUG, "<LINK> LD from %04X}", address);
   
-    result = phy_transfer(PHY(link), cmd, sizeof(cmd), &resp, sizeof(resp));
+    do {
+        result = phy_transfer(PHY(link), cmd, sizeof(cmd), &resp, sizeof(resp));
+    } while (result != sizeof(resp) && link_retry(link, attempt++));
     if (result != sizeof(resp)) {
         DBG_INFO(LINK_DEBUG, "phy_transfer failed %d", result);
         return -2;
@@ -364,14 +687,16 @@ int _link_ld16(void *link_ptr, u16 address, u16 *val)
     upd_datalink_t *link = (upd_datalink_t *)link_ptr;
     const u8 cmd[] = { UPDI_PHY_SYNC , UPDI_LDS | UPDI_ADDRESS_16 | UPDI_DATA_16, address & 0xFF, (address >> 8) & 0xFF};
     u8 resp[2];
-    int result;
+    int result, attempt = 0;
 
     if (!VALID_LINK(link))
         return ERROR_PTR;
 
     DBG_INFO(LINK_DEBUG, "<LINK> LD from %04X}", address);
 
-    result = phy_transfer(PHY(link), cmd, sizeof(cmd), resp, sizeof(resp));
+    do {
+        result = phy_transfer(PHY(link), cmd, sizeof(cmd), resp, sizeof(resp));
+    } while (result != sizeof(resp) && link_retry(link, attempt++));
     if (result != sizeof(resp)) {
         DBG_INFO(LINK_DEBUG, "phy_transfer failed %d", result);
         return -2;
@@ -426,12 +751,14 @@ int link_st(void *link_ptr, u16 address, u8 value)
 
     result = phy_transfer(PHY(link), cmd, sizeof(cmd), &resp, sizeof(resp));
     if (result != sizeof(resp) || resp != UPDI_PHY_ACK) {
+        UPDI_STATS_INC(link.ack_fail);
         DBG_INFO(LINK_DEBUG, "phy_transfer failed %d ack %02x", result, resp);
         return -2;
     }
 
     result = phy_transfer(PHY(link), val, sizeof(val), &resp, sizeof(resp));
     if (result != sizeof(resp) || resp != UPDI_PHY_ACK) {
+        UPDI_STATS_INC(link.ack_fail);
         DBG_INFO(LINK_DEBUG, "phy_transfer #2 failed %d ack %02x", result, resp);
         return -2;
     }
@@ -464,12 +791,14 @@ int link_st16(void *link_ptr, u16 address, u16 value)
 
     result = phy_transfer(PHY(link), cmd, sizeof(cmd), &resp, sizeof(resp));
     if (result != sizeof(resp) || resp != UPDI_PHY_ACK) {
+        UPDI_STATS_INC(link.ack_fail);
         DBG_INFO(LINK_DEBUG, "phy_transfer failed %d ack %02x", result, resp);
         return -2;
     }
 
     result = phy_transfer(PHY(link), val, sizeof(val), &resp, sizeof(resp));
     if (result != sizeof(resp) || resp != UPDI_PHY_ACK) {
+        UPDI_STATS_INC(link.ack_fail);
         DBG_INFO(LINK_DEBUG, "phy_transfer #2 failed %d ack %02x", result, resp);
         return -2;
     }
@@ -539,6 +868,56 @@ int link_ld_ptr_inc16(void *link_ptr, u8 *data, int len)
     return 0;
 }
 
+/*
+    LINK read a block in one transfer: ST ptr, REPEAT and LD *(ptr++) are sent together.
+    The ACK of the ST ptr is suppressed by setting CTRLA.RSD around it, so the only response is the data,
+    which comes last: the target answers on the same wire while the host would still be sending
+    @link_ptr: APP object pointer, acquired from updi_datalink_init()
+    @address: target address
+    @data: data output buffer
+    @len: data length to be read, max UPDI_MAX_REPEAT_SIZE + 1
+    @return 0 successful, other value if failed
+*/
+int link_ld_burst(void *link_ptr, u16 address, u8 *data, int len)
+{
+    upd_datalink_t *link = (upd_datalink_t *)link_ptr;
+    u8 ctrla, cmd[] = {
+        UPDI_PHY_SYNC, UPDI_STCS | UPDI_CS_CTRLA, 0,
+        UPDI_PHY_SYNC, UPDI_ST | UPDI_PTR_ADDRESS | UPDI_DATA_16, address & 0xFF, (address >> 8) & 0xFF,
+        UPDI_PHY_SYNC, UPDI_STCS | UPDI_CS_CTRLA, 0,
+        UPDI_PHY_SYNC, UPDI_REPEAT | UPDI_REPEAT_BYTE, (u8)(len - 1),
+        UPDI_PHY_SYNC, UPDI_LD | UPDI_PTR_INC | UPDI_DATA_8 };
+    int result, attempt = 0;
+
+    if (!VALID_LINK(link) || !data)
+        return ERROR_PTR;
+
+    if (len <= 0 || len > UPDI_MAX_REPEAT_SIZE + 1)
+        return -2;
+
+    DBG_INFO(LINK_DEBUG, "<LINK> LD burst %d bytes from %04X", len, address);
+
+    // CTRLA is restored at the end, the shadow value is kept if known
+    ctrla = (link->cs_valid & LINK_CS_BIT(UPDI_CS_CTRLA)) ? link->cs[UPDI_CS_CTRLA] : (1 << UPDI_CTRLA_IBDLY_BIT);
+    cmd[2] = ctrla | (1 << UPDI_CTRLA_RSD_BIT);
+    cmd[9] = ctrla;
+
+    do {
+        result = phy_transfer(PHY(link), cmd, sizeof(cmd), data, len);
+    } while (result != len && link_retry(link, attempt++));
+    if (result != len) {
+        // RSD may be left on, the CTRLA must be written again
+        link->cs_valid &= ~LINK_CS_BIT(UPDI_CS_CTRLA);
+        DBG_INFO(LINK_DEBUG, "phy_transfer failed %d", result);
+        return -3;
+    }
+
+    link->cs[UPDI_CS_CTRLA] = ctrla;
+    link->cs_valid |= LINK_CS_BIT(UPDI_CS_CTRLA);
+
+    return 0;
+}
+
 /*
     LINK set st/ld command address
     @link_ptr: APP object pointer, acquired from updi_datalink_init()
@@ -562,6 +941,7 @@ int link_st_ptr(void *link_ptr, u16 address)
 
     result = phy_transfer(PHY(link), cmd, sizeof(cmd), &resp, sizeof(resp));
     if (result != sizeof(resp) || resp != UPDI_PHY_ACK) {
+        UPDI_STATS_INC(link.ack_fail);
         DBG_INFO(LINK_DEBUG, "phy_transfer failed %d resp = 0x%02x", result, resp);
         return -2;
     }
@@ -575,9 +955,10 @@ int link_st_ptr(void *link_ptr, u16 address)
     @link_ptr: APP object pointer, acquired from updi_datalink_init()
     @data: data input buffer
     @len: data length
+    @acked: output bytes acknowledged, the data before the failure stored by the target, could be NULL
     @return 0 successful, other value if failed
 */
-int link_st_ptr_inc(void *link_ptr, const u8 *data, int len)
+int link_st_ptr_inc(void *link_ptr, const u8 *data, int len, int *acked)
 {
     /*
         Store data to the pointer location with pointer post - increment
@@ -588,6 +969,9 @@ int link_st_ptr_inc(void *link_ptr, const u8 *data, int len)
     int i;
     int result;
 
+    if (acked)
+        *acked = 0;
+
     if (!VALID_LINK(link))
         return ERROR_PTR;
 
@@ -595,18 +979,26 @@ int link_st_ptr_inc(void *link_ptr, const u8 *data, int len)
 
     result = phy_transfer(PHY(link), cmd, sizeof(cmd), &resp, sizeof(resp));
     if (result != sizeof(resp) || resp != UPDI_PHY_ACK) {
+        UPDI_STATS_INC(link.ack_fail);
         DBG_INFO(LINK_DEBUG, "phy_transfer failed %d resp 0x%02x", result, resp);
         return -2;
     }
 
     for (i = 1; i < len; i++) {
+        if (acked)
+            *acked = i;
+
         result = phy_transfer(PHY(link), &data[i], 1, &resp, sizeof(resp));
         if (result != sizeof(resp) || resp != UPDI_PHY_ACK) {
+            UPDI_STATS_INC(link.ack_fail);
             DBG_INFO(LINK_DEBUG, "phy_transfer failed %d i %d resp 0x%02x", result, i, resp);
             return -2;
         }
     }
 
+    if (acked)
+        *acked = len;
+
     return 0;
 }
 
@@ -616,9 +1008,10 @@ int link_st_ptr_inc(void *link_ptr, const u8 *data, int len)
     @link_ptr: APP object pointer, acquired from updi_datalink_init()
     @data: data input buffer
     @len: data length
+    @acked: output bytes acknowledged, the data before the failure stored by the target, could be NULL
     @return 0 successful, other value if failed
 */
-int link_st_ptr_inc16(void *link_ptr, const u8 *data, int len)
+int link_st_ptr_inc16(void *link_ptr, const u8 *data, int len, int *acked)
 {
     /*
         Store a 16 - bit word value to the pointer location with pointer post - increment
@@ -629,6 +1022,9 @@ int link_st_ptr_inc16(void *link_ptr, const u8 *data, int len)
     int i;
     int result;
 
+    if (acked)
+        *acked = 0;
+
     if (!VALID_LINK(link))
         return ERROR_PTR;
 
@@ -636,18 +1032,26 @@ int link_st_ptr_inc16(void *link_ptr, const u8 *data, int len)
 
     result = phy_transfer(PHY(link), cmd, sizeof(cmd), &resp, sizeof(resp));
     if (result != sizeof(resp) || resp != UPDI_PHY_ACK) {
+        UPDI_STATS_INC(link.ack_fail);
         DBG_INFO(LINK_DEBUG, "phy_transfer failed %d resp 0x%02x", result, resp);
         return -2;
     }
 
     for (i = 2; i < len; i += 2) {
+        if (acked)
+            *acked = i;
+
         result = phy_transfer(PHY(link), &data[i], 2, &resp, sizeof(resp));
         if (result != sizeof(resp) || resp != UPDI_PHY_ACK) {
+            UPDI_STATS_INC(link.ack_fail);
             DBG_INFO(LINK_DEBUG, "phy_transfer failed %d i %d resp 0x%02x", result, i, resp);
             return -3;
         }
     }
 
+    if (acked)
+        *acked = len;
+
     return 0;
 }
 
@@ -723,13 +1127,18 @@ int link_read_sib(void *link_ptr, u8 *data, int len)
         Read the SIB
     */
     upd_datalink_t *link = (upd_datalink_t *)link_ptr;
+    int result, attempt = 0;
 
     if (!VALID_LINK(link))
         return ERROR_PTR;
 
     DBG_INFO(LINK_DEBUG, "<LINK> Read SIB len %d", len);
 
-    return phy_sib(PHY(link), data, len);
+    do {
+        result = phy_sib(PHY(link), data, len);
+    } while (result && link_retry(link, attempt++));
+
+    return result;
 }
 
 /*
@@ -748,28 +1157,354 @@ int link_key(void *link_ptr, u8 size_k, const char *key)
     const u8 cmd[] = { UPDI_PHY_SYNC, UPDI_KEY | UPDI_KEY_KEY | size_k };
     u8 len = 8 << size_k;
     int i;
-    int result;
+    int result, attempt = 0;
 
     if (!VALID_LINK(link))
         return ERROR_PTR;
 
     DBG_INFO(LINK_DEBUG, "<LINK> Key %x", size_k);
 
-    result = phy_send(PHY(link), cmd, sizeof(cmd));
+    // The same key sent again is harmless, the whole key is retried after the recovery
+    do {
+        result = phy_send(PHY(link), cmd, sizeof(cmd));
+        if (result) {
+            DBG_INFO(LINK_DEBUG, "phy_send failed %d", result);
+            result = -2;
+            continue;
+        }
+
+        for (i = 0; i < len; i++) {
+            result = phy_send_byte(PHY(link), (u8)key[len - i - 1]); //Reserse the string
+            if (result) {
+                DBG_INFO(LINK_DEBUG, "phy_send byte %d failed %d", i, result);
+                result = -3;
+                break;
+            }
+        }
+    } while (result && link_retry(link, attempt++));
+
+    if (result)
+        return result;
+
+    UPDI_STATS_INC(link.keys);
+
+    return 0;
+}
+
+/*
+    LINK get the file descriptor of the serial port
+    @link_ptr: LINK object pointer, acquired from updi_datalink_open_async()
+    @return fd, negative if the port has no fd
+*/
+int link_get_fd(void *link_ptr)
+{
+    upd_datalink_t *link = (upd_datalink_t *)link_ptr;
+
+    if (!VALID_LINK(link))
+        return ERROR_PTR;
+
+    return phy_get_fd(PHY(link));
+}
+
+/*
+    LINK async transfer of the current op, the response is stored in la->resp if no rdata
+    @la: async state
+    @len: command length in la->cmd
+    @rdata: response buffer, NULL to la->resp
+    @rlen: response length
+    @return 0 successful, other value if failed
+*/
+static int link_async_transfer(link_async_t *la, int len, u8 *rdata, int rlen)
+{
+    upd_datalink_t *link = (upd_datalink_t *)la->link;
+    int result;
+
+    result = phy_async_start(&la->xfer, PHY(link), la->cmd, len, rdata ? rdata : la->resp, rlen, LINK_ASYNC_TIMEOUT_MS);
     if (result) {
-        DBG_INFO(LINK_DEBUG, "phy_send failed %d", result);
+        DBG_INFO(LINK_DEBUG, "phy_async_start failed %d", result);
         return -2;
     }
 
-    for (i = 0; i < len; i++) {
-        result = phy_send_byte(PHY(link), (u8)key[len - i - 1]); //Reserse the string
+    la->busy = true;
+
+    return 0;
+}
+
+/*
+    LINK async run a step of the current op, a transfer is started or the op is finished
+    @la: async state
+    @return 1 transfer started or waiting, 0 op finished, other value if failed
+*/
+static int link_async_step(link_async_t *la)
+{
+    upd_datalink_t *link = (upd_datalink_t *)la->link;
+    const link_op_t *op = &la->ops[la->index];
+    unsigned int now;
+    int i, result;
+
+    switch (op->type) {
+    case LINK_OP_BREAK:
+        if (la->step)
+            return 0;
+        result = phy_async_break(&la->xfer, PHY(link));
+        if (result) {
+            DBG_INFO(LINK_DEBUG, "phy_async_break failed %d", result);
+            return -2;
+        }
+        la->busy = true;
+        return 1;
+
+    case LINK_OP_BAUD:
+        result = phy_set_baudrate(PHY(link), op->len);
         if (result) {
-            DBG_INFO(LINK_DEBUG, "phy_send byte %d failed %d", i, result);
-            return -3;
+            DBG_INFO(LINK_DEBUG, "phy_set_baudrate %d failed %d", op->len, result);
+            return -2;
+        }
+        return 0;
+
+    case LINK_OP_LDCS:
+    case LINK_OP_WAIT_CS:
+        if (la->step) {
+            if (op->rdata)
+                *op->rdata = la->resp[0];
+            break;
+        }
+        la->cmd[0] = UPDI_PHY_SYNC;
+        la->cmd[1] = UPDI_LDCS | (op->address & 0x0F);
+        return link_async_transfer(la, 2, NULL, 1) ? -2 : 1;
+
+    case LINK_OP_STCS:
+        if (la->step)
+            return 0;
+        la->cmd[0] = UPDI_PHY_SYNC;
+        la->cmd[1] = UPDI_STCS | (op->address & 0x0F);
+        la->cmd[2] = op->value;
+        return link_async_transfer(la, 3, NULL, 0) ? -2 : 1;
+
+    case LINK_OP_LD:
+    case LINK_OP_WAIT:
+        if (la->step) {
+            if (op->rdata)
+                *op->rdata = la->resp[0];
+            break;
         }
+        la->cmd[0] = UPDI_PHY_SYNC;
+        la->cmd[1] = UPDI_LDS | UPDI_ADDRESS_16 | UPDI_DATA_8;
+        la->cmd[2] = op->address & 0xFF;
+        la->cmd[3] = (op->address >> 8) & 0xFF;
+        return link_async_transfer(la, 4, NULL, 1) ? -2 : 1;
+
+    case LINK_OP_ST:
+        if (la->step == 0) {
+            la->cmd[0] = UPDI_PHY_SYNC;
+            la->cmd[1] = UPDI_STS | UPDI_ADDRESS_16 | UPDI_DATA_8;
+            la->cmd[2] = op->address & 0xFF;
+            la->cmd[3] = (op->address >> 8) & 0xFF;
+            return link_async_transfer(la, 4, NULL, 1) ? -2 : 1;
+        }
+        if (la->resp[0] != UPDI_PHY_ACK) {
+            UPDI_STATS_INC(link.ack_fail);
+            DBG_INFO(LINK_DEBUG, "ST ack %02x", la->resp[0]);
+            return -4;
+        }
+        if (la->step == 2)
+            return 0;
+        la->cmd[0] = op->value;
+        return link_async_transfer(la, 1, NULL, 1) ? -2 : 1;
+
+    case LINK_OP_KEY:
+        if (la->step)
+            return 0;
+        la->cmd[0] = UPDI_PHY_SYNC;
+        la->cmd[1] = UPDI_KEY | UPDI_KEY_KEY | UPDI_KEY_64;
+        for (i = 0; i < 8; i++)
+            la->cmd[2 + i] = op->wdata[7 - i];  //Reserse the string
+        UPDI_STATS_INC(link.keys);
+        return link_async_transfer(la, 10, NULL, 0) ? -2 : 1;
+
+    case LINK_OP_SIB:
+        if (la->step)
+            return 0;
+        la->cmd[0] = UPDI_PHY_SYNC;
+        la->cmd[1] = UPDI_KEY | UPDI_KEY_SIB | UPDI_SIB_16BYTES;
+        return link_async_transfer(la, 2, op->rdata, min(op->len, 16)) ? -2 : 1;
+
+    case LINK_OP_READ:
+    case LINK_OP_WRITE:
+        if (op->len <= 0 || op->len > 256)
+            return -6;
+
+        /* Step 0: pointer, 1: repeat, 2: the first data, 3 ~: the next data of LINK_OP_WRITE */
+        if (la->step == 0) {
+            la->cmd[0] = UPDI_PHY_SYNC;
+            la->cmd[1] = UPDI_ST | UPDI_PTR_ADDRESS | UPDI_DATA_16;
+            la->cmd[2] = op->address & 0xFF;
+            la->cmd[3] = (op->address >> 8) & 0xFF;
+            return link_async_transfer(la, 4, NULL, 1) ? -2 : 1;
+        }
+
+        if ((la->step == 1 || (la->step >= 3 && op->type == LINK_OP_WRITE)) && la->resp[0] != UPDI_PHY_ACK) {
+            UPDI_STATS_INC(link.ack_fail);
+            DBG_INFO(LINK_DEBUG, "%s step %d ack %02x", op->type == LINK_OP_READ ? "READ" : "WRITE", la->step, la->resp[0]);
+            return -4;
+        }
+
+        if (la->step == 1 && op->len > 1) {
+            la->cmd[0] = UPDI_PHY_SYNC;
+            la->cmd[1] = UPDI_REPEAT | UPDI_REPEAT_BYTE;
+            la->cmd[2] = (u8)(op->len - 1);
+            return link_async_transfer(la, 3, NULL, 0) ? -2 : 1;
+        }
+
+        if (la->step <= 2) {
+            la->step = 2;
+            la->cmd[0] = UPDI_PHY_SYNC;
+            if (op->type == LINK_OP_READ) {
+                la->cmd[1] = UPDI_LD | UPDI_PTR_INC | UPDI_DATA_8;
+                return link_async_transfer(la, 2, op->rdata, op->len) ? -2 : 1;
+            }
+            la->cmd[1] = UPDI_ST | UPDI_PTR_INC | UPDI_DATA_8;
+            la->cmd[2] = op->wdata[0];
+            return link_async_transfer(la, 3, NULL, 1) ? -2 : 1;
+        }
+
+        // each data byte is acked
+        i = la->step - 2;
+        if (op->type == LINK_OP_READ || i >= op->len)
+            return 0;
+        la->cmd[0] = op->wdata[i];
+        return link_async_transfer(la, 1, NULL, 1) ? -2 : 1;
+
+    case LINK_OP_DELAY:
+        if (la->step)
+            return 0;
+        la->wake = get_time_ms() + op->len;
+        la->waiting = true;
+        return 1;
+
+    default:
+        return -6;
+    }
+
+    // LINK_OP_WAIT_CS and LINK_OP_WAIT: done if matched, else read again 1ms later until timeout
+    if (op->type == LINK_OP_LDCS || op->type == LINK_OP_LD)
+        return 0;
+
+    if ((la->resp[0] & op->mask) == op->value)
+        return 0;
+
+    now = get_time_ms();
+    if ((int)(now - la->deadline) >= 0) {
+        DBG_INFO(LINK_DEBUG, "Wait %02x timeout, value %02x", op->address, la->resp[0]);
+        return -5;
     }
 
+    la->wake = now + 1;
+    la->waiting = true;
+    la->step = -1;  // restart the op when wakeup
+
+    return 1;
+}
+
+/*
+    LINK async start a list of ops, the ops are executed by link_async_poll() in order
+    @la: async state, owned by caller until done
+    @link_ptr: LINK object pointer, acquired from updi_datalink_open_async()
+    @ops: op list, must be kept until done
+    @nops: op count
+    @return 0 successful, other value if failed
+*/
+int link_async_start(link_async_t *la, void *link_ptr, const link_op_t *ops, int nops)
+{
+    upd_datalink_t *link = (upd_datalink_t *)link_ptr;
+
+    if (!VALID_LINK(link) || !la || !ops)
+        return ERROR_PTR;
+
+    // The ops(break, key, STCS) are not tracked by the shadow
+    link->cs_valid = 0;
+
+    memset(la, 0, sizeof(*la));
+    la->link = link;
+    la->ops = ops;
+    la->nops = nops;
+    la->step = -1;
+
     return 0;
 }
 
-#endif
\ No newline at end of file
+/*
+    LINK async poll, advances the op list as far as possible without waiting
+    @la: async state started by link_async_start()
+    @return 1 pending, 0 all the ops done, other value if failed, la->index is the failed op
+*/
+int link_async_poll(link_async_t *la)
+{
+    int result;
+
+    if (!la || !VALID_LINK((upd_datalink_t *)la->link))
+        return ERROR_PTR;
+
+    while (la->index < la->nops) {
+        if (la->busy) {
+            result = phy_async_poll(&la->xfer);
+            if (result > 0)
+                return 1;
+            la->busy = false;
+            if (result) {
+                DBG_INFO(LINK_DEBUG, "op %d step %d: phy_async_poll failed %d", la->index, la->step, result);
+                return -3;
+            }
+        }
+        else if (la->waiting) {
+            if ((int)(get_time_ms() - la->wake) < 0)
+                return 1;
+            la->waiting = false;
+        }
+
+        if (la->step < 0) {
+            la->step = 0;
+            if (la->ops[la->index].type == LINK_OP_WAIT_CS || la->ops[la->index].type == LINK_OP_WAIT) {
+                if (!la->deadline_set) {
+                    la->deadline = get_time_ms() + la->ops[la->index].timeout;
+                    la->deadline_set = true;
+                }
+            }
+        }
+        else {
+            la->step++;
+        }
+
+        result = link_async_step(la);
+        if (result < 0) {
+            DBG_INFO(LINK_DEBUG, "op %d(type %d) step %d failed %d", la->index, la->ops[la->index].type, la->step, result);
+            return result;
+        }
+
+        if (result == 0) {
+            la->index++;
+            la->step = -1;
+            la->deadline_set = false;
+        }
+    }
+
+    return 0;
+}
+
+/*
+    LINK async get the time the poll should be done even without any data received
+    @la: async state started by link_async_start()
+    @return get_time_ms() time of timeout or delay
+*/
+unsigned int link_async_wake(const link_async_t *la)
+{
+    if (la->busy)
+        return la->xfer.deadline;
+
+    if (la->waiting)
+        return la->wake;
+
+    return get_time_ms();
+}
+
+#endif
@@ -3,11 +3,108 @@
 
 #ifdef CUPDI
 
+#include "physical.h"
+
+/* Time(ms) allowed for the target response of an async transfer */
+#ifndef LINK_ASYNC_TIMEOUT_MS
+#define LINK_ASYNC_TIMEOUT_MS 20
+#endif
+
+/* Default recovery policy, see link_set_retry() */
+#ifndef LINK_RETRY_ATTEMPTS
+#define LINK_RETRY_ATTEMPTS 2   //retries of a failed transaction, 0 no recovery
+#endif
+#ifndef LINK_RECOVER_BUDGET
+#define LINK_RECOVER_BUDGET 4   //recoveries of a transaction
+#endif
+
+/*
+    Link recovery policy, a failed idempotent transaction(instruction, block read, page write, SIB or key)
+    is retried after the link is recovered by double break and re-init.
+    Both are counted for each transaction, so a long session on a noisy line is not cut by the earlier glitches
+    @attempts: retries of each transaction, 0 disables the recovery
+    @budget: recoveries(the failed ones included) allowed for the retries of each transaction
+*/
+typedef struct _link_retry {
+    int attempts;
+    int budget;
+}link_retry_t;
+
+/*
+    Micro-op types of link_async_start()
+*/
+typedef enum {
+    LINK_OP_BREAK,      // double break
+    LINK_OP_BAUD,       // set host baudrate to @len
+    LINK_OP_LDCS,       // load CS @address to *@rdata
+    LINK_OP_STCS,       // store @value to CS @address
+    LINK_OP_LD,         // load @address to *@rdata
+    LINK_OP_ST,         // store @value to @address
+    LINK_OP_KEY,        // 64-bit key @wdata
+    LINK_OP_SIB,        // SIB of @len bytes to @rdata
+    LINK_OP_READ,       // read @len(max 256) bytes from @address to @rdata
+    LINK_OP_WRITE,      // write @len(max 256) bytes of @wdata to @address
+    LINK_OP_WAIT_CS,    // load CS @address until (val & @mask) == @value, in @timeout ms
+    LINK_OP_WAIT,       // load @address until (val & @mask) == @value, in @timeout ms
+    LINK_OP_DELAY,      // delay @len ms
+}LINK_OP_T;
+
+/*
+    Link micro-op, the fields used depend on the type
+*/
+typedef struct _link_op {
+    u8 type;
+    u16 address;
+    u8 value;
+    u8 mask;
+    const u8 *wdata;
+    u8 *rdata;
+    int len;
+    int timeout;
+}link_op_t;
+
+/*
+    Link async state, the ops run one by one without blocking
+    @link: LINK object
+    @ops/nops: op list
+    @index: current op
+    @step: transfer step in current op
+    @xfer: phy transfer of the step
+    @cmd/resp: buffer of the transfer
+    @busy: transfer running
+    @waiting: delayed until @wake
+    @deadline_set/deadline: timeout of wait ops, kept across the retries
+*/
+typedef struct _link_async {
+    void *link;
+    const link_op_t *ops;
+    int nops;
+    int index;
+    int step;
+    phy_async_t xfer;
+    u8 cmd[PHY_ASYNC_MAX_LEN];
+    u8 resp[1];
+    bool busy;
+    bool waiting;
+    bool deadline_set;
+    unsigned int wake;
+    unsigned int deadline;
+}link_async_t;
+
+void *updi_datalink_open(const char *port);
+void *updi_datalink_open_async(const char *port);
 void *updi_datalink_init(const char *port, int baud);
+int link_connect(void *link_ptr, int baud);
 void updi_datalink_deinit(void *link_ptr);
+int link_set_ibdly(void *link_ptr, int ibdly);
+int link_get_timing(void *link_ptr, int *baud, int *ibdly);
 int link_set_init(void *link_ptr, int baud);
 int link_check(void *link_ptr);
+int link_set_retry(void *link_ptr, const link_retry_t *policy);
+int link_recover(void *link_ptr);
+bool link_retry(void *link_ptr, int attempt);
 int _link_ldcs(void *link_ptr, u8 address, u8 *val);
+int _link_ldcs_cached(void *link_ptr, u8 address, u8 *val);
 u8 link_ldcs(void *link_ptr, u8 address);
 int link_stcs(void *link_ptr, u8 address, u8 value);
 int _link_ld(void *link_ptr, u16 address, u8 *val);
@@ -19,12 +116,17 @@ int link_st16(void *link_ptr, u16 address, u16 value);
 int link_ld_ptr_inc(void *link_ptr, u8 *data, int len);
 int link_ld_ptr_inc16(void *link_ptr, u8 *data, int len);
 int link_st_ptr(void *link_ptr, u16 address);
-int link_st_ptr_inc(void *link_ptr, const u8 *data, int len);
-int link_st_ptr_inc16(void *link_ptr, const u8 *data, int len);
+int link_ld_burst(void *link_ptr, u16 address, u8 *data, int len);
+int link_st_ptr_inc(void *link_ptr, const u8 *data, int len, int *acked);
+int link_st_ptr_inc16(void *link_ptr, const u8 *data, int len, int *acked);
 int link_repeat(void *link_ptr, u8 repeats);
 int link_repeat16(void *link_ptr, u16 repeats);
 int link_read_sib(void *link_ptr, u8 *data, int len);
 int link_key(void *link_ptr, u8 size_k, const char *key);
+int link_get_fd(void *link_ptr);
+int link_async_start(link_async_t *la, void *link_ptr, const link_op_t *ops, int nops);
+int link_async_poll(link_async_t *la);
+unsigned int link_async_wake(const link_async_t *la);
 
 #endif
 
@@ -21,6 +21,7 @@ limitations under the License.
 #include "application.h"
 #include "nvm.h"
 #include "constants.h"
+#include "stats.h"
 
 /*
     NVM level memory struct
@@ -49,23 +50,33 @@ typedef struct _upd_nvm {
 #define NVM_REG(_nvm, _name) ((_nvm)->dev->mmap->reg._name)
 
 /*
-    NVM object init
+    NVM object open, the target is not required to be connected, connect it with nvm_connect()
     @port: serial port name of Window or Linux
-    @baud: baudrate
     @dev: point chip dev object
     @return NVM ptr, NULL if failed
 */
-upd_nvm_t nvmmem;
-void *updi_nvm_init(const char *port, int baud, void *dev)
+UPDI_THREAD_LOCAL upd_nvm_t nvmmem[UPDI_MAX_CHANNEL];
+void *updi_nvm_open(const char *port, void *dev)
 {
     upd_nvm_t *nvm = NULL;
     void *app;
+    int i;
 
-    DBG_INFO(NVM_DEBUG, "<NVM> init nvm");
+    DBG_INFO(NVM_DEBUG, "<NVM> open nvm");
+
+    for (i = 0; i < ARRAY_SIZE(nvmmem); i++) {
+        if (!VALID_NVM(&nvmmem[i]))
+            break;
+    }
 
-    app = updi_application_init(port, baud, dev);
+    if (i >= ARRAY_SIZE(nvmmem)) {
+        DBG_INFO(NVM_DEBUG, "<NVM> no free channel");
+        return NULL;
+    }
+
+    app = updi_application_open(port, dev);
     if (app) {
-        nvm = &nvmmem;//(upd_nvm_t *)malloc(sizeof(*nvm));
+        nvm = &nvmmem[i];//(upd_nvm_t *)malloc(sizeof(*nvm));
         nvm->mgwd = UPD_NVM_MAGIC_WORD;
         nvm->progmode = false;
         nvm->dev = (device_info_t *)dev;
@@ -75,6 +86,61 @@ void *updi_nvm_init(const char *port, int baud, void *dev)
     return nvm;
 }
 
+/*
+    NVM object init
+    @port: serial port name of Window or Linux
+    @baud: baudrate
+    @dev: point chip dev object
+    @return NVM ptr, NULL if failed
+*/
+void *updi_nvm_init(const char *port, int baud, void *dev)
+{
+    void *nvm;
+
+    DBG_INFO(NVM_DEBUG, "<NVM> init nvm");
+
+    nvm = updi_nvm_open(port, dev);
+    if (nvm && nvm_connect(nvm, baud)) {
+        updi_nvm_deinit(nvm);
+        return NULL;
+    }
+
+    return nvm;
+}
+
+/*
+    NVM connect the target, the progmode flag is cleared since it may be a new target
+    @nvm_ptr: NVM object pointer, acquired from updi_nvm_open()
+    @baud: baudrate
+    @return 0 successful, other value failed
+*/
+int nvm_connect(void *nvm_ptr, int baud)
+{
+    upd_nvm_t *nvm = (upd_nvm_t *)nvm_ptr;
+
+    if (!VALID_NVM(nvm))
+        return ERROR_PTR;
+
+    nvm->progmode = false;
+
+    return app_connect(APP(nvm), baud);
+}
+
+/*
+    NVM probe whether the target is connected, it's cheap(one UPDI status read) for presence detection
+    @nvm_ptr: NVM object pointer, acquired from updi_nvm_open()
+    @return 0 target responded, other value failed
+*/
+int nvm_probe(void *nvm_ptr)
+{
+    upd_nvm_t *nvm = (upd_nvm_t *)nvm_ptr;
+
+    if (!VALID_NVM(nvm))
+        return ERROR_PTR;
+
+    return app_probe(APP(nvm));
+}
+
 /*
     NVM object destroy
     @nvm_ptr: NVM object pointer, acquired from updi_nvm_init()
@@ -86,10 +152,75 @@ void updi_nvm_deinit(void *nvm_ptr)
         DBG_INFO(NVM_DEBUG, "<NVM> deinit nvm");
 
         updi_application_deinit(APP(nvm));
+        nvm->mgwd = 0;
         //free(nvm);
     }
 }
 
+/*
+    NVM set the delay after each sending of PHY
+    @nvm_ptr: NVM object pointer, acquired from updi_nvm_init()
+    @ibdly: delay ms, 0 no delay
+    @return 0 successful, other value failed
+*/
+int nvm_set_ibdly(void *nvm_ptr, int ibdly)
+{
+    upd_nvm_t *nvm = (upd_nvm_t *)nvm_ptr;
+
+    if (!VALID_NVM(nvm))
+        return ERROR_PTR;
+
+    return app_set_ibdly(APP(nvm), ibdly);
+}
+
+/*
+    NVM set the recovery policy of the link
+    @nvm_ptr: NVM object pointer, acquired from updi_nvm_init()
+    @policy: recovery policy, NULL for the default
+    @return 0 successful, other value failed
+*/
+int nvm_set_retry(void *nvm_ptr, const link_retry_t *policy)
+{
+    upd_nvm_t *nvm = (upd_nvm_t *)nvm_ptr;
+
+    if (!VALID_NVM(nvm))
+        return ERROR_PTR;
+
+    return app_set_retry(APP(nvm), policy);
+}
+
+/*
+    NVM get the baudrate and the delay after each sending of PHY
+    @nvm_ptr: NVM object pointer, acquired from updi_nvm_init()
+    @baud: output of baudrate
+    @ibdly: output of delay ms
+    @return 0 successful, other value failed
+*/
+int nvm_get_timing(void *nvm_ptr, int *baud, int *ibdly)
+{
+    upd_nvm_t *nvm = (upd_nvm_t *)nvm_ptr;
+
+    if (!VALID_NVM(nvm))
+        return ERROR_PTR;
+
+    return app_get_timing(APP(nvm), baud, ibdly);
+}
+
+/*
+    NVM get the device info of the session
+    @nvm_ptr: NVM object pointer, acquired from updi_nvm_init()
+    @return device_info_t ptr, NULL if failed
+*/
+const void *nvm_get_device(void *nvm_ptr)
+{
+    upd_nvm_t *nvm = (upd_nvm_t *)nvm_ptr;
+
+    if (!VALID_NVM(nvm))
+        return NULL;
+
+    return nvm->dev;
+}
+
 /*
     NVM get device ID information
     @nvm_ptr: NVM object pointer, acquired from updi_nvm_init()
@@ -110,6 +241,24 @@ int nvm_get_device_info(void *nvm_ptr)
     return app_device_info(APP(nvm));
 }
 
+/*
+    NVM get the device identification of the session, the signature row is read at the first call in progmode
+    @nvm_ptr: NVM object pointer, acquired from updi_nvm_init()
+    @return identification, NULL if failed
+*/
+const app_device_id_t *nvm_get_device_id(void *nvm_ptr)
+{
+    upd_nvm_t *nvm = (upd_nvm_t *)nvm_ptr;
+
+    if (!VALID_NVM(nvm))
+        return NULL;
+
+    if (nvm->progmode && app_read_device_id(APP(nvm)))
+        return NULL;
+
+    return app_get_device_id(APP(nvm));
+}
+
 /*
     NVM set chip into Unlocked Mode with UPDI_KEY_NVM command
     @nvm_ptr: NVM object pointer, acquired from updi_nvm_init()
@@ -221,12 +370,18 @@ int nvm_unlock_device(void *nvm_ptr)
 
     // Unlock
     result = app_unlock(APP(nvm));
-    if (!result) {
+    if (result) {
         DBG_INFO(NVM_DEBUG, "app_unlock failed %d", result);
         return -2;
     }
 
-    // Unlock after using the NVM key results in prog mode.
+    // The chip erase key only unlocks the device, the NVM key is still needed for prog mode.
+    result = app_enter_progmode(APP(nvm));
+    if (result) {
+        DBG_INFO(NVM_DEBUG, "app_enter_progmode failed %d", result);
+        return -3;
+    }
+
     nvm->progmode = true;
 
     return 0;
@@ -325,14 +480,15 @@ int nvm_read_flash(void *nvm_ptr, u16 address, u8 *data, int len)
 }
 
 /*
-    NVM write flash
+    NVM write flash common function
     @nvm_ptr: NVM object pointer, acquired from updi_nvm_init()
     @address: target address
     @data: data buffer
     @len: data len
+    @erase: each page is erase-written, else page written which requires the page erased
     @return 0 successful, other value failed
 */
-int nvm_write_flash(void *nvm_ptr, u16 address, const u8 *data, int len)
+int _nvm_write_flash(void *nvm_ptr, u16 address, const u8 *data, int len, bool erase)
 {
     /*
     Writes to flash
@@ -369,21 +525,25 @@ int nvm_write_flash(void *nvm_ptr, u16 address, const u8 *data, int len)
     }
 
     page_size = info.nvm_pagesize;
-    pages = (len + page_size - 1) / page_size;
+    // page count by the page boundary, the first chunk may be not page aligned
+    pages = ((address & (page_size - 1)) + len + page_size - 1) / page_size;
     for (i = 0, off = 0; i < pages; i++) {
         DBG_INFO(NVM_DEBUG, "Writing flash page(%d/%d) at 0x%x", i, pages, address + off);
 
         size = len - off;
-        if (size > page_size)
-            size = page_size;
+        if (size > page_size - ((address + off) & (page_size - 1)))
+            size = page_size - ((address + off) & (page_size - 1));
 
-        result = app_write_nvm(APP(nvm), address + off, data + off, size);
+        if (erase)
+            result = app_erase_write_nvm(APP(nvm), address + off, data + off, size);
+        else
+            result = app_write_nvm(APP(nvm), address + off, data + off, size);
         if (result) {
-            DBG_INFO(NVM_DEBUG, "app_write_nvm failed %d", result);
+            DBG_INFO(NVM_DEBUG, "app_write_nvm(erase %d) failed %d", erase, result);
             break;
         }
 
-        off += page_size;
+        off += size;
     }
 
 
@@ -392,10 +552,82 @@ int nvm_write_flash(void *nvm_ptr, u16 address, const u8 *data, int len)
         return -6;
     }
 
+    UPDI_STATS_ADD(nvm.flash_bytes, len);
+
+    return 0;
+}
+
+/*
+    NVM write flash, the pages must be erased
+    @nvm_ptr: NVM object pointer, acquired from updi_nvm_init()
+    @address: target address
+    @data: data buffer
+    @len: data len
+    @return 0 successful, other value failed
+*/
+int nvm_write_flash(void *nvm_ptr, u16 address, const u8 *data, int len)
+{
+    return _nvm_write_flash(nvm_ptr, address, data, len, false);
+}
+
+/*
+    NVM erase-write flash, each page is erased and written by one command, the other pages are kept
+    @nvm_ptr: NVM object pointer, acquired from updi_nvm_init()
+    @address: target address
+    @data: data buffer
+    @len: data len
+    @return 0 successful, other value failed
+*/
+int nvm_erase_write_flash(void *nvm_ptr, u16 address, const u8 *data, int len)
+{
+    return _nvm_write_flash(nvm_ptr, address, data, len, true);
+}
+
+/*
+    NVM erase a flash page
+    @nvm_ptr: NVM object pointer, acquired from updi_nvm_init()
+    @address: an address in the page
+    @return 0 successful, other value failed
+*/
+int nvm_erase_flash_page(void *nvm_ptr, u16 address)
+{
+    upd_nvm_t *nvm = (upd_nvm_t *)nvm_ptr;
+    nvm_info_t info;
+    int result;
+
+    if (!VALID_NVM(nvm))
+        return ERROR_PTR;
+
+    DBG_INFO(NVM_DEBUG, "<NVM> Erase flash page");
+
+    if (!nvm->progmode) {
+        DBG_INFO(NVM_DEBUG, "Enter progmode first!");
+        return -2;
+    }
+
+    result = nvm_get_block_info(nvm, NVM_FLASH, &info);
+    if (result) {
+        DBG_INFO(NVM_DEBUG, "nvm_get_block_info failed");
+        return -3;
+    }
+
+    if (address < info.nvm_start)
+        address += info.nvm_start;
+
+    if (address >= info.nvm_start + info.nvm_size) {
+        DBG_INFO(NVM_DEBUG, "flash address overflow, addr %hx.", address);
+        return -4;
+    }
+
+    result = app_page_erase(APP(nvm), address);
+    if (result) {
+        DBG_INFO(NVM_DEBUG, "app_page_erase failed %d", result);
+        return -5;
+    }
+
     return 0;
 }
 
-#if 0
 /*
 NVM read eeprom
     @nvm_ptr: NVM object pointer, acquired from updi_nvm_init()
@@ -479,13 +711,14 @@ int _nvm_write_eeprom(void *nvm_ptr, const nvm_info_t *info, u16 address, const
     }
 
     page_size = info->nvm_pagesize;
-    pages = (len + page_size - 1) / page_size;
+    // page count by the page boundary, the first chunk may be not page aligned
+    pages = ((address & (page_size - 1)) + len + page_size - 1) / page_size;
     for (i = 0, off = 0; i < pages; i++) {
         DBG_INFO(NVM_DEBUG, "Writing eeprom page(%d/%d) at 0x%x", i, pages, address + off);
 
         size = len - off;
-        if (size > page_size)
-            size = page_size;
+        if (size > page_size - ((address + off) & (page_size - 1)))
+            size = page_size - ((address + off) & (page_size - 1));
 
         result = _app_erase_write_nvm(APP(nvm), address + off, data + off, size, false);
         if (result) {
@@ -493,7 +726,7 @@ int _nvm_write_eeprom(void *nvm_ptr, const nvm_info_t *info, u16 address, const
             break;
         }
 
-        off += page_size;
+        off += size;
     }
 
     if (i < pages || result) {
@@ -501,6 +734,8 @@ int _nvm_write_eeprom(void *nvm_ptr, const nvm_info_t *info, u16 address, const
         return -5;
     }
 
+    UPDI_STATS_ADD(nvm.eeprom_bytes, len);
+
     return 0;
 }
 
@@ -549,7 +784,7 @@ int nvm_write_userrow(void *nvm_ptr, u16 address, const u8 *data, int len)
 
     return _nvm_write_eeprom(nvm_ptr, &info, address, data, len);
 }
-#endif
+
 /*
     NVM read fuse
     @nvm_ptr: NVM object pointer, acquired from updi_nvm_init()
@@ -635,6 +870,8 @@ int _nvm_write_fuse(void *nvm_ptr, const nvm_info_t *info, u16 address, const u8
         return -6;
     }
 
+    UPDI_STATS_INC(nvm.fuse_writes);
+
     return 0;
 }
 
@@ -651,7 +888,7 @@ int nvm_write_fuse(void *nvm_ptr, u16 address, const u8 *data, int len)
 {
     upd_nvm_t *nvm = (upd_nvm_t *)nvm_ptr;
     nvm_info_t info;
-    int i, result;
+    int i, result, attempt;
 
     result = nvm_get_block_info(nvm, NVM_FUSES, &info);
     if (result) {
@@ -660,7 +897,11 @@ int nvm_write_fuse(void *nvm_ptr, u16 address, const u8 *data, int len)
     }
 
     for (i = 0; i < len; i++) {
-        result = _nvm_write_fuse(nvm_ptr, &info, address + i, data[i]);
+        // Writing the same fuse value again is harmless
+        attempt = 0;
+        do {
+            result = _nvm_write_fuse(nvm_ptr, &info, address + i, data[i]);
+        } while (result && nvm->progmode && app_retry(APP(nvm), attempt++));
         if (result) {
             DBG_INFO(NVM_DEBUG, "_nvm_write_fuse fuse (%d) failed %d", i, result);
             return -2;
@@ -685,7 +926,7 @@ int nvm_read_mem(void *nvm_ptr, u16 address, u8 *data, int len)
         Read Memory
     */
     upd_nvm_t *nvm = (upd_nvm_t *)nvm_ptr;
-    int size, off;
+    int size, off, attempt;
     int result;
 
     if (!VALID_NVM(nvm))
@@ -704,7 +945,10 @@ int nvm_read_mem(void *nvm_ptr, u16 address, u8 *data, int len)
     
         DBG_INFO(NVM_DEBUG, "Reading %d bytes at address 0x%x", size, address + off);
 
-        result = app_read_data_bytes(APP(nvm), address + off, data + off, size);
+        attempt = 0;
+        do {
+            result = app_read_data_bytes(APP(nvm), address + off, data + off, size);
+        } while (result && app_retry(APP(nvm), attempt++));
         if (result) {
             DBG_INFO(NVM_DEBUG, "app_read_data_bytes failed %d", result);
             break;
@@ -713,6 +957,8 @@ int nvm_read_mem(void *nvm_ptr, u16 address, u8 *data, int len)
         off += size;
     } while (off < len);
 
+    UPDI_STATS_ADD(nvm.read_bytes, off);
+
     return result;
 }
 
@@ -762,21 +1008,21 @@ int nvm_write_mem(void *nvm_ptr, u16 address, const u8 *data, int len)
 }
 
 /*
-    NVM write auto selec which part to be operated
+    NVM write auto select which part to be operated by the address range
     @nvm_ptr: NVM object pointer, acquired from updi_nvm_init()
     @address: target address
     @data: data buffer
     @len: data len
     @return 0 successful, other value failed
 */
-#if 0
 int nvm_write_auto(void *nvm_ptr, u16 address, const u8 *data, int len)
 {
     upd_nvm_t *nvm = (upd_nvm_t *)nvm_ptr;
     nvm_info_t info;
-    //nvm_op op, nvm_ops[] = { nvm_write_flash, nvm_write_eeprom, nvm_write_userrow, nvm_write_fuse };
-    nvm_op op = nvm_write_flash;
-	int i, result;
+    /* indexed by NVM_TYPE_T, lockbits is written by fuse command */
+    const nvm_op nvm_ops[] = { nvm_write_flash, nvm_write_eeprom, nvm_write_userrow, nvm_write_fuse, nvm_write_fuse };
+    nvm_op op;
+    int i, result;
 
     if (!VALID_NVM(nvm))
         return ERROR_PTR;
@@ -788,18 +1034,18 @@ int nvm_write_auto(void *nvm_ptr, u16 address, const u8 *data, int len)
         result = nvm_get_block_info(nvm_ptr, i, &info);
         if (result) {
             DBG_INFO(NVM_DEBUG, "<NVM> nvm_get_block_info %d failed", i);
-            return -i;
+            return -2;
         }
 
-        /*if (address >= info.nvm_start && address + len <= info.nvm_start + info.nvm_size) {
+        if (address >= info.nvm_start && address + len <= info.nvm_start + info.nvm_size) {
             op = nvm_ops[i];
             break;
-        }*/
+        }
     }
 
     return op(nvm_ptr, address, data, len);
 }
-#endif
+
 /*
     NVM reset
     @nvm_ptr: NVM object pointer, acquired from updi_nvm_init()
@@ -859,4 +1105,197 @@ int nvm_get_block_info(void *nvm_ptr, int type, nvm_info_t *info)
 
     return dev_get_nvm_info(nvm->dev, type, info);
 }
+/*
+    NVM async operation: enter programming mode, the progmode flag is set when the operation finished
+    @op: async operation object
+    @nvm_ptr: NVM object pointer, acquired from updi_nvm_init()
+    @return APP_ASYNC_PENDING, other value failed
+*/
+int nvm_async_enter_progmode(nvm_async_t *op, void *nvm_ptr)
+{
+    upd_nvm_t *nvm = (upd_nvm_t *)nvm_ptr;
+
+    if (!op || !VALID_NVM(nvm))
+        return ERROR_PTR;
+
+    DBG_INFO(NVM_DEBUG, "<NVM> Async entering NVM programming mode");
+
+    op->nvm = nvm_ptr;
+
+    return app_async_enter_progmode(&op->app, APP(nvm));
+}
+
+/*
+    NVM async operation: erase flash with UPDI_NVMCTRL_CTRLA_CHIP_ERASE command
+    @op: async operation object
+    @nvm_ptr: NVM object pointer, acquired from updi_nvm_init()
+    @return APP_ASYNC_PENDING, other value failed
+*/
+int nvm_async_chip_erase(nvm_async_t *op, void *nvm_ptr)
+{
+    upd_nvm_t *nvm = (upd_nvm_t *)nvm_ptr;
+
+    if (!op || !VALID_NVM(nvm))
+        return ERROR_PTR;
+
+    DBG_INFO(NVM_DEBUG, "<NVM> Async erase device");
+
+    if (!nvm->progmode) {
+        DBG_INFO(NVM_DEBUG, "Enter progmode first!");
+        return -2;
+    }
+
+    op->nvm = nvm_ptr;
+
+    return app_async_chip_erase(&op->app, APP(nvm));
+}
+
+/*
+    NVM async operation: write one flash page
+    @op: async operation object
+    @nvm_ptr: NVM object pointer, acquired from updi_nvm_init()
+    @address: target address
+    @data: data buffer, kept until the operation finished
+    @len: data len, not cross the page boundary
+    @return APP_ASYNC_PENDING, other value failed
+*/
+int nvm_async_write_flash_page(nvm_async_t *op, void *nvm_ptr, u16 address, const u8 *data, int len)
+{
+    upd_nvm_t *nvm = (upd_nvm_t *)nvm_ptr;
+    nvm_info_t info;
+    int result;
+
+    if (!op || !VALID_NVM(nvm) || !data)
+        return ERROR_PTR;
+
+    if (!nvm->progmode) {
+        DBG_INFO(NVM_DEBUG, "Enter progmode first!");
+        return -2;
+    }
+
+    result = nvm_get_block_info(nvm, NVM_FLASH, &info);
+    if (result) {
+        DBG_INFO(NVM_DEBUG, "nvm_get_block_info failed");
+        return -3;
+    }
+
+    if (address < info.nvm_start)
+        address += info.nvm_start;
+
+    if (address + len > info.nvm_start + info.nvm_size ||
+        (address & (info.nvm_pagesize - 1)) + len > info.nvm_pagesize) {
+        DBG_INFO(NVM_DEBUG, "flash page address overflow, addr %hx, len %x.", address, len);
+        return -4;
+    }
+
+    DBG_INFO(NVM_DEBUG, "<NVM> Async writing flash page at 0x%x", address);
+
+    op->nvm = nvm_ptr;
+
+    return app_async_write_page(&op->app, APP(nvm), address, data, len);
+}
+
+/*
+    NVM async operation: read memory, each poll reads one UPDI burst
+    @op: async operation object
+    @nvm_ptr: NVM object pointer, acquired from updi_nvm_init()
+    @address: target address
+    @data: data output buffer
+    @len: data len
+    @return APP_ASYNC_PENDING, other value failed
+*/
+int nvm_async_read_mem(nvm_async_t *op, void *nvm_ptr, u16 address, u8 *data, int len)
+{
+    upd_nvm_t *nvm = (upd_nvm_t *)nvm_ptr;
+
+    if (!op || !VALID_NVM(nvm))
+        return ERROR_PTR;
+
+    DBG_INFO(NVM_DEBUG, "<NVM> Async read memory");
+
+    if (!nvm->progmode)
+        DBG_INFO(NVM_DEBUG, "Memory read at locked mode");
+
+    op->nvm = nvm_ptr;
+
+    return app_async_read_block(&op->app, APP(nvm), address, data, len);
+}
+
+/*
+    NVM async operation: write one fuse byte
+    @op: async operation object
+    @nvm_ptr: NVM object pointer, acquired from updi_nvm_init()
+    @address: fuse address
+    @data: fuse value, kept until the operation finished
+    @return APP_ASYNC_PENDING, other value failed
+*/
+int nvm_async_write_fuse(nvm_async_t *op, void *nvm_ptr, u16 address, const u8 *data)
+{
+    upd_nvm_t *nvm = (upd_nvm_t *)nvm_ptr;
+    nvm_info_t info;
+    int result;
+
+    if (!op || !VALID_NVM(nvm) || !data)
+        return ERROR_PTR;
+
+    if (!nvm->progmode) {
+        DBG_INFO(NVM_DEBUG, "Enter progmode first!");
+        return -2;
+    }
+
+    result = nvm_get_block_info(nvm, NVM_FUSES, &info);
+    if (result) {
+        DBG_INFO(NVM_DEBUG, "nvm_get_block_info failed");
+        return -3;
+    }
+
+    if (address < info.nvm_start)
+        address += info.nvm_start;
+
+    if (address >= info.nvm_start + info.nvm_size) {
+        DBG_INFO(NVM_DEBUG, "fuse address overflow, addr %hx.", address);
+        return -4;
+    }
+
+    DBG_INFO(NVM_DEBUG, "<NVM> Async writing fuse at 0x%x", address);
+
+    op->nvm = nvm_ptr;
+
+    return app_async_write_fuse(&op->app, APP(nvm), address, data);
+}
+
+/*
+    NVM async operation poll
+    @op: async operation object, started by nvm_async_xxx()
+    @return APP_ASYNC_PENDING to poll again at nvm_async_wake(), 0 finished, other value failed
+*/
+int nvm_async_poll(nvm_async_t *op)
+{
+    upd_nvm_t *nvm;
+    int result;
+
+    if (!op)
+        return ERROR_PTR;
+
+    nvm = (upd_nvm_t *)op->nvm;
+    if (!VALID_NVM(nvm))
+        return ERROR_PTR;
+
+    result = app_async_poll(&op->app);
+    if (!result && op->app.type == APP_ASYNC_PROGMODE)
+        nvm->progmode = true;
+
+    return result;
+}
+
+/*
+    NVM async operation next poll time
+    @op: async operation object
+    @return time(ms) the operation should be polled
+*/
+unsigned int nvm_async_wake(const nvm_async_t *op)
+{
+    return app_async_wake(&op->app);
+}
+
 #endif
\ No newline at end of file
@@ -3,9 +3,19 @@
 
 #ifdef CUPDI
 
+#include "application.h"
+
+void *updi_nvm_open(const char *port, void *dev);
 void *updi_nvm_init(const char *port, int baud, void *dev);
+int nvm_connect(void *nvm_ptr, int baud);
+int nvm_probe(void *nvm_ptr);
 void updi_nvm_deinit(void *nvm_ptr);
+int nvm_set_ibdly(void *nvm_ptr, int ibdly);
+int nvm_get_timing(void *nvm_ptr, int *baud, int *ibdly);
+int nvm_set_retry(void *nvm_ptr, const link_retry_t *policy);
+const void *nvm_get_device(void *nvm_ptr);
 int nvm_get_device_info(void *nvm_ptr);
+const app_device_id_t *nvm_get_device_id(void *nvm_ptr);
 int nvm_enter_progmode(void *nvm_ptr);
 int nvm_leave_progmode(void *nvm_ptr);
 int nvm_disable(void *nvm_ptr);
@@ -13,10 +23,12 @@ int nvm_unlock_device(void *nvm_ptr);
 int nvm_chip_erase(void *nvm_ptr);
 int nvm_read_flash(void *nvm_ptr, u16 address, u8 *data, int len);
 int nvm_write_flash(void *nvm_ptr, u16 address, const u8 *data, int len);
-//int nvm_read_eeprom(void *nvm_ptr, u16 address, u8 *data, int len);
-//int nvm_write_eeprom(void *nvm_ptr, u16 address, const u8 *data, int len);
-//int nvm_read_userrow(void *nvm_ptr, u16 address, u8 *data, int len);
-//int nvm_write_userrow(void *nvm_ptr, u16 address, const u8 *data, int len);
+int nvm_erase_write_flash(void *nvm_ptr, u16 address, const u8 *data, int len);
+int nvm_erase_flash_page(void *nvm_ptr, u16 address);
+int nvm_read_eeprom(void *nvm_ptr, u16 address, u8 *data, int len);
+int nvm_write_eeprom(void *nvm_ptr, u16 address, const u8 *data, int len);
+int nvm_read_userrow(void *nvm_ptr, u16 address, u8 *data, int len);
+int nvm_write_userrow(void *nvm_ptr, u16 address, const u8 *data, int len);
 int nvm_read_fuse(void *nvm_ptr, u16 address, u8 *data, int len);
 int nvm_write_fuse(void *nvm_ptr, u16 address, const u8 *data, int len);
 int nvm_read_mem(void *nvm_ptr, u16 address, u8 *data, int len);
@@ -27,6 +39,25 @@ int nvm_reset(void *nvm_ptr, int delay_ms);
 int nvm_get_block_info(void *nvm_ptr, /*NVM_TYPE_T*/int type, nvm_info_t *info);
 
 typedef int(*nvm_op)(void *nvm_ptr, u16 address, const u8 *data, int len);
+typedef int(*nvm_read_op)(void *nvm_ptr, u16 address, u8 *data, int len);
+
+/*
+    NVM async operation, the non-blocking form of enter progmode, chip erase, page write, read and fuse write
+    @app: APP async operation
+    @nvm: NVM object pointer
+*/
+typedef struct _nvm_async {
+    app_async_t app;
+    void *nvm;
+}nvm_async_t;
+
+int nvm_async_enter_progmode(nvm_async_t *op, void *nvm_ptr);
+int nvm_async_chip_erase(nvm_async_t *op, void *nvm_ptr);
+int nvm_async_write_flash_page(nvm_async_t *op, void *nvm_ptr, u16 address, const u8 *data, int len);
+int nvm_async_read_mem(nvm_async_t *op, void *nvm_ptr, u16 address, u8 *data, int len);
+int nvm_async_write_fuse(nvm_async_t *op, void *nvm_ptr, u16 address, const u8 *data);
+int nvm_async_poll(nvm_async_t *op);
+unsigned int nvm_async_wake(const nvm_async_t *op);
 
 /*
 Max waiting time for chip reset
@@ -19,6 +19,8 @@ limitations under the License.
 #include "platform/platform.h"
 #include "physical.h"
 #include "constants.h"
+#include "trace.h"
+#include "stats.h"
 
 /*
     PHY level memory struct
@@ -26,6 +28,7 @@ limitations under the License.
     @ser: pointer to sercom object
     @stat: store sercom parameter
     @ibdly: interval between each transfer action
+    @brk: double break being sent, the line errors are expected
 */
 typedef struct _upd_physical{
 #define UPD_PHYSICAL_MAGIC_WORD 0xE1E1 //'uphy'
@@ -33,57 +36,52 @@ typedef struct _upd_physical{
     void *ser;
     SER_PORT_STATE_T stat;
     int ibdly;  //delay ms for updi bus transfer switch
+    bool brk;
 }upd_physical_t;
 
 #define VALID_PHY(_phy) ((_phy) && ((_phy)->mgwd == UPD_PHYSICAL_MAGIC_WORD))
 #define SER(_phy) ((HANDLE)_phy->ser)
+#define PHY_CHN(_phy) ((int)((_phy) - physical))
 
 /*
-    PHY object init
+    PHY object open, the port is opened without handshake
     @port: serial port name of Window or Linux
     @baud: baudrate
-    @return LINK ptr, NULL if failed
+    @return PHY ptr, NULL if failed
 */
-upd_physical_t physical;
-void *updi_physical_init(const char *port, int baud)
+UPDI_THREAD_LOCAL upd_physical_t physical[UPDI_MAX_CHANNEL];
+void *updi_physical_open(const char *port, int baud)
 {
     void *ser;
     upd_physical_t *phy = NULL;
     SER_PORT_STATE_T stat;
-    //u8 data[] = { UPDI_BREAK };
-    int result;
+    int i;
 
     DBG_INFO(PHY_DEBUG, "<PHY> Opening port %s, baudrate %d", port, baud);
 
+    for (i = 0; i < ARRAY_SIZE(physical); i++) {
+        if (!VALID_PHY(&physical[i]))
+            break;
+    }
+
+    if (i >= ARRAY_SIZE(physical)) {
+        DBG_INFO(PHY_DEBUG, "<PHY> Init: no free channel");
+        return NULL;
+    }
+
     stat.baudRate = baud;
     stat.byteSize = 8;
     stat.stopBits = TWOSTOPBITS;
     stat.parity = EVENPARITY;
     ser = (void *)OpenPort(port, &stat);
     if (ser) {
-        phy = &physical;//(upd_physical_t *)malloc(sizeof(*phy));
+        phy = &physical[i];//(upd_physical_t *)malloc(sizeof(*phy));
         phy->mgwd = UPD_PHYSICAL_MAGIC_WORD;
         phy->ser = ser;
         phy->ibdly = 1;
+        phy->brk = false;
         stat.baudRate = baud;
         memcpy(&phy->stat, &stat, sizeof(stat));
-        
-        //send an initial break as handshake
-        
-        /*result = phy_send(phy, data, 1);
-        if (result) {
-            DBG_INFO(PHY_DEBUG, "<PHY> Init: phy_send failed %d", result);
-            return NULL;
-        }*/
-        
-        // send an initial double break as handshake
-        result = phy_send_double_break(phy);
-        if (result) {
-            DBG_INFO(PHY_DEBUG, "phy_send_double_break failed %d", result);
-            updi_physical_deinit(phy);
-            return NULL;
-        }
-		
     }
     else {
         DBG_INFO(PHY_DEBUG, "<PHY> Init: OpenPort %s failed ", port);
@@ -92,6 +90,32 @@ void *updi_physical_init(const char *port, int baud)
     return phy;
 }
 
+/*
+    PHY object init
+    @port: serial port name of Window or Linux
+    @baud: baudrate
+    @return PHY ptr, NULL if failed
+*/
+void *updi_physical_init(const char *port, int baud)
+{
+    upd_physical_t *phy;
+    int result;
+
+    phy = (upd_physical_t *)updi_physical_open(port, baud);
+    if (!phy)
+        return NULL;
+
+    // send an initial double break as handshake
+    result = phy_send_double_break(phy);
+    if (result) {
+        DBG_INFO(PHY_DEBUG, "phy_send_double_break failed %d", result);
+        updi_physical_deinit(phy);
+        return NULL;
+    }
+
+    return phy;
+}
+
 /*
     PHY object destroy
     @ptr_phy: APP object pointer, acquired from updi_physical_init()
@@ -108,6 +132,7 @@ void updi_physical_deinit(void *ptr_phy)
     if (phy->ser) {
         ClosePort(SER(phy));
     }
+    phy->mgwd = 0;
     //free(phy);
 }
 
@@ -141,6 +166,44 @@ int phy_set_baudrate(void *ptr_phy, int baud)
     return 0;
 }
 
+/*
+    PHY set the delay after each sending, the target turnaround time for slow adapters
+    @ptr_phy: PHY object pointer, acquired from updi_physical_init()
+    @ibdly: delay ms, 0 no delay
+    @return 0 successful, other value if failed
+*/
+int phy_set_ibdly(void *ptr_phy, int ibdly)
+{
+    upd_physical_t *phy = (upd_physical_t *)ptr_phy;
+
+    if (!VALID_PHY(phy))
+        return ERROR_PTR;
+
+    phy->ibdly = ibdly;
+
+    return 0;
+}
+
+/*
+    PHY get the baudrate and the delay after each sending, the link timing of the programming time estimate
+    @ptr_phy: PHY object pointer, acquired from updi_physical_init()
+    @baud: output of baudrate
+    @ibdly: output of delay ms
+    @return 0 successful, other value if failed
+*/
+int phy_get_timing(void *ptr_phy, int *baud, int *ibdly)
+{
+    upd_physical_t *phy = (upd_physical_t *)ptr_phy;
+
+    if (!VALID_PHY(phy) || !baud || !ibdly)
+        return ERROR_PTR;
+
+    *baud = phy->stat.baudRate;
+    *ibdly = phy->ibdly;
+
+    return 0;
+}
+
 /*
 PHY send break
 @ptr_phy: APP object pointer, acquired from updi_physical_init()
@@ -204,7 +267,11 @@ int phy_send_double_break(void *ptr_phy)
     }
 
     /*Send two break characters, with 1 stop bit in between */
-    result = phy_send(phy, data, 2);
+    phy->brk = true;
+    result = _phy_send(phy, data, 2);
+    phy->brk = false;
+    UPDI_TRACE_RECORD(PHY_CHN(phy), UPDI_TRACE_BREAK, data, 2, result);
+    UPDI_STATS_INC(phy.breaks);
     if (result) {
         DBG_INFO(PHY_DEBUG, "<PHY> D-Break: phy_send failed %d", result);
         return -3;
@@ -220,6 +287,38 @@ int phy_send_double_break(void *ptr_phy)
     return 0;
 }
 
+/*
+    PHY check the line errors latched by the port since the flush before sending
+    @phy: PHY object
+    @return 0 none, PHY_ERROR_LINE if any
+*/
+static int phy_line_error(upd_physical_t *phy)
+{
+    int err, offset;
+
+    err = GetPortError(SER(phy), &offset);
+    if (err <= 0 || phy->brk)
+        return 0;
+
+    DBG_INFO(PHY_DEBUG, "<PHY> Line error 0x%x at byte %d", err, offset);
+    UPDI_STATS_INC(phy.line_errors);
+
+    return PHY_ERROR_LINE;
+}
+
+/*
+    PHY wait a tick for the serial data, the deferred log records are printed meanwhile
+    @phy: PHY object
+*/
+static void phy_wait(upd_physical_t *phy)
+{
+    log_drain(0);
+
+    // The lean driver returns once the transfer is done, the others have no done event
+    if (WaitData(SER(phy), 1) < 0)
+        msleep(1);
+}
+
 /*
     PHY send data by each byte
     @ptr_phy: APP object pointer, acquired from updi_physical_init()
@@ -227,7 +326,7 @@ int phy_send_double_break(void *ptr_phy)
     @len: data lenght
     @return 0 successful, other value if failed
 */
-int phy_send_each(void *ptr_phy, const u8 *data, int len)
+int _phy_send_each(void *ptr_phy, const u8 *data, int len)
 {
     /*
         Sends a char array to UPDI with inter - byte delay
@@ -235,7 +334,7 @@ int phy_send_each(void *ptr_phy, const u8 *data, int len)
      */
     upd_physical_t * phy = (upd_physical_t *)ptr_phy;
     u8 val;
-    int result;
+    int result, retry;
 
     if (!VALID_PHY(phy))
         return ERROR_PTR;
@@ -243,6 +342,7 @@ int phy_send_each(void *ptr_phy, const u8 *data, int len)
     DBG(PHY_DEBUG, "<PHY> Send:", data, len, (unsigned char *)"0x%02x ");
 
     result = FlushPort(SER(phy));
+    UPDI_STATS_INC(phy.flushes);
     if (result) {
         DBG_INFO(PHY_DEBUG, "<PHY> Send: FlushPort failed %d", result);
     }
@@ -259,22 +359,28 @@ int phy_send_each(void *ptr_phy, const u8 *data, int len)
 		//msleep(100);
 		
         /* Echo */
-		i = 0;
+		retry = 0;
 		do {
-			msleep(1);
+			phy_wait(phy);
 			result += ReadData(SER(phy), &val, 1);
-		} while (result != 1 && (i++) < 100);
+			if (phy_line_error(phy))
+				return PHY_ERROR_LINE;
+		} while (result != 1 && (retry++) < 100);
 
         if (result != 1) {
             DBG_INFO(PHY_DEBUG, "<PHY> Send: ReadData failed %d", result);
+            UPDI_STATS_INC(phy.timeouts);
             return -3;
         }
 
         if (data[i] != val) {
             DBG_INFO(PHY_DEBUG, "<PHY> Send: ReadData mismatch %02x(%02x) located = %d", val, data[i], i);
+            UPDI_STATS_INC(phy.echo_mismatch);
             return -4;
         }
 
+        UPDI_STATS_INC(phy.tx_bytes);
+
         if (phy->ibdly)
             msleep(phy->ibdly);
     }
@@ -282,6 +388,26 @@ int phy_send_each(void *ptr_phy, const u8 *data, int len)
     return 0;
 }
 
+/*
+    PHY send data by each byte, traced
+    @ptr_phy: APP object pointer, acquired from updi_physical_init()
+    @data: data to be sent
+    @len: data lenght
+    @return 0 successful, other value if failed
+*/
+int phy_send_each(void *ptr_phy, const u8 *data, int len)
+{
+    int result;
+
+    result = _phy_send_each(ptr_phy, data, len);
+    if (result != ERROR_PTR)
+        UPDI_TRACE_RECORD(PHY_CHN((upd_physical_t *)ptr_phy), UPDI_TRACE_TX, data, len, result);
+    if (!result && len >= 2 && data[0] == UPDI_PHY_SYNC)
+        UPDI_STATS_INC(link.insn[data[1] >> 5]);
+
+    return result;
+}
+
 /*
 PHY send data
 @ptr_phy: APP object pointer, acquired from updi_physical_init()
@@ -290,20 +416,23 @@ PHY send data
 @return 0 successful, other value if failed
 */
 #define MAX_LEN 16
-u8 buffer[MAX_LEN];
-int phy_send(void *ptr_phy, const u8 *data, int len)
+int _phy_send(void *ptr_phy, const u8 *data, int len)
 {
     /*
     Sends a char array to UPDI with inter - byte delay
     Note that the byte will echo back
     */
     upd_physical_t * phy = (upd_physical_t *)ptr_phy;
-    int i, result;
+    u8 buffer[MAX_LEN];
+    int i, n, result, line = 0;
     u8 *rbuf;
 
     if (!VALID_PHY(phy))
         return ERROR_PTR;
 
+    if (len > MAX_LEN)
+        return -2;
+
     DBG(PHY_DEBUG, "<PHY> Send:", data, len, (unsigned char *)"0x%02x ");
 
     memset(buffer, 0, sizeof(buffer));
@@ -314,6 +443,7 @@ int phy_send(void *ptr_phy, const u8 *data, int len)
     }*/
 
     result = FlushPort(SER(phy));
+    UPDI_STATS_INC(phy.flushes);
     if (result) {
         DBG_INFO(PHY_DEBUG, "<PHY> Send: FlushPort failed %d", result);
     }
@@ -331,12 +461,22 @@ int phy_send(void *ptr_phy, const u8 *data, int len)
     if (result == 0) {
 		i = 0;
 		do {
-			msleep(1);
-            result += ReadData(SER(phy), rbuf, len);
-		} while (result != len && (i++) < 100);
-						
-        if (result != len) {
+			phy_wait(phy);
+            n = ReadData(SER(phy), rbuf + result, len - result);
+            if (n < 0)
+                break;
+            result += n;
+            line = phy_line_error(phy);
+		} while (!line && result != len && (i++) < 100);
+
+        if (n < 0) {
+            DBG_INFO(PHY_DEBUG, "<PHY> Send: ReadData (%d) failed %d", len, n);
+            result = -6;
+        } else if (line) {
+            result = line;
+        } else if (result != len) {
             DBG_INFO(PHY_DEBUG, "<PHY> Send: ReadData (%d) failed %d", len, result);
+            UPDI_STATS_INC(phy.timeouts);
             result = -4;
         }
     }
@@ -345,12 +485,16 @@ int phy_send(void *ptr_phy, const u8 *data, int len)
         for (i = 0; i < len; i++) {
             if (data[i] != rbuf[i]) {
                 DBG_INFO(PHY_DEBUG, "<PHY> Send: ReadData mismatch %02x(%02x) located = %d", rbuf[i], data[i], i);
+                UPDI_STATS_INC(phy.echo_mismatch);
                 result = -5;
                 break;
             }
         }
     }
 
+    if (result == len)
+        UPDI_STATS_ADD(phy.tx_bytes, len);
+
     if (phy->ibdly)
         msleep(phy->ibdly);
 
@@ -362,6 +506,26 @@ int phy_send(void *ptr_phy, const u8 *data, int len)
         return result;
 }
 
+/*
+    PHY send data, traced
+    @ptr_phy: APP object pointer, acquired from updi_physical_init()
+    @data: data to be sent
+    @len: data lenght
+    @return 0 successful, other value if failed
+*/
+int phy_send(void *ptr_phy, const u8 *data, int len)
+{
+    int result;
+
+    result = _phy_send(ptr_phy, data, len);
+    if (result != ERROR_PTR)
+        UPDI_TRACE_RECORD(PHY_CHN((upd_physical_t *)ptr_phy), UPDI_TRACE_TX, data, len, result);
+    if (!result && len >= 2 && data[0] == UPDI_PHY_SYNC)
+        UPDI_STATS_INC(link.insn[data[1] >> 5]);
+
+    return result;
+}
+
 /*
     PHY send data
     @ptr_phy: APP object pointer, acquired from updi_physical_init()
@@ -407,6 +571,7 @@ int phy_receive_each(void *ptr_phy, u8 *data, int len)
         
         if (retry < 0) {
             DBG_INFO(PHY_DEBUG, "<PHY> Recv: ReadData timeout");
+            UPDI_STATS_INC(phy.timeouts);
             break;
         }
     }
@@ -414,6 +579,9 @@ int phy_receive_each(void *ptr_phy, u8 *data, int len)
     if (i)
         DBG(PHY_DEBUG, "<PHY> Recv: Received(%d/%d): ", data, i, (unsigned char *)"0x%02x ", i, len);
 
+    UPDI_TRACE_RECORD(PHY_CHN(phy), UPDI_TRACE_RX, data, len, i);
+    UPDI_STATS_ADD(phy.rx_bytes, i);
+
     return i;
 }
 
@@ -422,7 +590,7 @@ PHY receive data
 @ptr_phy: APP object pointer, acquired from updi_physical_init()
 @data: data buffer to receive
 @len: data lenght
-@return 0 successful, other value if failed
+@return bytes received, PHY_ERROR_LINE if a line error latched
 */
 int phy_receive(void *ptr_phy, u8 *data, int len)
 {
@@ -430,24 +598,41 @@ int phy_receive(void *ptr_phy, u8 *data, int len)
     Receives a frame of a known number of chars from UPDI
     */
     upd_physical_t * phy = (upd_physical_t *)ptr_phy;
-    int result = 0;
+    int result = 0, line;
 
     if (!VALID_PHY(phy))
         return ERROR_PTR;
 
-    /* Read */
-	int i = 0;
+    /* Read, the timeout restarts whenever data is coming, a line error fails at once */
+	int i = 0, n;
 	do {
-		result += ReadData(SER(phy), data, len);
-		msleep(1);
-	} while (result != len && i++ < 10);
-    
+		n = ReadData(SER(phy), data + result, len - result);
+		if (n > 0) {
+			result += n;
+			i = 0;
+		}
+		line = phy_line_error(phy);
+		if (line || result == len)
+			break;
+		phy_wait(phy);
+	} while (i++ < 10);
+
+    if (line) {
+        DBG(PHY_DEBUG, "<PHY> Recv: Line error after(%d/%d): ", data, result, (unsigned char *)"0x%02x ", result, len);
+        UPDI_TRACE_RECORD(PHY_CHN(phy), UPDI_TRACE_RX, data, len, line);
+        return line;
+    }
+
     if (result != len) {
         DBG(PHY_DEBUG, "<PHY> Recv: Received(%d/%d) failed: ", data, result, (unsigned char *)"0x%02x ", result, len);
+        UPDI_STATS_INC(phy.timeouts);
     }
 
     DBG(PHY_DEBUG, "<PHY> Recv: Received(%d/%d): ", data, result, (unsigned char *)"0x%02x ", result, len);
 
+    UPDI_TRACE_RECORD(PHY_CHN(phy), UPDI_TRACE_RX, data, len, result);
+    UPDI_STATS_ADD(phy.rx_bytes, result);
+
     return result;
 }
 
@@ -476,36 +661,40 @@ int phy_receive(void *ptr_phy, u8 *data, int len)
     @wlen: send length
     @rdata: data buffer to receive
     @len: receiving lenght
-    @return 0 successful, other value if failed
+    @return bytes received, PHY_ERROR_LINE if a line error latched, other negative value if failed
 */
 int phy_transfer(void *ptr_phy, const u8 *wdata, int wlen, u8 *rdata, int rlen)
 {
+    upd_physical_t *phy = (upd_physical_t *)ptr_phy;
     int result;
-    int retry = 0;  //determine retries in higher level by protocol used
+    UPDI_STATS_TIME(start);
 
     DBG_INFO(PHY_DEBUG, "<PHY> Transfer: Write %d bytes, Read %d bytes", wlen, rlen);
 
-    do {
-        result = phy_send(ptr_phy, wdata, wlen);
-        if (result) {
-            DBG_INFO(PHY_DEBUG, "<PHY> Transfer: phy_send failed %d", result);
+    // Not retried here, the link recovery policy knows whether the transaction is idempotent.
+    // The lean driver receives the response into rdata directly, the others ignore it
+    if (VALID_PHY(phy))
+        ArmReceive(SER(phy), rdata, rlen);
+
+    result = phy_send(ptr_phy, wdata, wlen);
+    if (result) {
+        DBG_INFO(PHY_DEBUG, "<PHY> Transfer: phy_send failed %d", result);
+        if (result != PHY_ERROR_LINE)
             result = -2;
-        }
-        else {
-            result = phy_receive(ptr_phy, rdata, rlen);
-            if (result != rlen) {
-                DBG_INFO(PHY_DEBUG, "<PHY> Transfer: phy_receive failed, Got %d bytes", result);
+    }
+    else {
+        result = phy_receive(ptr_phy, rdata, rlen);
+        if (result != rlen) {
+            DBG_INFO(PHY_DEBUG, "<PHY> Transfer: phy_receive failed, Got %d bytes", result);
+            if (result != PHY_ERROR_LINE)
                 result = -3;
-            }
-            else {
-                break;
-            }
         }
+    }
 
-        if (result < 0)
-            retry--;
+    if (VALID_PHY(phy))
+        ArmReceive(SER(phy), NULL, 0);
 
-    } while (retry >= 0);
+    UPDI_STATS_HIST(transfer, get_time_us() - start);
 
     return result;
 }
@@ -545,4 +734,226 @@ int phy_sib(void *ptr_phy, u8 *data, int len)
     return 0;
 }
 
-#endif
\ No newline at end of file
+/*
+    PHY get the file descriptor of the serial port, for the event loop waiting on it
+    @ptr_phy: PHY object pointer, acquired from updi_physical_open()
+    @return fd, negative if the port has no fd
+*/
+int phy_get_fd(void *ptr_phy)
+{
+    upd_physical_t *phy = (upd_physical_t *)ptr_phy;
+
+    if (!VALID_PHY(phy))
+        return ERROR_PTR;
+
+    return GetPortFd(SER(phy));
+}
+
+/*
+    PHY async transfer start, the data is sent and the echo/response are collected by phy_async_poll() later
+    @xfer: transfer state, owned by caller until done
+    @ptr_phy: PHY object pointer, acquired from updi_physical_open()
+    @wdata: data to be sent, must be kept until done
+    @wlen: send length, max PHY_ASYNC_MAX_LEN
+    @rdata: data buffer to receive
+    @rlen: receiving length
+    @timeout: ms allowed beyond the time of the characters on the wire
+    @return 0 successful, other value if failed
+*/
+int _phy_async_start(phy_async_t *xfer, void *ptr_phy, const u8 *wdata, int wlen, u8 *rdata, int rlen, int timeout)
+{
+    upd_physical_t *phy = (upd_physical_t *)ptr_phy;
+    int result;
+
+    if (!VALID_PHY(phy) || !xfer)
+        return ERROR_PTR;
+
+    if (wlen > PHY_ASYNC_MAX_LEN)
+        return -2;
+
+    DBG(PHY_DEBUG, "<PHY> Async send:", wdata, wlen, (unsigned char *)"0x%02x ");
+
+    xfer->phy = phy;
+    xfer->wdata = wdata;
+    xfer->wlen = wlen;
+    xfer->rdata = rdata;
+    xfer->rlen = rlen;
+    xfer->cnt = 0;
+    xfer->brk = false;
+
+    // 12 bits each character(8E2 and start bit), in the current baudrate
+    xfer->deadline = get_time_ms() + (wlen + rlen) * 12 * 1000 / phy->stat.baudRate + 1 + timeout;
+
+    result = FlushPort(SER(phy));
+    UPDI_STATS_INC(phy.flushes);
+    if (result) {
+        DBG_INFO(PHY_DEBUG, "<PHY> Async: FlushPort failed %d", result);
+    }
+
+    ArmReceive(SER(phy), rdata, rlen);
+    result = SendData(SER(phy), wdata, wlen);
+    if (result) {
+        DBG_INFO(PHY_DEBUG, "<PHY> Async: SendData (%d) failed %d", wlen, result);
+        return -3;
+    }
+
+    return 0;
+}
+
+/*
+    PHY async transfer start, traced, see _phy_async_start()
+    @xfer: transfer state, owned by caller until done
+    @ptr_phy: PHY object pointer, acquired from updi_physical_open()
+    @wdata: data to be sent, must be kept until done
+    @wlen: send length, max PHY_ASYNC_MAX_LEN
+    @rdata: data buffer to receive
+    @rlen: receiving length
+    @timeout: ms allowed beyond the time of the characters on the wire
+    @return 0 successful, other value if failed
+*/
+int phy_async_start(phy_async_t *xfer, void *ptr_phy, const u8 *wdata, int wlen, u8 *rdata, int rlen, int timeout)
+{
+    int result;
+
+    result = _phy_async_start(xfer, ptr_phy, wdata, wlen, rdata, rlen, timeout);
+    if (result != ERROR_PTR)
+        UPDI_TRACE_RECORD(PHY_CHN((upd_physical_t *)ptr_phy), UPDI_TRACE_TX, wdata, wlen, result);
+    if (!result && wlen >= 2 && wdata[0] == UPDI_PHY_SYNC)
+        UPDI_STATS_INC(link.insn[wdata[1] >> 5]);
+
+    return result;
+}
+
+/*
+    PHY async double break start, the baudrate is restored when the echo is received
+    @xfer: transfer state, owned by caller until done
+    @ptr_phy: PHY object pointer, acquired from updi_physical_open()
+    @return 0 successful, other value if failed
+*/
+int phy_async_break(phy_async_t *xfer, void *ptr_phy)
+{
+    static const u8 data[] = { UPDI_BREAK, UPDI_BREAK };
+    upd_physical_t *phy = (upd_physical_t *)ptr_phy;
+    SER_PORT_STATE_T stat;
+    DWORD baud;
+    int result;
+
+    if (!VALID_PHY(phy) || !xfer)
+        return ERROR_PTR;
+
+    DBG_INFO(PHY_DEBUG, "<PHY> Async D-Break");
+
+    // Same as phy_send_double_break(), 300 baud pulls the line low 30ms
+    stat.baudRate = 300;
+    stat.byteSize = 8;
+    stat.stopBits = ONESTOPBIT;
+    stat.parity = EVENPARITY;
+    result = SetPortState(SER(phy), &stat);
+    if (result) {
+        DBG_INFO(PHY_DEBUG, "<PHY> Async D-Break: SetPortState failed %d", result);
+        return -2;
+    }
+
+    baud = phy->stat.baudRate;
+    phy->stat.baudRate = stat.baudRate; // deadline in break baudrate
+    result = _phy_async_start(xfer, phy, data, sizeof(data), NULL, 0, 10);
+    phy->stat.baudRate = baud;
+    UPDI_TRACE_RECORD(PHY_CHN(phy), UPDI_TRACE_BREAK, data, sizeof(data), result);
+    UPDI_STATS_INC(phy.breaks);
+    if (result) {
+        SetPortState(SER(phy), &phy->stat);
+        return -3;
+    }
+
+    xfer->brk = true;
+
+    return 0;
+}
+
+/*
+    PHY async transfer poll, reads what has been received without waiting
+    @xfer: transfer state started by phy_async_start() or phy_async_break()
+    @return 1 pending, 0 done, other value if failed
+*/
+int phy_async_poll(phy_async_t *xfer)
+{
+    upd_physical_t *phy;
+    int i, n;
+
+    if (!xfer || !VALID_PHY((upd_physical_t *)xfer->phy))
+        return ERROR_PTR;
+
+    phy = (upd_physical_t *)xfer->phy;
+
+    /* Echo first, then the response, all bytes arrived are taken before the deadline is checked */
+    do {
+        if (xfer->cnt < xfer->wlen)
+            n = ReadData(SER(phy), xfer->echo + xfer->cnt, xfer->wlen - xfer->cnt);
+        else if (xfer->cnt < xfer->wlen + xfer->rlen)
+            n = ReadData(SER(phy), xfer->rdata + xfer->cnt - xfer->wlen, xfer->wlen + xfer->rlen - xfer->cnt);
+        else
+            n = 0;
+
+        // The break characters are framing errors, the async break doesn't set phy->brk
+        if (n >= 0 && !xfer->brk && phy_line_error(phy)) {
+            UPDI_TRACE_RECORD(PHY_CHN(phy), UPDI_TRACE_RX, xfer->rdata, xfer->rlen, PHY_ERROR_LINE);
+            ArmReceive(SER(phy), NULL, 0);
+            return PHY_ERROR_LINE;
+        }
+
+        if (n < 0) {
+            DBG_INFO(PHY_DEBUG, "<PHY> Async: ReadData failed %d", n);
+            UPDI_TRACE_RECORD(PHY_CHN(phy), UPDI_TRACE_RX, xfer->rdata, xfer->rlen, -2);
+            ArmReceive(SER(phy), NULL, 0);
+            if (xfer->brk)
+                SetPortState(SER(phy), &phy->stat);
+            return -2;
+        }
+
+        if (n > 0 && xfer->cnt < xfer->wlen && xfer->cnt + n >= xfer->wlen) {
+            for (i = 0; i < xfer->wlen; i++) {
+                if (xfer->echo[i] != xfer->wdata[i]) {
+                    DBG_INFO(PHY_DEBUG, "<PHY> Async: echo mismatch %02x(%02x) located = %d", xfer->echo[i], xfer->wdata[i], i);
+                    UPDI_TRACE_RECORD(PHY_CHN(phy), UPDI_TRACE_RX, xfer->rdata, xfer->rlen, -4);
+                    UPDI_STATS_INC(phy.echo_mismatch);
+                    ArmReceive(SER(phy), NULL, 0);
+                    if (xfer->brk)
+                        SetPortState(SER(phy), &phy->stat);
+                    return -4;
+                }
+            }
+        }
+        xfer->cnt += n;
+    } while (n > 0 && xfer->cnt < xfer->wlen + xfer->rlen);
+
+    if (xfer->cnt >= xfer->wlen + xfer->rlen) {
+        ArmReceive(SER(phy), NULL, 0);
+        UPDI_STATS_ADD(phy.tx_bytes, xfer->wlen);
+        UPDI_STATS_ADD(phy.rx_bytes, xfer->rlen);
+        if (xfer->brk && SetPortState(SER(phy), &phy->stat)) {
+            DBG_INFO(PHY_DEBUG, "<PHY> Async D-Break: re-SetPortState failed");
+            return -5;
+        }
+
+        if (xfer->rlen) {
+            DBG(PHY_DEBUG, "<PHY> Async recv: ", xfer->rdata, xfer->rlen, (unsigned char *)"0x%02x ");
+            UPDI_TRACE_RECORD(PHY_CHN(phy), UPDI_TRACE_RX, xfer->rdata, xfer->rlen, xfer->rlen);
+        }
+
+        return 0;
+    }
+
+    if ((int)(get_time_ms() - xfer->deadline) >= 0) {
+        DBG_INFO(PHY_DEBUG, "<PHY> Async: timeout, Got %d/%d bytes", xfer->cnt, xfer->wlen + xfer->rlen);
+        UPDI_TRACE_RECORD(PHY_CHN(phy), UPDI_TRACE_RX, xfer->rdata, xfer->rlen, -3);
+        UPDI_STATS_INC(phy.timeouts);
+        ArmReceive(SER(phy), NULL, 0);
+        if (xfer->brk)
+            SetPortState(SER(phy), &phy->stat);
+        return -3;
+    }
+
+    return 1;
+}
+
+#endif
@@ -3,17 +3,54 @@
 
 #ifdef CUPDI
 
+/* Parity/frame/overrun error latched by the port, the transfer is failed without waiting the timeout */
+#define PHY_ERROR_LINE -16
+
+/* Max send length of an async transfer */
+#define PHY_ASYNC_MAX_LEN 16
+
+/*
+    PHY async transfer state, see phy_async_start()
+    @phy: PHY object
+    @wdata/wlen: data sent
+    @rdata/rlen: response buffer
+    @echo: echo of the sent data
+    @cnt: bytes received, echo and response
+    @brk: double break, the baudrate is restored when done
+    @deadline: get_time_ms() when timeout
+*/
+typedef struct _phy_async {
+    void *phy;
+    const u8 *wdata;
+    int wlen;
+    u8 *rdata;
+    int rlen;
+    u8 echo[PHY_ASYNC_MAX_LEN];
+    int cnt;
+    bool brk;
+    unsigned int deadline;
+}phy_async_t;
+
+void *updi_physical_open(const char *port, int baud);
 void *updi_physical_init(const char *port, int baud);
 void updi_physical_deinit(void *ptr_phy);
 int phy_set_baudrate(void *ptr_phy, int baud);
+int phy_set_ibdly(void *ptr_phy, int ibdly);
+int phy_get_timing(void *ptr_phy, int *baud, int *ibdly);
 //int phy_send_break(void *ptr_phy);
 int phy_send_double_break(void *ptr_phy);
+int _phy_send(void *ptr_phy, const u8 *data, int len);
 int phy_send(void *ptr_phy, const u8 *data, int len);
 int phy_send_byte(void *ptr_phy, u8 val);
 int phy_receive(void *ptr_phy, u8 *data, int len);
 //u8 phy_receive_byte(void *ptr_phy);
 int phy_transfer(void *ptr_phy, const u8 *wdata, int wlen, u8 *rdata, int rlen);
 int phy_sib(void *ptr_phy, u8 *data, int len);
+int phy_get_fd(void *ptr_phy);
+int _phy_async_start(phy_async_t *xfer, void *ptr_phy, const u8 *wdata, int wlen, u8 *rdata, int rlen, int timeout);
+int phy_async_start(phy_async_t *xfer, void *ptr_phy, const u8 *wdata, int wlen, u8 *rdata, int rlen, int timeout);
+int phy_async_break(phy_async_t *xfer, void *ptr_phy);
+int phy_async_poll(phy_async_t *xfer);
 
 #endif
 
@@ -0,0 +1,102 @@
+#ifdef CUPDI
+
+#include "platform/platform.h"
+#include "constants.h"
+#include "stats.h"
+
+#ifdef UPDI_STATS
+
+UPDI_THREAD_LOCAL updi_stats_t updi_stats;
+
+/*
+    Add a latency sample to the histogram
+    @hist: histogram
+    @us: latency
+*/
+void _updi_stats_hist(updi_hist_t *hist, unsigned int us)
+{
+    int n = 31 - __builtin_clz(us | 1);
+
+    if (n >= UPDI_STATS_HIST_BUCKETS)
+        n = UPDI_STATS_HIST_BUCKETS - 1;
+
+    hist->bucket[n]++;
+    hist->count++;
+    hist->sum_us += us;
+    if (us > hist->max_us)
+        hist->max_us = us;
+}
+
+/*
+    Get the statistics of this thread, could be read after each part
+    @returns statistics
+*/
+const updi_stats_t *updi_stats_get(void)
+{
+    return &updi_stats;
+}
+
+/*
+    Clear the statistics of this thread
+*/
+void updi_stats_reset(void)
+{
+    memset(&updi_stats, 0, sizeof(updi_stats));
+}
+
+/*
+    Print a histogram, only the used buckets
+    @name: histogram name
+    @hist: histogram
+*/
+static void updi_stats_hist_report(const char *name, const updi_hist_t *hist)
+{
+    int i;
+
+    if (!hist->count) {
+        printf("  %s: none\n", name);
+        return;
+    }
+
+    printf("  %s: %u, mean %u us, max %u us\n", name, hist->count, (unsigned int)(hist->sum_us / hist->count), hist->max_us);
+    for (i = 0; i < UPDI_STATS_HIST_BUCKETS; i++) {
+        if (hist->bucket[i])
+            printf("    %8u-%-8u us %u\n", i ? 1u << i : 0, (1u << (i + 1)) - 1, hist->bucket[i]);
+    }
+}
+
+/*
+    Print the statistics
+    @stats: statistics, from updi_stats_get()
+*/
+void updi_stats_report(const updi_stats_t *stats)
+{
+    static const char * const insn_names[] = { "LDS", "LD", "STS", "ST", "LDCS", "REPEAT", "STCS", "KEY" };
+    static const char * const cmd_names[] = { "NOP", "WP", "ER", "ERWP", "PBC", "CHER", "EEER", "WFU" };
+    int i;
+
+    printf("<STATS> phy: tx %u rx %u bytes, echo mismatch %u, timeout %u, line error %u, retry %u, flush %u, break %u\n",
+        stats->phy.tx_bytes, stats->phy.rx_bytes, stats->phy.echo_mismatch, stats->phy.timeouts, stats->phy.line_errors,
+        stats->phy.retries, stats->phy.flushes, stats->phy.breaks);
+
+    printf("<STATS> link: ack fail %u, key %u, recover %u(failed %u), retry %u, cs cached %u, insn", stats->link.ack_fail,
+        stats->link.keys, stats->link.recoveries, stats->link.recover_fails, stats->link.retries, stats->link.cs_cached);
+    for (i = 0; i < ARRAY_SIZE(insn_names); i++)
+        printf(" %s %u", insn_names[i], stats->link.insn[i]);
+    puts("");
+
+    printf("<STATS> app: reset %u, nvm wait %u us, nvm cmd", stats->app.resets, stats->app.nvm_wait_us);
+    for (i = 0; i < ARRAY_SIZE(cmd_names); i++)
+        printf(" %s %u", cmd_names[i], stats->app.nvm_cmd[i]);
+    puts("");
+
+    printf("<STATS> nvm: read %u bytes, written flash %u eeprom %u bytes, fuse %u\n",
+        stats->nvm.read_bytes, stats->nvm.flash_bytes, stats->nvm.eeprom_bytes, stats->nvm.fuse_writes);
+
+    updi_stats_hist_report("phy_transfer", &stats->transfer);
+    updi_stats_hist_report("nvm ready", &stats->nvm_ready);
+}
+
+#endif
+
+#endif
@@ -0,0 +1,116 @@
+#ifndef __UD_STATS_H
+#define __UD_STATS_H
+
+#ifdef CUPDI
+
+/*
+    UPDI statistics, the counters of each layer and the latency histograms updated by the stack,
+    compiled in with UPDI_STATS. Each session thread has its own statistics.
+*/
+
+/* Log2 buckets, bucket 0 is < 2us, bucket n is [2^n, 2^(n+1)) us, the last one includes the longer */
+#define UPDI_STATS_HIST_BUCKETS 24
+
+/*
+    Latency histogram
+    @bucket: counts of each log2 bucket
+    @count: samples
+    @max_us: max latency
+    @sum_us: sum of the latency
+*/
+typedef struct _updi_hist {
+    unsigned int bucket[UPDI_STATS_HIST_BUCKETS];
+    unsigned int count;
+    unsigned int max_us;
+    unsigned long long sum_us;
+}updi_hist_t;
+
+/*
+    Statistics of all the layers
+    phy:
+        @tx_bytes/rx_bytes: bytes sent/received(echo excluded)
+        @echo_mismatch: sent bytes echoed with other value
+        @timeouts: echo or response not completed in time
+        @line_errors: parity/frame/overrun errors latched by the port
+        @retries: transfers sent again by the link retry policy
+        @flushes: port flushes before sending
+        @breaks: double breaks
+    link:
+        @insn: instructions sent, indexed by the opcode(bit 7:5), see UPDI_LDS...UPDI_KEY
+        @ack_fail: ACK missing or wrong after ST/STS
+        @keys: keys sent
+        @recoveries/recover_fails: link recoveries(double break and re-init) done and failed
+        @retries: transactions retried after the recovery
+        @cs_cached: LDCS served and STCS skipped by the CS shadow
+    app:
+        @nvm_cmd: NVMCTRL commands executed, indexed by UPDI_NVMCTRL_CTRLA_xxx
+        @resets: reset applied
+        @nvm_wait_us: time waited for NVM controller ready
+    nvm:
+        @read_bytes: bytes read from the memories
+        @flash_bytes/eeprom_bytes: bytes written of flash/eeprom(userrow)
+        @fuse_writes: fuse bytes written
+    @transfer: phy_transfer() latency
+    @nvm_ready: app_wait_flash_ready() latency
+*/
+typedef struct _updi_stats {
+    struct {
+        unsigned int tx_bytes;
+        unsigned int rx_bytes;
+        unsigned int echo_mismatch;
+        unsigned int timeouts;
+        unsigned int line_errors;
+        unsigned int retries;
+        unsigned int flushes;
+        unsigned int breaks;
+    }phy;
+    struct {
+        unsigned int insn[8];
+        unsigned int ack_fail;
+        unsigned int keys;
+        unsigned int recoveries;
+        unsigned int recover_fails;
+        unsigned int retries;
+        unsigned int cs_cached;
+    }link;
+    struct {
+        unsigned int nvm_cmd[8];
+        unsigned int resets;
+        unsigned int nvm_wait_us;
+    }app;
+    struct {
+        unsigned int read_bytes;
+        unsigned int flash_bytes;
+        unsigned int eeprom_bytes;
+        unsigned int fuse_writes;
+    }nvm;
+    updi_hist_t transfer;
+    updi_hist_t nvm_ready;
+}updi_stats_t;
+
+#ifdef UPDI_STATS
+extern UPDI_THREAD_LOCAL updi_stats_t updi_stats;
+
+void _updi_stats_hist(updi_hist_t *hist, unsigned int us);
+const updi_stats_t *updi_stats_get(void);
+void updi_stats_reset(void);
+void updi_stats_report(const updi_stats_t *stats);
+
+#define UPDI_STATS_ADD(_field, _n) (updi_stats._field += (_n))
+#define UPDI_STATS_INC(_field) (updi_stats._field++)
+#define UPDI_STATS_HIST(_field, _us) _updi_stats_hist(&updi_stats._field, (_us))
+/* Start time of a histogram sample */
+#define UPDI_STATS_TIME(_var) unsigned int _var = get_time_us()
+#else
+#define UPDI_STATS_ADD(_field, _n)
+#define UPDI_STATS_INC(_field)
+#define UPDI_STATS_HIST(_field, _us)
+#define UPDI_STATS_TIME(_var)
+#define updi_stats_get() NULL
+#define updi_stats_reset()
+#define updi_stats_report(stats)
+#endif
+
+#endif
+
+#endif
@@ -0,0 +1,180 @@
+#ifdef CUPDI
+
+#include "platform/platform.h"
+#include "constants.h"
+#include "trace.h"
+
+#ifdef UPDI_TRACE
+
+#if UPDI_TRACE_SIZE & (UPDI_TRACE_SIZE - 1)
+#error "UPDI_TRACE_SIZE must be power of 2"
+#endif
+
+/*
+    Trace ring
+    @entry: entries, the latest UPDI_TRACE_SIZE are kept
+    @head: next entry to be written, free running
+*/
+typedef struct _updi_trace {
+    updi_trace_entry_t entry[UPDI_TRACE_SIZE];
+    unsigned int head;
+}updi_trace_t;
+
+/* Each session thread traces its own PHY channels */
+static UPDI_THREAD_LOCAL updi_trace_t updi_trace;
+
+/*
+    Record a transaction, called at the PHY send/receive boundary so only the copy is done here
+    @chn: PHY channel index
+    @dir: UPDI_TRACE_DIR_T
+    @data: payload
+    @len: bytes requested
+    @result: TX: 0 or the failed code, RX: bytes received or the failed code
+*/
+void _updi_trace(int chn, int dir, const u8 *data, int len, int result)
+{
+    updi_trace_t *tr = &updi_trace;
+    updi_trace_entry_t *ent = &tr->entry[tr->head++ & (UPDI_TRACE_SIZE - 1)];
+    int i, n;
+
+    ent->time_us = get_time_us();
+    ent->len = (u16)len;
+    ent->result = (short)result;
+    ent->dir = (u8)dir;
+    ent->chn = (u8)chn;
+
+    // The received bytes only, for RX
+    n = dir == UPDI_TRACE_RX ? result : len;
+    if (!data || n < 0)
+        n = 0;
+    else if (n > UPDI_TRACE_DATA)
+        n = UPDI_TRACE_DATA;
+
+    for (i = 0; i < n; i++)
+        ent->data[i] = data[i];
+    for (; i < UPDI_TRACE_DATA; i++)
+        ent->data[i] = 0;
+}
+
+/*
+    Copy the trace entries, the oldest first
+    @entries: output buffer
+    @max: size of entries
+    @returns entries copied
+*/
+int updi_trace_snapshot(updi_trace_entry_t *entries, int max)
+{
+    updi_trace_t *tr = &updi_trace;
+    unsigned int head = tr->head, count;
+    int i;
+
+    count = min(head, UPDI_TRACE_SIZE);
+    if (count > (unsigned int)max)
+        count = max;
+
+    for (i = 0; i < (int)count; i++)
+        entries[i] = tr->entry[(head - count + i) & (UPDI_TRACE_SIZE - 1)];
+
+    return (int)count;
+}
+
+/*
+    Decode the instruction of a TX entry against the UPDI instruction set
+    @ent: entry
+    @buf: output string buffer
+    @size: buf size
+    @returns buf
+*/
+const char *updi_trace_decode(const updi_trace_entry_t *ent, char *buf, int size)
+{
+    static const char * const ptr_mode[] = { "*(ptr)", "*(ptr++)", "ptr", "?" };
+    static const char * const size_name[] = { "b", "w", "3b", "?" };
+    u8 op;
+
+    if (ent->dir == UPDI_TRACE_BREAK) {
+        snprintf(buf, size, "BREAK");
+        return buf;
+    }
+
+    if (ent->dir == UPDI_TRACE_RX) {
+        snprintf(buf, size, "%d/%d bytes", ent->result, ent->len);
+        return buf;
+    }
+
+    // Instructions start with SYNC, the other sending is data of the previous instruction(ST/KEY/REPEAT)
+    if (ent->len < 2 || ent->data[0] != UPDI_PHY_SYNC) {
+        snprintf(buf, size, "DATA");
+        return buf;
+    }
+
+    op = ent->data[1];
+    switch (op & 0xE0) {
+    case UPDI_LDS:
+    case UPDI_STS:
+        snprintf(buf, size, "%s a%s d%s", (op & 0xE0) == UPDI_LDS ? "LDS" : "STS",
+            size_name[(op >> 2) & 0x3], size_name[op & 0x3]);
+        break;
+    case UPDI_LD:
+    case UPDI_ST:
+        snprintf(buf, size, "%s %s %s", (op & 0xE0) == UPDI_LD ? "LD" : "ST",
+            ptr_mode[(op >> 2) & 0x3], size_name[op & 0x3]);
+        break;
+    case UPDI_LDCS:
+        snprintf(buf, size, "LDCS 0x%02x", op & 0x0F);
+        break;
+    case UPDI_STCS:
+        snprintf(buf, size, "STCS 0x%02x", op & 0x0F);
+        break;
+    case UPDI_REPEAT:
+        snprintf(buf, size, "REPEAT %s", size_name[op & 0x3]);
+        break;
+    default:
+        snprintf(buf, size, "%s", (op & UPDI_KEY_SIB) ? "SIB" : "KEY");
+    }
+
+    return buf;
+}
+
+/*
+    Print the trace, the oldest first
+    @max: latest entries printed, 0 all of them
+*/
+void updi_trace_dump(int max)
+{
+    static const char * const dir_name[] = { "TX", "RX", "BRK" };
+    updi_trace_entry_t ent;
+    updi_trace_t *tr = &updi_trace;
+    unsigned int head = tr->head, count;
+    char op[24];
+    int i, j, n;
+
+    count = min(head, UPDI_TRACE_SIZE);
+    if (max > 0 && count > (unsigned int)max)
+        count = max;
+
+    printf("<TRACE> %u entries\n", count);
+    for (i = 0; i < (int)count; i++) {
+        ent = tr->entry[(head - count + i) & (UPDI_TRACE_SIZE - 1)];
+        printf("%10u ch%u %-3s %-20s len %3u result %4d:", ent.time_us, ent.chn, dir_name[ent.dir % 3],
+            updi_trace_decode(&ent, op, sizeof(op)), ent.len, ent.result);
+
+        n = ent.dir == UPDI_TRACE_RX ? ent.result : ent.len;
+        if (n > UPDI_TRACE_DATA)
+            n = UPDI_TRACE_DATA;
+        for (j = 0; j < n; j++)
+            printf(" %02x", ent.data[j]);
+        puts("");
+    }
+}
+
+/*
+    Clear the trace
+*/
+void updi_trace_clear(void)
+{
+    updi_trace.head = 0;
+}
+
+#endif
+
+#endif
@@ -0,0 +1,55 @@
+#ifndef __UD_TRACE_H
+#define __UD_TRACE_H
+
+#ifdef CUPDI
+
+/*
+    UPDI bus trace, each PHY transaction is recorded into a RAM ring(the oldest are overwritten)
+    which is dumped on demand or when a part failed. Compiled in with UPDI_TRACE.
+*/
+#ifndef UPDI_TRACE_SIZE
+#define UPDI_TRACE_SIZE 64  //entries, power of 2
+#endif
+#define UPDI_TRACE_DATA 8   //payload bytes kept of each transaction
+
+typedef enum {
+    UPDI_TRACE_TX,      //data sent(echo checked)
+    UPDI_TRACE_RX,      //response received
+    UPDI_TRACE_BREAK,   //double break
+}UPDI_TRACE_DIR_T;
+
+/*
+    Trace entry
+    @time_us: get_time_us() when the transaction finished
+    @len: bytes requested
+    @result: TX: 0 or the failed code, RX: bytes received or the failed code
+    @dir: UPDI_TRACE_DIR_T
+    @chn: PHY channel index
+    @data: first UPDI_TRACE_DATA bytes of the payload
+*/
+typedef struct _updi_trace_entry {
+    unsigned int time_us;
+    u16 len;
+    short result;
+    u8 dir;
+    u8 chn;
+    u8 data[UPDI_TRACE_DATA];
+}updi_trace_entry_t;
+
+#ifdef UPDI_TRACE
+void _updi_trace(int chn, int dir, const u8 *data, int len, int result);
+int updi_trace_snapshot(updi_trace_entry_t *entries, int max);
+void updi_trace_dump(int max);
+void updi_trace_clear(void);
+const char *updi_trace_decode(const updi_trace_entry_t *ent, char *buf, int size);
+#define UPDI_TRACE_RECORD(_chn, _dir, _data, _len, _result) _updi_trace((_chn), (_dir), (_data), (_len), (_result))
+#else
+#define UPDI_TRACE_RECORD(_chn, _dir, _data, _len, _result)
+#define updi_trace_snapshot(entries, max) 0
+#define updi_trace_dump(max)
+#define updi_trace_clear()
+#endif
+
+#endif
+
+#endif
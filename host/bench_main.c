@@ -0,0 +1,561 @@
+/*
+ * bench_main.c
+ *
+ * Layered benchmark of the cupdi stack, each layer measured alone:
+ *   phy      phy_transfer() round trip(LDCS, 2 bytes out and 1 byte back)
+ *   link     link_ld_ptr_inc()/link_st_ptr_inc() bytes per second, pointer and repeat included
+ *   app      app_write_nvm() pages per second, NVM busy waiting included
+ *   program  cupdi_program_part() of the image in cupdi/hex_file/ihex.c, each phase, and the prediction of
+ *            cupdi/estimate.c calibrated by the phy round trip, so the model error is seen on the next rows
+ * swept over baud, block size and ibdly(the PHY delay after each sending).
+ *   crc      crc_benchmark() of cupdi/crc/crc.c, bitwise reference and table variants over each block size,
+ *            no port used. Measured by cupdi_bench only, the clock of cupdi_bench_sim is the simulator's
+ *
+ * The results are CSV(default) or JSON lines on stdout, one row each layer/op/baud/ibdly/block.
+ * Built as cupdi_bench for USB-UART adapters and cupdi_bench_sim for the simulator(CUPDI_BENCH_SIM),
+ * the simulator time is its virtual clock so the numbers are reproducible for regression check.
+ *
+ *  cupdi_bench [-c port] [-d device] [-b bauds] [-s blocks] [-i ibdlys] [-n iterations] [-p cycles]
+ *              [-l layers] [-a address] [-f csv|json] [-t turnaround_us]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <platform/platform.h>
+#include <device/device.h>
+#include <updi/constants.h>
+#include <updi/link.h>
+#include <updi/application.h>
+#include <updi/nvm.h>
+#include <hex_file/hexfile.h>
+#include <crc/crc.h>
+#include "cupdi.h"
+#include "estimate.h"
+#ifdef CUPDI_BENCH_SIM
+#include <platform/sim/updi_sim.h>
+#endif
+
+/* Max values of a sweep list */
+#define BENCH_MAX_SWEEP 16
+
+/* SRAM scratch of tiny1617 for the link store benchmark, the part is re-programmed by 'program' layer */
+#define BENCH_SCRATCH_ADDRESS 0x3800
+
+enum { BENCH_PHY = 1 << 0, BENCH_LINK = 1 << 1, BENCH_APP = 1 << 2, BENCH_PROGRAM = 1 << 3, BENCH_CRC = 1 << 4 };
+
+/*
+    Sweep list
+    @val: values
+    @count: value count
+*/
+typedef struct _bench_list {
+    int val[BENCH_MAX_SWEEP];
+    int count;
+}bench_list_t;
+
+/*
+    Samples of one row
+    @count: samples
+    @sum/min/max: time(us) of the samples
+*/
+typedef struct _bench_sample {
+    unsigned int count;
+    unsigned long long sum;
+    unsigned int min;
+    unsigned int max;
+}bench_sample_t;
+
+/*
+    Benchmark config
+*/
+typedef struct _bench {
+    const char *port;
+    const char *dev_name;
+    const device_info_t *dev;
+    bench_list_t bauds;
+    bench_list_t blocks;
+    bench_list_t ibdlys;
+    int iterations;
+    int cycles;
+    int layers;
+    u16 scratch;
+    bool json;
+    int failed;
+    unsigned int rtt_us;    //phy round trip of the current sweep point, 0 if not measured
+}bench_t;
+
+static void sample_reset(bench_sample_t *s)
+{
+    memset(s, 0, sizeof(*s));
+}
+
+static void sample_add(bench_sample_t *s, unsigned int us)
+{
+    if (!s->count || us < s->min)
+        s->min = us;
+    if (us > s->max)
+        s->max = us;
+    s->sum += us;
+    s->count++;
+}
+
+/*
+    Parse comma separated integers
+    @str: list string
+    @list: output
+    @return 0 successful, other value if failed
+*/
+static int parse_list(const char *str, bench_list_t *list)
+{
+    char *end;
+
+    list->count = 0;
+    while (*str && list->count < BENCH_MAX_SWEEP) {
+        list->val[list->count++] = (int)strtol(str, &end, 0);
+        if (end == str)
+            return -2;
+        str = *end == ',' ? end + 1 : end;
+    }
+
+    return list->count ? 0 : -3;
+}
+
+/*
+    Emit a result row
+    @b: benchmark
+    @layer/op: the measured function
+    @baud/ibdly/block: sweep point
+    @s: samples, the time of each op
+    @units: units(bytes or pages) of each op for the rate
+    @unit: rate unit name
+    @no return
+*/
+static void emit(bench_t *b, const char *layer, const char *op, int baud, int ibdly, int block,
+    const bench_sample_t *s, double units, const char *unit)
+{
+    double mean = s->count ? (double)s->sum / s->count : 0;
+    double rate = mean > 0 ? units * 1000000.0 / mean : 0;
+
+    if (b->json) {
+        printf("{\"layer\":\"%s\",\"op\":\"%s\",\"baud\":%d,\"ibdly\":%d,\"block\":%d,\"count\":%u,"
+            "\"mean_us\":%.1f,\"min_us\":%u,\"max_us\":%u,\"rate\":%.2f,\"unit\":\"%s\"}\n",
+            layer, op, baud, ibdly, block, s->count, mean, s->min, s->max, rate, unit);
+    }
+    else {
+        printf("%s,%s,%d,%d,%d,%u,%.1f,%u,%u,%.2f,%s\n",
+            layer, op, baud, ibdly, block, s->count, mean, s->min, s->max, rate, unit);
+    }
+    fflush(stdout);
+}
+
+static void bench_fail(bench_t *b, const char *layer, const char *what, int baud, int ibdly, int result)
+{
+    fprintf(stderr, "%s: %s failed %d (baud %d, ibdly %d)\n", layer, what, result, baud, ibdly);
+    b->failed++;
+}
+
+/*
+    PHY and LINK layers, on a connected link
+*/
+static void bench_link(bench_t *b, int baud, int ibdly)
+{
+    nvm_info_t iflash;
+    bench_sample_t s;
+    u8 data[UPDI_MAX_REPEAT_SIZE + 1], resp;
+    unsigned int t;
+    void *link;
+    int i, j, block, result = 0;
+
+    link = updi_datalink_init(b->port, baud);
+    if (!link) {
+        bench_fail(b, "link", "connect", baud, ibdly, -2);
+        return;
+    }
+    link_set_ibdly(link, ibdly);
+    dev_get_nvm_info(b->dev, NVM_FLASH, &iflash);
+
+    if (b->layers & BENCH_PHY) {
+        sample_reset(&s);
+        for (i = 0; i < b->iterations; i++) {
+            t = get_time_us();
+            result = _link_ldcs(link, UPDI_CS_STATUSA, &resp);
+            if (result)
+                break;
+            sample_add(&s, get_time_us() - t);
+        }
+        if (result) {
+            bench_fail(b, "phy", "transfer", baud, ibdly, result);
+        }
+        else {
+            emit(b, "phy", "transfer", baud, ibdly, 3, &s, 1, "ops/s");
+            b->rtt_us = (unsigned int)(s.sum / s.count);
+        }
+    }
+
+    if (!(b->layers & BENCH_LINK))
+        goto out;
+
+    for (j = 0; j < b->blocks.count; j++) {
+        block = b->blocks.val[j];
+        if (block <= 0 || block > (int)sizeof(data))
+            continue;
+
+        // Load from flash, the part must be unlocked
+        sample_reset(&s);
+        for (i = 0; i < b->iterations; i++) {
+            t = get_time_us();
+            result = link_st_ptr(link, iflash.nvm_start + (i * block) % iflash.nvm_size);
+            if (!result && block > 1)
+                result = link_repeat(link, (u8)(block - 1));
+            if (!result)
+                result = link_ld_ptr_inc(link, data, block);
+            if (result)
+                break;
+            sample_add(&s, get_time_us() - t);
+        }
+        if (result)
+            bench_fail(b, "link", "ld_ptr_inc", baud, ibdly, result);
+        else
+            emit(b, "link", "ld_ptr_inc", baud, ibdly, block, &s, block, "B/s");
+
+        // Store to SRAM scratch
+        memset(data, 0x5A, block);
+        sample_reset(&s);
+        for (i = 0; i < b->iterations; i++) {
+            t = get_time_us();
+            result = link_st_ptr(link, b->scratch);
+            if (!result && block > 1)
+                result = link_repeat(link, (u8)(block - 1));
+            if (!result)
+                result = link_st_ptr_inc(link, data, block, NULL);
+            if (result)
+                break;
+            sample_add(&s, get_time_us() - t);
+        }
+        if (result)
+            bench_fail(b, "link", "st_ptr_inc", baud, ibdly, result);
+        else
+            emit(b, "link", "st_ptr_inc", baud, ibdly, block, &s, block, "B/s");
+    }
+
+out:
+    updi_datalink_deinit(link);
+}
+
+/*
+    APP layer, the flash is chip erased and written by pages, block is the bytes written of each page
+*/
+static void bench_app(bench_t *b, int baud, int ibdly)
+{
+    nvm_info_t iflash;
+    bench_sample_t s;
+    u8 data[UPDI_MAX_REPEAT_SIZE + 1];
+    unsigned int t;
+    void *app;
+    int i, j, block, pages, result;
+
+    app = updi_application_init(b->port, baud, (void *)b->dev);
+    if (!app) {
+        bench_fail(b, "app", "connect", baud, ibdly, -2);
+        return;
+    }
+    app_set_ibdly(app, ibdly);
+    dev_get_nvm_info(b->dev, NVM_FLASH, &iflash);
+    pages = iflash.nvm_size / iflash.nvm_pagesize;
+
+    result = app_enter_progmode(app);
+    if (result) {
+        result = app_unlock(app);
+        if (!result)
+            result = app_enter_progmode(app);
+    }
+    if (result) {
+        bench_fail(b, "app", "progmode", baud, ibdly, result);
+        goto out;
+    }
+
+    for (j = 0; j < b->blocks.count; j++) {
+        block = b->blocks.val[j];
+        if (block <= 0 || block > iflash.nvm_pagesize || block > (int)sizeof(data))
+            continue;
+
+        result = app_chip_erase(app);
+        if (result) {
+            bench_fail(b, "app", "chip_erase", baud, ibdly, result);
+            break;
+        }
+
+        sample_reset(&s);
+        for (i = 0; i < b->iterations; i++) {
+            memset(data, (u8)i, block);
+            t = get_time_us();
+            result = app_write_nvm(app, iflash.nvm_start + (i % pages) * iflash.nvm_pagesize, data, block);
+            if (result)
+                break;
+            sample_add(&s, get_time_us() - t);
+        }
+        if (result)
+            bench_fail(b, "app", "write_nvm", baud, ibdly, result);
+        else
+            emit(b, "app", "write_nvm", baud, ibdly, block, &s, 1, "pages/s");
+    }
+
+    app_leave_progmode(app);
+out:
+    updi_application_deinit(app);
+}
+
+/*
+    End-to-end programming of the image, a row for the whole part and each phase
+*/
+static void bench_program(bench_t *b, int baud, int ibdly)
+{
+    bench_sample_t total, phases[CUPDI_PHASE_NUM];
+    cupdi_report_t report;
+    unsigned int leave;
+    estimate_param_t param;
+    estimate_image_t img;
+    estimate_result_t res;
+    unsigned int t;
+    void *nvm;
+    int i, j, result = 0;
+
+    sample_reset(&total);
+    for (j = 0; j < CUPDI_PHASE_NUM; j++)
+        sample_reset(&phases[j]);
+
+    for (i = 0; i < b->cycles; i++) {
+        cupdi_report_init(&report);
+        t = get_time_us();
+        nvm = updi_nvm_init(b->port, baud, (void *)b->dev);
+        if (!nvm) {
+            result = -3;
+            break;
+        }
+        nvm_set_ibdly(nvm, ibdly);
+        report.phase_ms[CUPDI_PHASE_CONNECT] = (get_time_us() - t) / 1000;
+        result = cupdi_program_part(nvm, UPDI_PLAN_DEFAULT, &report);
+        leave = get_time_us();
+        nvm_leave_progmode(nvm);
+        report.phase_ms[CUPDI_PHASE_LEAVE] = (get_time_us() - leave) / 1000;
+        updi_nvm_deinit(nvm);
+        if (result)
+            break;
+
+        sample_add(&total, get_time_us() - t);
+        for (j = 0; j < CUPDI_PHASE_NUM; j++)
+            sample_add(&phases[j], report.phase_ms[j] * 1000);
+    }
+
+    if (result) {
+        bench_fail(b, "program", "cupdi_program_part", baud, ibdly, result);
+        return;
+    }
+
+    emit(b, "program", "part", baud, ibdly, 0, &total, 1, "parts/s");
+    for (j = 0; j < CUPDI_PHASE_NUM; j++)
+        emit(b, "program", cupdi_phase_name(j), baud, ibdly, 0, &phases[j], 1, "ops/s");
+
+    // Prediction of the same part, the latency is fitted with the LDCS round trip(2 bytes out and 1 back)
+    estimate_default_param(&param, baud, ibdly);
+    if (b->rtt_us)
+        estimate_calibrate(&param, 2, 1, b->rtt_us);
+    if (estimate_image_stats(b->dev, dhex_get_image(), &img) || estimate_program(&param, &img, ESTIMATE_CHIP_ERASE, &res))
+        return;
+
+    sample_reset(&total);
+    sample_add(&total, res.total_us);
+    emit(b, "estimate", "part", baud, ibdly, 0, &total, 1, "parts/s");
+    for (j = 0; j < ESTIMATE_PART_NUM; j++) {
+        sample_reset(&phases[j]);
+        sample_add(&phases[j], res.us[j]);
+        emit(b, "estimate", estimate_part_name(j), baud, ibdly, 0, &phases[j], 1, "ops/s");
+    }
+}
+
+#ifndef CUPDI_BENCH_SIM
+/*
+    CRC layer, once for all the sweep points
+*/
+static void bench_crc(bench_t *b)
+{
+    static u8 buf[UPDI_MAX_TRANSFER_SIZE];
+    crc_bench_t rows[CRC_BENCH_NUM];
+    bench_sample_t s;
+    char op[32];
+    int i, k, block, result;
+
+    for (i = 0; i < sizeof(buf); i++)
+        buf[i] = (u8)(i * 7 + 1);
+
+    for (i = 0; i < b->blocks.count; i++) {
+        block = min(b->blocks.val[i], (int)sizeof(buf));
+        if (block <= 0)
+            continue;
+
+        result = crc_benchmark(buf, block, b->iterations, rows);
+        if (result)
+            bench_fail(b, "crc", "crc_benchmark", 0, 0, result);
+
+        for (k = 0; k < CRC_BENCH_NUM; k++) {
+            sample_reset(&s);
+            s.count = b->iterations;
+            s.sum = rows[k].bitwise_us;
+            s.min = s.max = rows[k].bitwise_us / b->iterations;
+            snprintf(op, sizeof(op), "%s_bitwise", rows[k].name);
+            emit(b, "crc", op, 0, 0, block, &s, block, "B/s");
+
+            s.sum = rows[k].fast_us;
+            s.min = s.max = rows[k].fast_us / b->iterations;
+            snprintf(op, sizeof(op), "%s_table", rows[k].name);
+            emit(b, "crc", op, 0, 0, block, &s, block, "B/s");
+        }
+    }
+}
+#endif
+
+static void usage(const char *name)
+{
+    fprintf(stderr, "usage: %s [-c port] [-d device] [-b bauds] [-s blocks] [-i ibdlys] [-n iterations] [-p cycles]\n"
+        "       [-l layers] [-a address] [-f csv|json] [-t turnaround_us]\n"
+        "  -c  serial port, default the first one\n"
+        "  -d  device name, default tiny1617\n"
+        "  -b  UPDI bauds, comma separated, default 115200,230400\n"
+        "  -s  block sizes of link and app(max page size), default 1,16,64,256\n"
+        "  -i  PHY delays(ms) after each sending, default 1,0\n"
+        "  -n  iterations of phy/link/app, default 16\n"
+        "  -p  program cycles, default 1\n"
+        "  -l  layers, comma separated of phy,link,app,program,crc, default all\n"
+        "  -a  SRAM scratch address of link store, default 0x%04x\n"
+        "  -f  output format, default csv\n"
+        "  -t  simulator turnaround(us) of each response, cupdi_bench_sim only\n", name, BENCH_SCRATCH_ADDRESS);
+}
+
+int main(int argc, char *argv[])
+{
+    static const char * const layer_names[] = { "phy", "link", "app", "program", "crc" };
+    bench_t bench = { 0 }, *b = &bench;
+    char *layers = NULL, *tok;
+    int turnaround = 0;
+    int i, j, baud, ibdly, opt;
+#ifdef CUPDI_BENCH_SIM
+    updi_sim_config_t cfg;
+#endif
+
+    b->dev_name = "tiny1617";
+    b->iterations = 16;
+    b->cycles = 1;
+    b->layers = BENCH_PHY | BENCH_LINK | BENCH_APP | BENCH_PROGRAM | BENCH_CRC;
+    b->scratch = BENCH_SCRATCH_ADDRESS;
+    parse_list("115200,230400", &b->bauds);
+    parse_list("1,16,64,256", &b->blocks);
+    parse_list("1,0", &b->ibdlys);
+
+    while ((opt = getopt(argc, argv, "c:d:b:s:i:n:p:l:a:f:t:h")) != -1) {
+        switch (opt) {
+        case 'c':
+            b->port = optarg;
+            break;
+        case 'd':
+            b->dev_name = optarg;
+            break;
+        case 'b':
+            if (parse_list(optarg, &b->bauds))
+                goto bad;
+            break;
+        case 's':
+            if (parse_list(optarg, &b->blocks))
+                goto bad;
+            break;
+        case 'i':
+            if (parse_list(optarg, &b->ibdlys))
+                goto bad;
+            break;
+        case 'n':
+            b->iterations = atoi(optarg);
+            break;
+        case 'p':
+            b->cycles = atoi(optarg);
+            break;
+        case 'l':
+            layers = optarg;
+            break;
+        case 'a':
+            b->scratch = (u16)strtol(optarg, NULL, 0);
+            break;
+        case 'f':
+            b->json = !strcmp(optarg, "json");
+            break;
+        case 't':
+            turnaround = atoi(optarg);
+            break;
+        default:
+            goto bad;
+        }
+    }
+
+    if (layers) {
+        b->layers = 0;
+        for (tok = strtok(layers, ","); tok; tok = strtok(NULL, ",")) {
+            for (i = 0; i < ARRAY_SIZE(layer_names); i++) {
+                if (!strcmp(tok, layer_names[i]))
+                    b->layers |= 1 << i;
+            }
+        }
+    }
+
+    b->dev = get_chip_info(b->dev_name);
+    if (!b->dev) {
+        fprintf(stderr, "Device %s not support\n", b->dev_name);
+        return 2;
+    }
+
+    if (b->iterations <= 0 || b->cycles <= 0 || !b->layers)
+        goto bad;
+
+#ifdef CUPDI_BENCH_SIM
+    updi_sim_default_config(&cfg, b->dev);
+    cfg.turnaround_us = turnaround;
+    updi_sim_attach(0, &cfg);
+    if (!b->port)
+        b->port = GetPortName(0);
+#else
+    (void)turnaround;
+#endif
+
+    if (!b->json)
+        printf("layer,op,baud,ibdly,block,count,mean_us,min_us,max_us,rate,unit\n");
+
+    if (b->layers & BENCH_CRC) {
+#ifdef CUPDI_BENCH_SIM
+        if (layers)
+            fprintf(stderr, "crc: not measured by the simulator clock, run cupdi_bench -l crc\n");
+#else
+        bench_crc(b);
+#endif
+    }
+
+    for (i = 0; i < b->bauds.count; i++) {
+        baud = b->bauds.val[i];
+        for (j = 0; j < b->ibdlys.count; j++) {
+            ibdly = b->ibdlys.val[j];
+            b->rtt_us = 0;
+
+            if (b->layers & (BENCH_PHY | BENCH_LINK))
+                bench_link(b, baud, ibdly);
+
+            if (b->layers & BENCH_APP)
+                bench_app(b, baud, ibdly);
+
+            if (b->layers & BENCH_PROGRAM)
+                bench_program(b, baud, ibdly);
+        }
+    }
+
+    return b->failed ? 1 : 0;
+
+bad:
+    usage(argv[0]);
+    return 2;
+}
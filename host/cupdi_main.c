@@ -0,0 +1,147 @@
+/*
+ * cupdi_main.c
+ *
+ * Host programmer, runs the cupdi stack over a USB-UART adapter with the termios backend.
+ * The image programmed is the one converted into cupdi/hex_file/ihex.c.
+ *
+ *  cupdi [-c port] [-d device] [-b baud] [-n cycles] [-i image.hex] [-e] [-k] [-D region [-o file.hex]] [-l]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <platform/platform.h>
+#include <updi/stats.h>
+#include <hex_file/hexfile.h>
+#include <ihex/kk_ihex_write.h>
+#include "cupdi.h"
+
+/*
+    Hex line output of the dump
+*/
+static void dump_flush(struct ihex_state *ihex, char *buffer, char *eptr)
+{
+    fwrite(buffer, 1, eptr - buffer, (FILE *)ihex->args);
+}
+
+static void usage(const char *name)
+{
+    fprintf(stderr, "usage: %s [-c port] [-d device] [-b baud] [-n cycles] [-i image.hex] [-e] [-k] [-D region [-o file.hex]] [-l]\n"
+        "  -c  serial port, default the first USB-UART adapter\n"
+        "  -d  device name, default tiny1617\n"
+        "  -b  UPDI baud, default 115200\n"
+        "  -n  program cycles, default 1\n"
+        "  -i  Intel HEX image loaded at runtime, default the built-in image\n"
+        "  -e  preserve the eeprom, no chip erase\n"
+        "  -k  keep the flash out of the image(bootloader or data), no chip erase\n"
+        "  -D  dump a region(flash, eeprom, userrow, fuse, lock) as Intel HEX, nothing is programmed\n"
+        "  -o  dump output file, default stdout\n"
+        "  -l  list serial ports\n", name);
+}
+
+int main(int argc, char *argv[])
+{
+    static hex_data_t image;
+    const char *port = NULL;
+    const char *image_file = NULL;
+    const char *dump_file = NULL;
+    FILE *dump_out;
+    const char *dev_name = "tiny1617";
+    cupdi_report_t report;
+    unsigned int start, elapsed;
+    int dump = -1, baud = 115200, cycles = 1, flags = 0;
+    int i, j, opt, result, failed = 0;
+
+    while ((opt = getopt(argc, argv, "c:d:b:n:i:ekD:o:lh")) != -1) {
+        switch (opt) {
+        case 'c':
+            port = optarg;
+            break;
+        case 'd':
+            dev_name = optarg;
+            break;
+        case 'b':
+            baud = atoi(optarg);
+            break;
+        case 'n':
+            cycles = atoi(optarg);
+            break;
+        case 'i':
+            image_file = optarg;
+            break;
+        case 'D':
+            dump = cupdi_region_type(optarg);
+            if (dump < 0) {
+                usage(argv[0]);
+                return 2;
+            }
+            break;
+        case 'o':
+            dump_file = optarg;
+            break;
+        case 'e':
+            flags |= UPDI_PLAN_PRESERVE_EEPROM;
+            break;
+        case 'k':
+            flags |= UPDI_PLAN_PRESERVE_FLASH;
+            break;
+        case 'l':
+            for (i = 0; i < GetPortCount(); i++)
+                printf("%s\n", GetPortName(i));
+            return 0;
+        default:
+            usage(argv[0]);
+            return 2;
+        }
+    }
+
+    if (image_file) {
+        result = dhex_load_file(image_file, &image);
+        if (result) {
+            fprintf(stderr, "Load image %s failed %d\n", image_file, result);
+            return 2;
+        }
+        dhex_set_image(&image);
+    }
+
+    if (!port && !GetPortCount()) {
+        fprintf(stderr, "No serial port found\n");
+        return 2;
+    }
+
+    if (dump >= 0) {
+        dump_out = dump_file ? fopen(dump_file, "w") : stdout;
+        if (!dump_out) {
+            perror(dump_file);
+            return 2;
+        }
+
+        result = cupdi_dump_port(port, baud, dev_name, dump, dump_flush, dump_out);
+        if (dump_out != stdout)
+            fclose(dump_out);
+
+        fprintf(stderr, "dump: result %d\n", result);
+
+        return result ? 1 : 0;
+    }
+
+    for (i = 0; i < cycles; i++) {
+        start = get_time_ms();
+        result = cupdi_operate_port(port, baud, dev_name, flags, &report);
+        elapsed = get_time_ms() - start;
+        log_drain(0);
+        updi_stats_report(updi_stats_get());
+        updi_stats_reset();
+
+        printf("cycle %d: result %d, %u ms, flash plan %d\n", i, result, elapsed, report.plan);
+        for (j = 0; j < CUPDI_PHASE_NUM; j++)
+            printf("  %-12s %6u ms\n", cupdi_phase_name(j), report.phase_ms[j]);
+
+        if (result)
+            failed++;
+    }
+
+    printf("%d/%d cycles passed at %d baud\n", cycles - failed, cycles, baud);
+
+    return failed ? 1 : 0;
+}
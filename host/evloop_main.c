@@ -0,0 +1,1095 @@
+/*
+ * evloop_main.c
+ *
+ * Single-threaded event loop programmer: every serial port runs its part as a stage machine of link micro-ops
+ * (link_async_start()), one epoll_wait() serves all the ports, so a port waiting the target or the NVM controller
+ * doesn't hold any thread. The stages are those of cupdi_program_part(), their NVM sequences are the app_seq_xxx()
+ * ones of the APP async operations and the decisions are the shared ones of cupdi.c: device id check, changed fuses
+ * only, flash plan with its checkpoint, then flash, eeprom and userrow are programmed and verified from the image.
+ *
+ * Built as cupdi_evloop for USB-UART adapters and cupdi_evloop_sim for the simulator(CUPDI_EVLOOP_SIM), the
+ * simulated ports have no fd so the loop sleeps on the simulator clock instead of epoll_wait().
+ *
+ *  cupdi_evloop [-c port]... [-d device] [-b baud] [-n cycles] [-e] [-k]
+ *  cupdi_evloop_sim [-m ports] [-d device] [-b baud] [-n cycles] [-e] [-k] [-l] [-f N]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <platform/platform.h>
+#include <device/device.h>
+#include <updi/constants.h>
+#include <updi/physical.h>
+#include <updi/link.h>
+#include <updi/application.h>
+#include <hex_file/ihex.h>
+#include <hex_file/hexfile.h>
+#include <crc/crc.h>
+#include "cupdi.h"
+#include "production.h"
+#ifdef CUPDI_EVLOOP_SIM
+#include <platform/sim/updi_sim.h>
+#endif
+
+/* Max serial ports of the loop, each one takes a session of the pools */
+#define EV_MAX_PORT UPDI_MAX_CHANNEL
+
+/* Max micro-ops of a stage */
+#define EV_MAX_OPS 16
+
+/* Connect retries, each one starts with double break */
+#define EV_CONNECT_RETRY 3
+
+/* Time(ms) of the NVM controller ready waiting */
+#define EV_TIMEOUT_NVM_READY 100
+#define EV_TIMEOUT_CHIP_ERASE 500
+
+/* Max fuse bytes of a segment, read once to write the changed ones only */
+#define EV_MAX_FUSE 16
+
+/* Signature row bytes read in progmode: device id then serial number */
+#define EV_SIGROW_SIZE (UPDI_SERIAL_OFFSET + UPDI_SERIAL_SIZE)
+
+#ifdef CUPDI_EVLOOP_SIM
+/* Simulated ports by default */
+#define EV_SIM_PORTS 4
+#endif
+
+/*
+    Stages of a part, in order
+*/
+typedef enum {
+    EV_CONNECT,
+    EV_INFO,
+    EV_PROGMODE,
+    EV_UNLOCK,
+    EV_FUSE,
+    EV_PLAN,
+    EV_ERASE,
+    EV_PROGRAM,
+    EV_EEPROM,
+    EV_USERROW,
+    EV_VERIFY,
+    EV_VERIFY_EEPROM,
+    EV_VERIFY_USERROW,
+    EV_LOCK,
+    EV_LEAVE,
+    EV_IDLE,
+}EV_STAGE_T;
+
+/*
+    Port state
+    @name: serial port name
+    @link: link of the running part, NULL if idle
+    @fd: fd of the link in the epoll set, negative if not pollable(simulated port)
+    @la/ops/seq: micro-ops of the current stage
+    @stage: current stage
+    @seg/unit: image position of the stage, segment index and its page or byte, flash page index of all the image
+        flash pages for the flash stages, sample index for the plan
+    @reading: the fuse stage is reading the current fuse bytes
+    @rseg: segment whose fuse bytes are in @cur
+    @action: UPDI_PAGE_xxx of the flash page, negative if the page is not compared yet
+    @blank: the image page has no data
+    @last: last page sampled of the resume check
+    @page/pseg: flash page being sampled
+    @buf: page read from the part
+    @data: page of the image
+    @cur: fuse bytes read from the part
+    @sib/sigrow/status/nvm_status: device info and status read
+    @retry: connect retries left
+    @unlocked: unlock has been tried
+    @resume: the checkpoint is being checked for resuming
+    @plan: flash plan of the part
+    @ckpt: flash programming checkpoint, kept for the next part of the port if failed
+    @count: flash pages of each UPDI_PAGE_xxx action
+    @result: failed code of the part, 0 if passed
+    @start/phase_start/phase_ms: time of the part and its CUPDI_PHASE_T
+    @cycles: parts remain
+    @done/passed/last_error/busy_ms: port statistics
+*/
+typedef struct _ev_port {
+    const char *name;
+    void *link;
+    int fd;
+    link_async_t la;
+    link_op_t ops[EV_MAX_OPS];
+    app_seq_t seq;
+
+    EV_STAGE_T stage;
+    int seg;
+    int unit;
+    bool reading;
+    int rseg;
+    int action;
+    bool blank;
+    int last;
+    int page;
+    const segment_buffer_t *pseg;
+    u8 buf[MAX_MANIFEST_PAGE_SIZE];
+    u8 data[MAX_MANIFEST_PAGE_SIZE];
+    u8 cur[EV_MAX_FUSE];
+    u8 sib[16];
+    u8 sigrow[EV_SIGROW_SIZE];
+    u8 status;
+    u8 nvm_status;
+    int retry;
+    bool unlocked;
+    bool resume;
+    updi_plan_t plan;
+    updi_checkpoint_t ckpt;
+    int count[UPDI_PAGE_ACTION_NUM];
+    int result;
+
+    unsigned int start;
+    unsigned int phase_start;
+    unsigned int phase_ms[CUPDI_PHASE_NUM];
+
+    int cycles;
+    int done;
+    int passed;
+    int last_error;
+    unsigned int busy_ms;
+}ev_port_t;
+
+/*
+    Loop state
+    @epfd: epoll fd
+    @ports/nports: ports
+    @active: ports with a part running
+    @polled: ports in the epoll set
+    @dev: device memory map
+    @baud: UPDI baudrate
+    @flags: UPDI_PLAN_xxx flags of the planner
+    @stats: statistics of all parts
+*/
+typedef struct _ev_loop {
+    int epfd;
+    ev_port_t ports[EV_MAX_PORT];
+    int nports;
+    int active;
+    int polled;
+
+    const device_info_t *dev;
+    int baud;
+    int flags;
+    production_stats_t stats;
+}ev_loop_t;
+
+static void ev_begin(ev_loop_t *ev, ev_port_t *p);
+
+/*
+    Phase of the stage
+    @stage: EV_STAGE_T
+    @return CUPDI_PHASE_T, negative if not counted in any phase
+*/
+static int ev_stage_phase(EV_STAGE_T stage)
+{
+    static const int phases[] = {
+        [EV_CONNECT] = CUPDI_PHASE_CONNECT,
+        [EV_INFO] = CUPDI_PHASE_DEVICE_INFO,
+        [EV_PROGMODE] = CUPDI_PHASE_PROGMODE,
+        [EV_UNLOCK] = CUPDI_PHASE_PROGMODE,
+        [EV_FUSE] = CUPDI_PHASE_FUSE,
+        [EV_PLAN] = CUPDI_PHASE_ERASE,
+        [EV_ERASE] = CUPDI_PHASE_ERASE,
+        [EV_PROGRAM] = CUPDI_PHASE_PROGRAM,
+        [EV_EEPROM] = CUPDI_PHASE_PROGRAM,
+        [EV_USERROW] = CUPDI_PHASE_PROGRAM,
+        [EV_VERIFY] = CUPDI_PHASE_VERIFY,
+        [EV_VERIFY_EEPROM] = CUPDI_PHASE_VERIFY,
+        [EV_VERIFY_USERROW] = CUPDI_PHASE_VERIFY,
+        [EV_LOCK] = CUPDI_PHASE_LOCK,
+        [EV_LEAVE] = CUPDI_PHASE_LEAVE,
+        [EV_IDLE] = -1,
+    };
+
+    return phases[stage];
+}
+
+/*
+    Memory info of the region
+    @ev: loop
+    @type: NVM_TYPE_T
+    @return memory info
+*/
+static const nvm_info_t *ev_region(ev_loop_t *ev, int type)
+{
+    const chip_info_t *mmap = ev->dev->mmap;
+
+    switch (type) {
+    case NVM_FLASH:
+        return &mmap->flash;
+    case NVM_EEPROM:
+        return &mmap->eeprom;
+    case NVM_USERROW:
+        return &mmap->userrow;
+    case NVM_FUSES:
+        return &mmap->fuse;
+    default:
+        return &mmap->lockbits;
+    }
+}
+
+/*
+    Next image unit of the region, a eeprom/userrow page or a fuse byte
+    @ev: loop
+    @p: port, p->seg and p->unit are moved to the unit
+    @type: NVM_TYPE_T
+    @return segment of the unit, NULL if no more
+*/
+static const segment_buffer_t *ev_next_unit(ev_loop_t *ev, ev_port_t *p, int type)
+{
+    const hex_data_t *dhex = dhex_get_image();
+    const segment_buffer_t *seg;
+    int count;
+
+    for (; p->seg < ARRAY_SIZE(dhex->segment); p->seg++, p->unit = 0) {
+        seg = &dhex->segment[p->seg];
+        if (!seg->data || dhex_segment_region(seg, NULL) != type)
+            continue;
+
+        if (type == NVM_EEPROM || type == NVM_USERROW)
+            count = dhex_page_count(seg, ev_region(ev, type)->nvm_pagesize);
+        else
+            count = seg->len;
+
+        if (p->unit < count)
+            return seg;
+    }
+
+    return NULL;
+}
+
+/*
+    Image bytes of the eeprom/userrow page unit, only they are programmed as _nvm_write_eeprom()
+    @ev: loop
+    @p: port
+    @type: NVM_EEPROM or NVM_USERROW
+    @address: output of the target address
+    @data: output of the image bytes
+    @len: output of the bytes count
+    @return 0 successful, 1 if no more unit, negative if failed
+*/
+static int ev_data_unit(ev_loop_t *ev, ev_port_t *p, int type, u16 *address, const u8 **data, int *len)
+{
+    const nvm_info_t *info = ev_region(ev, type);
+    const segment_buffer_t *seg;
+    ihex_address_t offset, addr, from, to;
+
+    seg = ev_next_unit(ev, p, type);
+    if (!seg)
+        return 1;
+
+    dhex_segment_region(seg, &offset);
+    if (offset + seg->len > info->nvm_size || info->nvm_pagesize > MAX_MANIFEST_PAGE_SIZE) {
+        DBG_INFO(UPDI_DEBUG, "%s: segment %d overflow, offset %x len %x", p->name, p->seg, offset, seg->len);
+        return -3;
+    }
+
+    addr = dhex_page_address(seg, info->nvm_pagesize, p->unit);
+    from = max(addr, seg->addr_from);
+    to = min(addr + info->nvm_pagesize, seg->addr_from + seg->len);
+
+    *address = (u16)(info->nvm_start + offset + from - seg->addr_from);
+    *data = (const u8 *)seg->data + from - seg->addr_from;
+    *len = to - from;
+
+    return 0;
+}
+
+/*
+    Flash plan of the part is started: the checkpoint of the last failed part of the port is resumed if it's of the
+    same part and image, as updi_resume_check(), otherwise the flash is sampled for updi_plan_decide()
+    @ev: loop
+    @p: port
+    @no return
+*/
+static void ev_plan_begin(ev_loop_t *ev, ev_port_t *p)
+{
+    memset(&p->plan, 0, sizeof(p->plan));
+    memset(p->count, 0, sizeof(p->count));
+    p->last = -1;
+
+    p->ckpt.resumed = false;
+    p->resume = p->ckpt.valid && p->ckpt.pages &&
+        updi_checkpoint_match(&p->ckpt, dhex_get_image(), &ev->dev->mmap->flash, p->sigrow + UPDI_SERIAL_OFFSET);
+    if (!p->resume)
+        p->ckpt.valid = false;
+}
+
+/*
+    Flash plan of the part is decided after the pages sampled, the checkpoint of the plan is started
+    @ev: loop
+    @p: port
+    @return 1 the plan stage done, negative if failed
+*/
+static int ev_plan_end(ev_loop_t *ev, ev_port_t *p)
+{
+    int result;
+
+    if (p->resume) {
+        p->plan.plan = p->ckpt.plan;
+        p->ckpt.resumed = true;
+        DBG_INFO(UPDI_DEBUG, "%s: resume flash plan %d from page %d", p->name, p->ckpt.plan, p->ckpt.pages);
+        return 1;
+    }
+
+    // Unlocking erased the chip
+    if (p->unlocked) {
+        p->plan.plan = UPDI_PLAN_WRITE;
+    }
+    else {
+        result = updi_plan_decide(ev->dev, dhex_get_image(), ev->baud, 0, ev->flags, &p->plan);
+        if (result) {
+            DBG_INFO(UPDI_DEBUG, "%s: updi_plan_decide failed %d", p->name, result);
+            return -3;
+        }
+    }
+
+    DBG_INFO(UPDI_DEBUG, "%s: flash plan %d, sampled %d changed %d, predicted %u ms", p->name, p->plan.plan,
+        p->plan.sampled, p->plan.changed, p->plan.predict_ms);
+
+    updi_checkpoint_init(&p->ckpt, p->plan.plan, p->sigrow + UPDI_SERIAL_OFFSET);
+
+    return 1;
+}
+
+/*
+    Build the micro-ops of the stage and start them
+    @ev: loop
+    @p: port
+    @stage: the stage, p->seg/unit are the image position for the image stages
+    @return 0 successful, 1 if nothing to do in the stage, negative if failed
+*/
+static int ev_build(ev_loop_t *ev, ev_port_t *p, EV_STAGE_T stage)
+{
+    const chip_info_t *mmap = ev->dev->mmap;
+    const hex_data_t *dhex = dhex_get_image();
+    const segment_buffer_t *seg;
+    const nvm_info_t *info;
+    const u8 *data;
+    link_op_t *op;
+    ihex_address_t offset;
+    int index, skip, len, result;
+    u8 clksel;
+    u16 address;
+
+    app_seq_init(&p->seq, p->ops, ARRAY_SIZE(p->ops), mmap->reg.nvmctrl_address);
+    p->nvm_status = 0;
+
+    switch (stage) {
+    case EV_CONNECT:
+        // As link_connect(): double break, the link parameters at default baud, then the target baud
+        if (ev->baud <= 225000)
+            clksel = UPDI_ASI_CTRLA_CLKSEL_4M;
+        else if (ev->baud <= 450000)
+            clksel = UPDI_ASI_CTRLA_CLKSEL_8M;
+        else
+            clksel = UPDI_ASI_CTRLA_CLKSEL_16M;
+
+        app_seq_op(&p->seq, LINK_OP_BREAK, 0);
+        app_seq_op(&p->seq, LINK_OP_BAUD, 0)->len = 115200;
+        app_seq_stcs(&p->seq, UPDI_CS_CTRLB, 1 << UPDI_CTRLB_CCDETDIS_BIT);
+        app_seq_stcs(&p->seq, UPDI_CS_CTRLA, 1 << UPDI_CTRLA_IBDLY_BIT);
+        app_seq_stcs(&p->seq, UPDI_ASI_CTRLA, clksel);
+        app_seq_op(&p->seq, LINK_OP_BAUD, 0)->len = ev->baud;
+        app_seq_op(&p->seq, LINK_OP_LDCS, UPDI_CS_STATUSB)->rdata = &p->status;
+        app_seq_op(&p->seq, LINK_OP_LDCS, UPDI_CS_STATUSA)->rdata = &p->status;
+        break;
+
+    case EV_INFO:
+        op = app_seq_op(&p->seq, LINK_OP_SIB, 0);
+        op->rdata = p->sib;
+        op->len = sizeof(p->sib);
+        break;
+
+    case EV_PROGMODE:
+        // The signature row is readable only in progmode, as app_device_info()
+        app_seq_progmode(&p->seq, EV_TIMEOUT_NVM_READY);
+        app_seq_read(&p->seq, mmap->reg.sigrow_address, p->sigrow, sizeof(p->sigrow));
+        break;
+
+    case EV_UNLOCK:
+        app_seq_unlock(&p->seq, EV_TIMEOUT_CHIP_ERASE);
+        break;
+
+    case EV_FUSE:
+    case EV_LOCK:
+        // As _updi_write_fuse_changed(): the segment bytes are read once, then one changed byte each time
+        info = ev_region(ev, stage == EV_FUSE ? NVM_FUSES : NVM_LOCKBITS);
+        for (;;) {
+            seg = ev_next_unit(ev, p, stage == EV_FUSE ? NVM_FUSES : NVM_LOCKBITS);
+            if (!seg)
+                return 1;
+
+            if (seg->len > sizeof(p->cur)) {
+                DBG_INFO(UPDI_DEBUG, "%s: fuse len %d overflow", p->name, seg->len);
+                return -3;
+            }
+
+            dhex_segment_region(seg, &offset);
+            address = info->nvm_start + offset;
+            p->reading = p->rseg != p->seg;
+            if (p->reading) {
+                p->rseg = p->seg;
+                app_seq_read(&p->seq, address, p->cur, seg->len);
+                break;
+            }
+
+            p->unit = updi_fuse_next_changed(p->cur, (const u8 *)seg->data, seg->len, p->unit);
+            if (p->unit < seg->len) {
+                app_seq_write_fuse(&p->seq, address + p->unit, (u8)seg->data[p->unit], &p->nvm_status);
+                break;
+            }
+        }
+        break;
+
+    case EV_PLAN:
+        // Pages sampled one each time, as updi_resume_check() then updi_plan_flash()
+        if (p->resume) {
+            for (; (index = updi_resume_sample(p->ckpt.pages, p->unit)) >= 0 && index <= p->last; p->unit++);
+        }
+        else if (!p->unlocked) {
+            index = updi_plan_sample(updi_flash_pages(dhex, mmap->flash.nvm_pagesize), p->unit);
+        }
+        else {
+            index = -1;
+        }
+
+        if (index < 0)
+            return ev_plan_end(ev, p);
+
+        p->last = index;
+        p->pseg = updi_flash_page(dhex, &mmap->flash, index, &offset, &p->page);
+        app_seq_read(&p->seq, updi_page_address(&mmap->flash, p->pseg, offset, p->page), p->buf, mmap->flash.nvm_pagesize);
+        break;
+
+    case EV_ERASE:
+        if (p->plan.plan != UPDI_PLAN_CHIP_ERASE || p->ckpt.resumed)
+            return 1;
+
+        app_seq_chip_erase(&p->seq, EV_TIMEOUT_CHIP_ERASE, &p->nvm_status);
+        break;
+
+    case EV_PROGRAM:
+        // One page each time as updi_program_pages()/updi_program_flash(), the committed pages resumed are skipped
+        skip = p->ckpt.resumed ? p->ckpt.pages : 0;
+        p->unit = max(p->unit, skip);
+
+        seg = updi_flash_page(dhex, &mmap->flash, p->unit, &offset, &p->page);
+        if (!seg) {
+            DBG_INFO(UPDI_DEBUG, "%s: pages skipped %d, written %d, erased %d, erase-written %d", p->name,
+                p->count[UPDI_PAGE_SKIP], p->count[UPDI_PAGE_WRITE], p->count[UPDI_PAGE_ERASE], p->count[UPDI_PAGE_ERASE_WRITE]);
+            return 1;
+        }
+
+        if (offset + seg->len > mmap->flash.nvm_size) {
+            DBG_INFO(UPDI_DEBUG, "%s: segment overflow, offset %x len %x", p->name, offset, seg->len);
+            return -3;
+        }
+
+        address = updi_page_address(&mmap->flash, seg, offset, p->page);
+        if (p->action < 0) {
+            p->blank = dhex_page_data(seg, mmap->flash.nvm_pagesize, p->page, p->data);
+
+            // Compared with the part first, the page resumed may be committed partly by the failed attempt
+            if (p->plan.plan == UPDI_PLAN_PAGES || (skip && p->unit == skip)) {
+                app_seq_read(&p->seq, address, p->buf, mmap->flash.nvm_pagesize);
+                break;
+            }
+            p->action = UPDI_PAGE_WRITE;
+        }
+
+        if (p->action == UPDI_PAGE_ERASE)
+            app_seq_erase_page(&p->seq, address, &p->nvm_status);
+        else
+            app_seq_write_page(&p->seq, address, p->data, mmap->flash.nvm_pagesize,
+                p->action == UPDI_PAGE_WRITE ? UPDI_NVMCTRL_CTRLA_WRITE_PAGE : UPDI_NVMCTRL_CTRLA_ERASE_WRITE_PAGE, &p->nvm_status);
+        break;
+
+    case EV_EEPROM:
+    case EV_USERROW:
+        // One page each time, only the image bytes of the page are loaded and erase-written
+        result = ev_data_unit(ev, p, stage == EV_EEPROM ? NVM_EEPROM : NVM_USERROW, &address, &data, &len);
+        if (result)
+            return result;
+
+        app_seq_write_page(&p->seq, address, data, len, UPDI_NVMCTRL_CTRLA_ERASE_WRITE_PAGE, &p->nvm_status);
+        break;
+
+    case EV_VERIFY:
+        // As updi_verify(): each flash page is checked with the crc manifest
+        seg = updi_flash_page(dhex, &mmap->flash, p->unit, &offset, &p->page);
+        if (!seg)
+            return 1;
+
+        p->pseg = seg;
+        app_seq_read(&p->seq, updi_page_address(&mmap->flash, seg, offset, p->page), p->buf, mmap->flash.nvm_pagesize);
+        break;
+
+    case EV_VERIFY_EEPROM:
+    case EV_VERIFY_USERROW:
+        result = ev_data_unit(ev, p, stage == EV_VERIFY_EEPROM ? NVM_EEPROM : NVM_USERROW, &address, &data, &len);
+        if (result)
+            return result;
+
+        app_seq_read(&p->seq, address, p->buf, len);
+        break;
+
+    case EV_LEAVE:
+        app_seq_leave(&p->seq);
+        break;
+
+    default:
+        return 1;
+    }
+
+    return app_seq_start(&p->seq, &p->la, p->link) ? -2 : 0;
+}
+
+/*
+    Switch the port to a stage, the stages without any unit are skipped
+    @ev: loop
+    @p: port
+    @stage: the stage
+    @no return
+*/
+static void ev_enter(ev_loop_t *ev, ev_port_t *p, EV_STAGE_T stage)
+{
+    unsigned int now = get_time_ms();
+    int phase, result;
+
+    for (;; stage++) {
+        phase = ev_stage_phase(p->stage);
+        if (phase >= 0)
+            p->phase_ms[phase] += now - p->phase_start;
+        p->phase_start = now;
+
+        if (stage != p->stage) {
+            p->seg = 0;
+            p->unit = 0;
+            p->rseg = -1;
+            p->action = -1;
+
+            if (stage == EV_PLAN)
+                ev_plan_begin(ev, p);
+
+            // Nothing left to resume, as updi_program_planned()
+            if (stage == EV_VERIFY)
+                memset(&p->ckpt, 0, sizeof(p->ckpt));
+        }
+        p->stage = stage;
+
+        if (stage >= EV_IDLE)
+            return;
+
+        result = ev_build(ev, p, stage);
+        if (result == 0)
+            return;
+
+        if (result < 0) {
+            p->result = -3;
+            if (stage == EV_LEAVE)
+                return;
+            stage = EV_LEAVE - 1;
+        }
+    }
+}
+
+/*
+    Finish the part of the port, start the next one if cycles remain
+    @ev: loop
+    @p: port
+    @no return
+*/
+static void ev_finish(ev_loop_t *ev, ev_port_t *p)
+{
+    unsigned int elapsed = get_time_ms() - p->start;
+
+    if (p->link) {
+        if (p->fd >= 0) {
+            epoll_ctl(ev->epfd, EPOLL_CTL_DEL, p->fd, NULL);
+            ev->polled--;
+        }
+        updi_datalink_deinit(p->link);
+        p->link = NULL;
+    }
+
+    p->stage = EV_IDLE;
+    p->done++;
+    p->busy_ms += elapsed;
+    if (p->result)
+        p->last_error = p->result;
+    else
+        p->passed++;
+    production_stats_add(&ev->stats, p->result, elapsed, p->phase_ms);
+    ev->active--;
+
+    if (--p->cycles > 0)
+        ev_begin(ev, p);
+}
+
+/*
+    Fail the current stage, the part leaves progmode as cupdi_operate_port()
+    @ev: loop
+    @p: port
+    @result: link_async_poll() failed code
+    @no return
+*/
+static void ev_fail(ev_loop_t *ev, ev_port_t *p, int result)
+{
+    static const int codes[] = {
+        [EV_CONNECT] = -3, [EV_INFO] = -4, [EV_PROGMODE] = -5, [EV_UNLOCK] = -5, [EV_FUSE] = -6,
+        [EV_PLAN] = -8, [EV_ERASE] = -8, [EV_PROGRAM] = -9, [EV_EEPROM] = -9, [EV_USERROW] = -9,
+        [EV_VERIFY] = -10, [EV_VERIFY_EEPROM] = -10, [EV_VERIFY_USERROW] = -10, [EV_LOCK] = -11, [EV_LEAVE] = 0,
+    };
+
+    DBG_INFO(UPDI_DEBUG, "%s: stage %d op %d failed %d", p->name, p->stage, p->la.index, result);
+
+    if (p->stage == EV_CONNECT && --p->retry > 0) {
+        ev_enter(ev, p, EV_CONNECT);
+        return;
+    }
+
+    if (p->stage == EV_PROGMODE && !p->unlocked) {
+        DBG_INFO(UPDI_DEBUG, "%s: device is locked, performing unlock with chip erase", p->name);
+        p->unlocked = true;
+        // Unlocking erases the chip, nothing to resume
+        memset(&p->ckpt, 0, sizeof(p->ckpt));
+        ev_enter(ev, p, EV_UNLOCK);
+        return;
+    }
+
+    if (p->stage == EV_LEAVE || p->stage == EV_CONNECT) {
+        if (!p->result)
+            p->result = codes[p->stage];
+        ev_finish(ev, p);
+        return;
+    }
+
+    p->result = codes[p->stage];
+    ev_enter(ev, p, EV_LEAVE);
+}
+
+/*
+    The op list of the stage finished, check it and go to the next stage or unit
+    @ev: loop
+    @p: port
+    @no return
+*/
+static void ev_next(ev_loop_t *ev, ev_port_t *p)
+{
+    const hex_data_t *dhex = dhex_get_image();
+    int page_size = ev->dev->mmap->flash.nvm_pagesize;
+    const u8 *data;
+    int len;
+    u16 address;
+
+    if (p->nvm_status & (1 << UPDI_NVM_STATUS_WRITE_ERROR)) {
+        DBG_INFO(UPDI_DEBUG, "%s: NVM write error, status %02x", p->name, p->nvm_status);
+        ev_fail(ev, p, -4);
+        return;
+    }
+
+    switch (p->stage) {
+    case EV_CONNECT:
+        if (!p->status) {
+            // UPDI not OK - reinitialisation required
+            ev_fail(ev, p, -3);
+            return;
+        }
+        ev_enter(ev, p, EV_INFO);
+        break;
+
+    case EV_INFO:
+        DBG_INFO(UPDI_DEBUG, "%s: SIB %.16s", p->name, p->sib);
+        ev_enter(ev, p, EV_PROGMODE);
+        break;
+
+    case EV_PROGMODE:
+        if (dev_check_signature(ev->dev, p->sigrow)) {
+            DBG_INFO(UPDI_DEBUG, "%s: device id mismatch %02x %02x %02x", p->name, p->sigrow[0], p->sigrow[1], p->sigrow[2]);
+            p->result = -4;
+            ev_enter(ev, p, EV_LEAVE);
+            return;
+        }
+        ev_enter(ev, p, EV_FUSE);
+        break;
+
+    case EV_UNLOCK:
+        ev_enter(ev, p, EV_PROGMODE);
+        break;
+
+    case EV_FUSE:
+    case EV_LOCK:
+        if (!p->reading)
+            p->unit++;
+        ev_enter(ev, p, p->stage);
+        break;
+
+    case EV_PLAN:
+        if (!p->resume) {
+            p->blank = dhex_page_data(p->pseg, page_size, p->page, p->data);
+            if (updi_page_compare(p->buf, p->data, page_size, p->blank) != UPDI_PAGE_SKIP)
+                p->plan.changed++;
+            p->plan.sampled++;
+            p->unit++;
+        }
+        else if (calc_crc24(p->buf, page_size) != dhex_get_page_crc(dhex, p->pseg, page_size, p->page)) {
+            // Start over with the plan sampling
+            DBG_INFO(UPDI_DEBUG, "%s: checkpoint page %d mismatch", p->name, p->last);
+            p->resume = false;
+            p->ckpt.valid = false;
+            p->unit = 0;
+        }
+        else {
+            p->unit++;
+        }
+        ev_enter(ev, p, EV_PLAN);
+        break;
+
+    case EV_PROGRAM:
+        if (p->action < 0) {
+            p->action = updi_page_compare(p->buf, p->data, page_size, p->blank);
+            if (p->action != UPDI_PAGE_SKIP) {
+                ev_enter(ev, p, EV_PROGRAM);
+                return;
+            }
+        }
+
+        updi_checkpoint_record(&p->ckpt, p->data, page_size);
+        p->count[p->action]++;
+        p->action = -1;
+        p->unit++;
+        ev_enter(ev, p, EV_PROGRAM);
+        break;
+
+    case EV_EEPROM:
+    case EV_USERROW:
+        p->unit++;
+        ev_enter(ev, p, p->stage);
+        break;
+
+    case EV_VERIFY:
+        if (calc_crc24(p->buf, page_size) != dhex_get_page_crc(dhex, p->pseg, page_size, p->page)) {
+            DBG_INFO(UPDI_DEBUG, "%s: verify flash page %d mismatch", p->name, p->unit);
+            ev_fail(ev, p, -5);
+            return;
+        }
+        p->unit++;
+        ev_enter(ev, p, EV_VERIFY);
+        break;
+
+    case EV_VERIFY_EEPROM:
+    case EV_VERIFY_USERROW:
+        ev_data_unit(ev, p, p->stage == EV_VERIFY_EEPROM ? NVM_EEPROM : NVM_USERROW, &address, &data, &len);
+        if (memcmp(p->buf, data, len)) {
+            DBG_INFO(UPDI_DEBUG, "%s: verify %04x mismatch", p->name, address);
+            ev_fail(ev, p, -5);
+            return;
+        }
+        p->unit++;
+        ev_enter(ev, p, p->stage);
+        break;
+
+    case EV_LEAVE:
+        ev_finish(ev, p);
+        break;
+
+    default:
+        ev_enter(ev, p, p->stage + 1);
+        break;
+    }
+}
+
+/*
+    Start a part on the port
+    @ev: loop
+    @p: port
+    @no return
+*/
+static void ev_begin(ev_loop_t *ev, ev_port_t *p)
+{
+    struct epoll_event event;
+
+    memset(p->phase_ms, 0, sizeof(p->phase_ms));
+    p->start = p->phase_start = get_time_ms();
+    p->result = 0;
+    p->retry = EV_CONNECT_RETRY;
+    p->unlocked = false;
+    p->stage = EV_IDLE;
+    p->fd = -1;
+    ev->active++;
+
+    p->link = updi_datalink_open_async(p->name);
+    if (!p->link) {
+        DBG_INFO(UPDI_DEBUG, "%s: open failed", p->name);
+        p->result = -3;
+        ev_finish(ev, p);
+        return;
+    }
+
+    // The simulated ports are polled by time
+    if (link_get_fd(p->link) >= 0) {
+        event.events = EPOLLIN;
+        event.data.ptr = p;
+        if (epoll_ctl(ev->epfd, EPOLL_CTL_ADD, link_get_fd(p->link), &event)) {
+            DBG_INFO(UPDI_DEBUG, "%s: epoll_ctl failed", p->name);
+            p->result = -3;
+            ev_finish(ev, p);
+            return;
+        }
+        p->fd = link_get_fd(p->link);
+        ev->polled++;
+    }
+
+    ev_enter(ev, p, EV_CONNECT);
+}
+
+/*
+    Time the port should be polled even without any data received
+    @p: port
+    @return get_time_ms() time
+*/
+static unsigned int ev_wake(const ev_port_t *p)
+{
+    // A transfer of a port not polled by fd is checked each tick
+    if (p->fd < 0 && p->la.busy)
+        return get_time_ms() + 1;
+
+    return link_async_wake(&p->la);
+}
+
+/*
+    Run the port until it waits for data or time
+    @ev: loop
+    @p: port
+    @no return
+*/
+static void ev_run(ev_loop_t *ev, ev_port_t *p)
+{
+    int result;
+
+    while (p->stage < EV_IDLE) {
+        result = link_async_poll(&p->la);
+        if (result > 0)
+            break;
+
+        if (result == 0)
+            ev_next(ev, p);
+        else
+            ev_fail(ev, p, result);
+    }
+}
+
+/*
+    Print the report of all ports and the summary
+    @ev: loop
+    @wall_ms: elapsed time of the whole loop
+    @no return
+*/
+static void ev_report(const ev_loop_t *ev, unsigned int wall_ms)
+{
+    const ev_port_t *p;
+    production_summary_t sum;
+    int i;
+
+    printf("%-24s %6s %6s %6s %10s\n", "port", "done", "passed", "error", "mean ms");
+    for (i = 0; i < ev->nports; i++) {
+        p = &ev->ports[i];
+        printf("%-24s %6d %6d %6d %10u\n", p->name, p->done, p->passed, p->last_error,
+            p->done ? p->busy_ms / p->done : 0);
+    }
+
+    production_stats_summary(&ev->stats, &sum);
+    printf("parts %u, passed %u, failed %u\n", ev->stats.count, ev->stats.passed, ev->stats.count - ev->stats.passed);
+    printf("cycle ms: min %u, mean %u, p99 %u, max %u\n", sum.min, sum.mean, sum.p99, sum.max);
+    for (i = 0; i < CUPDI_PHASE_NUM; i++)
+        printf("  %-12s mean %6u ms\n", cupdi_phase_name(i), ev->stats.count ? ev->stats.phase_sum[i] / ev->stats.count : 0);
+    printf("wall %u ms, throughput %.1f parts/min\n", wall_ms, wall_ms ? ev->stats.count * 60000.0 / wall_ms : 0.0);
+}
+
+static void usage(const char *name)
+{
+#ifdef CUPDI_EVLOOP_SIM
+    fprintf(stderr, "usage: %s [-m ports] [-d device] [-b baud] [-n cycles] [-e] [-k] [-l] [-f N]\n"
+        "  -m  simulated ports(max %d), default %d\n", name, EV_MAX_PORT, EV_SIM_PORTS);
+#else
+    fprintf(stderr, "usage: %s [-c port]... [-d device] [-b baud] [-n cycles] [-e] [-k]\n"
+        "  -c  serial port, repeat for more ports(max %d), default all USB-UART adapters\n", name, EV_MAX_PORT);
+#endif
+    fprintf(stderr, "  -d  device name, default tiny1617\n"
+        "  -b  UPDI baud, default 115200\n"
+        "  -n  program cycles of each port, default 1\n"
+        "  -e  preserve the eeprom, no chip erase\n"
+        "  -k  keep the flash out of the image(bootloader or data), no chip erase\n");
+#ifdef CUPDI_EVLOOP_SIM
+    fprintf(stderr, "  -l  the simulated parts start locked\n"
+        "  -f  one of N target responses is lost, 0 never\n");
+#endif
+}
+
+int main(int argc, char *argv[])
+{
+    static ev_loop_t loop;
+    ev_loop_t *ev = &loop;
+    struct epoll_event events[EV_MAX_PORT];
+    const char *dev_name = "tiny1617";
+    unsigned int start, now, wake;
+    int cycles = 1, timeout;
+    int i, n, opt;
+#ifdef CUPDI_EVLOOP_SIM
+    updi_sim_config_t cfg;
+    int ports = EV_SIM_PORTS;
+    unsigned int drop_every = 0;
+    bool locked = false;
+    const char *optstr = "m:d:b:n:eklf:h";
+#else
+    const char *optstr = "c:d:b:n:ekh";
+#endif
+
+    ev->baud = 115200;
+
+    while ((opt = getopt(argc, argv, optstr)) != -1) {
+        switch (opt) {
+#ifdef CUPDI_EVLOOP_SIM
+        case 'm':
+            ports = atoi(optarg);
+            break;
+        case 'l':
+            locked = true;
+            break;
+        case 'f':
+            drop_every = atoi(optarg);
+            break;
+#else
+        case 'c':
+            if (ev->nports < EV_MAX_PORT)
+                ev->ports[ev->nports++].name = optarg;
+            break;
+#endif
+        case 'd':
+            dev_name = optarg;
+            break;
+        case 'b':
+            ev->baud = atoi(optarg);
+            break;
+        case 'n':
+            cycles = atoi(optarg);
+            break;
+        case 'e':
+            ev->flags |= UPDI_PLAN_PRESERVE_EEPROM;
+            break;
+        case 'k':
+            ev->flags |= UPDI_PLAN_PRESERVE_FLASH;
+            break;
+        default:
+            usage(argv[0]);
+            return 2;
+        }
+    }
+
+    if (ev->baud > 900000) {
+        fprintf(stderr, "Unsupported baudrate for UPDI clk %d, max 0.9Mhz\n", ev->baud);
+        return 2;
+    }
+
+    ev->dev = get_chip_info(dev_name);
+    if (!ev->dev) {
+        fprintf(stderr, "Device %s not support\n", dev_name);
+        return 2;
+    }
+
+#ifdef CUPDI_EVLOOP_SIM
+    updi_sim_default_config(&cfg, ev->dev);
+    cfg.locked = locked;
+    cfg.drop_every = drop_every;
+    for (i = 0; i < ports && i < EV_MAX_PORT && i < GetPortCount(); i++) {
+        updi_sim_attach(i, &cfg);
+        ev->ports[ev->nports++].name = GetPortName(i);
+    }
+#else
+    if (!ev->nports) {
+        for (i = 0; i < GetPortCount() && i < EV_MAX_PORT; i++)
+            ev->ports[ev->nports++].name = GetPortName(i);
+    }
+#endif
+
+    if (!ev->nports || cycles <= 0) {
+        fprintf(stderr, "No serial port or job\n");
+        return 2;
+    }
+
+    if (ev->dev->mmap->flash.nvm_pagesize > MAX_MANIFEST_PAGE_SIZE) {
+        fprintf(stderr, "Flash page size %d not supported\n", ev->dev->mmap->flash.nvm_pagesize);
+        return 2;
+    }
+
+    if (dhex_check_manifest(dhex_get_image())) {
+        fprintf(stderr, "Image corrupted\n");
+        return 2;
+    }
+
+    ev->epfd = epoll_create1(0);
+    if (ev->epfd < 0) {
+        perror("epoll_create1");
+        return 2;
+    }
+
+    production_stats_reset(&ev->stats);
+
+    start = get_time_ms();
+    for (i = 0; i < ev->nports; i++) {
+        ev->ports[i].cycles = cycles;
+        ev_begin(ev, &ev->ports[i]);
+    }
+
+    while (ev->active) {
+        log_drain(0);
+
+        // Wait until the earliest timeout or delay of the ports
+        now = get_time_ms();
+        timeout = -1;
+        for (i = 0; i < ev->nports; i++) {
+            if (ev->ports[i].stage >= EV_IDLE)
+                continue;
+            wake = ev_wake(&ev->ports[i]);
+            n = (int)(wake - now) > 0 ? (int)(wake - now) : 0;
+            if (timeout < 0 || n < timeout)
+                timeout = n;
+        }
+
+        if (ev->polled) {
+            n = epoll_wait(ev->epfd, events, ARRAY_SIZE(events), timeout);
+            if (n < 0 && errno != EINTR) {
+                perror("epoll_wait");
+                break;
+            }
+        }
+        else {
+            // No fd to wait, the time passes
+            if (timeout > 0)
+                msleep(timeout);
+            n = 0;
+        }
+
+        for (i = 0; i < n; i++)
+            ev_run(ev, (ev_port_t *)events[i].data.ptr);
+
+        // The ports whose time is up, the ports not polled by fd are checked each time
+        now = get_time_ms();
+        for (i = 0; i < ev->nports; i++) {
+            if (ev->ports[i].stage < EV_IDLE &&
+                (ev->ports[i].fd < 0 || (int)(link_async_wake(&ev->ports[i].la) - now) <= 0))
+                ev_run(ev, &ev->ports[i]);
+        }
+    }
+
+    ev_report(ev, get_time_ms() - start);
+    close(ev->epfd);
+
+    return ev->stats.passed == ev->stats.count ? 0 : 1;
+}
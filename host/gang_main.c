@@ -0,0 +1,267 @@
+/*
+ * gang_main.c
+ *
+ * Multi-threaded host gang programmer: a part on each serial port, the jobs(one program cycle of a port)
+ * are taken from a shared queue by a thread pool. Each thread runs its sessions in its own pools
+ * (UPDI_THREAD_LOCAL), the image in cupdi/hex_file/ihex.c is checked once and shared read-only.
+ *
+ *  cupdi_gang [-c port]... [-d device] [-b baud] [-n cycles] [-j threads] [-e] [-k]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <platform/platform.h>
+#include <hex_file/ihex.h>
+#include <hex_file/hexfile.h>
+#include "cupdi.h"
+#include "production.h"
+
+/* Max serial ports of one gang */
+#define GANG_MAX_PORT 256
+
+/*
+    Port state
+    @name: serial port name
+    @busy: a job of the port is running
+    @done: jobs finished
+    @passed: jobs passed
+    @last_error: last failed code, 0 if never failed
+    @busy_ms: time sum of the jobs
+*/
+typedef struct _gang_port {
+    const char *name;
+    bool busy;
+    int done;
+    int passed;
+    int last_error;
+    unsigned int busy_ms;
+}gang_port_t;
+
+/*
+    Shared work queue, jobs are taken in order, a job is skipped while its port is busy
+    @lock/cond: guard of the queue, ports and stats
+    @job_port: port index of each job
+    @job_taken: the job is taken by a thread
+    @njobs: job count
+    @remain: jobs not taken
+    @dev_name/baud/flags: settings of cupdi_operate_port()
+    @stats: statistics of all parts
+*/
+typedef struct _gang_queue {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    int *job_port;
+    bool *job_taken;
+    int njobs;
+    int remain;
+
+    gang_port_t ports[GANG_MAX_PORT];
+    int nports;
+
+    const char *dev_name;
+    int baud;
+    int flags;
+    production_stats_t stats;
+}gang_queue_t;
+
+/*
+    Take the next job whose port is idle, wait if all the remaining jobs' ports are busy
+    @q: queue, locked by caller
+    @return job index, -1 if no job remains
+*/
+static int gang_take_job(gang_queue_t *q)
+{
+    int i;
+
+    while (q->remain) {
+        for (i = 0; i < q->njobs; i++) {
+            if (!q->job_taken[i] && !q->ports[q->job_port[i]].busy) {
+                q->job_taken[i] = true;
+                q->ports[q->job_port[i]].busy = true;
+                q->remain--;
+                return i;
+            }
+        }
+
+        pthread_cond_wait(&q->cond, &q->lock);
+    }
+
+    return -1;
+}
+
+static void *gang_worker(void *args)
+{
+    gang_queue_t *q = (gang_queue_t *)args;
+    cupdi_report_t report;
+    unsigned int start, elapsed;
+    gang_port_t *port;
+    int job, result;
+
+    pthread_mutex_lock(&q->lock);
+    while ((job = gang_take_job(q)) >= 0) {
+        port = &q->ports[q->job_port[job]];
+        pthread_mutex_unlock(&q->lock);
+
+        start = get_time_ms();
+        result = cupdi_operate_port(port->name, q->baud, q->dev_name, q->flags, &report);
+        elapsed = get_time_ms() - start;
+        // Deferred logs of this worker thread
+        log_drain(0);
+
+        pthread_mutex_lock(&q->lock);
+        port->busy = false;
+        port->done++;
+        port->busy_ms += elapsed;
+        if (result)
+            port->last_error = result;
+        else
+            port->passed++;
+        production_stats_add(&q->stats, result, elapsed, report.phase_ms);
+        pthread_cond_broadcast(&q->cond);
+    }
+    pthread_mutex_unlock(&q->lock);
+
+    return NULL;
+}
+
+/*
+    Print the report of all ports and the summary
+    @q: queue
+    @wall_ms: elapsed time of the whole gang
+    @no return
+*/
+static void gang_report(const gang_queue_t *q, unsigned int wall_ms)
+{
+    const gang_port_t *port;
+    production_summary_t sum;
+    int i;
+
+    printf("%-24s %6s %6s %6s %10s\n", "port", "done", "passed", "error", "mean ms");
+    for (i = 0; i < q->nports; i++) {
+        port = &q->ports[i];
+        printf("%-24s %6d %6d %6d %10u\n", port->name, port->done, port->passed, port->last_error,
+            port->done ? port->busy_ms / port->done : 0);
+    }
+
+    production_stats_summary(&q->stats, &sum);
+    printf("parts %u, passed %u, failed %u\n", q->stats.count, q->stats.passed, q->stats.count - q->stats.passed);
+    printf("cycle ms: min %u, mean %u, p99 %u, max %u\n", sum.min, sum.mean, sum.p99, sum.max);
+    for (i = 0; i < CUPDI_PHASE_NUM; i++)
+        printf("  %-12s mean %6u ms\n", cupdi_phase_name(i), q->stats.count ? q->stats.phase_sum[i] / q->stats.count : 0);
+    printf("wall %u ms, throughput %.1f parts/min\n", wall_ms, wall_ms ? q->stats.count * 60000.0 / wall_ms : 0.0);
+}
+
+static void usage(const char *name)
+{
+    fprintf(stderr, "usage: %s [-c port]... [-d device] [-b baud] [-n cycles] [-j threads] [-e] [-k]\n"
+        "  -c  serial port, repeat for more ports, default all USB-UART adapters\n"
+        "  -d  device name, default tiny1617\n"
+        "  -b  UPDI baud, default 115200\n"
+        "  -n  program cycles of each port, default 1\n"
+        "  -j  threads, default one for each port\n"
+        "  -e  preserve the eeprom, no chip erase\n"
+        "  -k  keep the flash out of the image(bootloader or data), no chip erase\n", name);
+}
+
+int main(int argc, char *argv[])
+{
+    static gang_queue_t queue;
+    gang_queue_t *q = &queue;
+    pthread_t *threads;
+    unsigned int start;
+    int cycles = 1, nthreads = 0;
+    int i, opt;
+
+    q->dev_name = "tiny1617";
+    q->baud = 115200;
+
+    while ((opt = getopt(argc, argv, "c:d:b:n:j:ekh")) != -1) {
+        switch (opt) {
+        case 'c':
+            if (q->nports < GANG_MAX_PORT)
+                q->ports[q->nports++].name = optarg;
+            break;
+        case 'd':
+            q->dev_name = optarg;
+            break;
+        case 'b':
+            q->baud = atoi(optarg);
+            break;
+        case 'n':
+            cycles = atoi(optarg);
+            break;
+        case 'j':
+            nthreads = atoi(optarg);
+            break;
+        case 'e':
+            q->flags |= UPDI_PLAN_PRESERVE_EEPROM;
+            break;
+        case 'k':
+            q->flags |= UPDI_PLAN_PRESERVE_FLASH;
+            break;
+        default:
+            usage(argv[0]);
+            return 2;
+        }
+    }
+
+    // All the adapters found if no port given, listed before any thread started
+    if (!q->nports) {
+        for (i = 0; i < GetPortCount() && i < GANG_MAX_PORT; i++)
+            q->ports[q->nports++].name = GetPortName(i);
+    }
+
+    if (!q->nports || cycles <= 0) {
+        fprintf(stderr, "No serial port or job\n");
+        return 2;
+    }
+
+    // The image is checked once, the threads only read it
+    if (dhex_check_manifest(dhex_get_image())) {
+        fprintf(stderr, "Image corrupted\n");
+        return 2;
+    }
+
+    if (nthreads <= 0 || nthreads > q->nports)
+        nthreads = q->nports;   //more threads than ports would only wait
+
+    // Jobs interleave the ports, so the first round keeps all ports busy
+    q->njobs = q->nports * cycles;
+    q->job_port = calloc(q->njobs, sizeof(*q->job_port));
+    q->job_taken = calloc(q->njobs, sizeof(*q->job_taken));
+    threads = calloc(nthreads, sizeof(*threads));
+    if (!q->job_port || !q->job_taken || !threads) {
+        fprintf(stderr, "Out of memory\n");
+        return 2;
+    }
+
+    for (i = 0; i < q->njobs; i++)
+        q->job_port[i] = i % q->nports;
+    q->remain = q->njobs;
+
+    pthread_mutex_init(&q->lock, NULL);
+    pthread_cond_init(&q->cond, NULL);
+    production_stats_reset(&q->stats);
+
+    start = get_time_ms();
+    for (i = 0; i < nthreads; i++) {
+        if (pthread_create(&threads[i], NULL, gang_worker, q)) {
+            fprintf(stderr, "Create thread %d failed\n", i);
+            nthreads = i;
+            break;
+        }
+    }
+
+    for (i = 0; i < nthreads; i++)
+        pthread_join(threads[i], NULL);
+
+    gang_report(q, get_time_ms() - start);
+
+    free(threads);
+    free(q->job_port);
+    free(q->job_taken);
+
+    return q->stats.passed == q->stats.count ? 0 : 1;
+}
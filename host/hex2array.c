@@ -0,0 +1,276 @@
+/*
+ * hex2array.c
+ *
+ * Image conversion: an avr-gcc Intel HEX file is converted into cupdi/hex_file/ihex.c, the image built into the
+ * programmer. The flash segments get their page crc manifest generated here with calc_crc24() of cupdi/crc/crc.c,
+ * so the manifest always matches the image bytes.
+ *
+ *  hex2array [-p page_size] [-o output] input.hex
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <platform/platform.h>
+#include <device/device.h>
+#include <ihex/kk_ihex_read.h>
+#include <hex_file/ihex.h>
+#include <hex_file/hexfile.h>
+
+/* Bytes of each output line */
+#define H2A_DATA_PER_LINE 17
+#define H2A_CRC_PER_LINE 8
+
+/*
+    Image being converted
+    @dhex: segments, absolute hex address with sid 0
+    @size: buffer size of each segment
+    @overflow: more segments than MAX_SEGMENT_COUNT_IN_RECORDS
+*/
+typedef struct _h2a_image {
+    hex_data_t dhex;
+    int size[MAX_SEGMENT_COUNT_IN_RECORDS];
+    bool overflow;
+}h2a_image_t;
+
+/*
+    Add the record bytes to the segment they continue or overlap, else to a new segment
+    @img: image
+    @addr: absolute address
+    @data: record data
+    @len: record length
+    @return 0 successful, other value if failed
+*/
+static int h2a_add(h2a_image_t *img, ihex_address_t addr, const u8 *data, int len)
+{
+    segment_buffer_t *seg;
+    char *buf;
+    int i, end, size;
+
+    for (i = 0; i < ARRAY_SIZE(img->dhex.segment); i++) {
+        seg = &img->dhex.segment[i];
+        if (!seg->data || addr < seg->addr_from || addr > seg->addr_to)
+            continue;
+
+        end = addr + len - seg->addr_from;
+        if (end > seg->len) {
+            if (end > img->size[i]) {
+                size = max(end, img->size[i] * 2);
+                buf = realloc((char *)seg->data, size);
+                if (!buf)
+                    return -2;
+                seg->data = buf;
+                img->size[i] = size;
+            }
+            memset((char *)seg->data + seg->len, 0xFF, end - seg->len);
+            seg->len = end;
+            seg->addr_to = seg->addr_from + end;
+        }
+        memcpy((char *)seg->data + addr - seg->addr_from, data, len);
+
+        return 0;
+    }
+
+    for (i = 0; i < ARRAY_SIZE(img->dhex.segment); i++) {
+        seg = &img->dhex.segment[i];
+        if (seg->data)
+            continue;
+
+        buf = malloc(len);
+        if (!buf)
+            return -2;
+        memcpy(buf, data, len);
+        seg->data = buf;
+        seg->len = len;
+        seg->addr_from = addr;
+        seg->addr_to = addr + len;
+        img->size[i] = len;
+
+        return 0;
+    }
+
+    img->overflow = true;
+
+    return -3;
+}
+
+/*
+    Hex record callback of kk_ihex_read
+*/
+static ihex_bool_t h2a_record(struct ihex_state *ihex, ihex_record_type_t type, ihex_bool_t checksum_error)
+{
+    h2a_image_t *img = (h2a_image_t *)ihex->args;
+    ihex_address_t addr = ihex->address;
+
+    if (checksum_error) {
+        fprintf(stderr, "checksum error at 0x%lx\n", (unsigned long)addr);
+        return false;
+    }
+
+    if (type != IHEX_DATA_RECORD)
+        return true;
+
+#ifndef IHEX_DISABLE_SEGMENTS
+    addr += SEGMENTID_TO_ADDR((ihex_address_t)ihex->segment);
+#endif
+
+    return h2a_add(img, addr, ihex->data, ihex->length) == 0;
+}
+
+/*
+    Sort the segments by address, the generated file doesn't depend on the record order
+*/
+static int h2a_compare(const void *a, const void *b)
+{
+    const segment_buffer_t *sa = (const segment_buffer_t *)a, *sb = (const segment_buffer_t *)b;
+
+    if (!sa->data || !sb->data)
+        return !sa->data - !sb->data;
+
+    return sa->addr_from < sb->addr_from ? -1 : sa->addr_from > sb->addr_from;
+}
+
+/*
+    Read the hex file
+    @file: hex file name
+    @img: output image
+    @return 0 successful, other value if failed
+*/
+static int h2a_read(const char *file, h2a_image_t *img)
+{
+    struct ihex_state ihex;
+    char line[600];
+    FILE *fp;
+
+    fp = fopen(file, "r");
+    if (!fp) {
+        perror(file);
+        return -2;
+    }
+
+    ihex_read_at_address(&ihex, 0, h2a_record, img);
+    while (fgets(line, sizeof(line), fp))
+        ihex_read_bytes(&ihex, line, (ihex_count_t)strlen(line));
+    ihex_end_read(&ihex);
+    fclose(fp);
+
+    if (img->overflow) {
+        fprintf(stderr, "%s: more than %d segments\n", file, MAX_SEGMENT_COUNT_IN_RECORDS);
+        return -3;
+    }
+
+    qsort(img->dhex.segment, ARRAY_SIZE(img->dhex.segment), sizeof(img->dhex.segment[0]), h2a_compare);
+
+    return 0;
+}
+
+/*
+    Write the image as the C source of cupdi/hex_file/ihex.c
+    @out: output stream
+    @img: image
+    @page_size: flash page size of the manifest
+*/
+static void h2a_write(FILE *out, const h2a_image_t *img, int page_size)
+{
+    const segment_buffer_t *seg;
+    int i, j, pages;
+
+    fprintf(out, "#ifdef CUPDI\n\n#include \"ihex.h\"\n\n");
+    fprintf(out, "/* Generated by host/hex2array, do not edit */\n\n");
+
+    for (i = 0; i < ARRAY_SIZE(img->dhex.segment); i++) {
+        seg = &img->dhex.segment[i];
+        if (!seg->data)
+            break;
+
+        fprintf(out, "const char bindata%d[] = {", i);
+        for (j = 0; j < seg->len; j++)
+            fprintf(out, "%s0x%02x,", j % H2A_DATA_PER_LINE ? "" : "\n\t", (u8)seg->data[j]);
+        fprintf(out, "\n};\n\n");
+    }
+
+    // The manifest of the flash segments only, the others are not programmed by page
+    for (i = 0; i < ARRAY_SIZE(img->dhex.segment); i++) {
+        seg = &img->dhex.segment[i];
+        if (!seg->data)
+            break;
+        if (dhex_segment_region(seg, NULL) != NVM_FLASH)
+            continue;
+
+        pages = dhex_page_count(seg, page_size);
+        fprintf(out, "const uint32_t bindata%d_crc[] = {", i);
+        for (j = 0; j < pages; j++)
+            fprintf(out, "%s0x%06x,", j % H2A_CRC_PER_LINE ? "" : "\n\t", dhex_calc_page_crc(seg, page_size, j));
+        fprintf(out, "\n};\n\n");
+    }
+
+    fprintf(out, "hex_data_t hexdata =\n{\n\t.flag = 1,\n\t.page_size = %d,\n", page_size);
+    for (i = 0; i < ARRAY_SIZE(img->dhex.segment); i++) {
+        seg = &img->dhex.segment[i];
+        if (!seg->data)
+            break;
+
+        fprintf(out, "\t.segment[%d].addr_from = %lu,\n", i, (unsigned long)seg->addr_from);
+        fprintf(out, "\t.segment[%d].addr_to = %lu,\n", i, (unsigned long)seg->addr_to);
+        fprintf(out, "\t.segment[%d].len = %d,\n", i, seg->len);
+        fprintf(out, "\t.segment[%d].sid = 0,\n", i);
+        fprintf(out, "\t.segment[%d].data = bindata%d,\n", i, i);
+        if (dhex_segment_region(seg, NULL) == NVM_FLASH)
+            fprintf(out, "\t.segment[%d].page_crc = bindata%d_crc,\n", i, i);
+    }
+    fprintf(out, "};\n\n#endif");
+}
+
+static void usage(const char *name)
+{
+    fprintf(stderr, "usage: %s [-p page_size] [-o output] input.hex\n"
+        "  -p  flash page size of the crc manifest, default 64, max %d\n"
+        "  -o  output file, default stdout\n", name, MAX_MANIFEST_PAGE_SIZE);
+}
+
+int main(int argc, char *argv[])
+{
+    static h2a_image_t img;
+    const char *output = NULL;
+    int page_size = 64;
+    int opt;
+    FILE *out = stdout;
+
+    while ((opt = getopt(argc, argv, "p:o:h")) != -1) {
+        switch (opt) {
+        case 'p':
+            page_size = atoi(optarg);
+            break;
+        case 'o':
+            output = optarg;
+            break;
+        default:
+            usage(argv[0]);
+            return 2;
+        }
+    }
+
+    if (optind >= argc || page_size <= 0 || page_size > MAX_MANIFEST_PAGE_SIZE || (page_size & (page_size - 1))) {
+        usage(argv[0]);
+        return 2;
+    }
+
+    if (h2a_read(argv[optind], &img))
+        return 1;
+
+    if (output) {
+        out = fopen(output, "w");
+        if (!out) {
+            perror(output);
+            return 1;
+        }
+    }
+
+    h2a_write(out, &img, page_size);
+
+    if (out != stdout)
+        fclose(out);
+
+    return 0;
+}
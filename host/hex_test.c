@@ -0,0 +1,172 @@
+/*
+ * hex_test.c
+ *
+ * Runtime hex loading test: the built-in image is written out as an Intel HEX file with kk_ihex_write, loaded back
+ * into a hex data structure of its own, then the segments are compared and the page crcs are checked against the
+ * manifest of the built-in image, which must stay untouched.
+ *
+ *  hex_test [-k] [file.hex]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <platform/platform.h>
+#include <device/device.h>
+#include <ihex/kk_ihex_write.h>
+#include <hex_file/ihex.h>
+#include <hex_file/hexfile.h>
+
+static int errors;
+
+#define CHECK(_cond, ...) do { if (!(_cond)) { printf("FAIL: " __VA_ARGS__); puts(""); errors++; } } while (0)
+
+static void hex_test_flush(struct ihex_state *ihex, char *buffer, char *eptr)
+{
+    *eptr = '\0';
+    fputs(buffer, (FILE *)ihex->args);
+}
+
+/*
+    Write the image as an Intel HEX file
+    @path: output file
+    @dhex: image
+    @return 0 successful, other value if failed
+*/
+static int hex_test_save(const char *path, const hex_data_t *dhex)
+{
+    struct ihex_state ihex;
+    const segment_buffer_t *seg;
+    FILE *fp;
+    int i;
+
+    fp = fopen(path, "w");
+    if (!fp)
+        return -2;
+
+    ihex_init(&ihex, hex_test_flush, fp);
+    for (i = 0; i < ARRAY_SIZE(dhex->segment); i++) {
+        seg = &dhex->segment[i];
+        if (!seg->data)
+            continue;
+
+        ihex_write_at_address(&ihex, SEGMENTID_TO_ADDR((ihex_address_t)seg->sid) + seg->addr_from);
+        ihex_write_bytes(&ihex, seg->data, seg->len);
+    }
+    ihex_end_write(&ihex);
+
+    return fclose(fp) ? -3 : 0;
+}
+
+/*
+    Find the loaded segment of the same hex address
+*/
+static const segment_buffer_t *hex_test_find(const hex_data_t *dhex, const segment_buffer_t *ref)
+{
+    ihex_address_t addr = SEGMENTID_TO_ADDR((ihex_address_t)ref->sid) + ref->addr_from;
+    const segment_buffer_t *seg;
+    int i;
+
+    for (i = 0; i < ARRAY_SIZE(dhex->segment); i++) {
+        seg = &dhex->segment[i];
+        if (seg->data && SEGMENTID_TO_ADDR((ihex_address_t)seg->sid) + seg->addr_from == addr)
+            return seg;
+    }
+
+    return NULL;
+}
+
+int main(int argc, char *argv[])
+{
+    static hex_data_t loaded;
+    const hex_data_t *builtin = &hexdata;
+    const segment_buffer_t *ref, *seg;
+    char path[] = "/tmp/hex_test_XXXXXX";
+    const char *file = NULL;
+    bool keep = false;
+    int i, page, pages, count = 0, result, opt, fd;
+
+    while ((opt = getopt(argc, argv, "kh")) != -1) {
+        switch (opt) {
+        case 'k':
+            keep = true;
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-k] [file.hex]\n  -k  keep the hex file written\n", argv[0]);
+            return 2;
+        }
+    }
+
+    if (optind < argc) {
+        file = argv[optind];
+    }
+    else {
+        fd = mkstemp(path);
+        if (fd < 0) {
+            perror(path);
+            return 2;
+        }
+        close(fd);
+        file = path;
+    }
+
+    result = hex_test_save(file, builtin);
+    CHECK(result == 0, "save %s %d", file, result);
+
+    result = dhex_load_file(file, &loaded);
+    CHECK(result == 0, "load %s %d", file, result);
+
+    for (i = 0; i < ARRAY_SIZE(builtin->segment); i++) {
+        ref = &builtin->segment[i];
+        if (!ref->data)
+            continue;
+
+        count++;
+        seg = hex_test_find(&loaded, ref);
+        CHECK(seg, "segment %d at 0x%lx not loaded", i, (unsigned long)ref->addr_from);
+        if (!seg)
+            continue;
+
+        CHECK(seg->len == ref->len && seg->addr_to - seg->addr_from == (ihex_address_t)ref->len,
+            "segment %d len %d(%d)", i, seg->len, ref->len);
+        CHECK(dhex_segment_region(seg, NULL) == dhex_segment_region(ref, NULL), "segment %d region", i);
+        if (seg->len != ref->len)
+            continue;
+        CHECK(!memcmp(seg->data, ref->data, ref->len), "segment %d data", i);
+
+        if (!ref->page_crc)
+            continue;
+
+        pages = dhex_page_count(seg, builtin->page_size);
+        CHECK(pages == dhex_page_count(ref, builtin->page_size), "segment %d pages %d", i, pages);
+        for (page = 0; page < pages; page++) {
+            CHECK(dhex_get_page_crc(&loaded, seg, builtin->page_size, page) == ref->page_crc[page],
+                "segment %d page %d crc", i, page);
+        }
+    }
+
+    for (i = 0, result = 0; i < ARRAY_SIZE(loaded.segment); i++)
+        result += loaded.segment[i].data != NULL;
+    CHECK(result == count, "segments loaded %d(%d)", result, count);
+
+    // The built-in image is kept, with its manifest
+    CHECK(dhex_check_manifest(builtin) == 0, "built-in image manifest");
+    CHECK(builtin->segment[0].data && builtin->segment[0].page_crc, "built-in image cleared");
+
+    // The loaded image is programmed once selected
+    dhex_set_image(&loaded);
+    CHECK(dhex_get_image() == &loaded, "image select");
+    dhex_set_image(NULL);
+    CHECK(dhex_get_image() == builtin, "image restore");
+
+    release_dhex(&loaded);
+    CHECK(!loaded.segment[0].data, "release");
+
+    if (file == path && !keep)
+        unlink(path);
+
+    printf("hex_test: %d segments, %s\n", count, errors ? "FAILED" : "passed");
+
+    return errors ? 1 : 0;
+}
@@ -0,0 +1,248 @@
+/*
+ * sim_main.c
+ *
+ * Host program running the cupdi stack against the UPDI target simulator, no hardware needed.
+ * The elapsed time is the virtual clock of the simulator: wire character time, target guard time,
+ * NVM busy time and the msleep() of the stack, it doesn't depend on the host speed.
+ *
+ *  cupdi_sim [-d device] [-b baud] [-n cycles] [-t turnaround_us] [-m max_baud] [-f drop_every] [-i image.hex] [-D region [-o file.hex]] [-p parts] [-l] [-g] [-e] [-k]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <platform/platform.h>
+#include <updi/stats.h>
+#include <device/device.h>
+#include <platform/sim/updi_sim.h>
+#include <hex_file/hexfile.h>
+#include <ihex/kk_ihex_write.h>
+#include "cupdi.h"
+#include "gang.h"
+#include "production.h"
+
+/* Time(ms) the simulated operator takes to put the next part on after one removed */
+#define SIM_SWAP_MS 2000
+
+/*
+    Hex line output of the dump
+*/
+static void dump_flush(struct ihex_state *ihex, char *buffer, char *eptr)
+{
+    fwrite(buffer, 1, eptr - buffer, (FILE *)ihex->args);
+}
+
+/*
+    Production line of the simulated operator
+    @cfg: configuration of each new part
+    @parts: parts to program
+    @stats: production statistics of the last part
+*/
+typedef struct _sim_line {
+    const updi_sim_config_t *cfg;
+    unsigned int parts;
+    production_stats_t stats;
+}sim_line_t;
+
+/*
+    Production result of each part, the part is swapped for a fresh one until all parts programmed
+*/
+static int sim_production_result(int result, const production_stats_t *stats, void *args)
+{
+    sim_line_t *line = (sim_line_t *)args;
+
+    memcpy(&line->stats, stats, sizeof(line->stats));
+    printf("part %u: result %d, %u ms\n", stats->count, result, stats->cycle[(stats->head + PRODUCTION_STATS_WINDOW - 1) % PRODUCTION_STATS_WINDOW]);
+    log_drain(0);
+
+    if (stats->count >= line->parts)
+        return 1;
+
+    updi_sim_replace(0, line->cfg, SIM_SWAP_MS);
+
+    return 0;
+}
+
+static void usage(const char *name)
+{
+    fprintf(stderr, "usage: %s [-d device] [-b baud] [-n cycles] [-t turnaround_us] [-m max_baud] [-f drop_every] [-i image.hex] [-D region [-o file.hex]] [-p parts] [-l] [-g] [-e] [-k]\n"
+        "  -d  device name, default tiny1617\n"
+        "  -b  UPDI baud, default 115200\n"
+        "  -n  program cycles on the same part, default 1\n"
+        "  -t  extra turnaround delay of each target response\n"
+        "  -m  max baud the target could synchronize, default no limit\n"
+        "  -f  one of N target responses is lost at random, the link recovery is tested\n"
+        "  -i  Intel HEX image loaded at runtime, default the built-in image\n"
+        "  -D  dump a region(flash, eeprom, userrow, fuse, lock) as Intel HEX after the program cycles\n"
+        "  -o  dump output file, default dump.hex\n"
+        "  -p  run the production loop for N parts, each one is replaced by a fresh part after programmed\n"
+        "  -l  the part starts locked\n"
+        "  -g  gang program a part on each simulated port\n"
+        "  -e  preserve the eeprom, no chip erase\n"
+        "  -k  keep the flash out of the image(bootloader or data), no chip erase\n", name);
+}
+
+int main(int argc, char *argv[])
+{
+    static hex_data_t image;
+    const char *dev_name = "tiny1617";
+    const char *image_file = NULL;
+    const char *dump_file = NULL;
+    FILE *dump_out;
+    const device_info_t *dev;
+    updi_sim_config_t cfg;
+    cupdi_report_t report;
+    production_summary_t sum;
+    sim_line_t line;
+    unsigned int start, elapsed;
+    int results[UPDI_SIM_PORT_NUM];
+    int parts = 0, dump = -1, baud = 115200, cycles = 1, turnaround = 0, max_baud = 0, drop_every = 0, flags = 0;
+    bool locked = false, gang = false;
+    int i, j, opt, result, failed = 0;
+
+    while ((opt = getopt(argc, argv, "d:b:n:t:m:f:i:D:o:p:lgekh")) != -1) {
+        switch (opt) {
+        case 'd':
+            dev_name = optarg;
+            break;
+        case 'b':
+            baud = atoi(optarg);
+            break;
+        case 'n':
+            cycles = atoi(optarg);
+            break;
+        case 't':
+            turnaround = atoi(optarg);
+            break;
+        case 'm':
+            max_baud = atoi(optarg);
+            break;
+        case 'f':
+            drop_every = atoi(optarg);
+            break;
+        case 'i':
+            image_file = optarg;
+            break;
+        case 'D':
+            dump = cupdi_region_type(optarg);
+            if (dump < 0) {
+                usage(argv[0]);
+                return 2;
+            }
+            break;
+        case 'o':
+            dump_file = optarg;
+            break;
+        case 'p':
+            parts = atoi(optarg);
+            break;
+        case 'l':
+            locked = true;
+            break;
+        case 'g':
+            gang = true;
+            break;
+        case 'e':
+            flags |= UPDI_PLAN_PRESERVE_EEPROM;
+            break;
+        case 'k':
+            flags |= UPDI_PLAN_PRESERVE_FLASH;
+            break;
+        default:
+            usage(argv[0]);
+            return 2;
+        }
+    }
+
+    // The gang flow always erases the chip
+    if (gang && flags) {
+        fprintf(stderr, "-e/-k not supported by the gang flow\n");
+        return 2;
+    }
+
+    if (image_file) {
+        result = dhex_load_file(image_file, &image);
+        if (result) {
+            fprintf(stderr, "Load image %s failed %d\n", image_file, result);
+            return 2;
+        }
+        dhex_set_image(&image);
+    }
+
+    dev = get_chip_info(dev_name);
+    if (!dev) {
+        fprintf(stderr, "Device %s not support\n", dev_name);
+        return 2;
+    }
+
+    updi_sim_default_config(&cfg, dev);
+    cfg.turnaround_us = turnaround;
+    cfg.max_baud = max_baud;
+    cfg.locked = locked;
+    cfg.drop_every = drop_every;
+
+    for (i = 0; i < (gang ? GetPortCount() : 1); i++)
+        updi_sim_attach(i, &cfg);
+
+    if (parts > 0) {
+        line.cfg = &cfg;
+        line.parts = parts;
+        production_stats_reset(&line.stats);
+        result = cupdi_production(GetPortName(0), flags, sim_production_result, &line);
+        log_drain(0);
+
+        production_stats_summary(&line.stats, &sum);
+        printf("cycle(ms): min %u, mean %u, p99 %u, max %u\n", sum.min, sum.mean, sum.p99, sum.max);
+        printf("%u/%d parts passed at %d baud\n", line.stats.passed, parts, baud);
+
+        return (result || line.stats.passed != (unsigned int)parts) ? 1 : 0;
+    }
+
+    for (i = 0; i < cycles; i++) {
+        start = get_time_ms();
+
+        if (gang) {
+            result = cupdi_gang_operate(NULL, 0, results);
+            elapsed = get_time_ms() - start;
+            printf("cycle %d: result %d, %u ms\n", i, result, elapsed);
+            for (j = 0; j < GetPortCount(); j++)
+                printf("  %s: %d%s\n", GetPortName(j), results[j], updi_sim_locked(updi_sim_get(j)) ? "" : " (unlocked)");
+        }
+        else {
+            result = cupdi_operate_port(GetPortName(0), baud, dev_name, flags, &report);
+            elapsed = get_time_ms() - start;
+            printf("cycle %d: result %d, %u ms, flash plan %d, resumed %d pages\n", i, result, elapsed, report.plan, report.resumed);
+            for (j = 0; j < CUPDI_PHASE_NUM; j++)
+                printf("  %-12s %6u ms\n", cupdi_phase_name(j), report.phase_ms[j]);
+        }
+
+        log_drain(0);
+        updi_stats_report(updi_stats_get());
+        updi_stats_reset();
+
+        if (result)
+            failed++;
+    }
+
+    printf("%d/%d cycles passed at %d baud\n", cycles - failed, cycles, baud);
+
+    if (dump >= 0) {
+        // stdout has the cycle reports
+        if (!dump_file)
+            dump_file = "dump.hex";
+        dump_out = fopen(dump_file, "w");
+        if (!dump_out) {
+            perror(dump_file);
+            return 2;
+        }
+
+        result = cupdi_dump_port(GetPortName(0), baud, dev_name, dump, dump_flush, dump_out);
+        fclose(dump_out);
+
+        fprintf(stderr, "dump: result %d\n", result);
+        if (result)
+            failed++;
+    }
+
+    return failed ? 1 : 0;
+}
@@ -2373,10 +2373,13 @@ static inline const struct sercomspi_regs_cfg *_spi_get_regs(const uint32_t hw_a
 	return NULL;
 }
 
+/* UPDI_SERCOM_LEAN: the handler is in cupdi/platform/serial_sercom.c */
+#ifndef UPDI_SERCOM_LEAN
 void SERCOM4_Handler(void)
 {
 	_sercom_usart_interrupt_handler(_sercom4_dev);
 }
+#endif
 
 int32_t _spi_m_sync_init(struct _spi_m_sync_dev *dev, void *const hw)
 {
@@ -1,16 +1,72 @@
 #include <atmel_start.h>
 #include "cupdi/cupdi.h"
+#include "cupdi/gang.h"
+#include "cupdi/production.h"
+
+#if defined(CUPDI) && defined(CUPDI_DUMP)
+#include <stdio.h>
+#include "cupdi/platform/platform.h"
+#include "cupdi/device/device.h"
+
+/*
+    Hex line output of the dump, stdout is the host uart
+*/
+static void dump_flush(struct ihex_state *ihex, char *buffer, char *eptr)
+{
+	fwrite(buffer, 1, eptr - buffer, stdout);
+}
+#endif
+
+#if defined(CUPDI) && defined(CRC_BENCHMARK)
+#include <stdio.h>
+#include "cupdi/crc/crc.h"
+
+/*
+	CRC benchmark of a page sized buffer, printed to the host uart
+*/
+static void crc_bench_print(void)
+{
+	static unsigned char buf[256];
+	crc_bench_t bench[CRC_BENCH_NUM];
+	int i, size;
+
+	for (i = 0; i < sizeof(buf); i++)
+		buf[i] = (unsigned char)(i * 7 + 1);
+
+	for (size = 32; size <= sizeof(buf); size <<= 1) {
+		crc_benchmark(buf, size, 64, bench);
+		for (i = 0; i < CRC_BENCH_NUM; i++)
+			printf("%s: %d bytes x 64, bitwise %u us, fast %u us, %08x %s\n", bench[i].name, size,
+				bench[i].bitwise_us, bench[i].fast_us, bench[i].result, bench[i].matched ? "ok" : "MISMATCH");
+	}
+}
+#endif
 
 int main(void)
 {
 	/* Initializes MCU, drivers and middleware */
 	atmel_start_init();
 
+#if defined(CUPDI) && defined(CRC_BENCHMARK)
+	crc_bench_print();
+#endif
+
 #ifdef CUPDI
+#if defined(CUPDI_GANG)
+	cupdi_gang_operate(NULL, 0, NULL);
+#elif defined(CUPDI_PRODUCTION)
+	cupdi_production(NULL, UPDI_PLAN_DEFAULT, NULL, NULL);
+#elif defined(CUPDI_DUMP)
+	cupdi_dump_port(NULL, 115200, "tiny1617", NVM_FLASH, dump_flush, NULL);
+#else
 	cupdi_operate();
+#endif
 #endif
 
 	/* Replace with your application code */
 	while (1) {
+#ifdef CUPDI
+		log_drain(0);
+#endif
 	}
 }